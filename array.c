@@ -9,14 +9,12 @@
 #include <stdlib.h>
 
 #include "proto.h"
+#include "internal.h"
 
 #ifndef ARRAY_ITEMS_SIZE
 #define ARRAY_ITEMS_SIZE 4
 #endif
 
-static void
-proto_array_methods (proto_array_t *array);
-
 /*
  * It uses the same strategy defined in Python implementation of lists.
  * Allocation expansion follows: 4, 8, 16, 25, 35, 46, 58, 72, 88, ...
@@ -35,11 +33,41 @@ proto_array_resize (proto_array_t *array,
   items = realloc (array->items, new_allocated * sizeof (void *));
   if (!items)
     return -1;
+  STATS_ADD (resizes, 1);
+  PROBE2 (array__resize, array, new_allocated);
+  STATS_ADD (allocations, 1);
+  STATS_ADD (bytes, new_allocated * sizeof (void *));
   array->items = items;
   array->allocated = new_allocated;
   return 0;
 }
 
+/*
+ * Position after the last element not greater than the given one, so equal
+ * elements keep their insertion order in sorted mode.
+ */
+size_t
+array_sorted_position (const proto_array_t *array,
+                       const void *element)
+{
+  size_t low = 0, high = array->length;
+
+  while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+
+      if (array->compare (element, array_item (array, middle)) < 0)
+        high = middle;
+      else
+        low = middle + 1;
+    }
+  return low;
+}
+
+/*
+ * In sorted mode the comparator owns the order: the element is placed at
+ * its sorted position and the requested one is ignored.
+ */
 static void
 proto_insert (void *self,
               size_t position,
@@ -52,12 +80,36 @@ proto_insert (void *self,
 
   if (position > array->length)
     return;
+  if (array->compare != NULL)
+    position = array_sorted_position (array, element);
+  PROBE2 (array__insert, array, position);
   if (proto_array_resize (array, array->length + 1) == -1)
     return;
+  heap_barrier (array->heap, element);
   for (i = array->length; i > position; i--)
     array->items[i] = array->items[i - 1];
   array->items[i] = (void *) element;
   array->length++;
+  hash_index_insert (array, element, position);
+  refs_hold (array->refs, element);
+}
+
+static size_t
+proto_scan (const proto_array_t *array,
+            const void *element)
+{
+  size_t position = 0, length, found;
+  void **items;
+
+  while (position < array->length)
+    {
+      items = array_segment (array, position, &length);
+      found = pointer_scan (items, length, element);
+      if (found != (size_t) -1)
+        return position + found;
+      position += length;
+    }
+  return -1;
 }
 
 static bool
@@ -66,13 +118,13 @@ proto_includes (const void *self,
 {
   if (self == NULL)
     return NULL;
-  size_t i;
   proto_array_t *array = (proto_array_t *) self;
 
-  for (i = 0; i < array->length; i++)
-    if (array->items[i] == element)
-      return true;
-  return false;
+  if (hash_index_ready (array))
+    return hash_index_lookup (array, element) != (size_t) -1;
+  if (array->compare != NULL)
+    return array->index (array, element) != (size_t) -1;
+  return proto_scan (array, element) != (size_t) -1;
 }
 
 static const void *
@@ -100,6 +152,7 @@ proto_del (void *self,
 
   if (length > position)
     {
+      heap_moving (array->heap, array);
       value = array->items[position];
       if (position == length - 1)
         array->items[position] = NULL;
@@ -112,6 +165,8 @@ proto_del (void *self,
           array->items[i] = NULL;
         }
       array->length--;
+      hash_index_delete (array, value, position);
+      refs_drop (array->refs, value);
       return value;
     }
   return NULL;
@@ -126,10 +181,20 @@ proto_index (const void *self,
   size_t i;
   proto_array_t *array = (proto_array_t *) self;
 
-  for (i = 0; i < array->length; i++)
-    if (array->items[i] == element)
-      return i;
-  return -1;
+  if (hash_index_ready (array))
+    return hash_index_lookup (array, element);
+  if (array->compare != NULL)
+    {
+      // Pointer-equal elements compare equal, so they sit in the equal range
+      i = proto_array_bsearch (array, element, array->compare);
+      if (i == (size_t) -1)
+        return -1;
+      for (; i < array->length && !array->compare (array_item (array, i), element); i++)
+        if (array_item (array, i) == element)
+          return i;
+      return -1;
+    }
+  return proto_scan (array, element);
 }
 
 static void
@@ -140,9 +205,18 @@ proto_push (void *self,
     return;
   proto_array_t *array = (proto_array_t *) self;
 
+  if (array->compare != NULL)
+    {
+      array->insert (array, array->length, element);
+      return;
+    }
+  PROBE2 (array__push, array, array->length);
   if (proto_array_resize (array, array->length + 1) == -1)
     return;
+  heap_barrier (array->heap, element);
   array->items[array->length++] = (void *) element;
+  hash_index_insert (array, element, array->length - 1);
+  refs_hold (array->refs, element);
 }
 
 static const void *
@@ -155,6 +229,8 @@ proto_pop (void *self)
 
   value = array->items[--array->length];
   array->items[array->length] = NULL;
+  hash_index_delete (array, value, array->length);
+  refs_drop (array->refs, value);
   return value;
 }
 
@@ -176,6 +252,7 @@ proto_shift (void *self)
     return NULL;
   proto_array_t *array = (proto_array_t *) self;
 
+  PROBE2 (array__shift, array, array->length);
   return array->del (array, 0);
 }
 
@@ -220,26 +297,10 @@ proto_reverse (const void *self)
 {
   if (self == NULL)
     return NULL;
-  signed long int i;
-  proto_array_t *array = (proto_array_t *) self;
-  proto_array_t *reverse = (proto_array_t *) malloc (sizeof (proto_array_t));
+  proto_array_view_t view;
 
-  if (!reverse)
-    return NULL;
-  reverse->allocated = array->allocated;
-  reverse->length = 0;
-  reverse->items = (void **) calloc (reverse->allocated, sizeof (void *));
-  if (!reverse->items)
-    {
-      free (reverse);
-      return NULL;
-    }
-  for (i = 0; i < reverse->allocated; i++)
-    reverse->items[i] = NULL;
-  proto_array_methods (reverse);
-  for (i = array->length - 1; i >= 0; i--)
-    reverse->push (reverse, array->at (array, i));
-  return reverse;
+  proto_array_reverse_view (&view, (const proto_array_t *) self);
+  return view.to_array (&view);
 }
 
 static void
@@ -262,31 +323,98 @@ proto_array_methods (proto_array_t *array)
   array->reverse = &proto_reverse;
 }
 
+/*
+ * An empty array with room for capacity items, so callers that know the
+ * final length fill it without going through proto_array_resize.
+ */
 proto_array_t *
-proto_init_array ()
+array_with_capacity (size_t capacity)
 {
-  size_t i;
   proto_array_t *array = (proto_array_t *) malloc (sizeof (proto_array_t));
 
   if (!array)
     return NULL;
-  array->allocated = ARRAY_ITEMS_SIZE;
+  if (capacity < ARRAY_ITEMS_SIZE)
+    capacity = ARRAY_ITEMS_SIZE;
+  array->allocated = capacity;
   array->length = 0;
-  array->items = (void **) calloc (ARRAY_ITEMS_SIZE, sizeof (void *));
+  array->compare = NULL;
+  array->hash_index = NULL;
+  array->chunks = NULL;
+  array->heap = NULL;
+  array->refs = NULL;
+  array->items = (void **) calloc (capacity, sizeof (void *));
   if (!array->items)
     {
       free (array);
       return NULL;
     }
-  for (i = 0; i < ARRAY_ITEMS_SIZE; i++)
-    array->items[i] = NULL;
+  STATS_ADD (allocations, 2);
+  STATS_ADD (bytes, sizeof (proto_array_t) + capacity * sizeof (void *));
   proto_array_methods (array);
   return array;
 }
 
+/*
+ * Sets up an array in place over items it doesn't own, for read-only
+ * argument lists that live on the stack; it must not grow or be deleted.
+ */
+void
+array_over (proto_array_t *array,
+            void **items,
+            size_t length)
+{
+  array->allocated = length;
+  array->length = length;
+  array->items = items;
+  array->compare = NULL;
+  array->hash_index = NULL;
+  array->chunks = NULL;
+  array->heap = NULL;
+  array->refs = NULL;
+  proto_array_methods (array);
+}
+
+proto_array_t *
+proto_init_array ()
+{
+  return array_with_capacity (ARRAY_ITEMS_SIZE);
+}
+
 void
 proto_del_array (proto_array_t *array)
 {
+  if (array->refs != NULL)
+    refs_release_items (array);
+  hash_index_free (array);
+  chunked_free (array);
   free (array->items);
   free (array);
 }
+
+/*
+ * Bytes that deleting the array frees: itself, its items vector or tree of
+ * leaves, and its hash index. The elements it points to aren't counted.
+ */
+size_t
+proto_array_memory_usage (const proto_array_t *array)
+{
+  if (array == NULL)
+    return 0;
+  return sizeof (proto_array_t) + array->allocated * sizeof (void *)
+    + chunked_memory_usage (array) + hash_index_memory_usage (array);
+}
+
+// A chunked array has no items vector, so its capacity is 0
+bool
+proto_array_stats (const proto_array_t *array,
+                   proto_array_stats_t *stats)
+{
+  if (array == NULL || stats == NULL)
+    return false;
+  stats->length = array->length;
+  stats->capacity = array->allocated;
+  stats->chunked = array->chunks != NULL;
+  stats->indexed = array->hash_index != NULL;
+  return true;
+}
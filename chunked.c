@@ -0,0 +1,447 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef CHUNK_CAPACITY
+#define CHUNK_CAPACITY 64
+#endif
+#ifndef CHUNK_FANOUT
+#define CHUNK_FANOUT 32
+#endif
+
+/*
+ * A chunked array keeps its items in fixed-size leaves under a B+tree whose
+ * nodes know how many items they hold, so a position is found by walking
+ * down the counts. Inserting or deleting moves at most one leaf worth of
+ * items, plus an occasional split or merge along the path.
+ */
+typedef struct {
+  bool is_leaf;
+  size_t count;
+  size_t size;
+} proto_chunk_t;
+
+typedef struct {
+  proto_chunk_t chunk;
+  void *items[CHUNK_CAPACITY];
+} proto_chunk_leaf_t;
+
+typedef struct {
+  proto_chunk_t chunk;
+  proto_chunk_t *children[CHUNK_FANOUT];
+} proto_chunk_inner_t;
+
+static proto_chunk_t *
+chunk_new (bool is_leaf)
+{
+  proto_chunk_t *chunk;
+
+  if (is_leaf)
+    chunk = (proto_chunk_t *) malloc (sizeof (proto_chunk_leaf_t));
+  else
+    chunk = (proto_chunk_t *) malloc (sizeof (proto_chunk_inner_t));
+  if (!chunk)
+    return NULL;
+  STATS_ADD (allocations, 1);
+  STATS_ADD (bytes, is_leaf ? sizeof (proto_chunk_leaf_t) : sizeof (proto_chunk_inner_t));
+  chunk->is_leaf = is_leaf;
+  chunk->count = 0;
+  chunk->size = 0;
+  return chunk;
+}
+
+static void
+chunk_free (proto_chunk_t *chunk)
+{
+  size_t i;
+
+  if (!chunk->is_leaf)
+    for (i = 0; i < chunk->count; i++)
+      chunk_free (((proto_chunk_inner_t *) chunk)->children[i]);
+  free (chunk);
+}
+
+/*
+ * Finds the child holding position, turning position into an offset inside
+ * it. A position equal to the size selects the last child, for appending.
+ */
+static size_t
+chunk_child (const proto_chunk_inner_t *inner,
+             size_t *position)
+{
+  size_t i;
+
+  for (i = 0; i < inner->chunk.count - 1; i++)
+    {
+      if (*position < inner->children[i]->size)
+        break;
+      *position -= inner->children[i]->size;
+    }
+  return i;
+}
+
+static void
+chunk_resize (proto_chunk_inner_t *inner)
+{
+  size_t i;
+
+  inner->chunk.size = 0;
+  for (i = 0; i < inner->chunk.count; i++)
+    inner->chunk.size += inner->children[i]->size;
+}
+
+/*
+ * Moves the upper half of a full node into a new right sibling. Appending
+ * at the end of a leaf splits unevenly instead, so leaves filled by push
+ * stay full.
+ */
+static proto_chunk_t *
+chunk_split (proto_chunk_t *chunk,
+             size_t position)
+{
+  proto_chunk_t *right = chunk_new (chunk->is_leaf);
+  size_t keep = chunk->count / 2;
+
+  if (!right)
+    return NULL;
+  if (chunk->is_leaf)
+    {
+      proto_chunk_leaf_t *leaf = (proto_chunk_leaf_t *) chunk;
+
+      if (position == chunk->count)
+        keep = chunk->count;
+      memcpy (((proto_chunk_leaf_t *) right)->items, leaf->items + keep,
+        (chunk->count - keep) * sizeof (void *));
+      right->count = right->size = chunk->count - keep;
+      chunk->count = chunk->size = keep;
+    }
+  else
+    {
+      memcpy (((proto_chunk_inner_t *) right)->children, ((proto_chunk_inner_t *) chunk)->children + keep,
+        (chunk->count - keep) * sizeof (proto_chunk_t *));
+      right->count = chunk->count - keep;
+      chunk->count = keep;
+      chunk_resize ((proto_chunk_inner_t *) right);
+      chunk_resize ((proto_chunk_inner_t *) chunk);
+    }
+  return right;
+}
+
+static inline bool
+chunk_is_full (const proto_chunk_t *chunk)
+{
+  return chunk->count == (chunk->is_leaf ? CHUNK_CAPACITY : CHUNK_FANOUT);
+}
+
+/*
+ * Splits the i-th child of a node that has room for one more child;
+ * position is where the coming insert lands inside that child.
+ */
+static bool
+chunk_split_child (proto_chunk_inner_t *inner,
+                   size_t i,
+                   size_t position)
+{
+  proto_chunk_t *right = chunk_split (inner->children[i], position);
+
+  if (!right)
+    return false;
+  memmove (inner->children + i + 2, inner->children + i + 1,
+    (inner->chunk.count - i - 1) * sizeof (proto_chunk_t *));
+  inner->children[i + 1] = right;
+  inner->chunk.count++;
+  return true;
+}
+
+/*
+ * Full nodes are split on the way down, before anything is inserted, so an
+ * allocation failure leaves a valid tree without the element.
+ */
+static bool
+chunk_insert (proto_array_t *array,
+              size_t position,
+              void *element)
+{
+  proto_chunk_t *chunk = (proto_chunk_t *) array->chunks, *path[64];
+  size_t depth = 0, i;
+
+  if (chunk_is_full (chunk))
+    {
+      proto_chunk_inner_t *root = (proto_chunk_inner_t *) chunk_new (false);
+
+      if (!root)
+        return false;
+      root->children[0] = chunk;
+      root->chunk.count = 1;
+      root->chunk.size = chunk->size;
+      if (!chunk_split_child (root, 0, position))
+        {
+          free (root);
+          return false;
+        }
+      array->chunks = chunk = &root->chunk;
+    }
+  while (!chunk->is_leaf)
+    {
+      proto_chunk_inner_t *inner = (proto_chunk_inner_t *) chunk;
+
+      i = chunk_child (inner, &position);
+      if (chunk_is_full (inner->children[i]))
+        {
+          if (!chunk_split_child (inner, i, position))
+            return false;
+          if (position >= inner->children[i]->size)
+            position -= inner->children[i++]->size;
+        }
+      path[depth++] = chunk;
+      chunk = inner->children[i];
+    }
+  proto_chunk_leaf_t *leaf = (proto_chunk_leaf_t *) chunk;
+
+  memmove (leaf->items + position + 1, leaf->items + position,
+    (chunk->count - position) * sizeof (void *));
+  leaf->items[position] = element;
+  chunk->count++;
+  chunk->size++;
+  while (depth)
+    path[--depth]->size++;
+  return true;
+}
+
+static void
+chunk_merge (proto_chunk_inner_t *inner,
+             size_t i)
+{
+  proto_chunk_t *left = inner->children[i], *right = inner->children[i + 1];
+
+  if (left->is_leaf)
+    memcpy (((proto_chunk_leaf_t *) left)->items + left->count,
+      ((proto_chunk_leaf_t *) right)->items, right->count * sizeof (void *));
+  else
+    memcpy (((proto_chunk_inner_t *) left)->children + left->count,
+      ((proto_chunk_inner_t *) right)->children, right->count * sizeof (proto_chunk_t *));
+  left->count += right->count;
+  left->size += right->size;
+  free (right);
+  memmove (inner->children + i + 1, inner->children + i + 2,
+    (inner->chunk.count - i - 2) * sizeof (proto_chunk_t *));
+  inner->chunk.count--;
+}
+
+/*
+ * Removes the item at position below chunk. A child left under a quarter
+ * full is merged with a neighbour when both fit in one node.
+ */
+static void *
+chunk_delete (proto_chunk_t *chunk,
+              size_t position)
+{
+  void *value;
+
+  if (chunk->is_leaf)
+    {
+      proto_chunk_leaf_t *leaf = (proto_chunk_leaf_t *) chunk;
+
+      value = leaf->items[position];
+      memmove (leaf->items + position, leaf->items + position + 1,
+        (chunk->count - position - 1) * sizeof (void *));
+      chunk->count--;
+      chunk->size--;
+      return value;
+    }
+  proto_chunk_inner_t *inner = (proto_chunk_inner_t *) chunk;
+  size_t i = chunk_child (inner, &position), capacity;
+  proto_chunk_t *child = inner->children[i];
+
+  value = chunk_delete (child, position);
+  chunk->size--;
+  capacity = child->is_leaf ? CHUNK_CAPACITY : CHUNK_FANOUT;
+  if (child->count == 0 && chunk->count > 1)
+    {
+      free (child);
+      memmove (inner->children + i, inner->children + i + 1,
+        (chunk->count - i - 1) * sizeof (proto_chunk_t *));
+      chunk->count--;
+    }
+  else if (child->count < capacity / 4)
+    {
+      if (i + 1 < chunk->count && child->count + inner->children[i + 1]->count <= capacity)
+        chunk_merge (inner, i);
+      else if (i > 0 && inner->children[i - 1]->count + child->count <= capacity)
+        chunk_merge (inner, i - 1);
+    }
+  return value;
+}
+
+static inline proto_chunk_t *
+chunked_root (const proto_array_t *array)
+{
+  return (proto_chunk_t *) array->chunks;
+}
+
+/*
+ * Contiguous run of items starting at position, up to the end of its leaf.
+ */
+void **
+chunked_segment (const proto_array_t *array,
+                 size_t position,
+                 size_t *length)
+{
+  proto_chunk_t *chunk = chunked_root (array);
+
+  while (!chunk->is_leaf)
+    chunk = ((proto_chunk_inner_t *) chunk)->children[chunk_child ((proto_chunk_inner_t *) chunk, &position)];
+  *length = chunk->count - position;
+  return ((proto_chunk_leaf_t *) chunk)->items + position;
+}
+
+void
+chunked_free (proto_array_t *array)
+{
+  if (array->chunks != NULL)
+    chunk_free (chunked_root (array));
+  array->chunks = NULL;
+}
+
+static size_t
+chunk_memory_usage (const proto_chunk_t *chunk)
+{
+  size_t bytes, i;
+
+  if (chunk->is_leaf)
+    return sizeof (proto_chunk_leaf_t);
+  bytes = sizeof (proto_chunk_inner_t);
+  for (i = 0; i < chunk->count; i++)
+    bytes += chunk_memory_usage (((const proto_chunk_inner_t *) chunk)->children[i]);
+  return bytes;
+}
+
+// Bytes of the tree of leaves, not counting the array itself
+size_t
+chunked_memory_usage (const proto_array_t *array)
+{
+  if (array->chunks == NULL)
+    return 0;
+  return chunk_memory_usage (chunked_root (array));
+}
+
+static void
+proto_chunked_insert (void *self,
+                      size_t position,
+                      const void *element)
+{
+  if (self == NULL)
+    return;
+  proto_array_t *array = (proto_array_t *) self;
+
+  if (position > array->length)
+    return;
+  if (array->compare != NULL)
+    position = array_sorted_position (array, element);
+  heap_barrier (array->heap, element);
+  if (!chunk_insert (array, position, (void *) element))
+    return;
+  array->length++;
+  hash_index_insert (array, element, position);
+  refs_hold (array->refs, element);
+}
+
+static const void *
+proto_chunked_at (const void *self,
+                  size_t position)
+{
+  if (self == NULL)
+    return NULL;
+  const proto_array_t *array = (const proto_array_t *) self;
+  size_t length;
+
+  if (position >= array->length)
+    return NULL;
+  return *chunked_segment (array, position, &length);
+}
+
+static const void *
+proto_chunked_del (void *self,
+                   size_t position)
+{
+  if (self == NULL)
+    return NULL;
+  proto_array_t *array = (proto_array_t *) self;
+  proto_chunk_t *root = chunked_root (array);
+  const void *value;
+
+  if (position >= array->length)
+    return NULL;
+  heap_moving (array->heap, array);
+  value = chunk_delete (root, position);
+  while (!root->is_leaf && root->count == 1)
+    {
+      array->chunks = ((proto_chunk_inner_t *) root)->children[0];
+      free (root);
+      root = chunked_root (array);
+    }
+  array->length--;
+  hash_index_delete (array, value, position);
+  refs_drop (array->refs, value);
+  return value;
+}
+
+static void
+proto_chunked_push (void *self,
+                    const void *element)
+{
+  if (self == NULL)
+    return;
+  proto_array_t *array = (proto_array_t *) self;
+
+  array->insert (array, array->length, element);
+}
+
+static const void *
+proto_chunked_pop (void *self)
+{
+  if (self == NULL)
+    return NULL;
+  proto_array_t *array = (proto_array_t *) self;
+
+  return array->del (array, array->length - 1);
+}
+
+/*
+ * Same operations as proto_init_array, but positional insert and delete
+ * cost O(log n) instead of moving the whole tail. Direct access to items is
+ * not available: it's NULL, and allocated is 0.
+ */
+proto_array_t *
+proto_init_chunked_array ()
+{
+  proto_array_t *array = proto_init_array ();
+
+  if (!array)
+    return NULL;
+  array->chunks = chunk_new (true);
+  if (!array->chunks)
+    {
+      proto_del_array (array);
+      return NULL;
+    }
+  free (array->items);
+  array->items = NULL;
+  array->allocated = 0;
+  array->insert = &proto_chunked_insert;
+  array->at = &proto_chunked_at;
+  array->del = &proto_chunked_del;
+  array->push = &proto_chunked_push;
+  array->pop = &proto_chunked_pop;
+  return array;
+}
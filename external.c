@@ -0,0 +1,421 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+#include "internal.h"
+
+// Bytes of buffered records (and their sort index) when no budget is given
+#ifndef EXTERNAL_SORT_BUDGET
+#define EXTERNAL_SORT_BUDGET (64UL << 20)
+#endif
+// Smallest read buffer per run while merging; more runs than fit are
+// merged in several rounds
+#ifndef EXTERNAL_SORT_BLOCK_SIZE
+#define EXTERNAL_SORT_BLOCK_SIZE (256UL << 10)
+#endif
+
+typedef struct {
+  FILE *file;
+  char *block;
+  size_t used;
+  size_t capacity;
+} proto_external_writer_t;
+
+typedef struct {
+  FILE *file;
+  char *block;
+  size_t count;
+  size_t index;
+  size_t capacity;
+} proto_external_reader_t;
+
+/*
+ * Records are buffered until the budget is full, then sorted in memory and
+ * spilled to a temporary file as a sorted run. Finishing merges every run in
+ * one pass through a loser tree, so the data is read and written about
+ * twice in all; a sort that never fills the budget touches no file at all.
+ */
+struct proto_external_sort {
+  size_t size;
+  proto_compare_t compare;
+  char *records;
+  void **items;
+  size_t capacity;
+  size_t length;
+  size_t total;
+  proto_external_writer_t writer;
+  FILE **runs;
+  size_t runs_length;
+  size_t runs_allocated;
+  bool failed;
+  bool finished;
+};
+
+static bool
+external_write (proto_external_writer_t *writer,
+                const void *record,
+                size_t size)
+{
+  if (writer->used + size > writer->capacity)
+    {
+      if (fwrite (writer->block, 1, writer->used, writer->file) != writer->used)
+        return false;
+      writer->used = 0;
+    }
+  memcpy (writer->block + writer->used, record, size);
+  writer->used += size;
+  return true;
+}
+
+static bool
+external_write_end (proto_external_writer_t *writer)
+{
+  bool written = fwrite (writer->block, 1, writer->used, writer->file) == writer->used;
+
+  writer->used = 0;
+  return written && fflush (writer->file) == 0;
+}
+
+static bool
+external_add_run (proto_external_sort_t *sorter,
+                  FILE *run)
+{
+  if (sorter->runs_length == sorter->runs_allocated)
+    {
+      size_t allocated = sorter->runs_allocated ? 2 * sorter->runs_allocated : 16;
+      FILE **runs = (FILE **) realloc (sorter->runs, allocated * sizeof (FILE *));
+
+      if (!runs)
+        return false;
+      sorter->runs = runs;
+      sorter->runs_allocated = allocated;
+    }
+  sorter->runs[sorter->runs_length++] = run;
+  return true;
+}
+
+// Sorts the buffered records through their index
+static void
+external_sort_buffer (proto_external_sort_t *sorter)
+{
+  size_t i;
+
+  for (i = 0; i < sorter->length; i++)
+    sorter->items[i] = sorter->records + i * sorter->size;
+  sort_items (sorter->items, sorter->length, sorter->compare);
+}
+
+static bool
+external_spill (proto_external_sort_t *sorter)
+{
+  FILE *run = tmpfile ();
+  size_t i;
+
+  if (!run)
+    return false;
+  external_sort_buffer (sorter);
+  sorter->writer.file = run;
+  for (i = 0; i < sorter->length; i++)
+    if (!external_write (&sorter->writer, sorter->items[i], sorter->size))
+      break;
+  if (i < sorter->length || !external_write_end (&sorter->writer) || !external_add_run (sorter, run))
+    {
+      fclose (run);
+      return false;
+    }
+  sorter->length = 0;
+  return true;
+}
+
+static bool
+external_read (proto_external_reader_t *reader,
+               size_t size)
+{
+  reader->index = 0;
+  reader->count = fread (reader->block, size, reader->capacity, reader->file);
+  return reader->count > 0;
+}
+
+// Whether run a goes before run b; exhausted runs go after everything
+static inline bool
+external_beats (const proto_external_sort_t *sorter,
+                const proto_external_reader_t *readers,
+                size_t a,
+                size_t b)
+{
+  int order;
+
+  if (readers[a].count == 0)
+    return false;
+  if (readers[b].count == 0)
+    return true;
+  order = sorter->compare (readers[a].block + readers[a].index * sorter->size,
+                           readers[b].block + readers[b].index * sorter->size);
+  return order < 0 || (order == 0 && a < b);
+}
+
+// Leaves are nodes k to 2k - 1; every inner node keeps the loser of its match
+static size_t
+external_build (const proto_external_sort_t *sorter,
+                const proto_external_reader_t *readers,
+                size_t *tree,
+                size_t k,
+                size_t node)
+{
+  size_t left, right;
+
+  if (node >= k)
+    return node - k;
+  left = external_build (sorter, readers, tree, k, 2 * node);
+  right = external_build (sorter, readers, tree, k, 2 * node + 1);
+  if (external_beats (sorter, readers, left, right))
+    {
+      tree[node] = right;
+      return left;
+    }
+  tree[node] = left;
+  return right;
+}
+
+/*
+ * Merges k runs, reading each through its own slice of the record buffer.
+ * Records go to the writer when there is one, else to the callback straight
+ * from the read buffers. The runs are closed either way.
+ */
+static bool
+external_merge (proto_external_sort_t *sorter,
+                FILE **runs,
+                size_t k,
+                proto_external_writer_t *writer,
+                void (*callback) (const void *record, size_t position, void *context),
+                void *context)
+{
+  proto_external_reader_t *readers;
+  size_t *tree, i, winner, node, swap, position = 0, slice = sorter->capacity / k;
+  bool merged = false;
+
+  readers = (proto_external_reader_t *) malloc (k * sizeof (proto_external_reader_t));
+  tree = (size_t *) malloc (k * sizeof (size_t));
+  if (!readers || !tree)
+    goto done;
+  for (i = 0; i < k; i++)
+    {
+      readers[i].file = runs[i];
+      readers[i].block = sorter->records + i * slice * sorter->size;
+      readers[i].capacity = slice;
+      rewind (runs[i]);
+      if (!external_read (&readers[i], sorter->size) && ferror (runs[i]))
+        goto done;
+    }
+  tree[0] = external_build (sorter, readers, tree, k, 1);
+  while (readers[winner = tree[0]].count > 0)
+    {
+      proto_external_reader_t *reader = &readers[winner];
+      const char *record = reader->block + reader->index * sorter->size;
+
+      if (writer == NULL)
+        callback (record, position++, context);
+      else if (!external_write (writer, record, sorter->size))
+        goto done;
+      if (++reader->index == reader->count && !external_read (reader, sorter->size) && ferror (reader->file))
+        goto done;
+      for (node = (winner + k) / 2; node > 0; node /= 2)
+        if (external_beats (sorter, readers, tree[node], winner))
+          {
+            swap = tree[node];
+            tree[node] = winner;
+            winner = swap;
+          }
+      tree[0] = winner;
+    }
+  merged = writer == NULL || external_write_end (writer);
+
+done:
+  for (i = 0; i < k; i++)
+    fclose (runs[i]);
+  free (readers);
+  free (tree);
+  return merged;
+}
+
+/*
+ * Sorts records of size bytes with compare, which gets pointers to two
+ * records. The budget is the memory for buffered records and their index
+ * (0 picks EXTERNAL_SORT_BUDGET); runs are spilled with tmpfile.
+ */
+proto_external_sort_t *
+proto_init_external_sort (size_t size,
+                          proto_compare_t compare,
+                          size_t budget)
+{
+  proto_external_sort_t *sorter;
+
+  if (size == 0 || compare == NULL)
+    return NULL;
+  if (budget == 0)
+    budget = EXTERNAL_SORT_BUDGET;
+  sorter = (proto_external_sort_t *) calloc (1, sizeof (proto_external_sort_t));
+  if (!sorter)
+    return NULL;
+  sorter->size = size;
+  sorter->compare = compare;
+  sorter->capacity = budget / (size + sizeof (void *));
+  if (sorter->capacity < 2)
+    sorter->capacity = 2;
+  sorter->writer.capacity = EXTERNAL_SORT_BLOCK_SIZE < size ? size : EXTERNAL_SORT_BLOCK_SIZE;
+  sorter->records = (char *) malloc (sorter->capacity * size);
+  sorter->items = (void **) malloc (sorter->capacity * sizeof (void *));
+  sorter->writer.block = (char *) malloc (sorter->writer.capacity);
+  if (!sorter->records || !sorter->items || !sorter->writer.block)
+    {
+      proto_del_external_sort (sorter);
+      return NULL;
+    }
+  return sorter;
+}
+
+// Copies a record in; false once spilling failed or the sort has finished
+bool
+proto_external_sort_push (proto_external_sort_t *sorter,
+                          const void *record)
+{
+  if (sorter == NULL || record == NULL || sorter->failed || sorter->finished)
+    return false;
+  if (sorter->length == sorter->capacity && !external_spill (sorter))
+    {
+      sorter->failed = true;
+      return false;
+    }
+  memcpy (sorter->records + sorter->length++ * sorter->size, record, sorter->size);
+  sorter->total++;
+  return true;
+}
+
+// Pushes the record each item points to, e.g. the proto_data_t of a typed array
+bool
+proto_external_sort_push_array (proto_external_sort_t *sorter,
+                                const proto_array_t *array)
+{
+  void **segment;
+  size_t position, length, i;
+
+  if (sorter == NULL || array == NULL)
+    return false;
+  for (position = 0; position < array->length; position += length)
+    {
+      segment = array_segment (array, position, &length);
+      for (i = 0; i < length; i++)
+        if (!proto_external_sort_push (sorter, segment[i]))
+          return false;
+    }
+  return true;
+}
+
+size_t
+proto_external_sort_length (const proto_external_sort_t *sorter)
+{
+  if (sorter == NULL)
+    return 0;
+  return sorter->total;
+}
+
+/*
+ * Finishes the sort, calling back with every record in order; records are
+ * only valid during the call. A sorter finishes once: later calls and
+ * pushes fail.
+ */
+bool
+proto_external_sort_each (proto_external_sort_t *sorter,
+                          void (*callback) (const void *record, size_t position, void *context),
+                          void *context)
+{
+  proto_external_writer_t *writer;
+  size_t i, fan_in;
+  FILE *run;
+
+  if (sorter == NULL || callback == NULL || sorter->failed || sorter->finished)
+    return false;
+  sorter->finished = true;
+  writer = &sorter->writer;
+  if (sorter->runs_length == 0)
+    {
+      external_sort_buffer (sorter);
+      for (i = 0; i < sorter->length; i++)
+        callback (sorter->items[i], i, context);
+      return true;
+    }
+  if (sorter->length > 0 && !external_spill (sorter))
+    return false;
+  fan_in = sorter->capacity * sorter->size / EXTERNAL_SORT_BLOCK_SIZE;
+  if (fan_in < 2)
+    fan_in = 2;
+  if (fan_in > sorter->capacity)
+    fan_in = sorter->capacity;
+  // Only when the budget can't give every run a block: merge the oldest ones
+  while (sorter->runs_length > fan_in)
+    {
+      if (!(run = tmpfile ()))
+        return false;
+      writer->file = run;
+      if (!external_merge (sorter, sorter->runs, fan_in, writer, NULL, NULL))
+        {
+          fclose (run);
+          sorter->runs_length -= fan_in;
+          memmove (sorter->runs, sorter->runs + fan_in, sorter->runs_length * sizeof (FILE *));
+          return false;
+        }
+      sorter->runs_length -= fan_in;
+      memmove (sorter->runs, sorter->runs + fan_in, sorter->runs_length * sizeof (FILE *));
+      sorter->runs[sorter->runs_length++] = run;
+    }
+  i = sorter->runs_length;
+  sorter->runs_length = 0;
+  return external_merge (sorter, sorter->runs, i, NULL, callback, context);
+}
+
+static void
+external_push_mapped (const void *record,
+                      size_t position,
+                      void *context)
+{
+  proto_mapped_array_push ((proto_mapped_array_t *) context, record);
+}
+
+// Finishes the sort by appending every record, in order, to a file-backed array
+bool
+proto_external_sort_to_mapped (proto_external_sort_t *sorter,
+                               proto_mapped_array_t *output)
+{
+  size_t length = proto_mapped_array_length (output);
+
+  if (sorter == NULL || output == NULL || mapped_record_size (output) != sorter->size
+      || !proto_mapped_array_reserve (output, length + sorter->total))
+    return false;
+  if (!proto_external_sort_each (sorter, &external_push_mapped, output))
+    return false;
+  return proto_mapped_array_length (output) == length + sorter->total;
+}
+
+void
+proto_del_external_sort (proto_external_sort_t *sorter)
+{
+  size_t i;
+
+  if (sorter == NULL)
+    return;
+  for (i = 0; i < sorter->runs_length; i++)
+    fclose (sorter->runs[i]);
+  free (sorter->runs);
+  free (sorter->records);
+  free (sorter->items);
+  free (sorter->writer.block);
+  free (sorter);
+}
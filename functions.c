@@ -8,8 +8,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "proto.h"
+#include "internal.h"
+
+// Arguments a call can hold on the stack; longer signatures use the heap
+#ifndef SIGNATURE_STACK_SLOTS
+#define SIGNATURE_STACK_SLOTS 16
+#endif
+// Rows handed to a batch function at a time
+#ifndef SIGNATURE_BATCH_ROWS
+#define SIGNATURE_BATCH_ROWS 256
+#endif
+
+struct proto_signature {
+  size_t length;
+  proto_type_t types[];
+};
+
+/*
+ * A frame is the argument list of a call: the array passed to the function,
+ * its items and the unboxed data they point to, all in one block.
+ */
+struct proto_frame {
+  proto_array_t arguments;
+  size_t capacity;
+  void **items;
+  proto_data_t *slots;
+};
 
 void *
 proto_generic_caller (const char *arguments,
@@ -19,8 +46,11 @@ proto_generic_caller (const char *arguments,
   char current_char;
   void *return_value;
   va_list args;
+  size_t start = latency_active () ? latency_now () : 0, boxed = 0, called = 0;
   proto_array_t *arguments_list = proto_init_array ();
 
+  STATS_ADD (calls, 1);
+  PROBE1 (call__entry, arguments);
   va_start (args, function);
   i = 0;
   current_char = arguments[i];
@@ -60,9 +90,437 @@ proto_generic_caller (const char *arguments,
       current_char = arguments[++i];
     }
   va_end (args);
+  if (start != 0)
+    boxed = latency_now ();
   return_value = function (arguments_list);
+  if (start != 0)
+    called = latency_now ();
   while (arguments_list->length)
     free ((void *) arguments_list->pop (arguments_list));
   proto_del_array (arguments_list);
+  PROBE1 (call__return, arguments);
+  if (start != 0)
+    {
+      size_t end = latency_now ();
+
+      latency_record (PROTO_LATENCY_CALL, arguments, (const void *) function, end - start);
+      latency_record (PROTO_LATENCY_BOXING, arguments, (const void *) function,
+                      (boxed - start) + (end - called));
+    }
+  return return_value;
+}
+
+static bool
+signature_type (char conversion,
+                proto_type_t *type)
+{
+  switch (conversion)
+    {
+      case 'd':
+        *type = decimal_t;
+        return true;
+      case 'i':
+        *type = integer_t;
+        return true;
+      case 's':
+        *type = string_t;
+        return true;
+      case 'o':
+        *type = object_t;
+        return true;
+      case 'a':
+        *type = array_t;
+        return true;
+      case 'b':
+        *type = boolean_t;
+        return true;
+      case 'f':
+        *type = function_t;
+        return true;
+      case 'p':
+        *type = pointer_t;
+        return true;
+    }
+  return false;
+}
+
+/*
+ * Parses a format like the one proto_generic_caller takes, once, so calls
+ * through the signature skip the parsing; an unknown conversion gives NULL.
+ */
+proto_signature_t *
+proto_signature_compile (const char *arguments)
+{
+  proto_signature_t *signature;
+  size_t i, length = 0;
+
+  if (arguments == NULL)
+    return NULL;
+  for (i = 0; arguments[i] != '\0'; i++)
+    if (arguments[i] == '%')
+      length++;
+  signature = (proto_signature_t *) malloc (sizeof (proto_signature_t) + length * sizeof (proto_type_t));
+  if (!signature)
+    return NULL;
+  signature->length = 0;
+  for (i = 0; arguments[i] != '\0'; i++)
+    if (arguments[i] == '%'
+        && !signature_type (arguments[++i], &signature->types[signature->length++]))
+      {
+        free (signature);
+        return NULL;
+      }
+  return signature;
+}
+
+size_t
+proto_signature_length (const proto_signature_t *signature)
+{
+  if (signature == NULL)
+    return 0;
+  return signature->length;
+}
+
+void
+proto_del_signature (proto_signature_t *signature)
+{
+  free (signature);
+}
+
+// Unboxes the variable arguments into slots and lists them in arguments
+static void
+signature_fill (const proto_signature_t *signature,
+                proto_array_t *arguments,
+                void **items,
+                proto_data_t *slots,
+                va_list args)
+{
+  size_t i;
+
+  STATS_ADD (calls, 1);
+  for (i = 0; i < signature->length; i++)
+    {
+      slots[i].type = signature->types[i];
+      switch (signature->types[i])
+        {
+          case decimal_t:
+            slots[i].data.decimal = va_arg (args, double);
+            break;
+          case integer_t:
+            slots[i].data.integer = va_arg (args, long);
+            break;
+          case string_t:
+            slots[i].data.string = va_arg (args, char *);
+            break;
+          case boolean_t:
+            slots[i].data.boolean = va_arg (args, int);
+            break;
+          case function_t:
+            slots[i].data.function = (void *(*) (void *)) va_arg (args, void *);
+            break;
+          default:
+            slots[i].data.pointer = va_arg (args, void *);
+            break;
+        }
+      items[i] = &slots[i];
+    }
+  array_over (arguments, items, signature->length);
+}
+
+// Calls through memo when there is one, else straight to function
+static void *
+signature_vcall (const proto_signature_t *signature,
+                 void *(*function) (const void *arguments),
+                 proto_memo_t *memo,
+                 va_list args)
+{
+  void *items[SIGNATURE_STACK_SLOTS];
+  proto_data_t slots[SIGNATURE_STACK_SLOTS];
+  proto_array_t arguments;
+  proto_frame_t *frame;
+  void *return_value;
+
+  if (signature->length <= SIGNATURE_STACK_SLOTS)
+    {
+      signature_fill (signature, &arguments, items, slots, args);
+      return memo ? proto_memo_call (memo, &arguments) : function (&arguments);
+    }
+  frame = proto_init_frame (signature);
+  if (!frame)
+    return NULL;
+  signature_fill (signature, &frame->arguments, frame->items, frame->slots, args);
+  return_value = memo ? proto_memo_call (memo, &frame->arguments) : function (&frame->arguments);
+  proto_del_frame (frame);
+  return return_value;
+}
+
+/*
+ * Calls function with the same argument list proto_generic_caller builds,
+ * but kept on the stack: the function must only read it, and nothing in it
+ * outlives the call.
+ */
+void *
+proto_signature_call (const proto_signature_t *signature,
+                      void *(*function) (const void *arguments), ...)
+{
+  void *return_value;
+  va_list args;
+
+  if (signature == NULL || function == NULL)
+    return NULL;
+  va_start (args, function);
+  return_value = signature_vcall (signature, function, NULL, args);
+  va_end (args);
   return return_value;
 }
+
+// Like proto_signature_call, answering repeated arguments from the memo
+void *
+proto_memo_call_signature (proto_memo_t *memo,
+                           const proto_signature_t *signature, ...)
+{
+  void *return_value;
+  va_list args;
+
+  if (memo == NULL || signature == NULL)
+    return NULL;
+  va_start (args, signature);
+  return_value = signature_vcall (signature, NULL, memo, args);
+  va_end (args);
+  return return_value;
+}
+
+/*
+ * Boxes the arguments once, into a frame the returned future owns, and runs
+ * the call on the pool; the function may read them until the future is
+ * deleted. Without a pool the call runs before this returns.
+ */
+proto_future_t *
+proto_signature_call_async (proto_pool_t *pool,
+                            const proto_signature_t *signature,
+                            void *(*function) (const void *arguments), ...)
+{
+  proto_frame_t *frame;
+  va_list args;
+
+  if (signature == NULL || function == NULL)
+    return NULL;
+  frame = proto_init_frame (signature);
+  if (!frame)
+    return NULL;
+  va_start (args, function);
+  signature_fill (signature, &frame->arguments, frame->items, frame->slots, args);
+  va_end (args);
+  return future_spawn (pool, function, &frame->arguments, frame);
+}
+
+proto_future_t *
+proto_generic_call_async (proto_pool_t *pool,
+                          const char *arguments,
+                          void *(*function) (const void *arguments), ...)
+{
+  proto_signature_t *signature;
+  proto_frame_t *frame;
+  va_list args;
+
+  if (function == NULL)
+    return NULL;
+  signature = proto_signature_compile (arguments);
+  frame = proto_init_frame (signature);
+  if (!frame)
+    {
+      proto_del_signature (signature);
+      return NULL;
+    }
+  va_start (args, function);
+  signature_fill (signature, &frame->arguments, frame->items, frame->slots, args);
+  va_end (args);
+  proto_del_signature (signature);
+  return future_spawn (pool, function, &frame->arguments, frame);
+}
+
+// A frame for calls through signature, or any other no longer than it
+proto_frame_t *
+proto_init_frame (const proto_signature_t *signature)
+{
+  proto_frame_t *frame;
+  size_t capacity;
+
+  if (signature == NULL)
+    return NULL;
+  capacity = signature->length;
+  frame = (proto_frame_t *) malloc (sizeof (proto_frame_t)
+    + capacity * (sizeof (void *) + sizeof (proto_data_t)));
+  if (!frame)
+    return NULL;
+  frame->capacity = capacity;
+  frame->slots = (proto_data_t *) (frame + 1);
+  frame->items = (void **) (frame->slots + capacity);
+  array_over (&frame->arguments, frame->items, 0);
+  return frame;
+}
+
+/*
+ * Like proto_signature_call, with the argument list built in frame; it stays
+ * there until the next call through the frame, so the function may keep it.
+ */
+void *
+proto_signature_call_frame (const proto_signature_t *signature,
+                            proto_frame_t *frame,
+                            void *(*function) (const void *arguments), ...)
+{
+  va_list args;
+
+  if (signature == NULL || frame == NULL || function == NULL || signature->length > frame->capacity)
+    return NULL;
+  va_start (args, function);
+  signature_fill (signature, &frame->arguments, frame->items, frame->slots, args);
+  va_end (args);
+  return function (&frame->arguments);
+}
+
+void
+proto_del_frame (proto_frame_t *frame)
+{
+  free (frame);
+}
+
+// Bytes of one value of type in a typed column
+static size_t
+signature_type_size (proto_type_t type)
+{
+  switch (type)
+    {
+      case decimal_t:
+        return sizeof (double);
+      case integer_t:
+        return sizeof (long);
+      case boolean_t:
+        return sizeof (bool);
+      case function_t:
+        return sizeof (void *(*) (void *));
+      default:
+        return sizeof (void *);
+    }
+}
+
+// Every column has either values or an array of proto_data_t, with rows of them
+static bool
+signature_columns_valid (const proto_signature_t *signature,
+                         const proto_column_t *columns,
+                         size_t rows)
+{
+  size_t i;
+
+  if (signature == NULL || (columns == NULL && signature->length > 0))
+    return false;
+  for (i = 0; i < signature->length; i++)
+    if ((columns[i].values == NULL) == (columns[i].array == NULL)
+        || (columns[i].array != NULL && columns[i].array->length < rows))
+      return false;
+  return true;
+}
+
+/*
+ * Calls function once per row of the argument columns, with the argument
+ * list proto_signature_call would build, and returns an array of what each
+ * call returned. Values of typed columns are unboxed into one reused frame;
+ * items of array columns are passed as they are.
+ */
+proto_array_t *
+proto_signature_call_rows (const proto_signature_t *signature,
+                           void *(*function) (const void *arguments),
+                           const proto_column_t *columns,
+                           size_t rows)
+{
+  proto_array_t *results;
+  proto_frame_t *frame;
+  size_t row, i;
+
+  if (function == NULL || !signature_columns_valid (signature, columns, rows))
+    return NULL;
+  results = array_with_capacity (rows);
+  frame = proto_init_frame (signature);
+  if (!results || !frame)
+    {
+      if (results)
+        proto_del_array (results);
+      proto_del_frame (frame);
+      return NULL;
+    }
+  array_over (&frame->arguments, frame->items, signature->length);
+  for (i = 0; i < signature->length; i++)
+    frame->slots[i].type = signature->types[i];
+  for (row = 0; row < rows; row++)
+    {
+      for (i = 0; i < signature->length; i++)
+        if (columns[i].array != NULL)
+          frame->items[i] = array_item (columns[i].array, row);
+        else
+          {
+            size_t size = signature_type_size (signature->types[i]);
+
+            memcpy (&frame->slots[i].data, (const char *) columns[i].values + row * size, size);
+            frame->items[i] = &frame->slots[i];
+          }
+      STATS_ADD (calls, 1);
+      results->items[row] = function (&frame->arguments);
+    }
+  results->length = rows;
+  proto_del_frame (frame);
+  return results;
+}
+
+/*
+ * For functions written against the batch ABI: function gets one C array of
+ * unboxed values per argument, holding up to SIGNATURE_BATCH_ROWS rows, and
+ * stores one result per row. Typed columns are passed in place; array
+ * columns are unboxed a batch at a time.
+ */
+proto_array_t *
+proto_signature_call_batch (const proto_signature_t *signature,
+                            void (*function) (const void *const *columns, size_t rows, void **results),
+                            const proto_column_t *columns,
+                            size_t rows)
+{
+  proto_array_t *results;
+  const void **batch;
+  char *scratch;
+  size_t row, count, i, k, size;
+
+  if (function == NULL || !signature_columns_valid (signature, columns, rows))
+    return NULL;
+  results = array_with_capacity (rows);
+  batch = (const void **) malloc ((signature->length + 1) * sizeof (void *));
+  scratch = (char *) malloc (signature->length * SIGNATURE_BATCH_ROWS * sizeof (proto_typed_data_t) + 1);
+  if (!results || !batch || !scratch)
+    {
+      if (results)
+        proto_del_array (results);
+      free (batch);
+      free (scratch);
+      return NULL;
+    }
+  for (row = 0; row < rows; row += count)
+    {
+      count = rows - row < SIGNATURE_BATCH_ROWS ? rows - row : SIGNATURE_BATCH_ROWS;
+      for (i = 0; i < signature->length; i++)
+        {
+          size = signature_type_size (signature->types[i]);
+          if (columns[i].values != NULL)
+            {
+              batch[i] = (const char *) columns[i].values + row * size;
+              continue;
+            }
+          batch[i] = scratch + i * SIGNATURE_BATCH_ROWS * sizeof (proto_typed_data_t);
+          for (k = 0; k < count; k++)
+            memcpy ((char *) batch[i] + k * size,
+                    &((const proto_data_t *) array_item (columns[i].array, row + k))->data, size);
+        }
+      function (batch, count, results->items + row);
+    }
+  results->length = rows;
+  free (batch);
+  free (scratch);
+  return results;
+}
@@ -0,0 +1,235 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "proto.h"
+#include "internal.h"
+
+typedef struct proto_future_callback {
+  void (*callback) (void *result, void *context);
+  void *context;
+  struct proto_future_callback *next;
+} proto_future_callback_t;
+
+/*
+ * A future is the call it runs plus what the call returned. Callbacks are
+ * kept in order until the call returns and then run on the same thread;
+ * the future is done only after they all ran.
+ */
+struct proto_future {
+  proto_pool_t *pool;
+  void *(*function) (const void *arguments);
+  const void *arguments;
+  proto_frame_t *frame;
+  void *result;
+  proto_future_callback_t *callbacks;
+  proto_future_callback_t **callbacks_tail;
+  bool done;
+};
+
+// Every future shares one lock, so a waiter can watch any number of them
+static pthread_mutex_t future_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t future_done = PTHREAD_COND_INITIALIZER;
+
+static void
+future_run (size_t chunk,
+            void *context)
+{
+  proto_future_t *future = (proto_future_t *) context;
+  proto_future_callback_t *callback, *next;
+  void *result = future->function (future->arguments);
+
+  pthread_mutex_lock (&future_lock);
+  future->result = result;
+  while ((callback = future->callbacks) != NULL)
+    {
+      future->callbacks = NULL;
+      future->callbacks_tail = &future->callbacks;
+      pthread_mutex_unlock (&future_lock);
+      for (; callback != NULL; callback = next)
+        {
+          next = callback->next;
+          callback->callback (result, callback->context);
+          free (callback);
+        }
+      pthread_mutex_lock (&future_lock);
+    }
+  future->done = true;
+  pthread_cond_broadcast (&future_done);
+  pthread_mutex_unlock (&future_lock);
+}
+
+/*
+ * Runs function with arguments on the pool, or right here without one;
+ * the future takes over the frame the arguments may live in.
+ */
+proto_future_t *
+future_spawn (proto_pool_t *pool,
+              void *(*function) (const void *arguments),
+              const void *arguments,
+              proto_frame_t *frame)
+{
+  proto_future_t *future = (proto_future_t *) malloc (sizeof (proto_future_t));
+
+  if (!future)
+    {
+      proto_del_frame (frame);
+      return NULL;
+    }
+  future->pool = pool;
+  future->function = function;
+  future->arguments = arguments;
+  future->frame = frame;
+  future->result = NULL;
+  future->callbacks = NULL;
+  future->callbacks_tail = &future->callbacks;
+  future->done = false;
+  if (!pool_spawn (pool, &future_run, future))
+    future_run (0, future);
+  return future;
+}
+
+// Blocks until the call returned and its callbacks ran, then gives its result
+void *
+proto_future_wait (proto_future_t *future)
+{
+  bool helped;
+
+  if (future == NULL)
+    return NULL;
+  pthread_mutex_lock (&future_lock);
+  while (!future->done)
+    {
+      pthread_mutex_unlock (&future_lock);
+      helped = pool_help (future->pool);
+      pthread_mutex_lock (&future_lock);
+      if (!helped && !future->done)
+        pthread_cond_wait (&future_done, &future_lock);
+    }
+  pthread_mutex_unlock (&future_lock);
+  return future->result;
+}
+
+// Stores the result and returns true if the future is done, without blocking
+bool
+proto_future_poll (proto_future_t *future,
+                   void **result)
+{
+  bool done;
+
+  if (future == NULL)
+    return false;
+  pthread_mutex_lock (&future_lock);
+  done = future->done;
+  pthread_mutex_unlock (&future_lock);
+  if (done && result != NULL)
+    *result = future->result;
+  return done;
+}
+
+/*
+ * Calls back with the result once the call returns, on the thread that ran
+ * it; on a future that's already done, the callback runs right away.
+ */
+bool
+proto_future_then (proto_future_t *future,
+                   void (*callback) (void *result, void *context),
+                   void *context)
+{
+  proto_future_callback_t *node;
+
+  if (future == NULL || callback == NULL)
+    return false;
+  node = (proto_future_callback_t *) malloc (sizeof (proto_future_callback_t));
+  if (!node)
+    return false;
+  node->callback = callback;
+  node->context = context;
+  node->next = NULL;
+  pthread_mutex_lock (&future_lock);
+  if (!future->done)
+    {
+      *future->callbacks_tail = node;
+      future->callbacks_tail = &node->next;
+      pthread_mutex_unlock (&future_lock);
+      return true;
+    }
+  pthread_mutex_unlock (&future_lock);
+  free (node);
+  callback (future->result, context);
+  return true;
+}
+
+void
+proto_future_wait_all (proto_future_t *const *futures,
+                       size_t length)
+{
+  size_t i;
+
+  if (futures == NULL)
+    return;
+  for (i = 0; i < length; i++)
+    proto_future_wait (futures[i]);
+}
+
+// The position of a future that's done, or -1 when there's none to wait for
+size_t
+proto_future_wait_any (proto_future_t *const *futures,
+                       size_t length)
+{
+  proto_pool_t *pool = NULL;
+  size_t i, found = -1;
+  bool helped;
+
+  if (futures == NULL)
+    return -1;
+  for (i = 0; i < length && pool == NULL; i++)
+    if (futures[i] != NULL)
+      pool = futures[i]->pool;
+  pthread_mutex_lock (&future_lock);
+  for (;;)
+    {
+      bool pending = false;
+
+      for (i = 0; i < length && found == (size_t) -1; i++)
+        if (futures[i] != NULL)
+          {
+            if (futures[i]->done)
+              found = i;
+            pending = true;
+          }
+      if (found != (size_t) -1 || !pending)
+        break;
+      pthread_mutex_unlock (&future_lock);
+      helped = pool_help (pool);
+      pthread_mutex_lock (&future_lock);
+      if (!helped)
+        {
+          for (i = 0; i < length; i++)
+            if (futures[i] != NULL && futures[i]->done)
+              break;
+          if (i == length)
+            pthread_cond_wait (&future_done, &future_lock);
+        }
+    }
+  pthread_mutex_unlock (&future_lock);
+  return found;
+}
+
+// Waits for the future if it's still running, then releases it
+void
+proto_del_future (proto_future_t *future)
+{
+  if (future == NULL)
+    return;
+  proto_future_wait (future);
+  proto_del_frame (future->frame);
+  free (future);
+}
@@ -0,0 +1,401 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef HASH_INDEX_THRESHOLD
+#define HASH_INDEX_THRESHOLD 64
+#endif
+
+typedef struct {
+  const void *key;
+  size_t first;
+  size_t count;
+} proto_hash_index_entry_t;
+
+/*
+ * Table from element pointer to its number of occurrences and the position
+ * of the first one. Positions are stored with a bias, so shift/unshift move
+ * every position at once by changing the bias only. NULL marks an empty
+ * slot, so NULL elements get an entry of their own. The index is built
+ * while its table is allocated.
+ */
+typedef struct {
+  pointer_table_t table;
+  size_t bias;
+  proto_hash_index_entry_t null_entry;
+} proto_hash_index_t;
+
+static bool
+hash_index_init (proto_hash_index_t *index,
+                 size_t expected)
+{
+  index->table = (pointer_table_t) { NULL, sizeof (proto_hash_index_entry_t), 0, 0 };
+  if (!pointer_table_reserve (&index->table, expected))
+    return false;
+  index->bias = 0;
+  index->null_entry.key = NULL;
+  index->null_entry.first = 0;
+  index->null_entry.count = 0;
+  return true;
+}
+
+static proto_hash_index_entry_t *
+hash_index_find (proto_hash_index_t *index,
+                 const void *key)
+{
+  if (key == NULL)
+    return index->null_entry.count ? &index->null_entry : NULL;
+  return (proto_hash_index_entry_t *) pointer_table_find (&index->table, key);
+}
+
+/*
+ * Finds the entry for key, creating it with no occurrences and the given
+ * biased first position when it's missing. Returns NULL if it can't grow.
+ */
+static proto_hash_index_entry_t *
+hash_index_add (proto_hash_index_t *index,
+                const void *key,
+                size_t first)
+{
+  proto_hash_index_entry_t *entry;
+  bool added;
+
+  if (key == NULL)
+    {
+      if (!index->null_entry.count)
+        index->null_entry.first = first;
+      return &index->null_entry;
+    }
+  entry = (proto_hash_index_entry_t *) pointer_table_add (&index->table, key, &added);
+  if (added)
+    entry->first = first;
+  return entry;
+}
+
+static void
+hash_index_remove (proto_hash_index_t *index,
+                   proto_hash_index_entry_t *entry)
+{
+  if (entry == &index->null_entry)
+    entry->count = 0;
+  else
+    pointer_table_remove (&index->table, entry);
+}
+
+static void
+hash_index_move_from (proto_hash_index_t *index,
+                      size_t position,
+                      bool forward)
+{
+  proto_hash_index_entry_t *entry;
+  size_t i;
+
+  for (i = 0; i < index->table.capacity; i++)
+    {
+      entry = (proto_hash_index_entry_t *) pointer_table_entry (&index->table, i);
+      if (entry->key != NULL && entry->first - index->bias >= position)
+        entry->first += forward ? 1 : -1;
+    }
+  if (index->null_entry.count && index->null_entry.first - index->bias >= position)
+    index->null_entry.first += forward ? 1 : -1;
+}
+
+static bool
+hash_index_build (proto_array_t *array)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+  proto_hash_index_entry_t *entry;
+  size_t i;
+
+  if (!hash_index_init (index, array->length))
+    return false;
+  for (i = 0; i < array->length; i++)
+    {
+      entry = hash_index_add (index, array_item (array, i), i);
+      if (entry == NULL)
+        {
+          pointer_table_clear (&index->table);
+          return false;
+        }
+      entry->count++;
+    }
+  return true;
+}
+
+void
+hash_index_free (proto_array_t *array)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+
+  if (index == NULL)
+    return;
+  pointer_table_clear (&index->table);
+  free (index);
+  array->hash_index = NULL;
+}
+
+size_t
+hash_index_memory_usage (const proto_array_t *array)
+{
+  const proto_hash_index_t *index = (const proto_hash_index_t *) array->hash_index;
+
+  if (index == NULL)
+    return 0;
+  return sizeof (proto_hash_index_t) + index->table.capacity * index->table.size;
+}
+
+void
+hash_index_invalidate (proto_array_t *array)
+{
+  if (array->hash_index != NULL)
+    pointer_table_clear (&((proto_hash_index_t *) array->hash_index)->table);
+}
+
+bool
+hash_index_ready (proto_array_t *array)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+
+  if (index == NULL)
+    return false;
+  if (index->table.entries != NULL)
+    return true;
+  if (array->length < HASH_INDEX_THRESHOLD)
+    return false;
+  return hash_index_build (array);
+}
+
+size_t
+hash_index_lookup (const proto_array_t *array,
+                   const void *element)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+  proto_hash_index_entry_t *entry = hash_index_find (index, element);
+
+  if (entry == NULL)
+    return -1;
+  return entry->first - index->bias;
+}
+
+/*
+ * Called once the element is already stored at position.
+ */
+void
+hash_index_insert (proto_array_t *array,
+                   const void *element,
+                   size_t position)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+  proto_hash_index_entry_t *entry;
+
+  if (index == NULL || index->table.entries == NULL)
+    return;
+  if (position == 0)
+    index->bias--;
+  else if (position < array->length - 1)
+    hash_index_move_from (index, position, true);
+  entry = hash_index_add (index, element, position + index->bias);
+  if (entry == NULL)
+    {
+      pointer_table_clear (&index->table);
+      return;
+    }
+  if (entry->count && entry->first - index->bias > position)
+    entry->first = position + index->bias;
+  entry->count++;
+}
+
+/*
+ * Called once the element at position has been removed from the items.
+ */
+void
+hash_index_delete (proto_array_t *array,
+                   const void *element,
+                   size_t position)
+{
+  proto_hash_index_t *index = (proto_hash_index_t *) array->hash_index;
+  proto_hash_index_entry_t *entry;
+  bool was_first = false;
+  size_t i;
+
+  if (index == NULL || index->table.entries == NULL)
+    return;
+  entry = hash_index_find (index, element);
+  if (entry != NULL)
+    {
+      if (--entry->count == 0)
+        hash_index_remove (index, entry);
+      else
+        was_first = entry->first - index->bias == position;
+    }
+  if (position == 0)
+    index->bias++;
+  else if (position < array->length)
+    hash_index_move_from (index, position + 1, false);
+  if (!was_first)
+    return;
+  // The removed element had duplicates: its first occurrence moves forward
+  entry = hash_index_find (index, element);
+  for (i = position; i < array->length; i++)
+    if (array_item (array, i) == element)
+      {
+        entry->first = i + index->bias;
+        return;
+      }
+}
+
+void
+proto_array_hash_index (proto_array_t *array,
+                        bool enabled)
+{
+  proto_hash_index_t *index;
+
+  if (array == NULL)
+    return;
+  if (!enabled)
+    {
+      hash_index_free (array);
+      return;
+    }
+  if (array->hash_index != NULL)
+    return;
+  index = (proto_hash_index_t *) malloc (sizeof (proto_hash_index_t));
+  if (!index)
+    return;
+  index->table = (pointer_table_t) { NULL, sizeof (proto_hash_index_entry_t), 0, 0 };
+  array->hash_index = index;
+}
+
+/*
+ * Pushes every element of list missing from seen into result; when filter
+ * is given, elements must also be (or not be) in it.
+ */
+static bool
+hash_index_collect (proto_array_t *result,
+                    proto_hash_index_t *seen,
+                    const proto_array_t *list,
+                    proto_hash_index_t *filter,
+                    bool keep_members)
+{
+  proto_hash_index_entry_t *entry;
+  size_t i;
+
+  if (list == NULL)
+    return true;
+  for (i = 0; i < list->length; i++)
+    {
+      const void *element = array_item (list, i);
+
+      if (filter != NULL && (hash_index_find (filter, element) != NULL) != keep_members)
+        continue;
+      entry = hash_index_add (seen, element, 0);
+      if (entry == NULL)
+        return false;
+      if (entry->count++)
+        continue;
+      result->push (result, element);
+    }
+  return true;
+}
+
+static bool
+hash_index_from_array (proto_hash_index_t *index,
+                       const proto_array_t *list)
+{
+  proto_hash_index_entry_t *entry;
+  size_t i, length = list == NULL ? 0 : list->length;
+
+  if (!hash_index_init (index, length))
+    return false;
+  for (i = 0; i < length; i++)
+    {
+      entry = hash_index_add (index, array_item (list, i), i);
+      if (entry == NULL)
+        {
+          pointer_table_clear (&index->table);
+          return false;
+        }
+      entry->count++;
+    }
+  return true;
+}
+
+static proto_array_t *
+hash_index_set_operation (const proto_array_t *array,
+                          const proto_array_t *another,
+                          bool use_filter,
+                          bool keep_members)
+{
+  proto_array_t *result;
+  proto_hash_index_t seen, filter;
+  bool success;
+
+  if (array == NULL)
+    return NULL;
+  result = proto_init_array ();
+  if (!result)
+    return NULL;
+  if (!hash_index_init (&seen, array->length))
+    {
+      proto_del_array (result);
+      return NULL;
+    }
+  if (use_filter)
+    {
+      if (!hash_index_from_array (&filter, another))
+        {
+          pointer_table_clear (&seen.table);
+          proto_del_array (result);
+          return NULL;
+        }
+      success = hash_index_collect (result, &seen, array, &filter, keep_members);
+      pointer_table_clear (&filter.table);
+    }
+  else
+    success = hash_index_collect (result, &seen, array, NULL, false)
+      && hash_index_collect (result, &seen, another, NULL, false);
+  pointer_table_clear (&seen.table);
+  if (!success)
+    {
+      proto_del_array (result);
+      return NULL;
+    }
+  return result;
+}
+
+proto_array_t *
+proto_array_unique (const proto_array_t *array)
+{
+  return hash_index_set_operation (array, NULL, false, false);
+}
+
+proto_array_t *
+proto_array_union (const proto_array_t *array,
+                   const proto_array_t *another)
+{
+  return hash_index_set_operation (array, another, false, false);
+}
+
+proto_array_t *
+proto_array_intersection (const proto_array_t *array,
+                          const proto_array_t *another)
+{
+  return hash_index_set_operation (array, another, true, true);
+}
+
+proto_array_t *
+proto_array_difference (const proto_array_t *array,
+                        const proto_array_t *another)
+{
+  return hash_index_set_operation (array, another, true, false);
+}
@@ -0,0 +1,533 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef HEAP_MIN_TRIGGER
+#define HEAP_MIN_TRIGGER 1024
+#endif
+#ifndef HEAP_STEP_BUDGET
+#define HEAP_STEP_BUDGET 256
+#endif
+
+typedef enum {
+  HEAP_OBJECT,
+  HEAP_ARRAY,
+  HEAP_DATA
+} heap_kind_t;
+
+typedef enum {
+  HEAP_IDLE,
+  HEAP_MARK,
+  HEAP_SWEEP
+} heap_phase_t;
+
+typedef struct {
+  const void *pointer;
+  size_t epoch;
+  heap_kind_t kind;
+} heap_cell_t;
+
+typedef struct {
+  const void *pointer;
+  heap_kind_t kind;
+} heap_gray_t;
+
+/*
+ * Incremental mark and sweep over the objects, arrays and data boxes the
+ * heap allocated. Cells sit in an open addressing table keyed by address;
+ * a cell is marked when its epoch is the heap's, so starting a cycle
+ * unmarks them all at once, and cells allocated meanwhile are born marked.
+ * Marked cells not scanned yet wait on the gray stack; the one being
+ * scanned resumes where the last step left it.
+ */
+struct proto_heap {
+  pointer_table_t cells;
+  size_t epoch;
+  heap_phase_t phase;
+  bool failed;
+  const void **roots;
+  size_t roots_length;
+  size_t roots_capacity;
+  heap_gray_t *gray;
+  size_t gray_length;
+  size_t gray_capacity;
+  heap_gray_t current;
+  bool scanning;
+  size_t position;
+  object_cursor_t cursor;
+  size_t sweep;
+  size_t freed;
+  size_t budget;
+  size_t trigger;
+};
+
+static inline heap_cell_t *
+heap_find (proto_heap_t *heap,
+           const void *pointer)
+{
+  return (heap_cell_t *) pointer_table_find (&heap->cells, pointer);
+}
+
+/*
+ * New cells are marked: they can't be garbage of a cycle that started
+ * before them, and whatever is stored in them later goes through the
+ * barrier.
+ */
+static bool
+heap_track (proto_heap_t *heap,
+            const void *pointer,
+            heap_kind_t kind)
+{
+  size_t capacity = heap->cells.capacity;
+  heap_cell_t *cell;
+  bool added;
+
+  cell = (heap_cell_t *) pointer_table_add (&heap->cells, pointer, &added);
+  if (cell == NULL)
+    return false;
+  cell->epoch = heap->epoch;
+  cell->kind = kind;
+  // Cells moved, so a sweep in progress starts over; the ones it kept stay marked
+  if (heap->cells.capacity != capacity)
+    heap->sweep = 0;
+  return true;
+}
+
+static void
+heap_free_cell (const heap_cell_t *cell)
+{
+  switch (cell->kind)
+    {
+      case HEAP_OBJECT:
+        proto_del_object ((proto_object_t *) cell->pointer);
+        break;
+      case HEAP_ARRAY:
+        proto_del_array ((proto_array_t *) cell->pointer);
+        break;
+      case HEAP_DATA:
+        proto_del_data ((proto_data_t *) cell->pointer);
+        break;
+    }
+}
+
+/*
+ * Marks a cell and queues it for scanning. Values that aren't cells of
+ * this heap, scalars stored as pointers included, are left alone.
+ */
+void
+heap_shade (proto_heap_t *heap,
+            const void *value)
+{
+  heap_cell_t *cell;
+
+  if (heap->phase != HEAP_MARK)
+    return;
+  cell = heap_find (heap, value);
+  if (cell == NULL || cell->epoch == heap->epoch)
+    return;
+  cell->epoch = heap->epoch;
+  if (heap->gray_length == heap->gray_capacity)
+    {
+      size_t capacity = heap->gray_capacity ? 2 * heap->gray_capacity : 64;
+      heap_gray_t *gray = (heap_gray_t *) realloc (heap->gray, capacity * sizeof (heap_gray_t));
+
+      if (!gray)
+        {
+          // Its children may never be marked: this cycle can't sweep
+          heap->failed = true;
+          return;
+        }
+      heap->gray = gray;
+      heap->gray_capacity = capacity;
+    }
+  heap->gray[heap->gray_length].pointer = cell->pointer;
+  heap->gray[heap->gray_length].kind = cell->kind;
+  heap->gray_length++;
+}
+
+/*
+ * Objects set_chain made belong to the entry holding them rather than to
+ * the heap, and can be freed by the next write to it, so they're scanned
+ * whole as soon as they're reached.
+ */
+static void
+heap_scan_internal (proto_heap_t *heap,
+                    const proto_object_t *object)
+{
+  object_cursor_t cursor = { object, 0, NULL, 0, 0, false };
+  const proto_object_entry_t *entry;
+
+  heap_shade (heap, object->super);
+  while ((entry = object_cursor_next (&cursor)) != NULL)
+    {
+      heap_shade (heap, entry->value);
+      if (object_entry_internal (entry))
+        heap_scan_internal (heap, (const proto_object_t *) entry->value);
+    }
+  if (cursor.failed)
+    heap->failed = true;
+  free (cursor.stack);
+}
+
+static void
+heap_scan_begin (proto_heap_t *heap,
+                 heap_gray_t gray)
+{
+  heap->current = gray;
+  heap->scanning = true;
+  heap->position = 0;
+  if (gray.kind == HEAP_OBJECT)
+    {
+      heap->cursor.object = (const proto_object_t *) gray.pointer;
+      heap->cursor.bucket = 0;
+      heap->cursor.depth = 0;
+      heap->cursor.failed = false;
+      heap_shade (heap, heap->cursor.object->super);
+    }
+}
+
+// One property, item or data box of the cell being scanned
+static void
+heap_scan_next (proto_heap_t *heap)
+{
+  const proto_object_entry_t *entry;
+  const proto_array_t *array;
+  const proto_data_t *data;
+
+  switch (heap->current.kind)
+    {
+      case HEAP_OBJECT:
+        entry = object_cursor_next (&heap->cursor);
+        if (entry == NULL)
+          {
+            if (heap->cursor.failed)
+              heap->failed = true;
+            heap->scanning = false;
+            return;
+          }
+        heap_shade (heap, entry->value);
+        if (object_entry_internal (entry))
+          heap_scan_internal (heap, (const proto_object_t *) entry->value);
+        return;
+      case HEAP_ARRAY:
+        array = (const proto_array_t *) heap->current.pointer;
+        if (heap->position >= array->length)
+          {
+            heap->scanning = false;
+            return;
+          }
+        heap_shade (heap, array_item (array, heap->position++));
+        return;
+      case HEAP_DATA:
+        data = (const proto_data_t *) heap->current.pointer;
+        if (data->type == object_t || data->type == array_t || data->type == pointer_t)
+          heap_shade (heap, data->data.pointer);
+        heap->scanning = false;
+        return;
+    }
+}
+
+/*
+ * Called before the container's contents shift or are freed: a resumed
+ * scan could skip items or walk freed entries, so it's finished first.
+ */
+void
+heap_finish_scan (proto_heap_t *heap,
+                  const void *container)
+{
+  if (!heap->scanning || heap->current.pointer != container)
+    return;
+  while (heap->scanning)
+    heap_scan_next (heap);
+}
+
+static void
+heap_start_cycle (proto_heap_t *heap)
+{
+  size_t i;
+
+  heap->epoch++;
+  heap->phase = HEAP_MARK;
+  heap->failed = false;
+  heap->freed = 0;
+  for (i = 0; i < heap->roots_length; i++)
+    heap_shade (heap, heap->roots[i]);
+}
+
+static void
+heap_end_cycle (proto_heap_t *heap)
+{
+  heap->phase = HEAP_IDLE;
+  heap->trigger = 2 * heap->cells.used > HEAP_MIN_TRIGGER ? 2 * heap->cells.used : HEAP_MIN_TRIGGER;
+}
+
+/*
+ * Starts a cycle when there's none, then does up to budget units of work:
+ * scanning one property or item, or sweeping one table slot. Returns true
+ * when the cycle finished within this step.
+ */
+bool
+proto_heap_step (proto_heap_t *heap,
+                 size_t budget)
+{
+  heap_cell_t *cell;
+
+  if (heap == NULL)
+    return false;
+  if (heap->phase == HEAP_IDLE)
+    heap_start_cycle (heap);
+  for (; budget > 0; budget--)
+    {
+      if (heap->phase == HEAP_MARK)
+        {
+          if (heap->scanning)
+            heap_scan_next (heap);
+          else if (heap->gray_length)
+            heap_scan_begin (heap, heap->gray[--heap->gray_length]);
+          else if (heap->failed)
+            {
+              heap_end_cycle (heap);
+              return true;
+            }
+          else
+            {
+              heap->phase = HEAP_SWEEP;
+              heap->sweep = 0;
+            }
+          continue;
+        }
+      if (heap->sweep == heap->cells.capacity)
+        {
+          heap_end_cycle (heap);
+          return true;
+        }
+      cell = (heap_cell_t *) pointer_table_entry (&heap->cells, heap->sweep);
+      if (cell->pointer == NULL || cell->epoch == heap->epoch)
+        {
+          heap->sweep++;
+          continue;
+        }
+      heap_free_cell (cell);
+      // A cell after it may shift into this slot, so it's looked at again
+      pointer_table_remove (&heap->cells, cell);
+      heap->freed++;
+    }
+  return false;
+}
+
+// Keeps up with allocation: a cycle starts once the heap doubled since the last one
+static void
+heap_allocating (proto_heap_t *heap)
+{
+  if (heap->budget == 0)
+    return;
+  if (heap->phase != HEAP_IDLE || heap->cells.used >= heap->trigger)
+    proto_heap_step (heap, heap->budget);
+}
+
+proto_heap_t *
+proto_init_heap ()
+{
+  proto_heap_t *heap = (proto_heap_t *) calloc (1, sizeof (proto_heap_t));
+
+  if (!heap)
+    return NULL;
+  heap->cells = (pointer_table_t) { NULL, sizeof (heap_cell_t), 0, 0 };
+  heap->epoch = 1;
+  heap->phase = HEAP_IDLE;
+  heap->budget = HEAP_STEP_BUDGET;
+  heap->trigger = HEAP_MIN_TRIGGER;
+  return heap;
+}
+
+// Frees the heap and every cell in it, reachable or not
+void
+proto_del_heap (proto_heap_t *heap)
+{
+  size_t i;
+
+  if (heap == NULL)
+    return;
+  for (i = 0; i < heap->cells.capacity; i++)
+    if (pointer_table_key (&heap->cells, i) != NULL)
+      heap_free_cell ((const heap_cell_t *) pointer_table_entry (&heap->cells, i));
+  pointer_table_clear (&heap->cells);
+  free (heap->roots);
+  free (heap->gray);
+  free (heap->cursor.stack);
+  free (heap);
+}
+
+/*
+ * Allocations may run a step of collection first, so whatever the caller
+ * allocated before must be rooted or stored in a reachable cell by then.
+ * Cells are freed by the heap only: never pass them to proto_del_object,
+ * proto_del_array or proto_del_data.
+ */
+proto_object_t *
+proto_heap_object (proto_heap_t *heap)
+{
+  proto_object_t *object;
+
+  if (heap == NULL)
+    return NULL;
+  heap_allocating (heap);
+  object = proto_init_object ();
+  if (!object)
+    return NULL;
+  if (!heap_track (heap, object, HEAP_OBJECT))
+    {
+      proto_del_object (object);
+      return NULL;
+    }
+  object->heap = heap;
+  return object;
+}
+
+proto_array_t *
+proto_heap_array (proto_heap_t *heap)
+{
+  proto_array_t *array;
+
+  if (heap == NULL)
+    return NULL;
+  heap_allocating (heap);
+  array = proto_init_array ();
+  if (!array)
+    return NULL;
+  if (!heap_track (heap, array, HEAP_ARRAY))
+    {
+      proto_del_array (array);
+      return NULL;
+    }
+  array->heap = heap;
+  return array;
+}
+
+// A managed copy of data; an object, array or pointer in it is kept alive
+proto_data_t *
+proto_heap_data (proto_heap_t *heap,
+                 proto_data_t data)
+{
+  proto_data_t *box;
+
+  if (heap == NULL)
+    return NULL;
+  heap_allocating (heap);
+  box = (proto_data_t *) malloc (sizeof (proto_data_t));
+  if (!box)
+    return NULL;
+  *box = data;
+  if (!heap_track (heap, box, HEAP_DATA))
+    {
+      free (box);
+      return NULL;
+    }
+  return box;
+}
+
+// Roots are counted: a pointer rooted twice stays a root until unrooted twice
+bool
+proto_heap_root (proto_heap_t *heap,
+                 const void *pointer)
+{
+  if (heap == NULL || pointer == NULL)
+    return false;
+  if (heap->roots_length == heap->roots_capacity)
+    {
+      size_t capacity = heap->roots_capacity ? 2 * heap->roots_capacity : 16;
+      const void **roots = (const void **) realloc (heap->roots, capacity * sizeof (void *));
+
+      if (!roots)
+        return false;
+      heap->roots = roots;
+      heap->roots_capacity = capacity;
+    }
+  heap->roots[heap->roots_length++] = pointer;
+  heap_shade (heap, pointer);
+  return true;
+}
+
+bool
+proto_heap_unroot (proto_heap_t *heap,
+                   const void *pointer)
+{
+  size_t i;
+
+  if (heap == NULL)
+    return false;
+  for (i = heap->roots_length; i > 0; i--)
+    if (heap->roots[i - 1] == pointer)
+      {
+        heap->roots[i - 1] = heap->roots[--heap->roots_length];
+        return true;
+      }
+  return false;
+}
+
+/*
+ * Object properties, array methods and set_super go through the barrier
+ * on their own; writes that bypass them, to items or to a data box, call
+ * this with the value written.
+ */
+void
+proto_heap_barrier (proto_heap_t *heap,
+                    const void *value)
+{
+  heap_barrier (heap, value);
+}
+
+// Work each allocation does while a cycle runs; 0 leaves collection to the caller
+void
+proto_heap_set_budget (proto_heap_t *heap,
+                       size_t budget)
+{
+  if (heap != NULL)
+    heap->budget = budget;
+}
+
+/*
+ * Finishes the cycle in progress, then runs a whole one, so everything
+ * unreachable when called is freed. Returns the number of cells freed.
+ */
+size_t
+proto_heap_collect (proto_heap_t *heap)
+{
+  size_t freed = 0;
+
+  if (heap == NULL)
+    return 0;
+  if (heap->phase != HEAP_IDLE)
+    {
+      while (!proto_heap_step (heap, SIZE_MAX));
+      freed = heap->freed;
+    }
+  while (!proto_heap_step (heap, SIZE_MAX));
+  return freed + heap->freed;
+}
+
+size_t
+proto_heap_count (const proto_heap_t *heap)
+{
+  if (heap == NULL)
+    return 0;
+  return heap->cells.used;
+}
+
+bool
+proto_heap_collecting (const proto_heap_t *heap)
+{
+  if (heap == NULL)
+    return false;
+  return heap->phase != HEAP_IDLE;
+}
@@ -0,0 +1,290 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+// Helpers shared between translation units. They don't use the proto_
+// prefix, so they stay out of the exported symbols of the shared library.
+
+#ifndef __proto_internal_h__
+#define __proto_internal_h__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "proto.h"
+
+/*
+ * Operation counters, per thread so counting takes no lock. Without
+ * PROTO_STATS every use compiles to nothing.
+ */
+#ifdef PROTO_STATS
+extern _Thread_local proto_stats_t stats_counters;
+#define STATS_ADD(counter, amount) (stats_counters.counter += (amount))
+#else
+#define STATS_ADD(counter, amount) ((void) 0)
+#endif
+
+/*
+ * USDT probes under the "proto" provider, for perf or bpftrace to attach
+ * to; each is a single nop until something does. Without <sys/sdt.h> they
+ * compile to nothing.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE1(name, a) STAP_PROBE1 (proto, name, a)
+#define PROBE2(name, a, b) STAP_PROBE2 (proto, name, a, b)
+#else
+#define PROBE1(name, a) ((void) 0)
+#define PROBE2(name, a, b) ((void) 0)
+#endif
+
+extern atomic_bool latency_on;
+
+// Whether calls are being timed, for a single relaxed load on hot paths
+static inline bool
+latency_active ()
+{
+  return atomic_load_explicit (&latency_on, memory_order_relaxed);
+}
+
+size_t
+latency_now ();
+
+void
+latency_record (proto_latency_kind_t kind, const char *name, const void *function, size_t nanoseconds);
+
+proto_array_t *
+array_with_capacity (size_t capacity);
+
+void
+array_over (proto_array_t *array, void **items, size_t length);
+
+size_t
+array_sorted_position (const proto_array_t *array, const void *element);
+
+void **
+chunked_segment (const proto_array_t *array, size_t position, size_t *length);
+
+void
+chunked_free (proto_array_t *array);
+
+size_t
+chunked_memory_usage (const proto_array_t *array);
+
+/*
+ * Chunked arrays have no items vector: code that reads items directly goes
+ * through these, which cost nothing extra on a flat array. A segment is the
+ * run of consecutive items starting at position.
+ */
+static inline void **
+array_segment (const proto_array_t *array,
+               size_t position,
+               size_t *length)
+{
+  if (array->chunks != NULL)
+    return chunked_segment (array, position, length);
+  *length = array->length - position;
+  return array->items + position;
+}
+
+static inline void *
+array_item (const proto_array_t *array,
+            size_t position)
+{
+  if (array->chunks == NULL)
+    return array->items[position];
+  return (void *) array->at (array, position);
+}
+
+/*
+ * Open addressing table keyed by address, behind the array hash index, the
+ * heap's cells and counted values. Entries are size bytes and start with
+ * their key; a NULL key marks an empty slot. { NULL, size, 0, 0 } is an
+ * empty table, allocated on its first add.
+ */
+typedef struct {
+  char *entries;
+  size_t size;
+  size_t capacity;
+  size_t used;
+} pointer_table_t;
+
+static inline size_t
+pointer_table_home (const pointer_table_t *table,
+                    const void *key)
+{
+  uint64_t hash = (uint64_t) (uintptr_t) key * UINT64_C (0x9E3779B97F4A7C15);
+
+  return (size_t) (hash >> 32) & (table->capacity - 1);
+}
+
+static inline void *
+pointer_table_entry (const pointer_table_t *table,
+                     size_t slot)
+{
+  return table->entries + slot * table->size;
+}
+
+static inline const void *
+pointer_table_key (const pointer_table_t *table,
+                   size_t slot)
+{
+  return *(const void **) pointer_table_entry (table, slot);
+}
+
+static inline void *
+pointer_table_find (const pointer_table_t *table,
+                    const void *key)
+{
+  size_t slot, mask = table->capacity - 1;
+
+  if (table->capacity == 0)
+    return NULL;
+  for (slot = pointer_table_home (table, key); pointer_table_key (table, slot) != NULL; slot = (slot + 1) & mask)
+    if (pointer_table_key (table, slot) == key)
+      return pointer_table_entry (table, slot);
+  return NULL;
+}
+
+bool
+pointer_table_reserve (pointer_table_t *table, size_t expected);
+
+void *
+pointer_table_add (pointer_table_t *table, const void *key, bool *added);
+
+void
+pointer_table_remove (pointer_table_t *table, void *entry);
+
+void
+pointer_table_clear (pointer_table_t *table);
+
+void
+hash_index_free (proto_array_t *array);
+
+size_t
+hash_index_memory_usage (const proto_array_t *array);
+
+void
+hash_index_invalidate (proto_array_t *array);
+
+bool
+hash_index_ready (proto_array_t *array);
+
+size_t
+hash_index_lookup (const proto_array_t *array, const void *element);
+
+void
+hash_index_insert (proto_array_t *array, const void *element, size_t position);
+
+void
+hash_index_delete (proto_array_t *array, const void *element, size_t position);
+
+typedef struct {
+  const proto_object_t *object;
+  size_t bucket;
+  const void **stack;
+  size_t depth;
+  size_t capacity;
+  bool failed;
+} object_cursor_t;
+
+const proto_object_entry_t *
+object_cursor_next (object_cursor_t *cursor);
+
+bool
+object_entry_internal (const proto_object_entry_t *entry);
+
+void
+heap_shade (proto_heap_t *heap, const void *value);
+
+void
+heap_finish_scan (proto_heap_t *heap, const void *container);
+
+// Write barrier of the objects and arrays a heap manages; others skip it
+static inline void
+heap_barrier (void *heap,
+              const void *value)
+{
+  if (heap != NULL && value != NULL)
+    heap_shade ((proto_heap_t *) heap, value);
+}
+
+// Called before a managed object or array moves or frees what it holds
+static inline void
+heap_moving (void *heap,
+             const void *container)
+{
+  if (heap != NULL)
+    heap_finish_scan ((proto_heap_t *) heap, container);
+}
+
+void
+refs_retain_into (void *refs, const void *value);
+
+void
+refs_release_later (const void *value);
+
+void
+refs_release_object (const proto_object_t *object);
+
+void
+refs_release_items (const proto_array_t *array);
+
+// Counted objects and arrays retain what they store; others skip it
+static inline void
+refs_hold (void *refs,
+           const void *value)
+{
+  if (refs != NULL && value != NULL)
+    refs_retain_into (refs, value);
+}
+
+// Releases a value a counted object or array no longer holds
+static inline void
+refs_drop (void *refs,
+           const void *value)
+{
+  if (refs != NULL && value != NULL)
+    refs_release_later (value);
+}
+
+size_t
+mapped_record_size (const proto_mapped_array_t *array);
+
+size_t
+pointer_scan (void *const *items, size_t length, const void *element);
+
+void
+pool_run (proto_pool_t *pool, size_t chunks,
+          void (*body) (size_t chunk, void *context), void *context);
+
+bool
+pool_spawn (proto_pool_t *pool, void (*body) (size_t chunk, void *context), void *context);
+
+bool
+pool_help (proto_pool_t *pool);
+
+proto_future_t *
+future_spawn (proto_pool_t *pool, void *(*function) (const void *arguments),
+              const void *arguments, proto_frame_t *frame);
+
+void *
+memo_call (proto_memo_t *memo, void *(*function) (const void *arguments), const void *arguments);
+
+void
+object_memos_free (proto_object_t *object);
+
+size_t
+object_memos_memory_usage (const proto_object_t *object);
+
+void
+sort_items (void **items, size_t length, proto_compare_t compare);
+
+#endif // __proto_internal_h__
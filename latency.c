@@ -0,0 +1,492 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "proto.h"
+#include "internal.h"
+
+/*
+ * Values below 2^HISTOGRAM_SUB_BITS get a bucket each; above that, every
+ * power of two is split into 2^(HISTOGRAM_SUB_BITS - 1) buckets, so a
+ * bucket is never wider than 1/32 of the values it holds.
+ */
+#ifndef HISTOGRAM_SUB_BITS
+#define HISTOGRAM_SUB_BITS 6
+#endif
+
+#define HISTOGRAM_HALF ((size_t) 1 << (HISTOGRAM_SUB_BITS - 1))
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_HALF)
+
+#ifndef LATENCY_SITE_BUCKETS
+#define LATENCY_SITE_BUCKETS 64
+#endif
+
+struct proto_histogram {
+  atomic_size_t count;
+  atomic_size_t min;
+  atomic_size_t max;
+  atomic_size_t counts[HISTOGRAM_BUCKETS];
+};
+
+/*
+ * A call site: what ran, under which name, and how long it took. Generic
+ * calls are told apart by the function called as well as the format, so
+ * functions sharing a signature get a site each.
+ */
+typedef struct latency_site {
+  proto_latency_kind_t kind;
+  char *name;
+  const void *function;
+  proto_histogram_t histogram;
+  struct latency_site *next;
+} latency_site_t;
+
+typedef struct {
+  char *text;
+  size_t length;
+  size_t capacity;
+} dump_buffer_t;
+
+static const char *latency_kinds[] = { "property", "call", "boxing" };
+
+atomic_bool latency_on;
+static _Atomic (latency_site_t *) latency_sites[LATENCY_SITE_BUCKETS];
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+histogram_index (size_t value)
+{
+  size_t shift;
+
+  if (value < 2 * HISTOGRAM_HALF)
+    return value;
+  shift = (63 - __builtin_clzll ((unsigned long long) value)) - (HISTOGRAM_SUB_BITS - 1);
+  return (shift << (HISTOGRAM_SUB_BITS - 1)) + (value >> shift);
+}
+
+// The highest value that lands in bucket index
+static size_t
+histogram_value (size_t index)
+{
+  size_t shift;
+
+  if (index < 2 * HISTOGRAM_HALF)
+    return index;
+  shift = index / HISTOGRAM_HALF - 1;
+  return ((index - shift * HISTOGRAM_HALF + 1) << shift) - 1;
+}
+
+static void
+histogram_clear (proto_histogram_t *histogram)
+{
+  size_t i;
+
+  atomic_init (&histogram->count, 0);
+  atomic_init (&histogram->min, SIZE_MAX);
+  atomic_init (&histogram->max, 0);
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    atomic_init (&histogram->counts[i], 0);
+}
+
+proto_histogram_t *
+proto_init_histogram ()
+{
+  proto_histogram_t *histogram = (proto_histogram_t *) malloc (sizeof (proto_histogram_t));
+
+  if (!histogram)
+    return NULL;
+  histogram_clear (histogram);
+  return histogram;
+}
+
+// Safe from any number of threads at once
+void
+proto_histogram_record (proto_histogram_t *histogram,
+                        size_t value)
+{
+  size_t seen;
+
+  if (histogram == NULL)
+    return;
+  atomic_fetch_add_explicit (&histogram->counts[histogram_index (value)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit (&histogram->count, 1, memory_order_relaxed);
+  seen = atomic_load_explicit (&histogram->min, memory_order_relaxed);
+  while (value < seen
+         && !atomic_compare_exchange_weak_explicit (&histogram->min, &seen, value,
+                                                    memory_order_relaxed, memory_order_relaxed));
+  seen = atomic_load_explicit (&histogram->max, memory_order_relaxed);
+  while (value > seen
+         && !atomic_compare_exchange_weak_explicit (&histogram->max, &seen, value,
+                                                    memory_order_relaxed, memory_order_relaxed));
+}
+
+size_t
+proto_histogram_count (const proto_histogram_t *histogram)
+{
+  if (histogram == NULL)
+    return 0;
+  return atomic_load_explicit (&histogram->count, memory_order_relaxed);
+}
+
+size_t
+proto_histogram_min (const proto_histogram_t *histogram)
+{
+  if (proto_histogram_count (histogram) == 0)
+    return 0;
+  return atomic_load_explicit (&histogram->min, memory_order_relaxed);
+}
+
+size_t
+proto_histogram_max (const proto_histogram_t *histogram)
+{
+  if (histogram == NULL)
+    return 0;
+  return atomic_load_explicit (&histogram->max, memory_order_relaxed);
+}
+
+/*
+ * The value below which percentile (0 to 100) percent of the recorded
+ * values fall, as the top of its bucket; 0 on an empty histogram.
+ */
+size_t
+proto_histogram_percentile (const proto_histogram_t *histogram,
+                            double percentile)
+{
+  size_t count = proto_histogram_count (histogram), target, seen = 0, i, max;
+
+  if (count == 0)
+    return 0;
+  if (percentile > 100)
+    percentile = 100;
+  target = (size_t) (percentile / 100 * count + 0.5);
+  if (target == 0)
+    target = 1;
+  max = proto_histogram_max (histogram);
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+      seen += atomic_load_explicit (&histogram->counts[i], memory_order_relaxed);
+      if (seen >= target)
+        return histogram_value (i) < max ? histogram_value (i) : max;
+    }
+  return max;
+}
+
+// Adds what from recorded to into, as if into had recorded it too
+bool
+proto_histogram_merge (proto_histogram_t *into,
+                       const proto_histogram_t *from)
+{
+  size_t i, count;
+
+  if (into == NULL || from == NULL)
+    return false;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+      count = atomic_load_explicit (&from->counts[i], memory_order_relaxed);
+      if (count > 0)
+        atomic_fetch_add_explicit (&into->counts[i], count, memory_order_relaxed);
+    }
+  count = proto_histogram_count (from);
+  if (count == 0)
+    return true;
+  atomic_fetch_add_explicit (&into->count, count, memory_order_relaxed);
+  if (proto_histogram_min (from) < atomic_load (&into->min))
+    atomic_store (&into->min, proto_histogram_min (from));
+  if (proto_histogram_max (from) > atomic_load (&into->max))
+    atomic_store (&into->max, proto_histogram_max (from));
+  return true;
+}
+
+void
+proto_histogram_reset (proto_histogram_t *histogram)
+{
+  if (histogram != NULL)
+    histogram_clear (histogram);
+}
+
+void
+proto_del_histogram (proto_histogram_t *histogram)
+{
+  free (histogram);
+}
+
+static bool
+dump_append (dump_buffer_t *buffer,
+             const char *format, ...)
+{
+  va_list args;
+  int written;
+  char *text;
+
+  for (;;)
+    {
+      va_start (args, format);
+      written = vsnprintf (buffer->text + buffer->length, buffer->capacity - buffer->length, format, args);
+      va_end (args);
+      if (written < 0)
+        return false;
+      if (buffer->length + written < buffer->capacity)
+        {
+          buffer->length += written;
+          return true;
+        }
+      text = (char *) realloc (buffer->text, 2 * buffer->capacity + written);
+      if (!text)
+        return false;
+      buffer->text = text;
+      buffer->capacity = 2 * buffer->capacity + written;
+    }
+}
+
+static bool
+dump_string (dump_buffer_t *buffer,
+             const char *string)
+{
+  bool appended = dump_append (buffer, "\"");
+
+  for (; appended && *string != '\0'; string++)
+    if (*string == '"' || *string == '\\')
+      appended = dump_append (buffer, "\\%c", *string);
+    else if ((unsigned char) *string < 0x20)
+      appended = dump_append (buffer, "\\u%04x", (unsigned char) *string);
+    else
+      appended = dump_append (buffer, "%c", *string);
+  return appended && dump_append (buffer, "\"");
+}
+
+static bool
+dump_histogram (dump_buffer_t *buffer,
+                const proto_histogram_t *histogram)
+{
+  size_t i, count;
+  bool first = true, appended;
+
+  appended = dump_append (buffer, "{\"count\": %zu, \"min\": %zu, \"max\": %zu, "
+                          "\"p50\": %zu, \"p90\": %zu, \"p99\": %zu, \"p999\": %zu, \"buckets\": [",
+                          proto_histogram_count (histogram), proto_histogram_min (histogram),
+                          proto_histogram_max (histogram), proto_histogram_percentile (histogram, 50),
+                          proto_histogram_percentile (histogram, 90), proto_histogram_percentile (histogram, 99),
+                          proto_histogram_percentile (histogram, 99.9));
+  for (i = 0; appended && i < HISTOGRAM_BUCKETS; i++)
+    {
+      count = atomic_load_explicit (&histogram->counts[i], memory_order_relaxed);
+      if (count == 0)
+        continue;
+      appended = dump_append (buffer, "%s[%zu, %zu]", first ? "" : ", ", histogram_value (i), count);
+      first = false;
+    }
+  return appended && dump_append (buffer, "]}");
+}
+
+static char *
+dump_finish (dump_buffer_t *buffer,
+             bool appended)
+{
+  if (!appended)
+    {
+      free (buffer->text);
+      return NULL;
+    }
+  return buffer->text;
+}
+
+static bool
+dump_start (dump_buffer_t *buffer)
+{
+  buffer->length = 0;
+  buffer->capacity = 256;
+  buffer->text = (char *) malloc (buffer->capacity);
+  if (buffer->text)
+    buffer->text[0] = '\0';
+  return buffer->text != NULL;
+}
+
+/*
+ * The histogram as JSON: count, min, max, the usual percentiles and every
+ * non-empty bucket as [highest value, count]. The caller frees the text.
+ */
+char *
+proto_histogram_dump (const proto_histogram_t *histogram)
+{
+  dump_buffer_t buffer;
+
+  if (histogram == NULL || !dump_start (&buffer))
+    return NULL;
+  return dump_finish (&buffer, dump_histogram (&buffer, histogram));
+}
+
+// Timing costs a clock read per call, so it's off until asked for
+void
+proto_latency_enable (bool enabled)
+{
+  atomic_store (&latency_on, enabled);
+}
+
+bool
+proto_latency_enabled ()
+{
+  return latency_active ();
+}
+
+size_t
+latency_now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (size_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t
+latency_bucket (proto_latency_kind_t kind,
+                const char *name,
+                const void *function)
+{
+  size_t hash = 5381 + kind + (size_t) (uintptr_t) function;
+
+  for (; *name != '\0'; name++)
+    hash = hash * 33 + (unsigned char) *name;
+  return hash % LATENCY_SITE_BUCKETS;
+}
+
+static latency_site_t *
+latency_find (latency_site_t *site,
+              proto_latency_kind_t kind,
+              const char *name,
+              const void *function)
+{
+  for (; site != NULL; site = site->next)
+    if (site->kind == kind && site->function == function && strcmp (site->name, name) == 0)
+      return site;
+  return NULL;
+}
+
+/*
+ * Sites are only ever added while recording, at the head of their bucket,
+ * so lookups read the lists without taking the lock.
+ */
+void
+latency_record (proto_latency_kind_t kind,
+                const char *name,
+                const void *function,
+                size_t nanoseconds)
+{
+  size_t bucket;
+  latency_site_t *site;
+
+  if (name == NULL)
+    return;
+  bucket = latency_bucket (kind, name, function);
+  site = latency_find (atomic_load_explicit (&latency_sites[bucket], memory_order_acquire), kind, name, function);
+  if (site == NULL)
+    {
+      pthread_mutex_lock (&latency_lock);
+      site = latency_find (atomic_load_explicit (&latency_sites[bucket], memory_order_relaxed), kind, name,
+                           function);
+      if (site == NULL && (site = (latency_site_t *) malloc (sizeof (latency_site_t))) != NULL)
+        {
+          site->name = strdup (name);
+          if (!site->name)
+            {
+              free (site);
+              site = NULL;
+            }
+          else
+            {
+              site->kind = kind;
+              site->function = function;
+              histogram_clear (&site->histogram);
+              site->next = atomic_load_explicit (&latency_sites[bucket], memory_order_relaxed);
+              atomic_store_explicit (&latency_sites[bucket], site, memory_order_release);
+            }
+        }
+      pthread_mutex_unlock (&latency_lock);
+      if (site == NULL)
+        return;
+    }
+  proto_histogram_record (&site->histogram, nanoseconds);
+}
+
+/*
+ * The histogram of a site, or NULL when nothing was recorded under it.
+ * function is the one passed to proto_generic_caller, or NULL for
+ * properties.
+ */
+const proto_histogram_t *
+proto_latency_histogram (proto_latency_kind_t kind,
+                         const char *name,
+                         const void *function)
+{
+  latency_site_t *site;
+
+  if (name == NULL || kind > PROTO_LATENCY_BOXING)
+    return NULL;
+  site = latency_find (atomic_load_explicit (&latency_sites[latency_bucket (kind, name, function)],
+                                             memory_order_acquire),
+                       kind, name, function);
+  return site ? &site->histogram : NULL;
+}
+
+// Every site as JSON, {"sites": [{"kind", "name", "function", "histogram"}, ...]}
+char *
+proto_latency_dump ()
+{
+  dump_buffer_t buffer;
+  latency_site_t *site;
+  bool first = true, appended;
+  size_t i;
+
+  if (!dump_start (&buffer))
+    return NULL;
+  appended = dump_append (&buffer, "{\"sites\": [");
+  for (i = 0; appended && i < LATENCY_SITE_BUCKETS; i++)
+    for (site = atomic_load_explicit (&latency_sites[i], memory_order_acquire);
+         appended && site != NULL; site = site->next)
+      {
+        appended = dump_append (&buffer, "%s{\"kind\": \"%s\", \"name\": ", first ? "" : ", ",
+                                latency_kinds[site->kind])
+          && dump_string (&buffer, site->name)
+          && (site->function == NULL || dump_append (&buffer, ", \"function\": \"%p\"", (void *) site->function))
+          && dump_append (&buffer, ", \"histogram\": ")
+          && dump_histogram (&buffer, &site->histogram)
+          && dump_append (&buffer, "}");
+        first = false;
+      }
+  return dump_finish (&buffer, appended && dump_append (&buffer, "]}"));
+}
+
+/*
+ * Drops every site and what it recorded. Histograms handed out before are
+ * freed with them, so this must not race with anything recording.
+ */
+void
+proto_latency_reset ()
+{
+  latency_site_t *site, *next;
+  size_t i;
+
+  pthread_mutex_lock (&latency_lock);
+  for (i = 0; i < LATENCY_SITE_BUCKETS; i++)
+    {
+      site = atomic_exchange (&latency_sites[i], NULL);
+      for (; site != NULL; site = next)
+        {
+          next = site->next;
+          free (site->name);
+          free (site);
+        }
+    }
+  pthread_mutex_unlock (&latency_lock);
+}
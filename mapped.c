@@ -0,0 +1,320 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "proto.h"
+#include "internal.h"
+
+// Bytes of records a new file starts with
+#ifndef MAPPED_INITIAL_SIZE
+#define MAPPED_INITIAL_SIZE (1UL << 20)
+#endif
+// Bytes asked ahead of the current record while iterating
+#ifndef MAPPED_PREFETCH_SIZE
+#define MAPPED_PREFETCH_SIZE (8UL << 20)
+#endif
+
+#define MAPPED_MAGIC "protomap"
+#define MAPPED_HEADER_SIZE 64
+
+typedef struct {
+  char magic[8];
+  uint64_t size;
+  uint64_t length;
+} proto_mapped_header_t;
+
+_Static_assert (sizeof (proto_mapped_header_t) <= MAPPED_HEADER_SIZE, "mapped header doesn't fit");
+
+/*
+ * The file is a header followed by capacity records. The whole file is
+ * mapped shared, so records are read and written in place and the kernel
+ * pages them in and out; only the mapping needs address space, not memory.
+ */
+struct proto_mapped_array {
+  int fd;
+  char *map;
+  size_t mapped;
+  size_t size;
+  size_t capacity;
+  size_t page;
+};
+
+static inline proto_mapped_header_t *
+mapped_header (const proto_mapped_array_t *array)
+{
+  return (proto_mapped_header_t *) array->map;
+}
+
+static inline char *
+mapped_record (const proto_mapped_array_t *array,
+               size_t position)
+{
+  return array->map + MAPPED_HEADER_SIZE + position * array->size;
+}
+
+// The capacity a new array starts at, and the least a full one grows to
+static inline size_t
+mapped_initial_capacity (size_t size)
+{
+  return MAPPED_INITIAL_SIZE / size ? MAPPED_INITIAL_SIZE / size : 1;
+}
+
+// Grows the file and its mapping to hold capacity records
+static bool
+mapped_resize (proto_mapped_array_t *array,
+               size_t capacity)
+{
+  size_t bytes;
+  char *map;
+
+  if (capacity > (SIZE_MAX - MAPPED_HEADER_SIZE) / array->size)
+    return false;
+  bytes = MAPPED_HEADER_SIZE + capacity * array->size;
+  if (ftruncate (array->fd, (off_t) bytes) != 0)
+    return false;
+#ifdef HAVE_MREMAP
+  map = mremap (array->map, array->mapped, bytes, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return false;
+#else
+  // The old mapping stays valid until the new one is in place
+  map = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, array->fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+  munmap (array->map, array->mapped);
+#endif
+  array->map = map;
+  array->mapped = bytes;
+  array->capacity = capacity;
+  return true;
+}
+
+/*
+ * Opens the array stored at path, or creates it when the file is missing or
+ * empty. Every record has size bytes; an existing file made with a different
+ * size, or that isn't a mapped array, gives NULL.
+ */
+proto_mapped_array_t *
+proto_init_mapped_array (const char *path,
+                         size_t size)
+{
+  proto_mapped_array_t *array;
+  proto_mapped_header_t *header;
+  struct stat status;
+  size_t bytes;
+
+  if (path == NULL || size == 0 || size > SIZE_MAX / 2)
+    return NULL;
+  array = (proto_mapped_array_t *) calloc (1, sizeof (proto_mapped_array_t));
+  if (!array)
+    return NULL;
+  array->size = size;
+  array->page = (size_t) sysconf (_SC_PAGESIZE);
+  array->fd = open (path, O_RDWR | O_CREAT, 0644);
+  if (array->fd < 0)
+    {
+      free (array);
+      return NULL;
+    }
+  if (fstat (array->fd, &status) != 0)
+    goto failure;
+  bytes = (size_t) status.st_size;
+  if (bytes == 0)
+    {
+      array->capacity = mapped_initial_capacity (size);
+      bytes = MAPPED_HEADER_SIZE + array->capacity * size;
+      if (ftruncate (array->fd, (off_t) bytes) != 0)
+        goto failure;
+    }
+  else if (bytes < MAPPED_HEADER_SIZE)
+    goto failure;
+  array->map = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, array->fd, 0);
+  if (array->map == MAP_FAILED)
+    goto failure;
+  array->mapped = bytes;
+  header = mapped_header (array);
+  if (status.st_size == 0)
+    {
+      memcpy (header->magic, MAPPED_MAGIC, sizeof (header->magic));
+      header->size = size;
+      header->length = 0;
+      return array;
+    }
+  array->capacity = (bytes - MAPPED_HEADER_SIZE) / size;
+  if (memcmp (header->magic, MAPPED_MAGIC, sizeof (header->magic)) != 0
+      || header->size != size || header->length > array->capacity)
+    {
+      munmap (array->map, array->mapped);
+      goto failure;
+    }
+  return array;
+
+failure:
+  close (array->fd);
+  free (array);
+  return NULL;
+}
+
+size_t
+mapped_record_size (const proto_mapped_array_t *array)
+{
+  return array->size;
+}
+
+size_t
+proto_mapped_array_length (const proto_mapped_array_t *array)
+{
+  if (array == NULL)
+    return 0;
+  return (size_t) mapped_header (array)->length;
+}
+
+/*
+ * A pointer to the record at position, which may be written through. It is
+ * valid until the next push or reserve that grows the file, since growing
+ * may move the mapping.
+ */
+void *
+proto_mapped_array_at (const proto_mapped_array_t *array,
+                       size_t position)
+{
+  if (array == NULL || position >= mapped_header (array)->length)
+    return NULL;
+  return mapped_record (array, position);
+}
+
+// Makes room for capacity records, so pushes up to it never move the mapping
+bool
+proto_mapped_array_reserve (proto_mapped_array_t *array,
+                            size_t capacity)
+{
+  if (array == NULL)
+    return false;
+  if (capacity <= array->capacity)
+    return true;
+  return mapped_resize (array, capacity);
+}
+
+// Copies size bytes from record to the end of the array
+bool
+proto_mapped_array_push (proto_mapped_array_t *array,
+                         const void *record)
+{
+  size_t length, capacity;
+
+  if (array == NULL || record == NULL)
+    return false;
+  length = (size_t) mapped_header (array)->length;
+  if (length == array->capacity)
+    {
+      // A file reopened after being trimmed empty has no room at all
+      capacity = 2 * array->capacity;
+      if (capacity < mapped_initial_capacity (array->size))
+        capacity = mapped_initial_capacity (array->size);
+      if (!mapped_resize (array, capacity))
+        return false;
+    }
+  memcpy (mapped_record (array, length), record, array->size);
+  mapped_header (array)->length = length + 1;
+  return true;
+}
+
+/*
+ * Calls back for the records from begin up to end (or the length, if it
+ * comes first). The kernel is told the range is read sequentially and asked
+ * to read the next MAPPED_PREFETCH_SIZE bytes ahead of the callback, so a
+ * scan over a file larger than memory waits on the disk as little as it can.
+ */
+void
+proto_mapped_array_each (const proto_mapped_array_t *array,
+                         size_t begin,
+                         size_t end,
+                         void (*callback) (const void *record, size_t position, void *context),
+                         void *context)
+{
+  char *first, *last, *ahead, *record;
+  size_t position, length;
+
+  if (array == NULL || callback == NULL)
+    return;
+  length = (size_t) mapped_header (array)->length;
+  if (end > length)
+    end = length;
+  if (begin >= end)
+    return;
+  first = (char *) ((uintptr_t) mapped_record (array, begin) & ~(uintptr_t) (array->page - 1));
+  last = mapped_record (array, end);
+  madvise (first, (size_t) (last - first), MADV_SEQUENTIAL);
+  ahead = first;
+  record = mapped_record (array, begin);
+  for (position = begin; position < end; position++, record += array->size)
+    {
+      if (record >= ahead)
+        {
+          size_t window = (size_t) (last - ahead) < MAPPED_PREFETCH_SIZE
+            ? (size_t) (last - ahead) : MAPPED_PREFETCH_SIZE;
+
+          size_t step = (window / 2) & ~(array->page - 1);
+
+          madvise (ahead, window, MADV_WILLNEED);
+          // Ask for the next window halfway through this one
+          ahead += step ? step : window;
+        }
+      callback (record, position, context);
+    }
+  madvise (first, (size_t) (last - first), MADV_NORMAL);
+}
+
+/*
+ * Writes changed records back to the file: sync returns once they're on the
+ * disk, flush only schedules the writes.
+ */
+bool
+proto_mapped_array_sync (proto_mapped_array_t *array)
+{
+  if (array == NULL)
+    return false;
+  return msync (array->map, array->mapped, MS_SYNC) == 0;
+}
+
+bool
+proto_mapped_array_flush (proto_mapped_array_t *array)
+{
+  if (array == NULL)
+    return false;
+  return msync (array->map, array->mapped, MS_ASYNC) == 0;
+}
+
+// Unmaps the array and trims the file to its records; the file is kept
+void
+proto_del_mapped_array (proto_mapped_array_t *array)
+{
+  size_t length;
+
+  if (array == NULL)
+    return;
+  length = (size_t) mapped_header (array)->length;
+  munmap (array->map, array->mapped);
+  // A file that can't be trimmed keeps its spare capacity, which opens fine
+  (void) !ftruncate (array->fd, (off_t) (MAPPED_HEADER_SIZE + length * array->size));
+  close (array->fd);
+  free (array);
+}
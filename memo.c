@@ -0,0 +1,533 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef MEMO_CAPACITY
+#define MEMO_CAPACITY 1024
+#endif
+
+#define MEMO_NONE ((size_t) -1)
+
+typedef struct {
+  uint64_t hash;
+  proto_data_t *key;
+  size_t length;
+  void *result;
+  size_t next;
+  bool referenced;
+  bool used;
+} proto_memo_entry_t;
+
+/*
+ * Results are kept by a structural key: a copy of the argument data, with
+ * strings compared by content and other references by address. Entries sit
+ * in a fixed table chained from hash buckets; once it's full, a CLOCK hand
+ * evicts the first entry that wasn't hit since the hand last passed it.
+ */
+struct proto_memo {
+  void *(*function) (const void *arguments);
+  void (*release) (void *result);
+  pthread_mutex_t lock;
+  proto_memo_entry_t *entries;
+  size_t *buckets;
+  size_t capacity;
+  size_t mask;
+  size_t filled;
+  size_t length;
+  size_t hand;
+  size_t hits;
+  size_t misses;
+};
+
+typedef struct proto_object_memo {
+  char *key;
+  proto_memo_t *memo;
+  struct proto_object_memo *next;
+} proto_object_memo_t;
+
+static inline uint64_t
+memo_mix (uint64_t hash,
+          uint64_t value)
+{
+  hash = (hash ^ value) * UINT64_C (0x9e3779b97f4a7c15);
+  return hash ^ (hash >> 32);
+}
+
+static uint64_t
+memo_hash_datum (const proto_data_t *data)
+{
+  uint64_t hash = UINT64_C (0xcbf29ce484222325), bits;
+  const char *character;
+
+  if (data == NULL)
+    return 0;
+  switch (data->type)
+    {
+      case decimal_t:
+        memcpy (&bits, &data->data.decimal, sizeof (bits));
+        break;
+      case integer_t:
+        bits = (uint64_t) data->data.integer;
+        break;
+      case boolean_t:
+        bits = data->data.boolean;
+        break;
+      case string_t:
+        if (data->data.string != NULL)
+          for (character = data->data.string; *character != '\0'; character++)
+            hash = (hash ^ (unsigned char) *character) * UINT64_C (0x100000001b3);
+        bits = hash;
+        break;
+      default:
+        bits = (uint64_t) (uintptr_t) data->data.pointer;
+        break;
+    }
+  return memo_mix (data->type, bits);
+}
+
+static bool
+memo_equal_datum (const proto_data_t *a,
+                  const proto_data_t *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+  if (a->type != b->type)
+    return false;
+  switch (a->type)
+    {
+      case decimal_t:
+        return memcmp (&a->data.decimal, &b->data.decimal, sizeof (double)) == 0;
+      case integer_t:
+        return a->data.integer == b->data.integer;
+      case boolean_t:
+        return a->data.boolean == b->data.boolean;
+      case string_t:
+        if (a->data.string == NULL || b->data.string == NULL)
+          return a->data.string == b->data.string;
+        return strcmp (a->data.string, b->data.string) == 0;
+      default:
+        return a->data.pointer == b->data.pointer;
+    }
+}
+
+static uint64_t
+memo_hash (const proto_array_t *arguments)
+{
+  uint64_t hash = arguments->length;
+  size_t i;
+
+  for (i = 0; i < arguments->length; i++)
+    hash = memo_mix (hash, memo_hash_datum ((const proto_data_t *) array_item (arguments, i)));
+  return hash;
+}
+
+static size_t
+memo_find (const proto_memo_t *memo,
+           uint64_t hash,
+           const proto_array_t *arguments)
+{
+  size_t index, i;
+
+  for (index = memo->buckets[hash & memo->mask]; index != MEMO_NONE; index = memo->entries[index].next)
+    {
+      const proto_memo_entry_t *entry = &memo->entries[index];
+
+      if (entry->hash != hash || entry->length != arguments->length)
+        continue;
+      for (i = 0; i < entry->length; i++)
+        if (!memo_equal_datum (&entry->key[i], (const proto_data_t *) array_item (arguments, i)))
+          break;
+      if (i == entry->length)
+        return index;
+    }
+  return MEMO_NONE;
+}
+
+// Drops an entry, handing its result to release
+static void
+memo_remove (proto_memo_t *memo,
+             size_t index)
+{
+  proto_memo_entry_t *entry = &memo->entries[index];
+  size_t *link = &memo->buckets[entry->hash & memo->mask], i;
+
+  while (*link != index)
+    link = &memo->entries[*link].next;
+  *link = entry->next;
+  for (i = 0; i < entry->length; i++)
+    if (entry->key[i].type == string_t)
+      free (entry->key[i].data.string);
+  free (entry->key);
+  if (memo->release != NULL)
+    memo->release (entry->result);
+  entry->used = false;
+  memo->length--;
+}
+
+static size_t
+memo_slot (proto_memo_t *memo)
+{
+  size_t index;
+
+  if (memo->filled < memo->capacity)
+    return memo->filled++;
+  while (memo->entries[memo->hand].used && memo->entries[memo->hand].referenced)
+    {
+      memo->entries[memo->hand].referenced = false;
+      memo->hand = (memo->hand + 1) % memo->capacity;
+    }
+  index = memo->hand;
+  memo->hand = (memo->hand + 1) % memo->capacity;
+  if (memo->entries[index].used)
+    memo_remove (memo, index);
+  return index;
+}
+
+static bool
+memo_insert (proto_memo_t *memo,
+             uint64_t hash,
+             const proto_array_t *arguments,
+             void *result)
+{
+  proto_data_t *key = (proto_data_t *) malloc ((arguments->length + 1) * sizeof (proto_data_t));
+  proto_memo_entry_t *entry;
+  size_t index, i;
+
+  if (!key)
+    return false;
+  for (i = 0; i < arguments->length; i++)
+    {
+      const proto_data_t *data = (const proto_data_t *) array_item (arguments, i);
+
+      if (data == NULL)
+        break;
+      key[i] = *data;
+      if (data->type == string_t && data->data.string != NULL
+          && (key[i].data.string = strdup (data->data.string)) == NULL)
+        break;
+    }
+  if (i < arguments->length)
+    {
+      while (i-- > 0)
+        if (key[i].type == string_t)
+          free (key[i].data.string);
+      free (key);
+      return false;
+    }
+  index = memo_slot (memo);
+  entry = &memo->entries[index];
+  entry->hash = hash;
+  entry->key = key;
+  entry->length = arguments->length;
+  entry->result = result;
+  entry->referenced = false;
+  entry->used = true;
+  entry->next = memo->buckets[hash & memo->mask];
+  memo->buckets[hash & memo->mask] = index;
+  memo->length++;
+  return true;
+}
+
+static void
+memo_clear (proto_memo_t *memo)
+{
+  size_t i;
+
+  for (i = 0; i < memo->filled; i++)
+    if (memo->entries[i].used)
+      memo_remove (memo, i);
+  memo->filled = 0;
+  memo->hand = 0;
+}
+
+/*
+ * Caches up to capacity results of function (MEMO_CAPACITY when 0), which
+ * must be pure. The cache owns cached results: release, if given, is called
+ * on each one it drops.
+ */
+proto_memo_t *
+proto_init_memo (void *(*function) (const void *arguments),
+                 size_t capacity,
+                 void (*release) (void *result))
+{
+  proto_memo_t *memo;
+  size_t buckets = 2, i;
+
+  if (capacity == 0)
+    capacity = MEMO_CAPACITY;
+  while (buckets < 2 * capacity)
+    buckets <<= 1;
+  memo = (proto_memo_t *) calloc (1, sizeof (proto_memo_t));
+  if (!memo)
+    return NULL;
+  memo->entries = (proto_memo_entry_t *) calloc (capacity, sizeof (proto_memo_entry_t));
+  memo->buckets = (size_t *) malloc (buckets * sizeof (size_t));
+  if (!memo->entries || !memo->buckets)
+    {
+      free (memo->entries);
+      free (memo->buckets);
+      free (memo);
+      return NULL;
+    }
+  for (i = 0; i < buckets; i++)
+    memo->buckets[i] = MEMO_NONE;
+  memo->function = function;
+  memo->release = release;
+  memo->capacity = capacity;
+  memo->mask = buckets - 1;
+  pthread_mutex_init (&memo->lock, NULL);
+  return memo;
+}
+
+/*
+ * Calls through the memo for the function it was set up with, or binds it
+ * to function first when they differ, forgetting every cached result.
+ */
+void *
+memo_call (proto_memo_t *memo,
+           void *(*function) (const void *arguments),
+           const void *arguments)
+{
+  const proto_array_t *list = (const proto_array_t *) arguments;
+  uint64_t hash;
+  size_t index;
+  void *result;
+
+  if (list == NULL)
+    return function (arguments);
+  hash = memo_hash (list);
+  pthread_mutex_lock (&memo->lock);
+  if (memo->function != function)
+    {
+      memo_clear (memo);
+      memo->function = function;
+    }
+  if ((index = memo_find (memo, hash, list)) != MEMO_NONE)
+    {
+      memo->hits++;
+      memo->entries[index].referenced = true;
+      result = memo->entries[index].result;
+      pthread_mutex_unlock (&memo->lock);
+      return result;
+    }
+  memo->misses++;
+  pthread_mutex_unlock (&memo->lock);
+  // Runs unlocked; a result computed twice at once is kept only once
+  result = function (arguments);
+  pthread_mutex_lock (&memo->lock);
+  if (memo->function == function && (index = memo_find (memo, hash, list)) != MEMO_NONE)
+    {
+      if (memo->release != NULL)
+        memo->release (result);
+      result = memo->entries[index].result;
+    }
+  else if (memo->function == function && !memo_insert (memo, hash, list, result))
+    {
+      // Not cached, so the caller gets the only reference
+      pthread_mutex_unlock (&memo->lock);
+      return result;
+    }
+  pthread_mutex_unlock (&memo->lock);
+  return result;
+}
+
+/*
+ * Arguments are an array of proto_data_t, as proto_generic_caller passes
+ * them; a result is valid until the memo drops it.
+ */
+void *
+proto_memo_call (proto_memo_t *memo,
+                 const void *arguments)
+{
+  if (memo == NULL || memo->function == NULL)
+    return NULL;
+  return memo_call (memo, memo->function, arguments);
+}
+
+size_t
+proto_memo_hits (const proto_memo_t *memo)
+{
+  size_t hits;
+
+  if (memo == NULL)
+    return 0;
+  pthread_mutex_lock ((pthread_mutex_t *) &memo->lock);
+  hits = memo->hits;
+  pthread_mutex_unlock ((pthread_mutex_t *) &memo->lock);
+  return hits;
+}
+
+size_t
+proto_memo_misses (const proto_memo_t *memo)
+{
+  size_t misses;
+
+  if (memo == NULL)
+    return 0;
+  pthread_mutex_lock ((pthread_mutex_t *) &memo->lock);
+  misses = memo->misses;
+  pthread_mutex_unlock ((pthread_mutex_t *) &memo->lock);
+  return misses;
+}
+
+size_t
+proto_memo_length (const proto_memo_t *memo)
+{
+  size_t length;
+
+  if (memo == NULL)
+    return 0;
+  pthread_mutex_lock ((pthread_mutex_t *) &memo->lock);
+  length = memo->length;
+  pthread_mutex_unlock ((pthread_mutex_t *) &memo->lock);
+  return length;
+}
+
+// Forgets the result for arguments; false when none was cached
+bool
+proto_memo_invalidate (proto_memo_t *memo,
+                       const void *arguments)
+{
+  const proto_array_t *list = (const proto_array_t *) arguments;
+  size_t index;
+
+  if (memo == NULL || list == NULL)
+    return false;
+  pthread_mutex_lock (&memo->lock);
+  index = memo_find (memo, memo_hash (list), list);
+  if (index != MEMO_NONE)
+    memo_remove (memo, index);
+  pthread_mutex_unlock (&memo->lock);
+  return index != MEMO_NONE;
+}
+
+void
+proto_memo_clear (proto_memo_t *memo)
+{
+  if (memo == NULL)
+    return;
+  pthread_mutex_lock (&memo->lock);
+  memo_clear (memo);
+  pthread_mutex_unlock (&memo->lock);
+}
+
+void
+proto_del_memo (proto_memo_t *memo)
+{
+  if (memo == NULL)
+    return;
+  memo_clear (memo);
+  pthread_mutex_destroy (&memo->lock);
+  free (memo->entries);
+  free (memo->buckets);
+  free (memo);
+}
+
+/*
+ * Marks the function property at key as pure: from now on execute_property
+ * answers repeated arguments from a memo of capacity results. Marking a key
+ * twice keeps the first memo. Setting the property to another function
+ * empties it on the next call.
+ */
+bool
+proto_object_memoize (proto_object_t *object,
+                      const char *key,
+                      size_t capacity,
+                      void (*release) (void *result))
+{
+  proto_object_memo_t *node;
+
+  if (object == NULL || key == NULL)
+    return false;
+  if (proto_object_memo (object, key) != NULL)
+    return true;
+  node = (proto_object_memo_t *) malloc (sizeof (proto_object_memo_t));
+  if (!node)
+    return false;
+  node->key = strdup (key);
+  node->memo = proto_init_memo (NULL, capacity, release);
+  if (!node->key || !node->memo)
+    {
+      free (node->key);
+      proto_del_memo (node->memo);
+      free (node);
+      return false;
+    }
+  node->next = (proto_object_memo_t *) object->memos;
+  object->memos = node;
+  return true;
+}
+
+// The memo of a pure property, for its counters and invalidation
+proto_memo_t *
+proto_object_memo (const proto_object_t *object,
+                   const char *key)
+{
+  const proto_object_memo_t *node;
+
+  if (object == NULL || key == NULL)
+    return NULL;
+  for (node = (const proto_object_memo_t *) object->memos; node != NULL; node = node->next)
+    if (strcmp (node->key, key) == 0)
+      return node->memo;
+  return NULL;
+}
+
+void
+object_memos_free (proto_object_t *object)
+{
+  proto_object_memo_t *node = (proto_object_memo_t *) object->memos, *next;
+
+  for (; node != NULL; node = next)
+    {
+      next = node->next;
+      proto_del_memo (node->memo);
+      free (node->key);
+      free (node);
+    }
+  object->memos = NULL;
+}
+
+// Bytes of the table and the argument copies; results are the caller's
+static size_t
+memo_memory_usage (proto_memo_t *memo)
+{
+  size_t bytes, i, j;
+
+  pthread_mutex_lock (&memo->lock);
+  bytes = sizeof (proto_memo_t) + memo->capacity * sizeof (proto_memo_entry_t)
+    + (memo->mask + 1) * sizeof (size_t);
+  for (i = 0; i < memo->capacity; i++)
+    if (memo->entries[i].used)
+      {
+        bytes += (memo->entries[i].length + 1) * sizeof (proto_data_t);
+        for (j = 0; j < memo->entries[i].length; j++)
+          if (memo->entries[i].key[j].type == string_t && memo->entries[i].key[j].data.string != NULL)
+            bytes += strlen (memo->entries[i].key[j].data.string) + 1;
+      }
+  pthread_mutex_unlock (&memo->lock);
+  return bytes;
+}
+
+size_t
+object_memos_memory_usage (const proto_object_t *object)
+{
+  const proto_object_memo_t *node;
+  size_t bytes = 0;
+
+  for (node = (const proto_object_memo_t *) object->memos; node != NULL; node = node->next)
+    bytes += sizeof (proto_object_memo_t) + strlen (node->key) + 1 + memo_memory_usage (node->memo);
+  return bytes;
+}
@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "proto.h"
+#include "internal.h"
 
 #ifndef OBJECT_PROTOTYPE_SIZE
 #define OBJECT_PROTOTYPE_SIZE 20
@@ -23,16 +25,15 @@ typedef struct proto_hashmap_entry {
   bool is_internal_object;
 } proto_hashmap_entry_t;
 
-static unsigned long
+// Entries are handed out as proto_object_entry_t, which mirrors the start
+_Static_assert (offsetof (proto_hashmap_entry_t, key) == offsetof (proto_object_entry_t, key)
+  && offsetof (proto_hashmap_entry_t, value) == offsetof (proto_object_entry_t, value),
+  "proto_object_entry_t must match the start of proto_hashmap_entry_t");
+
+static inline unsigned long
 proto_hash_code (const char *str)
 {
-  unsigned long hash = 5381;
-  int c;
-
-  while ((c = *str++))
-    hash = ((hash << 5) + hash) + c;
-
-  return hash;
+  return proto_key_hash (str);
 }
 
 static void
@@ -46,6 +47,7 @@ proto_btree_insert (proto_hashmap_entry_t **root,
     }
   int strcmp_value = strcmp (item->key, (*root)->key);
 
+  STATS_ADD (comparisons, 1);
   if (!strcmp_value)
     {
       // Reassign value to object
@@ -53,6 +55,9 @@ proto_btree_insert (proto_hashmap_entry_t **root,
         proto_del_object ((*root)->value);
       (*root)->value = item->value;
       (*root)->is_internal_object = false;
+      free ((char *) item->key);
+      free (item);
+      return;
     }
   if (strcmp_value < 0)
     proto_btree_insert (&(*root)->left, item);
@@ -60,62 +65,95 @@ proto_btree_insert (proto_hashmap_entry_t **root,
     proto_btree_insert (&(*root)->right, item);
 }
 
+static proto_hashmap_entry_t *
+proto_btree_retrieve (proto_hashmap_entry_t **root,
+                      const char *key)
+{
+  if ((*root) == NULL)
+    {
+      return NULL;
+    }
+  int strcmp_value = strcmp (key, (*root)->key);
+
+  STATS_ADD (probes, 1);
+  STATS_ADD (comparisons, 1);
+  if (!strcmp_value)
+    return *root;
+  if (strcmp_value < 0)
+    return proto_btree_retrieve (&(*root)->left, key);
+   else // strcmp_value > 0
+    return proto_btree_retrieve (&(*root)->right, key);
+}
+
+static inline proto_hashmap_entry_t *
+object_entry_hashed (const proto_object_t *object,
+                     const char *key,
+                     unsigned long hash)
+{
+  return proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash % object->prototype_size], key);
+}
+
+// Sets a key whose full hash the caller already has
 static void
-proto_set_own_property (void *self,
-                        const char *key,
-                        const void *value)
+object_set_hashed (proto_object_t *object,
+                   const char *key,
+                   unsigned long hash,
+                   const void *value)
 {
-  if (key == NULL)
-    return;
-  proto_object_t *object = (proto_object_t *) self;
   proto_hashmap_entry_t *entry;
-  unsigned long hash = proto_hash_code (key) % object->prototype_size;
+  const void *replaced = NULL;
   char *key_copy;
 
+  hash %= object->prototype_size;
+  PROBE2 (object__set, object, key);
+  heap_barrier (object->heap, value);
+  if (object->refs != NULL)
+    {
+      entry = object_entry_hashed (object, key, hash);
+      if (entry != NULL && !entry->is_internal_object)
+        replaced = entry->value;
+    }
   entry = (proto_hashmap_entry_t *) malloc (sizeof (proto_hashmap_entry_t));
   if (!entry)
     return;
-  key_copy = (char *) calloc (strlen (key) + 1, sizeof (char *));
+  key_copy = (char *) calloc (strlen (key) + 1, sizeof (char));
   if (!key_copy)
     {
       free (entry);
       return;
     }
   strcpy (key_copy, key);
+  STATS_ADD (allocations, 2);
+  STATS_ADD (bytes, sizeof (proto_hashmap_entry_t) + strlen (key) + 1);
   entry->key = key_copy;
   entry->value = value;
   entry->left = NULL;
   entry->right = NULL;
   entry->is_internal_object = false;
   proto_btree_insert ((proto_hashmap_entry_t **) &object->prototype[hash], entry);
+  refs_hold (object->refs, value);
+  refs_drop (object->refs, replaced);
 }
 
-static proto_hashmap_entry_t *
-proto_btree_retrieve (proto_hashmap_entry_t **root,
-                      const char *key)
+static void
+proto_set_own_property (void *self,
+                        const char *key,
+                        const void *value)
 {
-  if ((*root) == NULL)
-    {
-      return NULL;
-    }
-  int strcmp_value = strcmp (key, (*root)->key);
-
-  if (!strcmp_value)
-    return *root;
-  if (strcmp_value < 0)
-    return proto_btree_retrieve (&(*root)->left, key);
-   else // strcmp_value > 0
-    return proto_btree_retrieve (&(*root)->right, key);
+  if (key == NULL)
+    return;
+  object_set_hashed ((proto_object_t *) self, key, proto_hash_code (key), value);
 }
 
-static const void *
+const void *
 proto_get_own_property (const void *self,
                         const char *key)
 {
   proto_object_t *object = (proto_object_t *) self;
-  unsigned long hash = proto_hash_code (key) % object->prototype_size;
-  proto_hashmap_entry_t *entry = proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash], key);
+  proto_hashmap_entry_t *entry = object_entry_hashed (object, key, proto_hash_code (key));
 
+  PROBE2 (object__get, object, key);
+  STATS_ADD (lookups, 1);
   if (entry == NULL)
     return NULL;
   return entry->value;
@@ -126,24 +164,15 @@ proto_has_own_property (const void *self,
                         const char *key)
 {
   proto_object_t *object = (proto_object_t *) self;
-  unsigned long hash = proto_hash_code (key) % object->prototype_size;
-  proto_hashmap_entry_t *entry = proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash], key);
+  proto_hashmap_entry_t *entry = object_entry_hashed (object, key, proto_hash_code (key));
 
+  PROBE2 (object__has, object, key);
+  STATS_ADD (lookups, 1);
   if (entry == NULL)
     return false;
   return true;
 }
 
-static proto_hashmap_entry_t *
-proto_btree_find_minimal (proto_hashmap_entry_t *root)
-{
-  proto_hashmap_entry_t *tmp = root;
-
-  while (tmp->left != NULL)
-    tmp = tmp->left;
-  return tmp;
-}
-
 static proto_hashmap_entry_t *
 proto_btree_delete (proto_hashmap_entry_t *root,
                     const char *key)
@@ -152,6 +181,7 @@ proto_btree_delete (proto_hashmap_entry_t *root,
     return root;
   int strcmp_value = strcmp (key, root->key);
 
+  STATS_ADD (comparisons, 1);
   if (strcmp_value < 0)
     root->left = proto_btree_delete (root->left, key);
   else if (strcmp_value > 0)
@@ -180,10 +210,24 @@ proto_btree_delete (proto_hashmap_entry_t *root,
         }
       else
         {
-          proto_hashmap_entry_t *garbage = proto_btree_find_minimal (root->right);
-          root->value = garbage->value;
-          root->is_internal_object = garbage->is_internal_object;
-          root->right = proto_btree_delete (root->right, key);
+          // Relinks the successor in the deleted entry's place rather than
+          // copying it over, so entries never move and slots stay valid
+          proto_hashmap_entry_t *garbage = root, *parent = root, *successor = root->right;
+
+          while (successor->left != NULL)
+            {
+              parent = successor;
+              successor = successor->left;
+            }
+          if (parent != root)
+            {
+              parent->left = successor->right;
+              successor->right = root->right;
+            }
+          successor->left = root->left;
+          root = successor;
+          free ((char *) garbage->key);
+          free (garbage);
         }
     }
   return root;
@@ -205,6 +249,21 @@ proto_print_btree (const proto_hashmap_entry_t *root)
   proto_print_btree (root->right);
 }
 
+// Whether the entry is one of the slots the object's shape declares
+static bool
+object_declares (const proto_object_t *object,
+                 const proto_hashmap_entry_t *entry)
+{
+  size_t i;
+
+  if (object->slots == NULL)
+    return false;
+  for (i = 0; i < ((const proto_shape_t *) object->shape)->length; i++)
+    if (object->slots[i] == entry)
+      return true;
+  return false;
+}
+
 static const void *
 proto_del_own_property (void *self,
                         const char *key)
@@ -214,9 +273,21 @@ proto_del_own_property (void *self,
   unsigned long hash = proto_hash_code (key) % object->prototype_size;
   proto_hashmap_entry_t *entry = proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash], key);
 
+  PROBE2 (object__del, object, key);
+  STATS_ADD (lookups, 1);
   if (entry == NULL)
     return NULL;
   value = entry->value;
+  heap_moving (object->heap, object);
+  if (!entry->is_internal_object)
+    refs_drop (object->refs, value);
+  // A shape's keys stay declared; deleting one only clears its value
+  if (object_declares (object, entry))
+    {
+      entry->value = NULL;
+      entry->is_internal_object = false;
+      return value;
+    }
   object->prototype[hash] = proto_btree_delete ((proto_hashmap_entry_t *) object->prototype[hash], key);
   return value;
 }
@@ -247,6 +318,8 @@ proto_set_chain (void *self,
             {
               object = (proto_object_t *) value;
               new_object = proto_init_object ();
+              new_object->heap = object->heap;
+              new_object->refs = object->refs;
               object->set_own_property (object, previous_key, new_object);
               hash = proto_hash_code (previous_key) % object->prototype_size;
               entry = proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash], previous_key);
@@ -257,7 +330,8 @@ proto_set_chain (void *self,
             }
           object = (proto_object_t *) value;
           current_key[pos_current_key] = '\0';
-          if (object->has_own_property (object, current_key))
+          // An empty property, such as a shape's unset slot, is filled in
+          if (object->get_own_property (object, current_key) != NULL)
             value = object->get_own_property (object, current_key);
           else
             {
@@ -273,6 +347,8 @@ proto_set_chain (void *self,
     {
       object = (proto_object_t *) value;
       new_object = proto_init_object ();
+      new_object->heap = object->heap;
+      new_object->refs = object->refs;
       object->set_own_property (object, previous_key, new_object);
       hash = proto_hash_code (previous_key) % object->prototype_size;
       entry = proto_btree_retrieve ((proto_hashmap_entry_t **) &object->prototype[hash], previous_key);
@@ -346,12 +422,40 @@ proto_execute_property (void *self,
 {
   proto_object_t *object = (proto_object_t *) self;
   void *(*function) (const void *arguments);
+  proto_memo_t *memo;
+  size_t start = latency_active () ? latency_now () : 0;
+  void *result;
 
-  if (object->has_own_property (object, key)) {
-    function = object->get_own_property (object, key);
-    return (const void *) function (arguments);
-  }
-  return NULL;
+  if (!object->has_own_property (object, key))
+    return NULL;
+  PROBE2 (property__entry, object, key);
+  function = object->get_own_property (object, key);
+  if (object->memos != NULL && (memo = proto_object_memo (object, key)) != NULL)
+    result = memo_call (memo, function, arguments);
+  else
+    result = function (arguments);
+  PROBE2 (property__return, object, key);
+  if (start != 0)
+    latency_record (PROTO_LATENCY_PROPERTY, key, NULL, latency_now () - start);
+  return (const void *) result;
+}
+
+/*
+ * Looks the property up now and runs it on the pool; arguments must stay
+ * valid until the future is done. NULL when there's no such property.
+ */
+proto_future_t *
+proto_execute_property_async (proto_pool_t *pool,
+                              proto_object_t *object,
+                              const char *key,
+                              const void *arguments)
+{
+  void *(*function) (const void *arguments);
+
+  if (object == NULL || key == NULL || !object->has_own_property (object, key))
+    return NULL;
+  function = object->get_own_property (object, key);
+  return future_spawn (pool, function, arguments, NULL);
 }
 
 static void
@@ -359,6 +463,10 @@ proto_set_super (void *self,
                  const void *reference)
 {
   proto_object_t *object = (proto_object_t *) self;
+
+  heap_barrier (object->heap, reference);
+  refs_hold (object->refs, reference);
+  refs_drop (object->refs, object->super);
   object->super = (proto_object_t *) reference;
 }
 
@@ -407,6 +515,60 @@ proto_merge (void *self,
     }
 }
 
+static bool
+object_cursor_push (object_cursor_t *cursor,
+                    const proto_hashmap_entry_t *entry)
+{
+  if (cursor->depth == cursor->capacity)
+    {
+      size_t capacity = cursor->capacity ? 2 * cursor->capacity : 16;
+      const void **stack = (const void **) realloc (cursor->stack, capacity * sizeof (void *));
+
+      if (!stack)
+        {
+          cursor->failed = true;
+          return false;
+        }
+      cursor->stack = stack;
+      cursor->capacity = capacity;
+    }
+  cursor->stack[cursor->depth++] = entry;
+  return true;
+}
+
+/*
+ * Own properties of the object one at a time, bucket by bucket, in no
+ * particular order; NULL after the last one, or when the stack can't grow,
+ * which sets failed. The stack only grows to the depth of the deepest
+ * bucket tree.
+ */
+const proto_object_entry_t *
+object_cursor_next (object_cursor_t *cursor)
+{
+  const proto_hashmap_entry_t *entry;
+
+  while (cursor->depth == 0)
+    {
+      if (cursor->bucket >= cursor->object->prototype_size)
+        return NULL;
+      entry = cursor->object->prototype[cursor->bucket++];
+      if (entry != NULL && !object_cursor_push (cursor, entry))
+        return NULL;
+    }
+  entry = cursor->stack[--cursor->depth];
+  if ((entry->right != NULL && !object_cursor_push (cursor, entry->right))
+      || (entry->left != NULL && !object_cursor_push (cursor, entry->left)))
+    return NULL;
+  return (const proto_object_entry_t *) entry;
+}
+
+// Whether set_chain made the entry's value, which the entry then owns
+bool
+object_entry_internal (const proto_object_entry_t *entry)
+{
+  return ((const proto_hashmap_entry_t *) entry)->is_internal_object;
+}
+
 proto_object_t *
 proto_init_object ()
 {
@@ -425,6 +587,8 @@ proto_init_object ()
     }
   for (i = 0; i < OBJECT_PROTOTYPE_SIZE; i++)
     object->prototype[i] = NULL;
+  STATS_ADD (allocations, 2);
+  STATS_ADD (bytes, sizeof (proto_object_t) + OBJECT_PROTOTYPE_SIZE * sizeof (proto_hashmap_entry_t *));
   object->set_own_property = &proto_set_own_property;
   object->get_own_property = &proto_get_own_property;
   object->has_own_property = &proto_has_own_property;
@@ -435,9 +599,194 @@ proto_init_object ()
   object->execute_property = &proto_execute_property;
   object->set_super = &proto_set_super;
   object->merge = &proto_merge;
+  object->memos = NULL;
+  object->shape = NULL;
+  object->slots = NULL;
+  object->heap = NULL;
+  object->refs = NULL;
+  return object;
+}
+
+/*
+ * An object whose shape's keys always exist, each in a slot numbered by
+ * its place in the shape. The slots point at the keys' entries, which
+ * never move, so proto_object_slot reads a value without hashing. The
+ * shape must outlive the object.
+ */
+proto_object_t *
+proto_init_shaped_object (const proto_shape_t *shape)
+{
+  proto_object_t *object;
+  size_t i;
+
+  if (shape == NULL || (shape->length > 0 && shape->keys == NULL))
+    return NULL;
+  object = proto_init_object ();
+  if (!object)
+    return NULL;
+  object->slots = (void **) calloc (shape->length ? shape->length : 1, sizeof (void *));
+  if (!object->slots)
+    {
+      proto_del_object (object);
+      return NULL;
+    }
+  object->shape = shape;
+  STATS_ADD (allocations, 1);
+  STATS_ADD (bytes, shape->length * sizeof (void *));
+  for (i = 0; i < shape->length; i++)
+    {
+      object_set_hashed (object, shape->keys[i].name, shape->keys[i].hash, NULL);
+      object->slots[i] = object_entry_hashed (object, shape->keys[i].name, shape->keys[i].hash);
+      if (object->slots[i] == NULL)
+        {
+          proto_del_object (object);
+          return NULL;
+        }
+    }
   return object;
 }
 
+const proto_shape_t *
+proto_object_shape (const proto_object_t *object)
+{
+  return object == NULL ? NULL : (const proto_shape_t *) object->shape;
+}
+
+void
+proto_object_set_slot (proto_object_t *object,
+                       size_t slot,
+                       const void *value)
+{
+  proto_hashmap_entry_t *entry;
+
+  if (object == NULL || object->slots == NULL || slot >= ((const proto_shape_t *) object->shape)->length)
+    return;
+  entry = (proto_hashmap_entry_t *) object->slots[slot];
+  heap_barrier (object->heap, value);
+  refs_hold (object->refs, value);
+  if (entry->is_internal_object)
+    proto_del_object ((proto_object_t *) entry->value);
+  else
+    refs_drop (object->refs, entry->value);
+  entry->value = value;
+  entry->is_internal_object = false;
+}
+
+/*
+ * Keyed access skips hashing the key; objects whose property functions
+ * were replaced still go through them.
+ */
+const void *
+proto_object_get_key (const proto_object_t *object,
+                      const proto_key_t *key)
+{
+  proto_hashmap_entry_t *entry;
+
+  if (object == NULL || key == NULL || key->name == NULL)
+    return NULL;
+  if (object->get_own_property != &proto_get_own_property)
+    return object->get_own_property (object, key->name);
+  entry = object_entry_hashed (object, key->name, key->hash);
+  PROBE2 (object__get, object, key->name);
+  STATS_ADD (lookups, 1);
+  return entry == NULL ? NULL : entry->value;
+}
+
+bool
+proto_object_has_key (const proto_object_t *object,
+                      const proto_key_t *key)
+{
+  if (object == NULL || key == NULL || key->name == NULL)
+    return false;
+  if (object->has_own_property != &proto_has_own_property)
+    return object->has_own_property (object, key->name);
+  PROBE2 (object__has, object, key->name);
+  STATS_ADD (lookups, 1);
+  return object_entry_hashed (object, key->name, key->hash) != NULL;
+}
+
+void
+proto_object_set_key (proto_object_t *object,
+                      const proto_key_t *key,
+                      const void *value)
+{
+  if (object == NULL || key == NULL || key->name == NULL)
+    return;
+  if (object->set_own_property != &proto_set_own_property)
+    object->set_own_property (object, key->name, value);
+  else
+    object_set_hashed (object, key->name, key->hash, value);
+}
+
+static size_t
+object_stats_tree (const proto_hashmap_entry_t *root,
+                   size_t depth,
+                   proto_object_stats_t *stats)
+{
+  if (root == NULL)
+    return 0;
+  stats->depths[depth < PROTO_STATS_HISTOGRAM ? depth : PROTO_STATS_HISTOGRAM - 1]++;
+  if (depth + 1 > stats->max_depth)
+    stats->max_depth = depth + 1;
+  return 1 + object_stats_tree (root->left, depth + 1, stats)
+    + object_stats_tree (root->right, depth + 1, stats);
+}
+
+// Walks every bucket's tree; works whether or not PROTO_STATS is on
+bool
+proto_object_stats (const proto_object_t *object,
+                    proto_object_stats_t *stats)
+{
+  size_t i, keys;
+
+  if (object == NULL || stats == NULL)
+    return false;
+  memset (stats, 0, sizeof (proto_object_stats_t));
+  stats->buckets = object->prototype_size;
+  for (i = 0; i < object->prototype_size; i++)
+    {
+      keys = object_stats_tree ((const proto_hashmap_entry_t *) object->prototype[i], 0, stats);
+      stats->occupancy[keys < PROTO_STATS_HISTOGRAM ? keys : PROTO_STATS_HISTOGRAM - 1]++;
+      stats->keys += keys;
+      if (keys > 0)
+        stats->used_buckets++;
+    }
+  return true;
+}
+
+static size_t
+object_memory_usage_tree (const proto_hashmap_entry_t *root)
+{
+  size_t bytes;
+
+  if (root == NULL)
+    return 0;
+  bytes = sizeof (proto_hashmap_entry_t) + strlen (root->key) + 1;
+  if (root->is_internal_object)
+    bytes += proto_object_memory_usage ((const proto_object_t *) root->value);
+  return bytes + object_memory_usage_tree (root->left) + object_memory_usage_tree (root->right);
+}
+
+/*
+ * Bytes that deleting the object frees: itself, its buckets, every entry
+ * and key copy, the objects set_chain made for it and its memos. Values
+ * it only points to aren't counted.
+ */
+size_t
+proto_object_memory_usage (const proto_object_t *object)
+{
+  size_t bytes, i;
+
+  if (object == NULL)
+    return 0;
+  bytes = sizeof (proto_object_t) + object->prototype_size * sizeof (proto_hashmap_entry_t *);
+  if (object->slots != NULL)
+    bytes += ((const proto_shape_t *) object->shape)->length * sizeof (void *);
+  for (i = 0; i < object->prototype_size; i++)
+    bytes += object_memory_usage_tree ((const proto_hashmap_entry_t *) object->prototype[i]);
+  return bytes + object_memos_memory_usage (object);
+}
+
 static void
 proto_del_hashmap_entry (proto_hashmap_entry_t *entry)
 {
@@ -457,11 +806,15 @@ proto_del_object (proto_object_t *object)
   size_t i;
   proto_hashmap_entry_t **prototype = (proto_hashmap_entry_t **) object->prototype;
 
+  if (object->refs != NULL)
+    refs_release_object (object);
   for (i = 0; i < object->prototype_size; i++)
     {
       proto_hashmap_entry_t *entry = prototype[i];
       proto_del_hashmap_entry (entry);
     }
   free (prototype);
+  free (object->slots);
+  object_memos_free (object);
   free (object);
 }
@@ -0,0 +1,255 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef PARALLEL_MIN_GRAIN
+#define PARALLEL_MIN_GRAIN 1024
+#endif
+#ifndef PARALLEL_CHUNKS_PER_WORKER
+#define PARALLEL_CHUNKS_PER_WORKER 8
+#endif
+
+/*
+ * Arrays are cut into chunks of fixed boundaries, a few per worker so idle
+ * workers can steal; results that depend on order are kept per chunk and
+ * put together in chunk order afterwards.
+ */
+typedef struct {
+  const proto_array_t *array;
+  size_t chunk_size;
+  void *function;
+  void *context;
+  proto_array_t *result;
+  unsigned char *keep;
+  size_t *counts;
+  char *partials;
+  const void *identity;
+  size_t size;
+} proto_parallel_t;
+
+static size_t
+parallel_chunks (proto_parallel_t *parallel,
+                 proto_pool_t *pool)
+{
+  size_t length = parallel->array->length;
+  size_t chunk_size = length / (proto_pool_workers (pool) * PARALLEL_CHUNKS_PER_WORKER);
+
+  if (chunk_size < PARALLEL_MIN_GRAIN)
+    chunk_size = PARALLEL_MIN_GRAIN;
+  parallel->chunk_size = chunk_size;
+  return (length + chunk_size - 1) / chunk_size;
+}
+
+static inline void
+parallel_bounds (const proto_parallel_t *parallel,
+                 size_t chunk,
+                 size_t *begin,
+                 size_t *end)
+{
+  *begin = chunk * parallel->chunk_size;
+  *end = *begin + parallel->chunk_size;
+  if (*end > parallel->array->length)
+    *end = parallel->array->length;
+}
+
+static void
+parallel_for_chunk (size_t chunk,
+                    void *context)
+{
+  proto_parallel_t *parallel = (proto_parallel_t *) context;
+  void (*function) (const void *, size_t, void *) = parallel->function;
+  size_t i, begin, end;
+
+  parallel_bounds (parallel, chunk, &begin, &end);
+  for (i = begin; i < end; i++)
+    function (array_item (parallel->array, i), i, parallel->context);
+}
+
+static void
+parallel_map_chunk (size_t chunk,
+                    void *context)
+{
+  proto_parallel_t *parallel = (proto_parallel_t *) context;
+  const void *(*function) (const void *, void *) = parallel->function;
+  size_t i, begin, end;
+
+  parallel_bounds (parallel, chunk, &begin, &end);
+  for (i = begin; i < end; i++)
+    parallel->result->items[i] = (void *) function (array_item (parallel->array, i), parallel->context);
+}
+
+static void
+parallel_filter_chunk (size_t chunk,
+                       void *context)
+{
+  proto_parallel_t *parallel = (proto_parallel_t *) context;
+  bool (*predicate) (const void *, void *) = parallel->function;
+  size_t i, begin, end, count = 0;
+
+  parallel_bounds (parallel, chunk, &begin, &end);
+  for (i = begin; i < end; i++)
+    {
+      parallel->keep[i] = predicate (array_item (parallel->array, i), parallel->context);
+      count += parallel->keep[i];
+    }
+  parallel->counts[chunk] = count;
+}
+
+static void
+parallel_scatter_chunk (size_t chunk,
+                        void *context)
+{
+  proto_parallel_t *parallel = (proto_parallel_t *) context;
+  void **target = parallel->result->items + parallel->counts[chunk];
+  size_t i, begin, end;
+
+  parallel_bounds (parallel, chunk, &begin, &end);
+  for (i = begin; i < end; i++)
+    if (parallel->keep[i])
+      *target++ = array_item (parallel->array, i);
+}
+
+static void
+parallel_reduce_chunk (size_t chunk,
+                       void *context)
+{
+  proto_parallel_t *parallel = (proto_parallel_t *) context;
+  void (*fold) (void *, const void *, void *) = parallel->function;
+  void *partial = parallel->partials + chunk * parallel->size;
+  size_t i, begin, end;
+
+  parallel_bounds (parallel, chunk, &begin, &end);
+  memcpy (partial, parallel->identity, parallel->size);
+  for (i = begin; i < end; i++)
+    fold (partial, array_item (parallel->array, i), parallel->context);
+}
+
+void
+proto_array_parallel_for (proto_pool_t *pool,
+                          const proto_array_t *array,
+                          void (*function) (const void *element, size_t position, void *context),
+                          void *context)
+{
+  proto_parallel_t parallel;
+  size_t chunks;
+
+  if (array == NULL || function == NULL)
+    return;
+  parallel.array = array;
+  parallel.function = function;
+  parallel.context = context;
+  chunks = parallel_chunks (&parallel, pool);
+  pool_run (pool, chunks, &parallel_for_chunk, &parallel);
+}
+
+proto_array_t *
+proto_array_parallel_map (proto_pool_t *pool,
+                          const proto_array_t *array,
+                          const void *(*function) (const void *element, void *context),
+                          void *context)
+{
+  proto_parallel_t parallel;
+  size_t chunks;
+
+  if (array == NULL || function == NULL)
+    return NULL;
+  parallel.array = array;
+  parallel.function = function;
+  parallel.context = context;
+  parallel.result = array_with_capacity (array->length);
+  if (!parallel.result)
+    return NULL;
+  chunks = parallel_chunks (&parallel, pool);
+  pool_run (pool, chunks, &parallel_map_chunk, &parallel);
+  parallel.result->length = array->length;
+  return parallel.result;
+}
+
+proto_array_t *
+proto_array_parallel_filter (proto_pool_t *pool,
+                             const proto_array_t *array,
+                             bool (*predicate) (const void *element, void *context),
+                             void *context)
+{
+  proto_parallel_t parallel;
+  size_t chunks, chunk, offset = 0;
+
+  if (array == NULL || predicate == NULL)
+    return NULL;
+  parallel.array = array;
+  parallel.function = predicate;
+  parallel.context = context;
+  chunks = parallel_chunks (&parallel, pool);
+  parallel.keep = (unsigned char *) malloc (array->length + 1);
+  parallel.counts = (size_t *) malloc ((chunks + 1) * sizeof (size_t));
+  if (!parallel.keep || !parallel.counts)
+    {
+      free (parallel.keep);
+      free (parallel.counts);
+      return NULL;
+    }
+  pool_run (pool, chunks, &parallel_filter_chunk, &parallel);
+  // Turn the counts into the position each chunk starts writing at
+  for (chunk = 0; chunk < chunks; chunk++)
+    {
+      size_t count = parallel.counts[chunk];
+
+      parallel.counts[chunk] = offset;
+      offset += count;
+    }
+  parallel.result = array_with_capacity (offset);
+  if (parallel.result)
+    {
+      pool_run (pool, chunks, &parallel_scatter_chunk, &parallel);
+      parallel.result->length = offset;
+    }
+  free (parallel.keep);
+  free (parallel.counts);
+  return parallel.result;
+}
+
+/*
+ * The accumulator holds the identity on entry and the result on return. Each
+ * chunk folds its elements into a copy of the identity; the partials are
+ * then combined into the accumulator in array order, so fold and combine
+ * need to be associative but not commutative.
+ */
+bool
+proto_array_parallel_reduce (proto_pool_t *pool,
+                             const proto_array_t *array,
+                             void *accumulator,
+                             size_t size,
+                             void (*fold) (void *accumulator, const void *element, void *context),
+                             void (*combine) (void *accumulator, const void *partial, void *context),
+                             void *context)
+{
+  proto_parallel_t parallel;
+  size_t chunks, chunk;
+
+  if (array == NULL || accumulator == NULL || fold == NULL || combine == NULL)
+    return false;
+  parallel.array = array;
+  parallel.function = fold;
+  parallel.context = context;
+  parallel.identity = accumulator;
+  parallel.size = size;
+  chunks = parallel_chunks (&parallel, pool);
+  parallel.partials = (char *) malloc (chunks * size + 1);
+  if (!parallel.partials)
+    return false;
+  pool_run (pool, chunks, &parallel_reduce_chunk, &parallel);
+  for (chunk = 0; chunk < chunks; chunk++)
+    combine (accumulator, parallel.partials + chunk * size, context);
+  free (parallel.partials);
+  return true;
+}
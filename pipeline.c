@@ -0,0 +1,351 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef PIPELINE_STAGES_SIZE
+#define PIPELINE_STAGES_SIZE 4
+#endif
+
+typedef enum {
+  pipeline_array,
+  pipeline_buffer,
+  pipeline_object
+} proto_pipeline_source_t;
+
+typedef enum {
+  stage_map,
+  stage_filter,
+  stage_take,
+  stage_skip,
+  stage_zip
+} proto_pipeline_kind_t;
+
+typedef struct {
+  proto_pipeline_kind_t kind;
+  void *function;
+  void *context;
+  size_t count;
+  size_t seen;
+  proto_pipeline_t *another;
+} proto_pipeline_stage_t;
+
+/*
+ * A pipeline is a source plus a list of stages. Nothing runs until an
+ * element is asked for; then each source element goes through every stage
+ * in one loop, so chaining stages never builds an intermediate array and
+ * memory doesn't depend on the length of the source.
+ */
+struct proto_pipeline {
+  proto_pipeline_source_t source;
+  const proto_array_t *array;
+  const char *buffer;
+  size_t size;
+  size_t position;
+  size_t length;
+  void **segment;
+  size_t segment_length;
+  object_cursor_t cursor;
+  proto_pipeline_stage_t *stages;
+  size_t stages_length;
+  size_t stages_allocated;
+  bool done;
+};
+
+static proto_pipeline_t *
+pipeline_new (proto_pipeline_source_t source)
+{
+  proto_pipeline_t *pipeline = (proto_pipeline_t *) calloc (1, sizeof (proto_pipeline_t));
+
+  if (!pipeline)
+    return NULL;
+  pipeline->source = source;
+  return pipeline;
+}
+
+static inline bool
+pipeline_source_next (proto_pipeline_t *pipeline,
+                      const void **element)
+{
+  switch (pipeline->source)
+    {
+    case pipeline_array:
+      if (pipeline->segment_length == 0)
+        {
+          if (pipeline->position >= pipeline->array->length)
+            return false;
+          pipeline->segment = array_segment (pipeline->array, pipeline->position,
+            &pipeline->segment_length);
+          pipeline->position += pipeline->segment_length;
+        }
+      pipeline->segment_length--;
+      *element = *pipeline->segment++;
+      return true;
+    case pipeline_buffer:
+      if (pipeline->position >= pipeline->length)
+        return false;
+      *element = pipeline->buffer + pipeline->position++ * pipeline->size;
+      return true;
+    case pipeline_object:
+      *element = object_cursor_next (&pipeline->cursor);
+      return *element != NULL;
+    }
+  return false;
+}
+
+static proto_pipeline_t *
+pipeline_stage (proto_pipeline_t *pipeline,
+                proto_pipeline_kind_t kind,
+                void *function,
+                void *context,
+                size_t count,
+                proto_pipeline_t *another)
+{
+  proto_pipeline_stage_t *stage;
+
+  if (pipeline == NULL)
+    {
+      proto_del_pipeline (another);
+      return NULL;
+    }
+  if (pipeline->stages_length == pipeline->stages_allocated)
+    {
+      size_t allocated = pipeline->stages_allocated ? 2 * pipeline->stages_allocated : PIPELINE_STAGES_SIZE;
+
+      stage = (proto_pipeline_stage_t *) realloc (pipeline->stages, allocated * sizeof (proto_pipeline_stage_t));
+      if (!stage)
+        {
+          proto_del_pipeline (another);
+          proto_del_pipeline (pipeline);
+          return NULL;
+        }
+      pipeline->stages = stage;
+      pipeline->stages_allocated = allocated;
+    }
+  stage = &pipeline->stages[pipeline->stages_length++];
+  stage->kind = kind;
+  stage->function = function;
+  stage->context = context;
+  stage->count = count;
+  stage->seen = 0;
+  stage->another = another;
+  return pipeline;
+}
+
+proto_pipeline_t *
+proto_pipeline_from_array (const proto_array_t *array)
+{
+  proto_pipeline_t *pipeline;
+
+  if (array == NULL)
+    return NULL;
+  pipeline = pipeline_new (pipeline_array);
+  if (pipeline)
+    pipeline->array = array;
+  return pipeline;
+}
+
+// A plain C array of length elements of size bytes; elements are pointers into it
+proto_pipeline_t *
+proto_pipeline_from_buffer (const void *buffer,
+                            size_t length,
+                            size_t size)
+{
+  proto_pipeline_t *pipeline;
+
+  if (buffer == NULL && length > 0)
+    return NULL;
+  pipeline = pipeline_new (pipeline_buffer);
+  if (!pipeline)
+    return NULL;
+  pipeline->buffer = (const char *) buffer;
+  pipeline->length = length;
+  pipeline->size = size;
+  return pipeline;
+}
+
+// Own properties as proto_object_entry_t, valid while the object isn't changed
+proto_pipeline_t *
+proto_pipeline_from_object (const proto_object_t *object)
+{
+  proto_pipeline_t *pipeline;
+
+  if (object == NULL)
+    return NULL;
+  pipeline = pipeline_new (pipeline_object);
+  if (pipeline)
+    pipeline->cursor.object = object;
+  return pipeline;
+}
+
+/*
+ * Stages are added to the end of the pipeline and return it, or NULL when
+ * there's no memory left, in which case the pipeline has been released.
+ * Every stage also accepts NULL, so a chain can be checked once at the end.
+ */
+proto_pipeline_t *
+proto_pipeline_map (proto_pipeline_t *pipeline,
+                    const void *(*function) (const void *element, void *context),
+                    void *context)
+{
+  return pipeline_stage (pipeline, stage_map, function, context, 0, NULL);
+}
+
+proto_pipeline_t *
+proto_pipeline_filter (proto_pipeline_t *pipeline,
+                       bool (*predicate) (const void *element, void *context),
+                       void *context)
+{
+  return pipeline_stage (pipeline, stage_filter, predicate, context, 0, NULL);
+}
+
+proto_pipeline_t *
+proto_pipeline_take (proto_pipeline_t *pipeline,
+                     size_t count)
+{
+  pipeline = pipeline_stage (pipeline, stage_take, NULL, NULL, count, NULL);
+  // Nothing gets past a stage that takes none, so the source is never read
+  if (pipeline && count == 0)
+    pipeline->done = true;
+  return pipeline;
+}
+
+proto_pipeline_t *
+proto_pipeline_skip (proto_pipeline_t *pipeline,
+                     size_t count)
+{
+  return pipeline_stage (pipeline, stage_skip, NULL, NULL, count, NULL);
+}
+
+// Pairs elements with those of another pipeline, which this one takes over
+proto_pipeline_t *
+proto_pipeline_zip (proto_pipeline_t *pipeline,
+                    proto_pipeline_t *another,
+                    const void *(*combine) (const void *element, const void *other, void *context),
+                    void *context)
+{
+  if (another == NULL)
+    {
+      proto_del_pipeline (pipeline);
+      return NULL;
+    }
+  return pipeline_stage (pipeline, stage_zip, combine, context, 0, another);
+}
+
+/*
+ * Stores the next element that makes it through every stage and returns
+ * true, or returns false once the source or a take stage runs out.
+ */
+bool
+proto_pipeline_next (proto_pipeline_t *pipeline,
+                     const void **element)
+{
+  proto_pipeline_stage_t *stage, *end;
+  const void *value, *other;
+
+  if (pipeline == NULL || element == NULL || pipeline->done)
+    return false;
+  end = pipeline->stages + pipeline->stages_length;
+  while (!pipeline->done && pipeline_source_next (pipeline, &value))
+    {
+      // A stage either continues with the next one or drops the element
+      for (stage = pipeline->stages; stage < end; stage++)
+        {
+          switch (stage->kind)
+            {
+            case stage_map:
+              value = ((const void *(*) (const void *, void *)) stage->function) (value, stage->context);
+              continue;
+            case stage_filter:
+              if (((bool (*) (const void *, void *)) stage->function) (value, stage->context))
+                continue;
+              break;
+            case stage_skip:
+              if (stage->seen == stage->count)
+                continue;
+              stage->seen++;
+              break;
+            case stage_take:
+              if (stage->seen == stage->count)
+                {
+                  pipeline->done = true;
+                  return false;
+                }
+              // Nothing gets past this stage after the last one it lets through
+              if (++stage->seen == stage->count)
+                pipeline->done = true;
+              continue;
+            case stage_zip:
+              if (!proto_pipeline_next (stage->another, &other))
+                {
+                  pipeline->done = true;
+                  return false;
+                }
+              value = ((const void *(*) (const void *, const void *, void *)) stage->function) (value, other,
+                stage->context);
+              continue;
+            }
+          break;
+        }
+      if (stage == end)
+        {
+          *element = value;
+          return true;
+        }
+    }
+  pipeline->done = true;
+  return false;
+}
+
+void
+proto_pipeline_each (proto_pipeline_t *pipeline,
+                     void (*callback) (const void *element, size_t position, void *context),
+                     void *context)
+{
+  const void *element;
+  size_t position = 0;
+
+  if (callback == NULL)
+    return;
+  while (proto_pipeline_next (pipeline, &element))
+    callback (element, position++, context);
+}
+
+// Runs what's left of the pipeline into a new array
+proto_array_t *
+proto_pipeline_collect (proto_pipeline_t *pipeline)
+{
+  proto_array_t *array;
+  const void *element;
+
+  if (pipeline == NULL)
+    return NULL;
+  array = proto_init_array ();
+  if (!array)
+    return NULL;
+  while (proto_pipeline_next (pipeline, &element))
+    array->push (array, element);
+  return array;
+}
+
+void
+proto_del_pipeline (proto_pipeline_t *pipeline)
+{
+  size_t i;
+
+  if (pipeline == NULL)
+    return;
+  for (i = 0; i < pipeline->stages_length; i++)
+    proto_del_pipeline (pipeline->stages[i].another);
+  free (pipeline->cursor.stack);
+  free (pipeline->stages);
+  free (pipeline);
+}
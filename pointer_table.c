@@ -0,0 +1,127 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef POINTER_TABLE_MIN_CAPACITY
+#define POINTER_TABLE_MIN_CAPACITY 16
+#endif
+
+// Moves every entry into a table of capacity slots, a power of two
+static bool
+pointer_table_resize (pointer_table_t *table,
+                      size_t capacity)
+{
+  char *entries = table->entries;
+  size_t i, slot, mask, old_capacity = table->capacity;
+
+  table->entries = (char *) calloc (capacity, table->size);
+  if (!table->entries)
+    {
+      table->entries = entries;
+      return false;
+    }
+  table->capacity = capacity;
+  mask = capacity - 1;
+  for (i = 0; i < old_capacity; i++)
+    if (*(const void **) (entries + i * table->size) != NULL)
+      {
+        const char *entry = entries + i * table->size;
+
+        for (slot = pointer_table_home (table, *(const void **) entry);
+             pointer_table_key (table, slot) != NULL;
+             slot = (slot + 1) & mask);
+        memcpy (pointer_table_entry (table, slot), entry, table->size);
+      }
+  free (entries);
+  return true;
+}
+
+/*
+ * Makes room for expected entries without growing again, keeping the
+ * table at most half full.
+ */
+bool
+pointer_table_reserve (pointer_table_t *table,
+                       size_t expected)
+{
+  size_t capacity = table->capacity ? table->capacity : POINTER_TABLE_MIN_CAPACITY;
+
+  while (capacity < expected * 2)
+    capacity <<= 1;
+  if (capacity == table->capacity)
+    return true;
+  return pointer_table_resize (table, capacity);
+}
+
+/*
+ * The entry for key, which must not be NULL. A new entry has every byte
+ * after the key zeroed and sets added; NULL means the table couldn't grow.
+ * Adding may move every entry, so pointers to entries don't survive it.
+ */
+void *
+pointer_table_add (pointer_table_t *table,
+                   const void *key,
+                   bool *added)
+{
+  size_t slot, mask;
+  char *entry;
+
+  *added = false;
+  if (!pointer_table_reserve (table, table->used + 1))
+    return NULL;
+  mask = table->capacity - 1;
+  for (slot = pointer_table_home (table, key); pointer_table_key (table, slot) != NULL; slot = (slot + 1) & mask)
+    if (pointer_table_key (table, slot) == key)
+      return pointer_table_entry (table, slot);
+  entry = (char *) pointer_table_entry (table, slot);
+  *(const void **) entry = key;
+  table->used++;
+  *added = true;
+  return entry;
+}
+
+/*
+ * Backward shift deletion: entries after the hole that don't belong before
+ * it are moved back, so lookups never need tombstones. The entry's slot
+ * may then hold one that came after it.
+ */
+void
+pointer_table_remove (pointer_table_t *table,
+                      void *entry)
+{
+  size_t hole, slot, home, mask = table->capacity - 1;
+
+  hole = slot = ((char *) entry - table->entries) / table->size;
+  for (;;)
+    {
+      slot = (slot + 1) & mask;
+      if (pointer_table_key (table, slot) == NULL)
+        break;
+      home = pointer_table_home (table, pointer_table_key (table, slot));
+      if (hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot))
+        continue;
+      memcpy (pointer_table_entry (table, hole), pointer_table_entry (table, slot), table->size);
+      hole = slot;
+    }
+  memset (pointer_table_entry (table, hole), 0, table->size);
+  table->used--;
+}
+
+void
+pointer_table_clear (pointer_table_t *table)
+{
+  free (table->entries);
+  table->entries = NULL;
+  table->capacity = 0;
+  table->used = 0;
+}
@@ -0,0 +1,406 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef POOL_DEQUE_SIZE
+#define POOL_DEQUE_SIZE 64
+#endif
+
+typedef struct {
+  void (*body) (size_t chunk, void *context);
+  void *context;
+  atomic_size_t remaining;
+  bool detached;
+} proto_pool_job_t;
+
+typedef struct {
+  proto_pool_job_t *job;
+  size_t begin;
+  size_t end;
+} proto_pool_task_t;
+
+/*
+ * Each worker owns a deque: it pushes and pops at the bottom, so it keeps
+ * working on the ranges it split last, while idle workers steal from the
+ * top, where the largest ranges are.
+ */
+typedef struct {
+  proto_pool_t *pool;
+  size_t id;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  proto_pool_task_t *tasks;
+  size_t capacity;
+  size_t top;
+  size_t bottom;
+} proto_pool_worker_t;
+
+struct proto_pool {
+  size_t workers;
+  proto_pool_worker_t *worker;
+  pthread_mutex_t lock;
+  pthread_cond_t work_available;
+  pthread_cond_t job_done;
+  atomic_size_t queued;
+  atomic_size_t next_worker;
+  bool shutdown;
+};
+
+static __thread proto_pool_worker_t *pool_current_worker = NULL;
+
+static bool
+pool_push (proto_pool_worker_t *worker,
+           proto_pool_task_t task)
+{
+  proto_pool_t *pool = worker->pool;
+
+  pthread_mutex_lock (&worker->lock);
+  if (worker->bottom - worker->top == worker->capacity)
+    {
+      proto_pool_task_t *tasks;
+      size_t i, length = worker->bottom - worker->top;
+
+      tasks = (proto_pool_task_t *) malloc (2 * worker->capacity * sizeof (proto_pool_task_t));
+      if (!tasks)
+        {
+          pthread_mutex_unlock (&worker->lock);
+          return false;
+        }
+      for (i = 0; i < length; i++)
+        tasks[i] = worker->tasks[(worker->top + i) % worker->capacity];
+      free (worker->tasks);
+      worker->tasks = tasks;
+      worker->capacity *= 2;
+      worker->top = 0;
+      worker->bottom = length;
+    }
+  worker->tasks[worker->bottom++ % worker->capacity] = task;
+  pthread_mutex_unlock (&worker->lock);
+  atomic_fetch_add (&pool->queued, 1);
+  pthread_mutex_lock (&pool->lock);
+  pthread_cond_signal (&pool->work_available);
+  pthread_mutex_unlock (&pool->lock);
+  return true;
+}
+
+static bool
+pool_take (proto_pool_worker_t *worker,
+           proto_pool_task_t *task,
+           bool from_top)
+{
+  bool found = false;
+
+  pthread_mutex_lock (&worker->lock);
+  if (worker->bottom != worker->top)
+    {
+      if (from_top)
+        *task = worker->tasks[worker->top++ % worker->capacity];
+      else
+        *task = worker->tasks[--worker->bottom % worker->capacity];
+      found = true;
+    }
+  pthread_mutex_unlock (&worker->lock);
+  if (found)
+    atomic_fetch_sub (&worker->pool->queued, 1);
+  return found;
+}
+
+static bool
+pool_find_task (proto_pool_worker_t *self,
+                proto_pool_task_t *task)
+{
+  proto_pool_t *pool = self->pool;
+  size_t i;
+
+  if (pool_take (self, task, false))
+    return true;
+  for (i = 1; i < pool->workers; i++)
+    if (pool_take (&pool->worker[(self->id + i) % pool->workers], task, true))
+      return true;
+  return false;
+}
+
+static void
+pool_finish (proto_pool_t *pool,
+             proto_pool_job_t *job,
+             size_t chunks)
+{
+  // A waited job lives on the waiter's stack, gone once remaining hits zero
+  bool detached = job->detached;
+
+  if (atomic_fetch_sub (&job->remaining, chunks) != chunks)
+    return;
+  // Nobody waits for a detached job: it's freed by whoever finishes it
+  if (detached)
+    {
+      free (job);
+      return;
+    }
+  pthread_mutex_lock (&pool->lock);
+  pthread_cond_broadcast (&pool->job_done);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/*
+ * Splits the range in halves, leaving the upper ones for thieves, until a
+ * single chunk is left to run. If a half can't be queued, it's run here.
+ */
+static void
+pool_execute (proto_pool_worker_t *self,
+              proto_pool_task_t task)
+{
+  proto_pool_job_t *job = task.job;
+  size_t chunk;
+
+  while (task.end - task.begin > 1)
+    {
+      proto_pool_task_t upper = task;
+
+      upper.begin = task.begin + (task.end - task.begin) / 2;
+      if (!pool_push (self, upper))
+        break;
+      task.end = upper.begin;
+    }
+  for (chunk = task.begin; chunk < task.end; chunk++)
+    job->body (chunk, job->context);
+  pool_finish (self->pool, job, task.end - task.begin);
+}
+
+static void *
+pool_worker_loop (void *argument)
+{
+  proto_pool_worker_t *self = (proto_pool_worker_t *) argument;
+  proto_pool_t *pool = self->pool;
+  proto_pool_task_t task;
+
+  pool_current_worker = self;
+  for (;;)
+    {
+      if (pool_find_task (self, &task))
+        {
+          pool_execute (self, task);
+          continue;
+        }
+      pthread_mutex_lock (&pool->lock);
+      while (!atomic_load (&pool->queued) && !pool->shutdown)
+        pthread_cond_wait (&pool->work_available, &pool->lock);
+      if (pool->shutdown && !atomic_load (&pool->queued))
+        {
+          pthread_mutex_unlock (&pool->lock);
+          break;
+        }
+      pthread_mutex_unlock (&pool->lock);
+    }
+  return NULL;
+}
+
+/*
+ * Runs body once for every chunk in [0, chunks) and returns when all are
+ * done. Without a pool the chunks run in order on the calling thread.
+ */
+void
+pool_run (proto_pool_t *pool,
+          size_t chunks,
+          void (*body) (size_t chunk, void *context),
+          void *context)
+{
+  proto_pool_job_t job;
+  proto_pool_task_t task;
+  proto_pool_worker_t *self = pool_current_worker;
+  size_t chunk;
+
+  if (pool == NULL || chunks < 2)
+    {
+      for (chunk = 0; chunk < chunks; chunk++)
+        body (chunk, context);
+      return;
+    }
+  job.body = body;
+  job.context = context;
+  job.detached = false;
+  atomic_init (&job.remaining, chunks);
+  task.job = &job;
+  task.begin = 0;
+  task.end = chunks;
+  if (self != NULL && self->pool == pool)
+    {
+      // Nested call from one of our workers: help until the job is done
+      pool_execute (self, task);
+      while (atomic_load (&job.remaining))
+        if (pool_find_task (self, &task))
+          pool_execute (self, task);
+        else
+          sched_yield ();
+      return;
+    }
+  chunk = atomic_fetch_add (&pool->next_worker, 1) % pool->workers;
+  if (!pool_push (&pool->worker[chunk], task))
+    {
+      for (chunk = 0; chunk < chunks; chunk++)
+        body (chunk, context);
+      return;
+    }
+  pthread_mutex_lock (&pool->lock);
+  while (atomic_load (&job.remaining))
+    pthread_cond_wait (&pool->job_done, &pool->lock);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/*
+ * Queues body to run once on the pool and returns without waiting for it;
+ * false when it couldn't be queued, so the caller may run it itself.
+ */
+bool
+pool_spawn (proto_pool_t *pool,
+            void (*body) (size_t chunk, void *context),
+            void *context)
+{
+  proto_pool_worker_t *self = pool_current_worker;
+  proto_pool_job_t *job;
+  proto_pool_task_t task;
+
+  if (pool == NULL)
+    return false;
+  job = (proto_pool_job_t *) malloc (sizeof (proto_pool_job_t));
+  if (!job)
+    return false;
+  job->body = body;
+  job->context = context;
+  job->detached = true;
+  atomic_init (&job->remaining, 1);
+  task.job = job;
+  task.begin = 0;
+  task.end = 1;
+  if (self == NULL || self->pool != pool)
+    self = &pool->worker[atomic_fetch_add (&pool->next_worker, 1) % pool->workers];
+  if (!pool_push (self, task))
+    {
+      free (job);
+      return false;
+    }
+  return true;
+}
+
+/*
+ * Lets one of the pool's workers run a queued task while it waits on
+ * something else, so waiting inside a task can't starve the pool. False
+ * when called from another thread or there's nothing to run.
+ */
+bool
+pool_help (proto_pool_t *pool)
+{
+  proto_pool_worker_t *self = pool_current_worker;
+  proto_pool_task_t task;
+
+  if (pool == NULL || self == NULL || self->pool != pool || !pool_find_task (self, &task))
+    return false;
+  pool_execute (self, task);
+  return true;
+}
+
+static void
+pool_free (proto_pool_t *pool,
+           size_t started)
+{
+  size_t i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast (&pool->work_available);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < started; i++)
+    pthread_join (pool->worker[i].thread, NULL);
+  for (i = 0; i < pool->workers; i++)
+    {
+      pthread_mutex_destroy (&pool->worker[i].lock);
+      free (pool->worker[i].tasks);
+    }
+  pthread_cond_destroy (&pool->job_done);
+  pthread_cond_destroy (&pool->work_available);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->worker);
+  free (pool);
+}
+
+proto_pool_t *
+proto_init_pool (size_t workers)
+{
+  proto_pool_t *pool;
+  size_t i;
+
+  if (workers == 0)
+    {
+      long online = sysconf (_SC_NPROCESSORS_ONLN);
+      workers = online > 0 ? (size_t) online : 1;
+    }
+  pool = (proto_pool_t *) malloc (sizeof (proto_pool_t));
+  if (!pool)
+    return NULL;
+  pool->worker = (proto_pool_worker_t *) calloc (workers, sizeof (proto_pool_worker_t));
+  if (!pool->worker)
+    {
+      free (pool);
+      return NULL;
+    }
+  pool->workers = workers;
+  pool->shutdown = false;
+  atomic_init (&pool->queued, 0);
+  atomic_init (&pool->next_worker, 0);
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work_available, NULL);
+  pthread_cond_init (&pool->job_done, NULL);
+  for (i = 0; i < workers; i++)
+    {
+      proto_pool_worker_t *worker = &pool->worker[i];
+
+      worker->pool = pool;
+      worker->id = i;
+      worker->capacity = POOL_DEQUE_SIZE;
+      worker->top = 0;
+      worker->bottom = 0;
+      worker->tasks = (proto_pool_task_t *) malloc (POOL_DEQUE_SIZE * sizeof (proto_pool_task_t));
+      pthread_mutex_init (&worker->lock, NULL);
+      if (!worker->tasks)
+        {
+          pool_free (pool, 0);
+          return NULL;
+        }
+    }
+  // Workers only start once every deque exists, since they steal from all
+  for (i = 0; i < workers; i++)
+    if (pthread_create (&pool->worker[i].thread, NULL, &pool_worker_loop, &pool->worker[i]))
+      {
+        pool_free (pool, i);
+        return NULL;
+      }
+  return pool;
+}
+
+size_t
+proto_pool_workers (const proto_pool_t *pool)
+{
+  if (pool == NULL)
+    return 1;
+  return pool->workers;
+}
+
+void
+proto_del_pool (proto_pool_t *pool)
+{
+  if (pool == NULL)
+    return;
+  pool_free (pool, pool->workers);
+}
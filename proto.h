@@ -90,8 +90,46 @@ typedef struct {
   const void *(*execute_property) (void *self, const char *key, const void *arguments);
   void (*set_super) (void *self, const void *reference);
   void (*merge) (void *self, const void *reference);
+  void *memos;
+  const void *shape;
+  void **slots;
+  void *heap;
+  void *refs;
 } proto_object_t;
 
+typedef struct {
+  const char *key;
+  const void *value;
+} proto_object_entry_t;
+
+/*
+ * A property key with its hash worked out ahead of time, so keyed access
+ * skips hashing it. In C, PROTO_KEY (name) takes one from the table of
+ * PROTO_KEY_<name> macros that proto_keys.py generates; in C++, use the
+ * "name"_pk literal from proto.hpp.
+ */
+typedef struct {
+  const char *name;
+  unsigned long hash;
+} proto_key_t;
+
+#define PROTO_KEY_INIT(name, hash) { (name), (hash) }
+#define PROTO_KEY(name) (&(const proto_key_t) PROTO_KEY_##name)
+
+/*
+ * A fixed set of keys. Objects made from a shape always have them, each in
+ * the slot numbered by its place in keys, which proto_object_slot reads
+ * without hashing or comparing.
+ */
+typedef struct {
+  size_t length;
+  const proto_key_t *keys;
+} proto_shape_t;
+
+#define PROTO_SHAPE_INIT(keys) { sizeof (keys) / sizeof ((keys)[0]), (keys) }
+
+typedef int (*proto_compare_t) (const void *a, const void *b);
+
 typedef struct {
   size_t allocated;
   size_t length;
@@ -109,8 +147,112 @@ typedef struct {
   const void *(*last) (const void *self);
   void (*concat) (void *self, const void *list);
   void *(*reverse) (const void *self);
+  proto_compare_t compare;
+  void *hash_index;
+  void *chunks;
+  void *heap;
+  void *refs;
 } proto_array_t;
 
+typedef struct {
+  const proto_array_t *array;
+  size_t offset;
+  size_t length;
+  ptrdiff_t stride;
+  const void *(*at) (const void *self, size_t position);
+  const void *(*first) (const void *self);
+  const void *(*last) (const void *self);
+  void (*each) (const void *self,
+                void (*callback) (const void *element, size_t position, void *context),
+                void *context);
+  void *(*to_array) (const void *self);
+} proto_array_view_t;
+
+typedef struct proto_pool proto_pool_t;
+
+typedef struct proto_queue proto_queue_t;
+
+typedef struct proto_vector proto_vector_t;
+
+typedef struct proto_vector_builder proto_vector_builder_t;
+
+typedef struct proto_pipeline proto_pipeline_t;
+
+typedef struct proto_mapped_array proto_mapped_array_t;
+
+typedef struct proto_external_sort proto_external_sort_t;
+
+typedef struct proto_signature proto_signature_t;
+
+typedef struct proto_frame proto_frame_t;
+
+typedef struct proto_future proto_future_t;
+
+typedef struct proto_memo proto_memo_t;
+
+typedef struct proto_heap proto_heap_t;
+
+/*
+ * A column of call arguments: either values, a C array of the type its
+ * signature conversion names (double, long, char *, bool, or a pointer), or
+ * an array of proto_data_t.
+ */
+typedef struct {
+  const void *values;
+  const proto_array_t *array;
+} proto_column_t;
+
+#define PROTO_STATS_HISTOGRAM 16
+
+/*
+ * Operation counters of the calling thread, kept only when the library is
+ * built with PROTO_STATS (./configure --enable-stats). Probes are the tree
+ * nodes lookups visited, so probes / lookups is the mean lookup depth.
+ */
+typedef struct {
+  size_t allocations;
+  size_t bytes;
+  size_t lookups;
+  size_t comparisons;
+  size_t probes;
+  size_t resizes;
+  size_t calls;
+} proto_stats_t;
+
+/*
+ * The shape of an object's buckets: occupancy[n] counts the buckets holding
+ * n keys and depths[n] the keys n nodes down their bucket's tree; the last
+ * slot of each histogram counts everything from there on.
+ */
+typedef struct {
+  size_t buckets;
+  size_t used_buckets;
+  size_t keys;
+  size_t max_depth;
+  size_t occupancy[PROTO_STATS_HISTOGRAM];
+  size_t depths[PROTO_STATS_HISTOGRAM];
+} proto_object_stats_t;
+
+typedef struct {
+  size_t length;
+  size_t capacity;
+  bool chunked;
+  bool indexed;
+} proto_array_stats_t;
+
+typedef struct proto_histogram proto_histogram_t;
+
+/*
+ * What a latency histogram times: execute_property by key, and
+ * proto_generic_caller by format and called function, whole and its boxing
+ * and unboxing alone.
+ */
+typedef enum {
+  PROTO_LATENCY_PROPERTY,
+  PROTO_LATENCY_CALL,
+  PROTO_LATENCY_BOXING
+} proto_latency_kind_t;
+
 proto_data_t *
 proto_decimal (double data);
 
@@ -144,16 +286,532 @@ proto_init_object ();
 void
 proto_del_object (proto_object_t *object);
 
+const void *
+proto_get_own_property (const void *self, const char *key);
+
 proto_array_t *
 proto_init_array ();
 
+proto_array_t *
+proto_init_chunked_array ();
+
 void
 proto_del_array (proto_array_t *array);
 
+void
+proto_init_array_view (proto_array_view_t *view, const proto_array_t *array,
+                       size_t offset, size_t length, ptrdiff_t stride);
+
+void
+proto_array_reverse_view (proto_array_view_t *view, const proto_array_t *array);
+
+void
+proto_array_sort (proto_array_t *array, proto_compare_t compare);
+
+size_t
+proto_array_bsearch (const proto_array_t *array, const void *element,
+                     proto_compare_t compare);
+
+void
+proto_array_keep_sorted (proto_array_t *array, proto_compare_t compare);
+
+void
+proto_array_hash_index (proto_array_t *array, bool enabled);
+
+proto_array_t *
+proto_array_unique (const proto_array_t *array);
+
+proto_array_t *
+proto_array_union (const proto_array_t *array, const proto_array_t *another);
+
+proto_array_t *
+proto_array_intersection (const proto_array_t *array,
+                          const proto_array_t *another);
+
+proto_array_t *
+proto_array_difference (const proto_array_t *array,
+                        const proto_array_t *another);
+
+proto_pool_t *
+proto_init_pool (size_t workers);
+
+size_t
+proto_pool_workers (const proto_pool_t *pool);
+
+void
+proto_del_pool (proto_pool_t *pool);
+
+void
+proto_array_parallel_for (proto_pool_t *pool, const proto_array_t *array,
+                          void (*function) (const void *element, size_t position,
+                                            void *context),
+                          void *context);
+
+proto_array_t *
+proto_array_parallel_map (proto_pool_t *pool, const proto_array_t *array,
+                          const void *(*function) (const void *element,
+                                                   void *context),
+                          void *context);
+
+proto_array_t *
+proto_array_parallel_filter (proto_pool_t *pool, const proto_array_t *array,
+                             bool (*predicate) (const void *element,
+                                                void *context),
+                             void *context);
+
+bool
+proto_array_parallel_reduce (proto_pool_t *pool, const proto_array_t *array,
+                             void *accumulator, size_t size,
+                             void (*fold) (void *accumulator,
+                                           const void *element, void *context),
+                             void (*combine) (void *accumulator,
+                                              const void *partial, void *context),
+                             void *context);
+
+proto_queue_t *
+proto_init_queue (size_t capacity);
+
+void
+proto_queue_push (proto_queue_t *queue, const void *element);
+
+bool
+proto_queue_try_push (proto_queue_t *queue, const void *element);
+
+const void *
+proto_queue_shift (proto_queue_t *queue);
+
+const void *
+proto_queue_try_shift (proto_queue_t *queue);
+
+size_t
+proto_queue_length (const proto_queue_t *queue);
+
+void
+proto_del_queue (proto_queue_t *queue);
+
+proto_vector_t *
+proto_init_vector ();
+
+void
+proto_del_vector (proto_vector_t *vector);
+
+size_t
+proto_vector_length (const proto_vector_t *vector);
+
+const void *
+proto_vector_at (const proto_vector_t *vector, size_t position);
+
+proto_vector_t *
+proto_vector_push (const proto_vector_t *vector, const void *element);
+
+proto_vector_t *
+proto_vector_set (const proto_vector_t *vector, size_t position,
+                  const void *element);
+
+proto_vector_t *
+proto_vector_pop (const proto_vector_t *vector);
+
+proto_vector_t *
+proto_vector_concat (const proto_vector_t *vector,
+                     const proto_vector_t *another);
+
+proto_vector_t *
+proto_vector_slice (const proto_vector_t *vector, size_t begin, size_t end);
+
+proto_vector_t *
+proto_vector_from_array (const proto_array_t *array);
+
+proto_array_t *
+proto_vector_to_array (const proto_vector_t *vector);
+
+proto_vector_builder_t *
+proto_init_vector_builder (const proto_vector_t *vector);
+
+bool
+proto_vector_builder_push (proto_vector_builder_t *builder,
+                           const void *element);
+
+bool
+proto_vector_builder_set (proto_vector_builder_t *builder, size_t position,
+                          const void *element);
+
+bool
+proto_vector_builder_pop (proto_vector_builder_t *builder);
+
+proto_vector_t *
+proto_vector_builder_finish (proto_vector_builder_t *builder);
+
+proto_pipeline_t *
+proto_pipeline_from_array (const proto_array_t *array);
+
+proto_pipeline_t *
+proto_pipeline_from_buffer (const void *buffer, size_t length, size_t size);
+
+proto_pipeline_t *
+proto_pipeline_from_object (const proto_object_t *object);
+
+proto_pipeline_t *
+proto_pipeline_map (proto_pipeline_t *pipeline,
+                    const void *(*function) (const void *element,
+                                             void *context),
+                    void *context);
+
+proto_pipeline_t *
+proto_pipeline_filter (proto_pipeline_t *pipeline,
+                       bool (*predicate) (const void *element, void *context),
+                       void *context);
+
+proto_pipeline_t *
+proto_pipeline_take (proto_pipeline_t *pipeline, size_t count);
+
+proto_pipeline_t *
+proto_pipeline_skip (proto_pipeline_t *pipeline, size_t count);
+
+proto_pipeline_t *
+proto_pipeline_zip (proto_pipeline_t *pipeline, proto_pipeline_t *another,
+                    const void *(*combine) (const void *element,
+                                            const void *other, void *context),
+                    void *context);
+
+bool
+proto_pipeline_next (proto_pipeline_t *pipeline, const void **element);
+
+void
+proto_pipeline_each (proto_pipeline_t *pipeline,
+                     void (*callback) (const void *element, size_t position,
+                                       void *context),
+                     void *context);
+
+proto_array_t *
+proto_pipeline_collect (proto_pipeline_t *pipeline);
+
+void
+proto_del_pipeline (proto_pipeline_t *pipeline);
+
+proto_mapped_array_t *
+proto_init_mapped_array (const char *path, size_t size);
+
+size_t
+proto_mapped_array_length (const proto_mapped_array_t *array);
+
+void *
+proto_mapped_array_at (const proto_mapped_array_t *array, size_t position);
+
+bool
+proto_mapped_array_reserve (proto_mapped_array_t *array, size_t capacity);
+
+bool
+proto_mapped_array_push (proto_mapped_array_t *array, const void *record);
+
+void
+proto_mapped_array_each (const proto_mapped_array_t *array,
+                         size_t begin,
+                         size_t end,
+                         void (*callback) (const void *record, size_t position, void *context),
+                         void *context);
+
+bool
+proto_mapped_array_sync (proto_mapped_array_t *array);
+
+bool
+proto_mapped_array_flush (proto_mapped_array_t *array);
+
+void
+proto_del_mapped_array (proto_mapped_array_t *array);
+
+proto_external_sort_t *
+proto_init_external_sort (size_t size, proto_compare_t compare, size_t budget);
+
+bool
+proto_external_sort_push (proto_external_sort_t *sorter, const void *record);
+
+bool
+proto_external_sort_push_array (proto_external_sort_t *sorter, const proto_array_t *array);
+
+size_t
+proto_external_sort_length (const proto_external_sort_t *sorter);
+
+bool
+proto_external_sort_each (proto_external_sort_t *sorter,
+                          void (*callback) (const void *record, size_t position, void *context),
+                          void *context);
+
+bool
+proto_external_sort_to_mapped (proto_external_sort_t *sorter, proto_mapped_array_t *output);
+
+void
+proto_del_external_sort (proto_external_sort_t *sorter);
+
+int
+proto_compare_integer (const void *a, const void *b);
+
+int
+proto_compare_decimal (const void *a, const void *b);
+
 void *
 proto_generic_caller (const char *arguments,
                       void *(*function) (const void *arguments), ...);
 
+proto_signature_t *
+proto_signature_compile (const char *arguments);
+
+size_t
+proto_signature_length (const proto_signature_t *signature);
+
+void
+proto_del_signature (proto_signature_t *signature);
+
+void *
+proto_signature_call (const proto_signature_t *signature,
+                      void *(*function) (const void *arguments), ...);
+
+proto_frame_t *
+proto_init_frame (const proto_signature_t *signature);
+
+void *
+proto_signature_call_frame (const proto_signature_t *signature,
+                            proto_frame_t *frame,
+                            void *(*function) (const void *arguments), ...);
+
+void
+proto_del_frame (proto_frame_t *frame);
+
+proto_future_t *
+proto_signature_call_async (proto_pool_t *pool,
+                            const proto_signature_t *signature,
+                            void *(*function) (const void *arguments), ...);
+
+proto_future_t *
+proto_generic_call_async (proto_pool_t *pool,
+                          const char *arguments,
+                          void *(*function) (const void *arguments), ...);
+
+proto_future_t *
+proto_execute_property_async (proto_pool_t *pool,
+                              proto_object_t *object,
+                              const char *key,
+                              const void *arguments);
+
+void *
+proto_future_wait (proto_future_t *future);
+
+bool
+proto_future_poll (proto_future_t *future, void **result);
+
+bool
+proto_future_then (proto_future_t *future,
+                   void (*callback) (void *result, void *context),
+                   void *context);
+
+void
+proto_future_wait_all (proto_future_t *const *futures, size_t length);
+
+size_t
+proto_future_wait_any (proto_future_t *const *futures, size_t length);
+
+void
+proto_del_future (proto_future_t *future);
+
+proto_memo_t *
+proto_init_memo (void *(*function) (const void *arguments),
+                 size_t capacity,
+                 void (*release) (void *result));
+
+void *
+proto_memo_call (proto_memo_t *memo, const void *arguments);
+
+void *
+proto_memo_call_signature (proto_memo_t *memo, const proto_signature_t *signature, ...);
+
+size_t
+proto_memo_hits (const proto_memo_t *memo);
+
+size_t
+proto_memo_misses (const proto_memo_t *memo);
+
+size_t
+proto_memo_length (const proto_memo_t *memo);
+
+bool
+proto_memo_invalidate (proto_memo_t *memo, const void *arguments);
+
+void
+proto_memo_clear (proto_memo_t *memo);
+
+void
+proto_del_memo (proto_memo_t *memo);
+
+bool
+proto_object_memoize (proto_object_t *object,
+                      const char *key,
+                      size_t capacity,
+                      void (*release) (void *result));
+
+proto_memo_t *
+proto_object_memo (const proto_object_t *object, const char *key);
+
+proto_array_t *
+proto_signature_call_rows (const proto_signature_t *signature,
+                           void *(*function) (const void *arguments),
+                           const proto_column_t *columns,
+                           size_t rows);
+
+proto_array_t *
+proto_signature_call_batch (const proto_signature_t *signature,
+                            void (*function) (const void *const *columns, size_t rows, void **results),
+                            const proto_column_t *columns,
+                            size_t rows);
+
+bool
+proto_stats_enabled ();
+
+bool
+proto_stats_read (proto_stats_t *stats);
+
+void
+proto_stats_reset ();
+
+bool
+proto_object_stats (const proto_object_t *object, proto_object_stats_t *stats);
+
+bool
+proto_array_stats (const proto_array_t *array, proto_array_stats_t *stats);
+
+proto_object_t *
+proto_init_shaped_object (const proto_shape_t *shape);
+
+const proto_shape_t *
+proto_object_shape (const proto_object_t *object);
+
+void
+proto_object_set_slot (proto_object_t *object, size_t slot, const void *value);
+
+const void *
+proto_object_get_key (const proto_object_t *object, const proto_key_t *key);
+
+bool
+proto_object_has_key (const proto_object_t *object, const proto_key_t *key);
+
+void
+proto_object_set_key (proto_object_t *object, const proto_key_t *key, const void *value);
+
+size_t
+proto_object_memory_usage (const proto_object_t *object);
+
+size_t
+proto_array_memory_usage (const proto_array_t *array);
+
+proto_heap_t *
+proto_init_heap ();
+
+void
+proto_del_heap (proto_heap_t *heap);
+
+proto_object_t *
+proto_heap_object (proto_heap_t *heap);
+
+proto_array_t *
+proto_heap_array (proto_heap_t *heap);
+
+proto_data_t *
+proto_heap_data (proto_heap_t *heap, proto_data_t data);
+
+bool
+proto_heap_root (proto_heap_t *heap, const void *pointer);
+
+bool
+proto_heap_unroot (proto_heap_t *heap, const void *pointer);
+
+void
+proto_heap_barrier (proto_heap_t *heap, const void *value);
+
+void
+proto_heap_set_budget (proto_heap_t *heap, size_t budget);
+
+bool
+proto_heap_step (proto_heap_t *heap, size_t budget);
+
+size_t
+proto_heap_collect (proto_heap_t *heap);
+
+size_t
+proto_heap_count (const proto_heap_t *heap);
+
+bool
+proto_heap_collecting (const proto_heap_t *heap);
+
+proto_object_t *
+proto_counted_object ();
+
+proto_array_t *
+proto_counted_array ();
+
+proto_data_t *
+proto_counted_data (proto_data_t data);
+
+void
+proto_retain (const void *value);
+
+void
+proto_release (const void *value);
+
+bool
+proto_share (const void *value);
+
+size_t
+proto_references (const void *value);
+
+size_t
+proto_refs_drain (size_t budget);
+
+size_t
+proto_refs_collect_cycles ();
+
+proto_histogram_t *
+proto_init_histogram ();
+
+void
+proto_histogram_record (proto_histogram_t *histogram, size_t value);
+
+size_t
+proto_histogram_count (const proto_histogram_t *histogram);
+
+size_t
+proto_histogram_min (const proto_histogram_t *histogram);
+
+size_t
+proto_histogram_max (const proto_histogram_t *histogram);
+
+size_t
+proto_histogram_percentile (const proto_histogram_t *histogram, double percentile);
+
+bool
+proto_histogram_merge (proto_histogram_t *into, const proto_histogram_t *from);
+
+char *
+proto_histogram_dump (const proto_histogram_t *histogram);
+
+void
+proto_histogram_reset (proto_histogram_t *histogram);
+
+void
+proto_del_histogram (proto_histogram_t *histogram);
+
+void
+proto_latency_enable (bool enabled);
+
+bool
+proto_latency_enabled ();
+
+const proto_histogram_t *
+proto_latency_histogram (proto_latency_kind_t kind, const char *name, const void *function);
+
+char *
+proto_latency_dump ();
+
+void
+proto_latency_reset ();
+
 static inline void *
 proto_data_value (proto_data_t *data)
 {
@@ -180,7 +838,7 @@ proto_data_value (proto_data_t *data)
         return &data->data.boolean;
         break;
       case function_t:
-        return data->data.function;
+        return (void *) data->data.function;
         break;
       case pointer_t:
         return data->data.pointer;
@@ -189,6 +847,87 @@ proto_data_value (proto_data_t *data)
   return NULL;
 }
 
+/*
+ * Direct calls for tight loops, which the compiler can inline where the
+ * function pointers would need an indirect call per access. Arrays take
+ * the fast path while they're flat, unsorted and unindexed, and otherwise
+ * fall back to their function pointers, as objects do when their
+ * get_own_property was replaced.
+ */
+static inline size_t
+proto_array_length (const proto_array_t *array)
+{
+  return array == NULL ? 0 : array->length;
+}
+
+static inline const void *
+proto_array_at (const proto_array_t *array,
+                size_t position)
+{
+  if (array == NULL || position >= array->length)
+    return NULL;
+  if (array->chunks == NULL)
+    return array->items[position];
+  return array->at (array, position);
+}
+
+static inline void
+proto_array_push_fast (proto_array_t *array,
+                       const void *element)
+{
+  if (array == NULL)
+    return;
+  if (array->length < array->allocated && array->chunks == NULL
+      && array->compare == NULL && array->hash_index == NULL
+      && array->heap == NULL && array->refs == NULL)
+    array->items[array->length++] = (void *) element;
+  else
+    array->push (array, element);
+}
+
+static inline const void *
+proto_object_get (const proto_object_t *object,
+                  const char *key)
+{
+  if (object == NULL || key == NULL)
+    return NULL;
+  if (object->get_own_property == &proto_get_own_property)
+    return proto_get_own_property (object, key);
+  return object->get_own_property (object, key);
+}
+
+// The hash objects use for their keys (djb2), and the one keys carry
+static inline unsigned long
+proto_key_hash (const char *name)
+{
+  unsigned long hash = 5381;
+  int c;
+
+  while ((c = *name++))
+    hash = ((hash << 5) + hash) + c;
+  return hash;
+}
+
+static inline proto_key_t
+proto_key (const char *name)
+{
+  proto_key_t key = { name, name == NULL ? 0 : proto_key_hash (name) };
+
+  return key;
+}
+
+/*
+ * A shaped object's slot points at the key's entry, so a read is three
+ * dependent loads (the slots, the slot, the entry's value) and no lookup.
+ * The slot must be below the shape's length; nothing is checked.
+ */
+static inline const void *
+proto_object_slot (const proto_object_t *object,
+                   size_t slot)
+{
+  return ((const proto_object_entry_t *) object->slots[slot])->value;
+}
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,569 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+// Header-only C++17 layer over proto.h: owning, move-only objects and
+// arrays, typed accessors, range-for and keys hashed at compile time.
+// Everything is inline and comes down to the same calls a C caller would
+// make.
+
+#ifndef __proto_library_hpp__
+#define __proto_library_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "proto.h"
+
+namespace proto
+{
+
+namespace detail
+{
+
+/*
+ * Values travel through proto as pointers. Pointers go as they are;
+ * other trivially copyable values that fit in one, like long, double or
+ * bool, go in the pointer's bits, so they're never boxed on the heap.
+ * A value set from C++ must be read back as the same type.
+ */
+template <typename T>
+inline constexpr bool is_storable_v = std::is_pointer_v<T> || std::is_null_pointer_v<T>
+  || (std::is_trivially_copyable_v<T> && sizeof (T) <= sizeof (void *));
+
+template <typename T>
+inline const void *
+pack (T value) noexcept
+{
+  static_assert (is_storable_v<T>, "proto stores pointers, or values no larger than one");
+  if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>)
+    return (const void *) value;
+  else
+    {
+      std::uintptr_t bits = 0;
+
+      std::memcpy (&bits, &value, sizeof (T));
+      return reinterpret_cast<const void *> (bits);
+    }
+}
+
+template <typename T>
+inline T
+unpack (const void *pointer) noexcept
+{
+  static_assert (is_storable_v<T>, "proto stores pointers, or values no larger than one");
+  if constexpr (std::is_pointer_v<T>)
+    return (T) pointer;
+  else
+    {
+      std::uintptr_t bits = reinterpret_cast<std::uintptr_t> (pointer);
+      std::remove_cv_t<T> value;
+
+      std::memcpy (&value, &bits, sizeof (T));
+      return value;
+    }
+}
+
+// proto_key_hash, at compile time
+constexpr unsigned long
+key_hash (const char *name,
+          std::size_t length) noexcept
+{
+  unsigned long hash = 5381;
+
+  for (std::size_t i = 0; i < length; i++)
+    hash = ((hash << 5) + hash) + static_cast<int> (name[i]);
+  return hash;
+}
+
+constexpr bool
+same_name (const char *a,
+           const char *b) noexcept
+{
+  while (*a != '\0' && *a == *b)
+    {
+      a++;
+      b++;
+    }
+  return *a == *b;
+}
+
+} // namespace detail
+
+inline namespace literals
+{
+
+// "name"_pk is the key with its hash worked out by the compiler
+constexpr proto_key_t
+operator""_pk (const char *name,
+               std::size_t length) noexcept
+{
+  return proto_key_t { name, detail::key_hash (name, length) };
+}
+
+} // namespace literals
+
+/*
+ * The slot of key in a shape's keys, or the number of keys when it isn't
+ * one of them; a constant when the keys are constexpr:
+ *
+ *   static constexpr proto_key_t user_keys[] = { "id"_pk, "name"_pk };
+ *   static constexpr proto_shape_t user_shape = PROTO_SHAPE_INIT (user_keys);
+ *   constexpr std::size_t user_name = proto::slot_of (user_keys, "name"_pk);
+ */
+template <std::size_t N>
+constexpr std::size_t
+slot_of (const proto_key_t (&keys)[N],
+         const proto_key_t &key) noexcept
+{
+  for (std::size_t i = 0; i < N; i++)
+    if (keys[i].hash == key.hash && detail::same_name (keys[i].name, key.name))
+      return i;
+  return N;
+}
+
+// Typed, non-owning view over an array's elements
+template <typename T>
+class array_view
+{
+public:
+  class iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = T;
+
+    iterator (const proto_array_t *array,
+              std::size_t position) noexcept
+      : array (array), position (position)
+    {
+    }
+
+    T
+    operator* () const noexcept
+    {
+      return detail::unpack<T> (proto_array_at (array, position));
+    }
+
+    iterator &
+    operator++ () noexcept
+    {
+      position++;
+      return *this;
+    }
+
+    iterator
+    operator++ (int) noexcept
+    {
+      iterator previous = *this;
+
+      position++;
+      return previous;
+    }
+
+    bool
+    operator== (const iterator &other) const noexcept
+    {
+      return position == other.position && array == other.array;
+    }
+
+    bool
+    operator!= (const iterator &other) const noexcept
+    {
+      return !(*this == other);
+    }
+
+  private:
+    const proto_array_t *array;
+    std::size_t position;
+  };
+
+  explicit array_view (const proto_array_t *array) noexcept
+    : handle (array)
+  {
+  }
+
+  std::size_t
+  size () const noexcept
+  {
+    return proto_array_length (handle);
+  }
+
+  bool
+  empty () const noexcept
+  {
+    return size () == 0;
+  }
+
+  T
+  operator[] (std::size_t position) const noexcept
+  {
+    return detail::unpack<T> (proto_array_at (handle, position));
+  }
+
+  iterator
+  begin () const noexcept
+  {
+    return iterator (handle, 0);
+  }
+
+  iterator
+  end () const noexcept
+  {
+    return iterator (handle, size ());
+  }
+
+private:
+  const proto_array_t *handle;
+};
+
+// Owns a proto_object_t and deletes it when it goes out of scope
+class object
+{
+public:
+  object ()
+    : handle (proto_init_object ())
+  {
+    if (handle == nullptr)
+      throw std::bad_alloc ();
+  }
+
+  // An object with the shape's keys in slots; the shape must outlive it
+  explicit object (const proto_shape_t &shape)
+    : handle (proto_init_shaped_object (&shape))
+  {
+    if (handle == nullptr)
+      throw std::bad_alloc ();
+  }
+
+  // Takes over an object made by the C API
+  explicit object (proto_object_t *adopted) noexcept
+    : handle (adopted)
+  {
+  }
+
+  object (const object &) = delete;
+  object &operator= (const object &) = delete;
+
+  object (object &&other) noexcept
+    : handle (std::exchange (other.handle, nullptr))
+  {
+  }
+
+  object &
+  operator= (object &&other) noexcept
+  {
+    if (this != &other)
+      {
+        reset ();
+        handle = std::exchange (other.handle, nullptr);
+      }
+    return *this;
+  }
+
+  ~object ()
+  {
+    reset ();
+  }
+
+  proto_object_t *
+  native () const noexcept
+  {
+    return handle;
+  }
+
+  // Gives up ownership; the caller deletes the object
+  proto_object_t *
+  release () noexcept
+  {
+    return std::exchange (handle, nullptr);
+  }
+
+  void
+  reset () noexcept
+  {
+    if (handle != nullptr)
+      proto_del_object (handle);
+    handle = nullptr;
+  }
+
+  explicit operator bool () const noexcept
+  {
+    return handle != nullptr;
+  }
+
+  bool
+  has (const char *key) const
+  {
+    return handle != nullptr && key != nullptr && handle->has_own_property (handle, key);
+  }
+
+  // A value-initialized T when the key is missing
+  template <typename T>
+  T
+  get (const char *key) const
+  {
+    return detail::unpack<T> (proto_object_get (handle, key));
+  }
+
+  template <typename T>
+  void
+  set (const char *key,
+       T value)
+  {
+    if (handle != nullptr)
+      handle->set_own_property (handle, key, detail::pack (value));
+  }
+
+  bool
+  has (const proto_key_t &key) const
+  {
+    return proto_object_has_key (handle, &key);
+  }
+
+  template <typename T>
+  T
+  get (const proto_key_t &key) const
+  {
+    return detail::unpack<T> (proto_object_get_key (handle, &key));
+  }
+
+  template <typename T>
+  void
+  set (const proto_key_t &key,
+       T value)
+  {
+    proto_object_set_key (handle, &key, detail::pack (value));
+  }
+
+  // Slots of a shaped object; slot must be below the shape's length
+  template <typename T>
+  T
+  slot (std::size_t slot) const noexcept
+  {
+    return detail::unpack<T> (proto_object_slot (handle, slot));
+  }
+
+  template <typename T>
+  void
+  set_slot (std::size_t slot,
+            T value)
+  {
+    proto_object_set_slot (handle, slot, detail::pack (value));
+  }
+
+  void
+  del (const char *key)
+  {
+    if (handle != nullptr && key != nullptr)
+      handle->del_own_property (handle, key);
+  }
+
+  template <typename T>
+  T
+  get_chain (const char *keys) const
+  {
+    if (handle == nullptr || keys == nullptr)
+      return T ();
+    return detail::unpack<T> (handle->get_chain (handle, keys));
+  }
+
+  template <typename T>
+  void
+  set_chain (const char *keys,
+             T value)
+  {
+    if (handle != nullptr && keys != nullptr)
+      handle->set_chain (handle, keys, detail::pack (value));
+  }
+
+  void
+  merge (const object &other)
+  {
+    if (handle != nullptr && other.handle != nullptr)
+      handle->merge (handle, other.handle);
+  }
+
+  template <typename R = const void *>
+  R
+  execute (const char *key,
+           const void *arguments = nullptr)
+  {
+    if (handle == nullptr || key == nullptr)
+      return R ();
+    return detail::unpack<R> (handle->execute_property (handle, key, arguments));
+  }
+
+private:
+  proto_object_t *handle;
+};
+
+// Owns a proto_array_t; its elements stay the caller's
+class array
+{
+public:
+  array ()
+    : handle (proto_init_array ())
+  {
+    if (handle == nullptr)
+      throw std::bad_alloc ();
+  }
+
+  explicit array (proto_array_t *adopted) noexcept
+    : handle (adopted)
+  {
+  }
+
+  static array
+  chunked ()
+  {
+    proto_array_t *adopted = proto_init_chunked_array ();
+
+    if (adopted == nullptr)
+      throw std::bad_alloc ();
+    return array (adopted);
+  }
+
+  array (const array &) = delete;
+  array &operator= (const array &) = delete;
+
+  array (array &&other) noexcept
+    : handle (std::exchange (other.handle, nullptr))
+  {
+  }
+
+  array &
+  operator= (array &&other) noexcept
+  {
+    if (this != &other)
+      {
+        reset ();
+        handle = std::exchange (other.handle, nullptr);
+      }
+    return *this;
+  }
+
+  ~array ()
+  {
+    reset ();
+  }
+
+  proto_array_t *
+  native () const noexcept
+  {
+    return handle;
+  }
+
+  proto_array_t *
+  release () noexcept
+  {
+    return std::exchange (handle, nullptr);
+  }
+
+  void
+  reset () noexcept
+  {
+    if (handle != nullptr)
+      proto_del_array (handle);
+    handle = nullptr;
+  }
+
+  explicit operator bool () const noexcept
+  {
+    return handle != nullptr;
+  }
+
+  std::size_t
+  size () const noexcept
+  {
+    return proto_array_length (handle);
+  }
+
+  bool
+  empty () const noexcept
+  {
+    return size () == 0;
+  }
+
+  template <typename T>
+  void
+  push (T value)
+  {
+    proto_array_push_fast (handle, detail::pack (value));
+  }
+
+  template <typename T>
+  void
+  insert (std::size_t position,
+          T value)
+  {
+    if (handle != nullptr)
+      handle->insert (handle, position, detail::pack (value));
+  }
+
+  template <typename T>
+  T
+  at (std::size_t position) const noexcept
+  {
+    return detail::unpack<T> (proto_array_at (handle, position));
+  }
+
+  template <typename T>
+  T
+  pop ()
+  {
+    return handle == nullptr ? T () : detail::unpack<T> (handle->pop (handle));
+  }
+
+  template <typename T>
+  T
+  shift ()
+  {
+    return handle == nullptr ? T () : detail::unpack<T> (handle->shift (handle));
+  }
+
+  template <typename T>
+  bool
+  includes (T value) const
+  {
+    return handle != nullptr && handle->includes (handle, detail::pack (value));
+  }
+
+  template <typename T>
+  array_view<T>
+  as () const noexcept
+  {
+    return array_view<T> (handle);
+  }
+
+  // Iterating the array itself gives the elements as they're stored
+  array_view<const void *>::iterator
+  begin () const noexcept
+  {
+    return as<const void *> ().begin ();
+  }
+
+  array_view<const void *>::iterator
+  end () const noexcept
+  {
+    return as<const void *> ().end ();
+  }
+
+private:
+  proto_array_t *handle;
+};
+
+} // namespace proto
+
+#endif // __proto_library_hpp__
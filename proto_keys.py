@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# Copyright 2015 (c) Ewerton Assis
+#
+# Prints a C header with a PROTO_KEY_<name> macro per key, holding the key
+# and the hash objects give it, for PROTO_KEY (name) to use without hashing
+# at run time. With --shape NAME, it also declares a shape of those keys in
+# order: NAME_keys, NAME_shape, and NAME_<KEY> slot numbers.
+#
+#   proto_keys.py --shape user id name email > user_keys.h
+
+import re
+import sys
+
+HASH_MASK = (1 << 64) - 1
+
+
+# djb2, as proto_key_hash; unsigned long arithmetic wraps the same way,
+# and a 32-bit long keeps the low half
+def key_hash(key):
+    hash = 5381
+    for c in key.encode('ascii'):
+        hash = (hash * 33 + c) & HASH_MASK
+    return hash
+
+
+def identifier(key):
+    name = re.sub(r'[^A-Za-z0-9_]', '_', key)
+    if not name or name[0].isdigit():
+        name = '_' + name
+    return name
+
+
+def c_string(key):
+    return '"' + key.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def generate(keys, shape = None):
+    seen = {}
+    for key in keys:
+        try:
+            key.encode('ascii')
+        except UnicodeError:
+            raise ValueError("{0}: only ASCII keys hash the same everywhere".format(key))
+        if not key:
+            raise ValueError("keys can't be empty")
+        name = identifier(key)
+        if name in seen and seen[name] != key:
+            raise ValueError("{0} and {1} both make PROTO_KEY_{2}".format(seen[name], key, name))
+        if name in seen and shape is not None:
+            raise ValueError("{0}: a shape declares each key once".format(key))
+        seen[name] = key
+    lines = ['// Generated by proto_keys.py; do not edit', '', '#include <proto.h>', '']
+    for key in sorted(seen.values(), key = keys.index):
+        lines.append('#define PROTO_KEY_{0} PROTO_KEY_INIT ({1}, {2}UL)'.format(identifier(key), c_string(key), key_hash(key)))
+    if shape is not None:
+        prefix = identifier(shape)
+        slots = [identifier(key).upper() for key in keys]
+        if len(set(slots)) != len(slots):
+            raise ValueError("two keys make the same {0}_ slot name".format(prefix.upper()))
+        guard = 'PROTO_SHAPE_{0}'.format(prefix.upper())
+        lines[2:2] = ['#ifndef {0}'.format(guard), '#define {0}'.format(guard), '']
+        lines += ['', '#if defined (__GNUC__)', '#define PROTO_SHAPE_UNUSED __attribute__ ((unused))',
+                  '#else', '#define PROTO_SHAPE_UNUSED', '#endif', '', 'enum {']
+        lines += ['  {0}_{1},'.format(prefix.upper(), slot) for slot in slots]
+        lines += ['};', '', 'static const proto_key_t {0}_keys[] PROTO_SHAPE_UNUSED = {{'.format(prefix)]
+        lines += ['  PROTO_KEY_{0},'.format(identifier(key)) for key in keys]
+        lines += ['};', '',
+                  'static const proto_shape_t {0}_shape PROTO_SHAPE_UNUSED = PROTO_SHAPE_INIT ({0}_keys);'.format(prefix),
+                  '', '#endif // {0}'.format(guard)]
+    return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    arguments = sys.argv[1:]
+    shape = None
+    if len(arguments) >= 2 and arguments[0] == '--shape':
+        shape, arguments = arguments[1], arguments[2:]
+    if not arguments:
+        print("usage: {0} [--shape NAME] KEY...".format(sys.argv[0]))
+        sys.exit(2)
+    try:
+        sys.stdout.write(generate(arguments, shape))
+    except ValueError as error:
+        sys.stderr.write("proto_keys.py: {0}\n".format(error))
+        sys.exit(1)
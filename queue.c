@@ -0,0 +1,392 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef QUEUE_CACHE_LINE
+#define QUEUE_CACHE_LINE 64
+#endif
+#ifndef QUEUE_SEGMENT_SIZE
+#define QUEUE_SEGMENT_SIZE 63
+#endif
+
+// Segment positions advance one extra step past the last slot, which marks
+// a segment boundary being crossed
+#define QUEUE_LAP (QUEUE_SEGMENT_SIZE + 1)
+
+#define QUEUE_WRITTEN 1
+#define QUEUE_READ 2
+#define QUEUE_DESTROY 4
+
+/*
+ * Bounded queues are a ring of cells, each with a sequence number telling
+ * whose turn it is: a producer may fill cell position % capacity when its
+ * sequence is position, a consumer may empty it when it's position + 1.
+ */
+typedef struct {
+  atomic_size_t sequence;
+  void *element;
+} proto_queue_cell_t;
+
+typedef struct {
+  void *element;
+  atomic_uint state;
+} proto_queue_slot_t;
+
+/*
+ * Unbounded queues are a list of segments. Slots are claimed by moving the
+ * head or tail position, so a thread only touches a segment once it owns a
+ * slot in it; the reader of the last slot frees the segment after every
+ * other reader is done with it.
+ */
+typedef struct proto_queue_segment {
+  _Atomic (struct proto_queue_segment *) next;
+  proto_queue_slot_t slots[QUEUE_SEGMENT_SIZE];
+} proto_queue_segment_t;
+
+// Producers and consumers each write their own cache line
+struct proto_queue {
+  _Alignas (QUEUE_CACHE_LINE) atomic_size_t head;
+  _Atomic (proto_queue_segment_t *) head_segment;
+  _Alignas (QUEUE_CACHE_LINE) atomic_size_t tail;
+  _Atomic (proto_queue_segment_t *) tail_segment;
+  _Alignas (QUEUE_CACHE_LINE) proto_queue_cell_t *cells;
+  size_t mask;
+};
+
+static inline void
+queue_backoff (unsigned int *step)
+{
+  unsigned int i;
+
+  if (*step < 6)
+    {
+      for (i = 0; i < 1U << *step; i++)
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause ();
+#else
+        atomic_signal_fence (memory_order_seq_cst);
+#endif
+      (*step)++;
+    }
+  else
+    sched_yield ();
+}
+
+static bool
+queue_ring_push (proto_queue_t *queue,
+                 const void *element)
+{
+  size_t position = atomic_load_explicit (&queue->tail, memory_order_relaxed);
+  proto_queue_cell_t *cell;
+
+  for (;;)
+    {
+      cell = &queue->cells[position & queue->mask];
+      size_t sequence = atomic_load_explicit (&cell->sequence, memory_order_acquire);
+      ptrdiff_t turn = (ptrdiff_t) (sequence - position);
+
+      if (turn == 0)
+        {
+          if (atomic_compare_exchange_weak_explicit (&queue->tail, &position, position + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            break;
+        }
+      else if (turn < 0)
+        return false;
+      else
+        position = atomic_load_explicit (&queue->tail, memory_order_relaxed);
+    }
+  cell->element = (void *) element;
+  atomic_store_explicit (&cell->sequence, position + 1, memory_order_release);
+  return true;
+}
+
+static const void *
+queue_ring_shift (proto_queue_t *queue)
+{
+  size_t position = atomic_load_explicit (&queue->head, memory_order_relaxed);
+  proto_queue_cell_t *cell;
+  const void *element;
+
+  for (;;)
+    {
+      cell = &queue->cells[position & queue->mask];
+      size_t sequence = atomic_load_explicit (&cell->sequence, memory_order_acquire);
+      ptrdiff_t turn = (ptrdiff_t) (sequence - (position + 1));
+
+      if (turn == 0)
+        {
+          if (atomic_compare_exchange_weak_explicit (&queue->head, &position, position + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            break;
+        }
+      else if (turn < 0)
+        return NULL;
+      else
+        position = atomic_load_explicit (&queue->head, memory_order_relaxed);
+    }
+  element = cell->element;
+  atomic_store_explicit (&cell->sequence, position + queue->mask + 1, memory_order_release);
+  return element;
+}
+
+static bool
+queue_segment_push (proto_queue_t *queue,
+                    const void *element)
+{
+  proto_queue_segment_t *segment, *next = NULL;
+  size_t position, offset;
+  unsigned int step = 0;
+
+  for (;;)
+    {
+      position = atomic_load_explicit (&queue->tail, memory_order_acquire);
+      segment = atomic_load_explicit (&queue->tail_segment, memory_order_acquire);
+      offset = position % QUEUE_LAP;
+      if (offset == QUEUE_SEGMENT_SIZE)
+        {
+          queue_backoff (&step);
+          continue;
+        }
+      // Allocate ahead, so claiming the last slot can't fail halfway
+      if (offset + 1 == QUEUE_SEGMENT_SIZE && next == NULL)
+        {
+          next = (proto_queue_segment_t *) calloc (1, sizeof (proto_queue_segment_t));
+          if (!next)
+            return false;
+        }
+      if (atomic_compare_exchange_weak_explicit (&queue->tail, &position, position + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        break;
+    }
+  if (offset + 1 == QUEUE_SEGMENT_SIZE)
+    {
+      atomic_store_explicit (&queue->tail_segment, next, memory_order_release);
+      atomic_store_explicit (&queue->tail, position + 2, memory_order_release);
+      atomic_store_explicit (&segment->next, next, memory_order_release);
+      next = NULL;
+    }
+  segment->slots[offset].element = (void *) element;
+  atomic_fetch_or_explicit (&segment->slots[offset].state, QUEUE_WRITTEN, memory_order_release);
+  free (next);
+  return true;
+}
+
+// Frees a segment once the readers of slots from start on are done with it
+static void
+queue_segment_destroy (proto_queue_segment_t *segment,
+                       size_t start)
+{
+  size_t i;
+
+  for (i = start; i < QUEUE_SEGMENT_SIZE - 1; i++)
+    {
+      atomic_uint *state = &segment->slots[i].state;
+
+      // Still being read: that reader carries on from the next slot
+      if (!(atomic_load_explicit (state, memory_order_acquire) & QUEUE_READ)
+          && !(atomic_fetch_or_explicit (state, QUEUE_DESTROY, memory_order_acq_rel) & QUEUE_READ))
+        return;
+    }
+  free (segment);
+}
+
+static const void *
+queue_segment_shift (proto_queue_t *queue)
+{
+  proto_queue_segment_t *segment, *next;
+  proto_queue_slot_t *slot;
+  size_t position, tail, offset;
+  unsigned int step = 0;
+  const void *element;
+
+  for (;;)
+    {
+      position = atomic_load_explicit (&queue->head, memory_order_acquire);
+      segment = atomic_load_explicit (&queue->head_segment, memory_order_acquire);
+      offset = position % QUEUE_LAP;
+      if (offset == QUEUE_SEGMENT_SIZE)
+        {
+          queue_backoff (&step);
+          continue;
+        }
+      tail = atomic_load_explicit (&queue->tail, memory_order_acquire);
+      if (tail % QUEUE_LAP == QUEUE_SEGMENT_SIZE)
+        tail++;
+      if (position >= tail)
+        return NULL;
+      if (atomic_compare_exchange_weak_explicit (&queue->head, &position, position + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+        break;
+    }
+  if (offset + 1 == QUEUE_SEGMENT_SIZE)
+    {
+      step = 0;
+      while ((next = atomic_load_explicit (&segment->next, memory_order_acquire)) == NULL)
+        queue_backoff (&step);
+      atomic_store_explicit (&queue->head_segment, next, memory_order_release);
+      atomic_store_explicit (&queue->head, position + 2, memory_order_release);
+    }
+  slot = &segment->slots[offset];
+  step = 0;
+  while (!(atomic_load_explicit (&slot->state, memory_order_acquire) & QUEUE_WRITTEN))
+    queue_backoff (&step);
+  element = slot->element;
+  if (offset + 1 == QUEUE_SEGMENT_SIZE)
+    queue_segment_destroy (segment, 0);
+  else if (atomic_fetch_or_explicit (&slot->state, QUEUE_READ, memory_order_acq_rel) & QUEUE_DESTROY)
+    queue_segment_destroy (segment, offset + 1);
+  return element;
+}
+
+static inline size_t
+queue_segment_count (size_t position)
+{
+  size_t offset = position % QUEUE_LAP;
+
+  return position / QUEUE_LAP * QUEUE_SEGMENT_SIZE
+    + (offset < QUEUE_SEGMENT_SIZE ? offset : QUEUE_SEGMENT_SIZE);
+}
+
+/*
+ * A capacity of 0 makes an unbounded queue, growing a segment at a time;
+ * any other capacity is rounded up to a power of two.
+ */
+proto_queue_t *
+proto_init_queue (size_t capacity)
+{
+  proto_queue_t *queue;
+  size_t i, size = 2;
+
+  queue = (proto_queue_t *) aligned_alloc (QUEUE_CACHE_LINE, sizeof (proto_queue_t));
+  if (!queue)
+    return NULL;
+  atomic_init (&queue->head, 0);
+  atomic_init (&queue->tail, 0);
+  atomic_init (&queue->head_segment, NULL);
+  atomic_init (&queue->tail_segment, NULL);
+  queue->cells = NULL;
+  queue->mask = 0;
+  if (capacity == 0)
+    {
+      proto_queue_segment_t *segment = calloc (1, sizeof (proto_queue_segment_t));
+
+      if (!segment)
+        {
+          free (queue);
+          return NULL;
+        }
+      atomic_init (&queue->head_segment, segment);
+      atomic_init (&queue->tail_segment, segment);
+      return queue;
+    }
+  while (size < capacity)
+    size <<= 1;
+  queue->cells = (proto_queue_cell_t *) malloc (size * sizeof (proto_queue_cell_t));
+  if (!queue->cells)
+    {
+      free (queue);
+      return NULL;
+    }
+  for (i = 0; i < size; i++)
+    atomic_init (&queue->cells[i].sequence, i);
+  queue->mask = size - 1;
+  return queue;
+}
+
+/*
+ * Elements can't be NULL, since shift returns NULL for an empty queue.
+ * try_push returns false when a bounded queue is full; push waits for room.
+ */
+bool
+proto_queue_try_push (proto_queue_t *queue,
+                      const void *element)
+{
+  if (queue == NULL || element == NULL)
+    return false;
+  if (queue->cells != NULL)
+    return queue_ring_push (queue, element);
+  return queue_segment_push (queue, element);
+}
+
+void
+proto_queue_push (proto_queue_t *queue,
+                  const void *element)
+{
+  unsigned int step = 0;
+
+  if (queue == NULL || element == NULL)
+    return;
+  while (!proto_queue_try_push (queue, element))
+    queue_backoff (&step);
+}
+
+const void *
+proto_queue_try_shift (proto_queue_t *queue)
+{
+  if (queue == NULL)
+    return NULL;
+  if (queue->cells != NULL)
+    return queue_ring_shift (queue);
+  return queue_segment_shift (queue);
+}
+
+const void *
+proto_queue_shift (proto_queue_t *queue)
+{
+  const void *element;
+  unsigned int step = 0;
+
+  if (queue == NULL)
+    return NULL;
+  while ((element = proto_queue_try_shift (queue)) == NULL)
+    queue_backoff (&step);
+  return element;
+}
+
+// Exact when no other thread is using the queue, a snapshot otherwise
+size_t
+proto_queue_length (const proto_queue_t *queue)
+{
+  size_t head, tail;
+
+  if (queue == NULL)
+    return 0;
+  head = atomic_load ((atomic_size_t *) &queue->head);
+  tail = atomic_load ((atomic_size_t *) &queue->tail);
+  if (queue->cells == NULL)
+    {
+      head = queue_segment_count (head);
+      tail = queue_segment_count (tail);
+    }
+  return tail > head ? tail - head : 0;
+}
+
+void
+proto_del_queue (proto_queue_t *queue)
+{
+  proto_queue_segment_t *segment, *next;
+
+  if (queue == NULL)
+    return;
+  segment = atomic_load (&queue->head_segment);
+  while (segment != NULL)
+    {
+      next = atomic_load (&segment->next);
+      free (segment);
+      segment = next;
+    }
+  free (queue->cells);
+  free (queue);
+}
@@ -0,0 +1,923 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef REFS_BATCH
+#define REFS_BATCH 256
+#endif
+#ifndef REFS_SHARED_MIN_CAPACITY
+#define REFS_SHARED_MIN_CAPACITY 64
+#endif
+
+typedef enum {
+  REFS_OBJECT,
+  REFS_ARRAY,
+  REFS_DATA
+} refs_kind_t;
+
+// Colors of the cycle detector; cells are black outside of it
+typedef enum {
+  REFS_BLACK,
+  REFS_GRAY,
+  REFS_WHITE
+} refs_color_t;
+
+/*
+ * The count of a counted value, kept apart from it so objects, arrays and
+ * data boxes share one layout. Counts of a thread's own values are read
+ * and written without atomic operations; sharing a value makes its count
+ * atomic from then on. A cycle candidate knows its position in the list,
+ * so it leaves the list as soon as it's freed.
+ */
+typedef struct {
+  atomic_size_t count;
+  const void *pointer;
+  refs_kind_t kind;
+  bool shared;
+  bool candidate;
+  size_t position;
+  refs_color_t color;
+  size_t trial;
+} refs_cell_t;
+
+// Entry of a table from a value to its header
+typedef struct {
+  const void *pointer;
+  refs_cell_t *cell;
+} refs_entry_t;
+
+typedef struct {
+  refs_cell_t **cells;
+  size_t length;
+  size_t capacity;
+} refs_list_t;
+
+/*
+ * What a thread keeps: its own values, the decrements it deferred, and
+ * the values whose count dropped without reaching zero, which are the
+ * only places a garbage cycle can be entered from. reading is odd while
+ * the thread looks a value up in the shared table.
+ */
+typedef struct refs_thread {
+  pointer_table_t table;
+  refs_list_t pending;
+  refs_list_t candidates;
+  bool draining;
+  bool registered;
+  size_t freed;
+  atomic_size_t reading;
+  struct refs_thread *next;
+} refs_thread_t;
+
+#define REFS_THREAD_INIT { { NULL, sizeof (refs_entry_t), 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, \
+                           false, false, 0, 0, NULL }
+
+typedef struct {
+  _Atomic (const void *) pointer;
+  _Atomic (refs_cell_t *) cell;
+} refs_slot_t;
+
+/*
+ * Shared values, found without a lock: entries never move within a table,
+ * removal leaves a tombstone, and a table that has to grow or drop its
+ * tombstones is rebuilt and swapped in whole. Writers take the lock, and
+ * free a table they replaced only once no thread can still be reading it.
+ */
+typedef struct {
+  size_t capacity;
+  size_t filled;
+  refs_slot_t slots[];
+} refs_shared_t;
+
+static _Thread_local refs_thread_t refs_local = REFS_THREAD_INIT;
+
+static const char refs_tombstone;
+static _Atomic (refs_shared_t *) refs_shared;
+static atomic_size_t refs_shared_used;
+static pthread_mutex_t refs_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static refs_thread_t *refs_threads;
+static pthread_key_t refs_exit_key;
+static pthread_once_t refs_exit_once = PTHREAD_ONCE_INIT;
+
+static inline size_t
+refs_shared_home (const refs_shared_t *table,
+                  const void *pointer)
+{
+  uint64_t hash = (uint64_t) (uintptr_t) pointer * UINT64_C (0x9E3779B97F4A7C15);
+
+  return (size_t) (hash >> 32) & (table->capacity - 1);
+}
+
+static refs_cell_t *
+refs_table_find (const pointer_table_t *table,
+                 const void *pointer)
+{
+  const refs_entry_t *entry = (const refs_entry_t *) pointer_table_find (table, pointer);
+
+  return entry == NULL ? NULL : entry->cell;
+}
+
+static bool
+refs_table_add (pointer_table_t *table,
+                refs_cell_t *cell)
+{
+  refs_entry_t *entry;
+  bool added;
+
+  entry = (refs_entry_t *) pointer_table_add (table, cell->pointer, &added);
+  if (entry == NULL)
+    return false;
+  entry->cell = cell;
+  return true;
+}
+
+static void
+refs_table_remove (pointer_table_t *table,
+                   const void *pointer)
+{
+  void *entry = pointer_table_find (table, pointer);
+
+  if (entry != NULL)
+    pointer_table_remove (table, entry);
+}
+
+static bool
+refs_list_push (refs_list_t *list,
+                refs_cell_t *cell)
+{
+  if (list->length == list->capacity)
+    {
+      size_t capacity = list->capacity ? 2 * list->capacity : REFS_BATCH;
+      refs_cell_t **cells = (refs_cell_t **) realloc (list->cells, capacity * sizeof (refs_cell_t *));
+
+      if (!cells)
+        return false;
+      list->cells = cells;
+      list->capacity = capacity;
+    }
+  list->cells[list->length++] = cell;
+  return true;
+}
+
+static void
+refs_thread_exit (void *unused);
+
+static void
+refs_exit_key_create ()
+{
+  pthread_key_create (&refs_exit_key, &refs_thread_exit);
+}
+
+/*
+ * Has the thread's state cleaned up when it exits, and lists it among the
+ * threads a writer of the shared table waits for.
+ */
+static inline void
+refs_thread_enter ()
+{
+  if (refs_local.registered)
+    return;
+  pthread_once (&refs_exit_once, &refs_exit_key_create);
+  pthread_setspecific (refs_exit_key, &refs_local);
+  pthread_mutex_lock (&refs_shared_lock);
+  refs_local.next = refs_threads;
+  refs_threads = &refs_local;
+  pthread_mutex_unlock (&refs_shared_lock);
+  refs_local.registered = true;
+}
+
+static refs_cell_t *
+refs_shared_find (const void *value)
+{
+  refs_shared_t *table;
+  refs_cell_t *cell = NULL;
+  const void *pointer;
+  size_t slot, mask, reading;
+
+  refs_thread_enter ();
+  reading = atomic_load_explicit (&refs_local.reading, memory_order_relaxed);
+  // Ordered before loading the table, against a writer swapping it out
+  atomic_store_explicit (&refs_local.reading, reading + 1, memory_order_seq_cst);
+  table = atomic_load_explicit (&refs_shared, memory_order_seq_cst);
+  if (table != NULL)
+    {
+      mask = table->capacity - 1;
+      for (slot = refs_shared_home (table, value);; slot = (slot + 1) & mask)
+        {
+          pointer = atomic_load_explicit (&table->slots[slot].pointer, memory_order_acquire);
+          if (pointer == NULL)
+            break;
+          if (pointer == value)
+            {
+              cell = atomic_load_explicit (&table->slots[slot].cell, memory_order_relaxed);
+              break;
+            }
+        }
+    }
+  atomic_store_explicit (&refs_local.reading, reading + 2, memory_order_release);
+  return cell;
+}
+
+// A value of the calling thread, or a shared one; NULL if it isn't counted
+static refs_cell_t *
+refs_find (const void *value)
+{
+  refs_cell_t *cell = refs_table_find (&refs_local.table, value);
+
+  if (cell != NULL || atomic_load_explicit (&refs_shared_used, memory_order_acquire) == 0)
+    return cell;
+  return refs_shared_find (value);
+}
+
+// Waits out every lookup that may have started on table, then frees it
+static void
+refs_shared_retire (refs_shared_t *table)
+{
+  refs_thread_t *thread;
+  size_t reading;
+
+  for (thread = refs_threads; thread != NULL; thread = thread->next)
+    {
+      reading = atomic_load_explicit (&thread->reading, memory_order_seq_cst);
+      if (reading % 2)
+        while (atomic_load_explicit (&thread->reading, memory_order_acquire) == reading)
+          sched_yield ();
+    }
+  free (table);
+}
+
+/*
+ * Puts the live entries in a new table with room for as many again, or
+ * more, and swaps it in. Called with the lock held.
+ */
+static bool
+refs_shared_rebuild (size_t used)
+{
+  refs_shared_t *old = atomic_load_explicit (&refs_shared, memory_order_relaxed), *table;
+  size_t i, slot, mask, capacity = REFS_SHARED_MIN_CAPACITY;
+  const void *pointer;
+
+  while (capacity < used * 4)
+    capacity <<= 1;
+  table = (refs_shared_t *) calloc (1, sizeof (refs_shared_t) + capacity * sizeof (refs_slot_t));
+  if (!table)
+    return false;
+  table->capacity = capacity;
+  mask = capacity - 1;
+  for (i = 0; old != NULL && i < old->capacity; i++)
+    {
+      pointer = atomic_load_explicit (&old->slots[i].pointer, memory_order_relaxed);
+      if (pointer == NULL || pointer == &refs_tombstone)
+        continue;
+      for (slot = refs_shared_home (table, pointer);
+           atomic_load_explicit (&table->slots[slot].pointer, memory_order_relaxed) != NULL;
+           slot = (slot + 1) & mask);
+      atomic_store_explicit (&table->slots[slot].cell,
+                             atomic_load_explicit (&old->slots[i].cell, memory_order_relaxed),
+                             memory_order_relaxed);
+      atomic_store_explicit (&table->slots[slot].pointer, pointer, memory_order_relaxed);
+      table->filled++;
+    }
+  atomic_store_explicit (&refs_shared, table, memory_order_seq_cst);
+  if (old != NULL)
+    refs_shared_retire (old);
+  return true;
+}
+
+// Called with the lock held, for a cell already marked shared
+static bool
+refs_shared_add (refs_cell_t *cell)
+{
+  refs_shared_t *table = atomic_load_explicit (&refs_shared, memory_order_relaxed);
+  size_t slot, mask, used = atomic_load_explicit (&refs_shared_used, memory_order_relaxed);
+  const void *pointer;
+
+  if ((table == NULL || (table->filled + 1) * 2 > table->capacity) && !refs_shared_rebuild (used + 1))
+    return false;
+  table = atomic_load_explicit (&refs_shared, memory_order_relaxed);
+  mask = table->capacity - 1;
+  for (slot = refs_shared_home (table, cell->pointer);; slot = (slot + 1) & mask)
+    {
+      pointer = atomic_load_explicit (&table->slots[slot].pointer, memory_order_relaxed);
+      if (pointer == NULL || pointer == &refs_tombstone)
+        break;
+    }
+  if (pointer == NULL)
+    table->filled++;
+  atomic_store_explicit (&table->slots[slot].cell, cell, memory_order_relaxed);
+  // Readers that see the pointer see the cell, and the cell's fields
+  atomic_store_explicit (&table->slots[slot].pointer, cell->pointer, memory_order_release);
+  atomic_fetch_add_explicit (&refs_shared_used, 1, memory_order_release);
+  return true;
+}
+
+// Called with the lock held
+static void
+refs_shared_remove (const void *value)
+{
+  refs_shared_t *table = atomic_load_explicit (&refs_shared, memory_order_relaxed);
+  size_t slot, mask = table->capacity - 1;
+  const void *pointer;
+
+  for (slot = refs_shared_home (table, value);; slot = (slot + 1) & mask)
+    {
+      pointer = atomic_load_explicit (&table->slots[slot].pointer, memory_order_relaxed);
+      if (pointer == NULL)
+        return;
+      if (pointer == value)
+        break;
+    }
+  atomic_store_explicit (&table->slots[slot].pointer, (const void *) &refs_tombstone, memory_order_release);
+  atomic_fetch_sub_explicit (&refs_shared_used, 1, memory_order_release);
+}
+
+static inline void
+refs_increment (refs_cell_t *cell)
+{
+  if (cell->shared)
+    atomic_fetch_add_explicit (&cell->count, 1, memory_order_relaxed);
+  else
+    atomic_store_explicit (&cell->count, atomic_load_explicit (&cell->count, memory_order_relaxed) + 1,
+                           memory_order_relaxed);
+}
+
+static refs_cell_t *
+refs_cell_new (const void *pointer,
+               refs_kind_t kind)
+{
+  refs_cell_t *cell;
+
+  refs_thread_enter ();
+  cell = (refs_cell_t *) malloc (sizeof (refs_cell_t));
+  if (!cell)
+    return NULL;
+  atomic_init (&cell->count, 1);
+  cell->pointer = pointer;
+  cell->kind = kind;
+  cell->shared = false;
+  cell->candidate = false;
+  cell->position = 0;
+  cell->color = REFS_BLACK;
+  cell->trial = 0;
+  if (!refs_table_add (&refs_local.table, cell))
+    {
+      free (cell);
+      return NULL;
+    }
+  return cell;
+}
+
+static void
+refs_free_value (refs_cell_t *cell)
+{
+  const proto_data_t *data;
+
+  switch (cell->kind)
+    {
+      case REFS_OBJECT:
+        proto_del_object ((proto_object_t *) cell->pointer);
+        break;
+      case REFS_ARRAY:
+        proto_del_array ((proto_array_t *) cell->pointer);
+        break;
+      case REFS_DATA:
+        data = (const proto_data_t *) cell->pointer;
+        if (data->type == object_t || data->type == array_t || data->type == pointer_t)
+          refs_release_later (data->data.pointer);
+        proto_del_data ((proto_data_t *) cell->pointer);
+        break;
+    }
+  refs_local.freed++;
+}
+
+// Takes a cell off the candidates, putting the last one in its place
+static void
+refs_candidate_drop (refs_cell_t *cell)
+{
+  refs_cell_t *last = refs_local.candidates.cells[--refs_local.candidates.length];
+
+  refs_local.candidates.cells[cell->position] = last;
+  last->position = cell->position;
+  cell->candidate = false;
+}
+
+/*
+ * The count reached zero: the value goes, and what it held is released
+ * through the pending list rather than right away, so freeing a long
+ * chain costs one batch at a time.
+ */
+static void
+refs_free (refs_cell_t *cell)
+{
+  if (cell->shared)
+    {
+      pthread_mutex_lock (&refs_shared_lock);
+      refs_shared_remove (cell->pointer);
+      pthread_mutex_unlock (&refs_shared_lock);
+    }
+  else
+    refs_table_remove (&refs_local.table, cell->pointer);
+  if (cell->candidate)
+    refs_candidate_drop (cell);
+  refs_free_value (cell);
+  free (cell);
+}
+
+static void
+refs_decrement (refs_cell_t *cell)
+{
+  size_t count;
+
+  if (cell->shared)
+    {
+      if (atomic_fetch_sub_explicit (&cell->count, 1, memory_order_acq_rel) == 1)
+        refs_free (cell);
+      return;
+    }
+  count = atomic_load_explicit (&cell->count, memory_order_relaxed) - 1;
+  atomic_store_explicit (&cell->count, count, memory_order_relaxed);
+  if (count == 0)
+    refs_free (cell);
+  else if (!cell->candidate && refs_list_push (&refs_local.candidates, cell))
+    {
+      cell->candidate = true;
+      cell->position = refs_local.candidates.length - 1;
+    }
+}
+
+/*
+ * Applies up to budget deferred decrements of the calling thread, the
+ * ones that freed values added along the way included. Returns the number
+ * of values freed.
+ */
+size_t
+proto_refs_drain (size_t budget)
+{
+  size_t freed = refs_local.freed;
+  bool draining = refs_local.draining;
+
+  refs_local.draining = true;
+  for (; budget > 0 && refs_local.pending.length; budget--)
+    refs_decrement (refs_local.pending.cells[--refs_local.pending.length]);
+  refs_local.draining = draining;
+  return refs_local.freed - freed;
+}
+
+void
+refs_release_later (const void *value)
+{
+  refs_cell_t *cell = refs_find (value);
+
+  if (cell == NULL)
+    return;
+  refs_thread_enter ();
+  if (!refs_list_push (&refs_local.pending, cell))
+    {
+      // Out of room to defer it: the decrement happens now
+      refs_decrement (cell);
+      return;
+    }
+  if (!refs_local.draining && refs_local.pending.length >= REFS_BATCH)
+    proto_refs_drain (REFS_BATCH);
+}
+
+static bool
+refs_share_from (refs_cell_t *root);
+
+void
+refs_retain_into (void *refs,
+                  const void *value)
+{
+  refs_cell_t *cell;
+
+  // A shared container only holds shared values
+  if (((const refs_cell_t *) refs)->shared)
+    {
+      cell = refs_table_find (&refs_local.table, value);
+      if (cell != NULL)
+        refs_share_from (cell);
+    }
+  cell = refs_find (value);
+  if (cell != NULL)
+    refs_increment (cell);
+}
+
+typedef void (*refs_visit_t) (refs_cell_t *cell, void *context);
+
+static void
+refs_visit_object (const proto_object_t *object,
+                   refs_visit_t visit,
+                   void *context)
+{
+  object_cursor_t cursor = { object, 0, NULL, 0, 0, false };
+  const proto_object_entry_t *entry;
+  refs_cell_t *cell;
+
+  if ((cell = refs_table_find (&refs_local.table, object->super)) != NULL)
+    visit (cell, context);
+  while ((entry = object_cursor_next (&cursor)) != NULL)
+    if (object_entry_internal (entry))
+      refs_visit_object ((const proto_object_t *) entry->value, visit, context);
+    else if ((cell = refs_table_find (&refs_local.table, entry->value)) != NULL)
+      visit (cell, context);
+  free (cursor.stack);
+}
+
+/*
+ * Calls visit with every value of the calling thread the cell holds.
+ * Shared values are left out: the cycle detector and sharing only walk
+ * a thread's own values.
+ */
+static void
+refs_visit (const refs_cell_t *cell,
+            refs_visit_t visit,
+            void *context)
+{
+  const proto_array_t *array;
+  const proto_data_t *data;
+  refs_cell_t *child;
+  size_t i;
+
+  switch (cell->kind)
+    {
+      case REFS_OBJECT:
+        refs_visit_object ((const proto_object_t *) cell->pointer, visit, context);
+        break;
+      case REFS_ARRAY:
+        array = (const proto_array_t *) cell->pointer;
+        for (i = 0; i < array->length; i++)
+          if ((child = refs_table_find (&refs_local.table, array_item (array, i))) != NULL)
+            visit (child, context);
+        break;
+      case REFS_DATA:
+        data = (const proto_data_t *) cell->pointer;
+        if ((data->type == object_t || data->type == array_t || data->type == pointer_t)
+            && (child = refs_table_find (&refs_local.table, data->data.pointer)) != NULL)
+          visit (child, context);
+        break;
+    }
+}
+
+static void
+refs_visit_share (refs_cell_t *cell,
+                  void *context)
+{
+  if (cell->color == REFS_BLACK)
+    {
+      cell->color = REFS_GRAY;
+      if (!refs_list_push ((refs_list_t *) context, cell))
+        cell->color = REFS_BLACK;
+    }
+}
+
+/*
+ * Makes the value, and the counted values it reaches, usable from any
+ * thread: they move to the shared table and their counts turn atomic.
+ */
+static bool
+refs_share_from (refs_cell_t *root)
+{
+  refs_list_t found = { NULL, 0, 0 };
+  refs_cell_t *cell;
+  size_t i, j;
+  bool shared = true;
+
+  refs_visit_share (root, &found);
+  for (i = 0; i < found.length; i++)
+    refs_visit (found.cells[i], &refs_visit_share, &found);
+  if (found.length == 0)
+    return false;
+  pthread_mutex_lock (&refs_shared_lock);
+  for (i = 0; i < found.length; i++)
+    {
+      cell = found.cells[i];
+      cell->color = REFS_BLACK;
+      cell->shared = true;
+      if (!refs_shared_add (cell))
+        {
+          cell->shared = false;
+          shared = false;
+          continue;
+        }
+      refs_table_remove (&refs_local.table, cell->pointer);
+    }
+  pthread_mutex_unlock (&refs_shared_lock);
+  // Shared values are no longer cycle candidates
+  for (i = j = 0; i < refs_local.candidates.length; i++)
+    {
+      cell = refs_local.candidates.cells[i];
+      if (cell->shared)
+        cell->candidate = false;
+      else
+        {
+          cell->position = j;
+          refs_local.candidates.cells[j++] = cell;
+        }
+    }
+  refs_local.candidates.length = j;
+  free (found.cells);
+  return shared;
+}
+
+bool
+proto_share (const void *value)
+{
+  refs_cell_t *cell;
+
+  if (value == NULL)
+    return false;
+  cell = refs_table_find (&refs_local.table, value);
+  if (cell == NULL)
+    return refs_find (value) != NULL;
+  return refs_share_from (cell);
+}
+
+/*
+ * Counted values start with one reference, the caller's. Counted objects
+ * and arrays retain what's stored in them and release it when it's
+ * replaced, removed or they're freed; a value removed that way stays
+ * valid until the calling thread's pending decrements are applied. Never
+ * free counted values with proto_del_object, proto_del_array or
+ * proto_del_data.
+ */
+proto_object_t *
+proto_counted_object ()
+{
+  proto_object_t *object = proto_init_object ();
+
+  if (!object)
+    return NULL;
+  object->refs = refs_cell_new (object, REFS_OBJECT);
+  if (object->refs == NULL)
+    {
+      proto_del_object (object);
+      return NULL;
+    }
+  return object;
+}
+
+proto_array_t *
+proto_counted_array ()
+{
+  proto_array_t *array = proto_init_array ();
+
+  if (!array)
+    return NULL;
+  array->refs = refs_cell_new (array, REFS_ARRAY);
+  if (array->refs == NULL)
+    {
+      proto_del_array (array);
+      return NULL;
+    }
+  return array;
+}
+
+// A counted copy of data, which retains the object, array or pointer in it
+proto_data_t *
+proto_counted_data (proto_data_t data)
+{
+  proto_data_t *box = (proto_data_t *) malloc (sizeof (proto_data_t));
+  refs_cell_t *cell;
+
+  if (!box)
+    return NULL;
+  *box = data;
+  if (refs_cell_new (box, REFS_DATA) == NULL)
+    {
+      free (box);
+      return NULL;
+    }
+  if (data.type == object_t || data.type == array_t || data.type == pointer_t)
+    {
+      cell = refs_find (data.data.pointer);
+      if (cell != NULL)
+        refs_increment (cell);
+    }
+  return box;
+}
+
+// Values that aren't counted, or not visible to this thread, are ignored
+void
+proto_retain (const void *value)
+{
+  refs_cell_t *cell;
+
+  if (value == NULL)
+    return;
+  cell = refs_find (value);
+  if (cell != NULL)
+    refs_increment (cell);
+}
+
+// The decrement is deferred to the thread's next batch
+void
+proto_release (const void *value)
+{
+  if (value != NULL)
+    refs_release_later (value);
+}
+
+// Not counting decrements still pending; 0 for values that aren't counted
+size_t
+proto_references (const void *value)
+{
+  refs_cell_t *cell;
+
+  if (value == NULL)
+    return 0;
+  cell = refs_find (value);
+  if (cell == NULL)
+    return 0;
+  return atomic_load_explicit (&cell->count, memory_order_relaxed);
+}
+
+void
+refs_release_object (const proto_object_t *object)
+{
+  object_cursor_t cursor = { object, 0, NULL, 0, 0, false };
+  const proto_object_entry_t *entry;
+
+  if (object->super != NULL)
+    refs_release_later (object->super);
+  // set_chain's objects release their own values when they're freed
+  while ((entry = object_cursor_next (&cursor)) != NULL)
+    if (entry->value != NULL && !object_entry_internal (entry))
+      refs_release_later (entry->value);
+  free (cursor.stack);
+}
+
+void
+refs_release_items (const proto_array_t *array)
+{
+  size_t i;
+
+  for (i = 0; i < array->length; i++)
+    if (array_item (array, i) != NULL)
+      refs_release_later (array_item (array, i));
+}
+
+typedef struct {
+  refs_list_t stack;
+  refs_list_t seen;
+  bool failed;
+} refs_trial_t;
+
+// Counts the edge into cell, seeing it first if it's new
+static void
+refs_visit_gray (refs_cell_t *cell,
+                 void *context)
+{
+  refs_trial_t *trial = (refs_trial_t *) context;
+
+  if (cell->color != REFS_GRAY)
+    {
+      cell->color = REFS_GRAY;
+      cell->trial = atomic_load_explicit (&cell->count, memory_order_relaxed);
+      if (!refs_list_push (&trial->seen, cell) || !refs_list_push (&trial->stack, cell))
+        trial->failed = true;
+    }
+  cell->trial--;
+}
+
+static void
+refs_visit_black (refs_cell_t *cell,
+                  void *context)
+{
+  refs_trial_t *trial = (refs_trial_t *) context;
+
+  if (cell->color == REFS_GRAY)
+    {
+      cell->color = REFS_BLACK;
+      if (!refs_list_push (&trial->stack, cell))
+        trial->failed = true;
+    }
+}
+
+/*
+ * Trial deletion over the values reachable from the candidates: each
+ * one's count less the references from inside that set is what holds it
+ * from outside. Values with outside references, and everything they
+ * reach, live; the rest are cycles nothing else points to.
+ */
+static size_t
+refs_collect_from (refs_list_t *roots)
+{
+  refs_trial_t trial = { { NULL, 0, 0 }, { NULL, 0, 0 }, false };
+  refs_cell_t *cell;
+  size_t i, freed = refs_local.freed;
+
+  for (i = 0; i < roots->length && !trial.failed; i++)
+    if (roots->cells[i]->color != REFS_GRAY)
+      {
+        cell = roots->cells[i];
+        cell->color = REFS_GRAY;
+        cell->trial = atomic_load_explicit (&cell->count, memory_order_relaxed);
+        if (!refs_list_push (&trial.seen, cell) || !refs_list_push (&trial.stack, cell))
+          trial.failed = true;
+        while (trial.stack.length && !trial.failed)
+          refs_visit (trial.stack.cells[--trial.stack.length], &refs_visit_gray, &trial);
+      }
+  for (i = 0; i < trial.seen.length && !trial.failed; i++)
+    if (trial.seen.cells[i]->color == REFS_GRAY && trial.seen.cells[i]->trial > 0)
+      {
+        trial.seen.cells[i]->color = REFS_BLACK;
+        trial.stack.length = 0;
+        if (!refs_list_push (&trial.stack, trial.seen.cells[i]))
+          trial.failed = true;
+        while (trial.stack.length && !trial.failed)
+          refs_visit (trial.stack.cells[--trial.stack.length], &refs_visit_black, &trial);
+      }
+  if (!trial.failed)
+    {
+      // Unlisted first, so the garbage doesn't release references to itself
+      for (i = 0; i < trial.seen.length; i++)
+        if (trial.seen.cells[i]->color == REFS_GRAY)
+          {
+            trial.seen.cells[i]->color = REFS_WHITE;
+            refs_table_remove (&refs_local.table, trial.seen.cells[i]->pointer);
+          }
+      // What the garbage held is only queued until every color is reset
+      refs_local.draining = true;
+      for (i = 0; i < trial.seen.length; i++)
+        if (trial.seen.cells[i]->color == REFS_WHITE)
+          {
+            refs_free_value (trial.seen.cells[i]);
+            free (trial.seen.cells[i]);
+            trial.seen.cells[i] = NULL;
+          }
+      refs_local.draining = false;
+    }
+  for (i = 0; i < trial.seen.length; i++)
+    if (trial.seen.cells[i] != NULL)
+      trial.seen.cells[i]->color = REFS_BLACK;
+  free (trial.stack.cells);
+  free (trial.seen.cells);
+  return refs_local.freed - freed;
+}
+
+/*
+ * Applies every pending decrement, then frees the calling thread's cycles
+ * of values that nothing outside them references any more. Cycles through
+ * shared values aren't found. Returns the number of values freed.
+ */
+size_t
+proto_refs_collect_cycles ()
+{
+  refs_list_t roots;
+  size_t i, freed;
+
+  freed = proto_refs_drain (SIZE_MAX);
+  roots = refs_local.candidates;
+  refs_local.candidates.cells = NULL;
+  refs_local.candidates.length = refs_local.candidates.capacity = 0;
+  for (i = 0; i < roots.length; i++)
+    roots.cells[i]->candidate = false;
+  freed += refs_collect_from (&roots);
+  free (roots.cells);
+  return freed + proto_refs_drain (SIZE_MAX);
+}
+
+/*
+ * A thread's values outlive it: what's left in its table is shared, so
+ * other threads can still release it. Writers stop waiting for the thread
+ * from then on.
+ */
+static void
+refs_thread_exit (void *unused)
+{
+  refs_list_t left = { NULL, 0, 0 };
+  refs_thread_t **thread;
+  size_t i;
+
+  proto_refs_drain (SIZE_MAX);
+  for (i = 0; i < refs_local.candidates.length; i++)
+    refs_local.candidates.cells[i]->candidate = false;
+  refs_local.candidates.length = 0;
+  for (i = 0; i < refs_local.table.capacity; i++)
+    if (pointer_table_key (&refs_local.table, i) != NULL)
+      refs_list_push (&left, ((refs_entry_t *) pointer_table_entry (&refs_local.table, i))->cell);
+  for (i = 0; i < left.length; i++)
+    if (!left.cells[i]->shared)
+      refs_share_from (left.cells[i]);
+  free (left.cells);
+  pthread_mutex_lock (&refs_shared_lock);
+  for (thread = &refs_threads; *thread != &refs_local; thread = &(*thread)->next);
+  *thread = refs_local.next;
+  pthread_mutex_unlock (&refs_shared_lock);
+  pointer_table_clear (&refs_local.table);
+  free (refs_local.pending.cells);
+  free (refs_local.candidates.cells);
+  refs_local = (refs_thread_t) REFS_THREAD_INIT;
+}
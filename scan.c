@@ -0,0 +1,139 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#if !defined(PROTO_NO_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_X86_64 1
+#include <immintrin.h>
+#endif
+
+#ifndef SCAN_VECTOR_THRESHOLD
+#define SCAN_VECTOR_THRESHOLD 32
+#endif
+
+static size_t
+scan_scalar (void *const *items,
+             size_t length,
+             const void *element)
+{
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    if (items[i] == element)
+      return i;
+  return -1;
+}
+
+#ifdef SCAN_X86_64
+
+/*
+ * SSE2 has no 64-bit compare, so pointers are compared as 32-bit halves:
+ * a pointer matches when both of its halves do, i.e. a pair of mask bits.
+ */
+static size_t
+scan_sse2 (void *const *items,
+           size_t length,
+           const void *element)
+{
+  __m128i needle = _mm_set1_epi64x ((long long) (uintptr_t) element);
+  size_t i = 0, tail;
+
+  for (; i + 4 <= length; i += 4)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (items + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (items + i + 2));
+      int mask_a = _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (a, needle)));
+      int mask_b = _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (b, needle)));
+      int mask = mask_a | (mask_b << 4);
+
+      // Keep only lanes where both halves matched
+      mask &= mask >> 1;
+      mask &= 0x55;
+      if (mask)
+        return i + (__builtin_ctz (mask) >> 1);
+    }
+  tail = scan_scalar (items + i, length - i, element);
+  return tail == (size_t) -1 ? tail : i + tail;
+}
+
+__attribute__ ((target ("avx2"))) static size_t
+scan_avx2 (void *const *items,
+           size_t length,
+           const void *element)
+{
+  __m256i needle = _mm256_set1_epi64x ((long long) (uintptr_t) element);
+  size_t i = 0, tail;
+
+  for (; i + 8 <= length; i += 8)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *) (items + i));
+      __m256i b = _mm256_loadu_si256 ((const __m256i *) (items + i + 4));
+      int mask_a = _mm256_movemask_pd (_mm256_castsi256_pd (_mm256_cmpeq_epi64 (a, needle)));
+      int mask_b = _mm256_movemask_pd (_mm256_castsi256_pd (_mm256_cmpeq_epi64 (b, needle)));
+      int mask = mask_a | (mask_b << 4);
+
+      if (mask)
+        return i + __builtin_ctz (mask);
+    }
+  tail = scan_scalar (items + i, length - i, element);
+  return tail == (size_t) -1 ? tail : i + tail;
+}
+
+static size_t
+scan_resolve (void *const *items, size_t length, const void *element);
+
+typedef size_t (*scan_function_t) (void *const *, size_t, const void *);
+
+static _Atomic scan_function_t scan_vector = &scan_resolve;
+
+/*
+ * First call picks the widest implementation the CPU supports; racing
+ * threads store the same pointer, so relaxed ordering is enough.
+ */
+static size_t
+scan_resolve (void *const *items,
+              size_t length,
+              const void *element)
+{
+  scan_function_t scan;
+
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    scan = &scan_avx2;
+  else
+    scan = &scan_sse2;
+  atomic_store_explicit (&scan_vector, scan, memory_order_relaxed);
+  return scan (items, length, element);
+}
+
+#endif // SCAN_X86_64
+
+/*
+ * Position of the first item equal to element, or -1 when there's none.
+ */
+size_t
+pointer_scan (void *const *items,
+              size_t length,
+              const void *element)
+{
+#ifdef SCAN_X86_64
+  if (length >= SCAN_VECTOR_THRESHOLD)
+    {
+      scan_function_t scan = atomic_load_explicit (&scan_vector, memory_order_relaxed);
+
+      return scan (items, length, element);
+    }
+#endif
+  return scan_scalar (items, length, element);
+}
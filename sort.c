@@ -0,0 +1,516 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifndef SORT_INSERTION_THRESHOLD
+#define SORT_INSERTION_THRESHOLD 24
+#endif
+#ifndef SORT_NINTHER_THRESHOLD
+#define SORT_NINTHER_THRESHOLD 128
+#endif
+#ifndef SORT_PARTIAL_INSERTION_LIMIT
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+#endif
+#ifndef SORT_RADIX_THRESHOLD
+#define SORT_RADIX_THRESHOLD 256
+#endif
+
+typedef struct {
+  uint64_t key;
+  void *item;
+} proto_radix_entry_t;
+
+static inline void
+sort_swap (void **a,
+           void **b)
+{
+  void *tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static inline void
+sort2 (void **a,
+       void **b,
+       proto_compare_t compare)
+{
+  if (compare (*b, *a) < 0)
+    sort_swap (a, b);
+}
+
+static inline void
+sort3 (void **a,
+       void **b,
+       void **c,
+       proto_compare_t compare)
+{
+  sort2 (a, b, compare);
+  sort2 (b, c, compare);
+  sort2 (a, b, compare);
+}
+
+static void
+sort_insertion (void **begin,
+                void **end,
+                proto_compare_t compare)
+{
+  void **current;
+
+  if (begin == end)
+    return;
+  for (current = begin + 1; current != end; current++)
+    {
+      void **sift = current, **sift_1 = current - 1;
+
+      if (compare (*sift, *sift_1) < 0)
+        {
+          void *tmp = *sift;
+
+          do
+            *sift-- = *sift_1;
+          while (sift != begin && compare (tmp, *--sift_1) < 0);
+          *sift = tmp;
+        }
+    }
+}
+
+/*
+ * Assumes *(begin - 1) is not greater than any element in [begin, end),
+ * so the inner loop needs no bounds check.
+ */
+static void
+sort_unguarded_insertion (void **begin,
+                          void **end,
+                          proto_compare_t compare)
+{
+  void **current;
+
+  if (begin == end)
+    return;
+  for (current = begin + 1; current != end; current++)
+    {
+      void **sift = current, **sift_1 = current - 1;
+
+      if (compare (*sift, *sift_1) < 0)
+        {
+          void *tmp = *sift;
+
+          do
+            *sift-- = *sift_1;
+          while (compare (tmp, *--sift_1) < 0);
+          *sift = tmp;
+        }
+    }
+}
+
+/*
+ * Insertion sort that gives up once it has moved more than
+ * SORT_PARTIAL_INSERTION_LIMIT elements; used to finish nearly sorted input.
+ */
+static bool
+sort_partial_insertion (void **begin,
+                        void **end,
+                        proto_compare_t compare)
+{
+  void **current;
+  size_t limit = 0;
+
+  if (begin == end)
+    return true;
+  for (current = begin + 1; current != end; current++)
+    {
+      void **sift = current, **sift_1 = current - 1;
+
+      if (compare (*sift, *sift_1) < 0)
+        {
+          void *tmp = *sift;
+
+          do
+            *sift-- = *sift_1;
+          while (sift != begin && compare (tmp, *--sift_1) < 0);
+          *sift = tmp;
+          limit += current - sift;
+        }
+      if (limit > SORT_PARTIAL_INSERTION_LIMIT)
+        return false;
+    }
+  return true;
+}
+
+static void
+sort_sift_down (void **items,
+                size_t root,
+                size_t length,
+                proto_compare_t compare)
+{
+  size_t child;
+
+  while ((child = 2 * root + 1) < length)
+    {
+      if (child + 1 < length && compare (items[child], items[child + 1]) < 0)
+        child++;
+      if (compare (items[root], items[child]) >= 0)
+        return;
+      sort_swap (&items[root], &items[child]);
+      root = child;
+    }
+}
+
+static void
+sort_heap (void **begin,
+           void **end,
+           proto_compare_t compare)
+{
+  size_t i, length = end - begin;
+
+  for (i = length / 2; i > 0; i--)
+    sort_sift_down (begin, i - 1, length, compare);
+  for (i = length - 1; i > 0; i--)
+    {
+      sort_swap (&begin[0], &begin[i]);
+      sort_sift_down (begin, 0, i, compare);
+    }
+}
+
+/*
+ * Partitions [begin, end) around the pivot at *begin; elements equal to the
+ * pivot go to the right. Returns the final pivot position.
+ */
+static void **
+sort_partition_right (void **begin,
+                      void **end,
+                      proto_compare_t compare,
+                      bool *already_partitioned)
+{
+  void *pivot = *begin;
+  void **first = begin, **last = end, **pivot_position;
+
+  while (compare (*++first, pivot) < 0);
+  if (first - 1 == begin)
+    while (first < last && compare (*--last, pivot) >= 0);
+  else
+    while (compare (*--last, pivot) >= 0);
+  *already_partitioned = first >= last;
+  while (first < last)
+    {
+      sort_swap (first, last);
+      while (compare (*++first, pivot) < 0);
+      while (compare (*--last, pivot) >= 0);
+    }
+  pivot_position = first - 1;
+  *begin = *pivot_position;
+  *pivot_position = pivot;
+  return pivot_position;
+}
+
+/*
+ * Like sort_partition_right, but elements equal to the pivot go to the left.
+ * Used when the pivot equals its predecessor, which puts every duplicate of
+ * it in place in a single pass.
+ */
+static void **
+sort_partition_left (void **begin,
+                     void **end,
+                     proto_compare_t compare)
+{
+  void *pivot = *begin;
+  void **first = begin, **last = end, **pivot_position;
+
+  while (compare (pivot, *--last) < 0);
+  if (last + 1 == end)
+    while (first < last && compare (pivot, *++first) >= 0);
+  else
+    while (compare (pivot, *++first) >= 0);
+  while (first < last)
+    {
+      sort_swap (first, last);
+      while (compare (pivot, *--last) < 0);
+      while (compare (pivot, *++first) >= 0);
+    }
+  pivot_position = last;
+  *begin = *pivot_position;
+  *pivot_position = pivot;
+  return pivot_position;
+}
+
+/*
+ * Pattern-defeating quicksort (Orson Peters): an introsort that detects
+ * already partitioned ranges, shuffles away bad pivot patterns and falls
+ * back to heapsort after too many unbalanced partitions.
+ */
+static void
+sort_pdq_loop (void **begin,
+               void **end,
+               proto_compare_t compare,
+               int bad_allowed,
+               bool leftmost)
+{
+  for (;;)
+    {
+      size_t size = end - begin, half = size / 2, l_size, r_size;
+      void **pivot_position;
+      bool already_partitioned;
+
+      if (size < SORT_INSERTION_THRESHOLD)
+        {
+          if (leftmost)
+            sort_insertion (begin, end, compare);
+          else
+            sort_unguarded_insertion (begin, end, compare);
+          return;
+        }
+      if (size > SORT_NINTHER_THRESHOLD)
+        {
+          sort3 (begin, begin + half, end - 1, compare);
+          sort3 (begin + 1, begin + (half - 1), end - 2, compare);
+          sort3 (begin + 2, begin + (half + 1), end - 3, compare);
+          sort3 (begin + (half - 1), begin + half, begin + (half + 1), compare);
+          sort_swap (begin, begin + half);
+        }
+      else
+        sort3 (begin + half, begin, end - 1, compare);
+      if (!leftmost && compare (*(begin - 1), *begin) >= 0)
+        {
+          begin = sort_partition_left (begin, end, compare) + 1;
+          continue;
+        }
+      pivot_position = sort_partition_right (begin, end, compare, &already_partitioned);
+      l_size = pivot_position - begin;
+      r_size = end - (pivot_position + 1);
+      if (l_size < size / 8 || r_size < size / 8)
+        {
+          if (--bad_allowed == 0)
+            {
+              sort_heap (begin, end, compare);
+              return;
+            }
+          if (l_size >= SORT_INSERTION_THRESHOLD)
+            {
+              sort_swap (begin, begin + l_size / 4);
+              sort_swap (pivot_position - 1, pivot_position - l_size / 4);
+              if (l_size > SORT_NINTHER_THRESHOLD)
+                {
+                  sort_swap (begin + 1, begin + (l_size / 4 + 1));
+                  sort_swap (begin + 2, begin + (l_size / 4 + 2));
+                  sort_swap (pivot_position - 2, pivot_position - (l_size / 4 + 1));
+                  sort_swap (pivot_position - 3, pivot_position - (l_size / 4 + 2));
+                }
+            }
+          if (r_size >= SORT_INSERTION_THRESHOLD)
+            {
+              sort_swap (pivot_position + 1, pivot_position + (1 + r_size / 4));
+              sort_swap (end - 1, end - r_size / 4);
+              if (r_size > SORT_NINTHER_THRESHOLD)
+                {
+                  sort_swap (pivot_position + 2, pivot_position + (2 + r_size / 4));
+                  sort_swap (pivot_position + 3, pivot_position + (3 + r_size / 4));
+                  sort_swap (end - 2, end - (1 + r_size / 4));
+                  sort_swap (end - 3, end - (2 + r_size / 4));
+                }
+            }
+        }
+      else if (already_partitioned
+               && sort_partial_insertion (begin, pivot_position, compare)
+               && sort_partial_insertion (pivot_position + 1, end, compare))
+        return;
+      sort_pdq_loop (begin, pivot_position, compare, bad_allowed, leftmost);
+      begin = pivot_position + 1;
+      leftmost = false;
+    }
+}
+
+static inline uint64_t
+sort_radix_key (const proto_data_t *data)
+{
+  uint64_t bits;
+
+  if (data->type == decimal_t)
+    {
+      memcpy (&bits, &data->data.decimal, sizeof (bits));
+      // Flip all bits of negatives, only the sign bit of positives
+      return (bits & UINT64_C (0x8000000000000000)) ? ~bits : bits ^ UINT64_C (0x8000000000000000);
+    }
+  return (uint64_t) (int64_t) data->data.integer ^ UINT64_C (0x8000000000000000);
+}
+
+/*
+ * Stable LSD radix sort on 8-bit digits for arrays of proto_data_t numbers.
+ * Digits shared by every key are skipped, so small ranges take few passes.
+ */
+static bool
+sort_radix (void **items,
+            size_t length)
+{
+  size_t counts[8][256], i, digit;
+  proto_radix_entry_t *source, *target, *swap;
+
+  source = (proto_radix_entry_t *) malloc (2 * length * sizeof (proto_radix_entry_t));
+  if (!source)
+    return false;
+  target = source + length;
+  memset (counts, 0, sizeof (counts));
+  for (i = 0; i < length; i++)
+    {
+      source[i].key = sort_radix_key ((const proto_data_t *) items[i]);
+      source[i].item = items[i];
+      for (digit = 0; digit < 8; digit++)
+        counts[digit][(source[i].key >> (digit * 8)) & 0xff]++;
+    }
+  for (digit = 0; digit < 8; digit++)
+    {
+      size_t offset = 0, shift = digit * 8, *count = counts[digit];
+
+      if (count[(source[0].key >> shift) & 0xff] == length)
+        continue;
+      for (i = 0; i < 256; i++)
+        {
+          size_t tmp = count[i];
+          count[i] = offset;
+          offset += tmp;
+        }
+      for (i = 0; i < length; i++)
+        target[count[(source[i].key >> shift) & 0xff]++] = source[i];
+      swap = source;
+      source = target;
+      target = swap;
+    }
+  for (i = 0; i < length; i++)
+    items[i] = source[i].item;
+  free (source < target ? source : target);
+  return true;
+}
+
+static int
+sort_log2 (size_t length)
+{
+  int log = 0;
+
+  while (length >>= 1)
+    log++;
+  return log;
+}
+
+int
+proto_compare_integer (const void *a,
+                       const void *b)
+{
+  long x = ((const proto_data_t *) a)->data.integer;
+  long y = ((const proto_data_t *) b)->data.integer;
+
+  return (x > y) - (x < y);
+}
+
+int
+proto_compare_decimal (const void *a,
+                       const void *b)
+{
+  double x = ((const proto_data_t *) a)->data.decimal;
+  double y = ((const proto_data_t *) b)->data.decimal;
+
+  return (x > y) - (x < y);
+}
+
+void
+sort_items (void **items,
+            size_t length,
+            proto_compare_t compare)
+{
+  if ((compare == &proto_compare_integer || compare == &proto_compare_decimal)
+      && length >= SORT_RADIX_THRESHOLD
+      && sort_radix (items, length))
+    return;
+  sort_pdq_loop (items, items + length, compare, sort_log2 (length), true);
+}
+
+/*
+ * Chunked arrays are copied out to a flat buffer, sorted there and copied
+ * back leaf by leaf, which keeps the tree shape as it was.
+ */
+static void
+sort_chunked (proto_array_t *array,
+              proto_compare_t compare)
+{
+  void **items = (void **) malloc (array->length * sizeof (void *)), **segment;
+  size_t position, length;
+
+  if (!items)
+    return;
+  for (position = 0; position < array->length; position += length)
+    {
+      segment = array_segment (array, position, &length);
+      memcpy (items + position, segment, length * sizeof (void *));
+    }
+  sort_items (items, array->length, compare);
+  for (position = 0; position < array->length; position += length)
+    {
+      segment = array_segment (array, position, &length);
+      memcpy (segment, items + position, length * sizeof (void *));
+    }
+  free (items);
+}
+
+void
+proto_array_sort (proto_array_t *array,
+                  proto_compare_t compare)
+{
+  if (array == NULL || compare == NULL)
+    return;
+  if (array->compare != compare)
+    array->compare = NULL;
+  if (array->length < 2)
+    return;
+  hash_index_invalidate (array);
+  heap_moving (array->heap, array);
+  if (array->chunks != NULL)
+    sort_chunked (array, compare);
+  else
+    sort_items (array->items, array->length, compare);
+}
+
+size_t
+proto_array_bsearch (const proto_array_t *array,
+                     const void *element,
+                     proto_compare_t compare)
+{
+  if (array == NULL)
+    return -1;
+  size_t low = 0, high = array->length;
+
+  if (compare == NULL)
+    compare = array->compare;
+  if (compare == NULL)
+    return -1;
+  while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+
+      if (compare (array_item (array, middle), element) < 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+  if (low < array->length && compare (array_item (array, low), element) == 0)
+    return low;
+  return -1;
+}
+
+void
+proto_array_keep_sorted (proto_array_t *array,
+                         proto_compare_t compare)
+{
+  if (array == NULL)
+    return;
+  proto_array_sort (array, compare);
+  array->compare = compare;
+}
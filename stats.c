@@ -0,0 +1,48 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <string.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#ifdef PROTO_STATS
+_Thread_local proto_stats_t stats_counters;
+#endif
+
+bool
+proto_stats_enabled ()
+{
+#ifdef PROTO_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Copies the calling thread's counters; false, and zeros, without PROTO_STATS
+bool
+proto_stats_read (proto_stats_t *stats)
+{
+  if (stats == NULL)
+    return false;
+#ifdef PROTO_STATS
+  *stats = stats_counters;
+  return true;
+#else
+  memset (stats, 0, sizeof (proto_stats_t));
+  return false;
+#endif
+}
+
+void
+proto_stats_reset ()
+{
+#ifdef PROTO_STATS
+  memset (&stats_counters, 0, sizeof (proto_stats_t));
+#endif
+}
@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define EDITS 4096
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Inserts and then deletes EDITS items in the middle of an array of length
+static double
+middle_edits (proto_array_t *array,
+              long *values,
+              size_t length)
+{
+  size_t i;
+  double start;
+
+  for (i = 0; i < length; i++)
+    array->push (array, &values[i]);
+  start = now ();
+  for (i = 0; i < EDITS; i++)
+    array->insert (array, array->length / 2, &values[i]);
+  for (i = 0; i < EDITS; i++)
+    array->del (array, array->length / 2);
+  return (now () - start) / (2 * EDITS);
+}
+
+int
+main ()
+{
+  proto_array_t *array;
+  long *values;
+  size_t length;
+  double flat_ns, chunked_ns;
+
+  printf ("%8s %14s %14s %8s\n", "length", "flat ns/op", "chunked ns/op", "speedup");
+  for (length = 1024; length <= (1 << 20); length <<= 2)
+    {
+      values = (long *) malloc (length * sizeof (long));
+      array = proto_init_array ();
+      flat_ns = middle_edits (array, values, length);
+      proto_del_array (array);
+      array = proto_init_chunked_array ();
+      chunked_ns = middle_edits (array, values, length);
+      proto_del_array (array);
+      printf ("%8zu %14.1f %14.1f %7.2fx\n", length, flat_ns, chunked_ns, flat_ns / chunked_ns);
+      free (values);
+    }
+  return 0;
+}
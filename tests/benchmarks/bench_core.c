@@ -0,0 +1,675 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Times proto's hot paths (objects, arrays, the managed heap, counted
+ * values and generic calls) over a sweep of sizes and key distributions,
+ * and prints one JSON document with the spread of the samples for each
+ * case. Pass a substring to run only the cases whose name contains it;
+ * compare two runs with tests/scripts/bench_compare.py.
+ */
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 21
+#endif
+
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 100000
+#endif
+
+#define LONG_KEY_PREFIX "a-rather-long-property-name-shared-by-every-key-"
+
+typedef enum {
+  KEYS_SEQUENTIAL,
+  KEYS_RANDOM,
+  KEYS_LONG
+} keys_t;
+
+static const char *keys_names[] = { "sequential", "random", "long" };
+static const size_t sizes[] = { 16, 256, 4096 };
+static const char *const property_names[] = {
+  "object.set", "object.get", "object.get_inline", "object.get_key", "object.get_slot", "object.has",
+  "object.del", NULL
+};
+static const char *const chain_names[] = { "object.set_chain", "object.get_chain", NULL };
+static const char *const array_names[] = {
+  "array.push", "array.push_fast", "array.at", "array.at_inline", "array.insert", "array.shift",
+  "array.includes", "array.reverse", "array.concat", NULL
+};
+static const char *const heap_names[] = { "heap.step", "heap.alloc", "heap.collect", NULL };
+static const char *const refs_names[] = { "refs.retain", "refs.store", "refs.cascade", NULL };
+
+// One case's samples; the first one warms up and isn't reported
+typedef struct {
+  const char *name;
+  const char *keys;
+  size_t size;
+  double samples[BENCH_SAMPLES + 1];
+} bench_case_t;
+
+static const char *filter;
+static bool first_case = true;
+static unsigned long seed = 88172645463325252UL;
+static volatile size_t sink;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// xorshift64, seeded the same on every run so runs see the same keys
+static unsigned long
+next_random ()
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile over sorted samples
+static double
+percentile (const double *sorted,
+            double rank)
+{
+  size_t position = (size_t) (rank * BENCH_SAMPLES + 0.5);
+
+  if (position > 0)
+    position--;
+  if (position >= BENCH_SAMPLES)
+    position = BENCH_SAMPLES - 1;
+  return sorted[position];
+}
+
+static bool
+wanted (const char *name)
+{
+  return filter == NULL || strstr (name, filter) != NULL;
+}
+
+// Whether any of a group's cases, listed up to a NULL, is wanted
+static bool
+wanted_any (const char *const *names)
+{
+  for (; *names != NULL; names++)
+    if (wanted (*names))
+      return true;
+  return false;
+}
+
+static void
+report (bench_case_t *bench)
+{
+  double sorted[BENCH_SAMPLES];
+
+  memcpy (sorted, bench->samples + 1, sizeof (sorted));
+  qsort (sorted, BENCH_SAMPLES, sizeof (double), &compare_doubles);
+  printf ("%s\n    {\"name\": \"%s\", \"keys\": \"%s\", \"size\": %zu, "
+          "\"min_ns\": %.2f, \"median_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f}",
+          first_case ? "" : ",", bench->name, bench->keys, bench->size,
+          sorted[0], percentile (sorted, 0.5), percentile (sorted, 0.9), percentile (sorted, 0.99));
+  first_case = false;
+}
+
+static void
+init_case (bench_case_t *bench,
+           const char *name,
+           const char *keys,
+           size_t size)
+{
+  bench->name = name;
+  bench->keys = keys;
+  bench->size = size;
+}
+
+// Keys for a distribution, in the order they're visited
+static char **
+make_keys (keys_t distribution,
+           size_t size)
+{
+  char **keys = (char **) malloc (size * sizeof (char *));
+  size_t i, j, length;
+
+  for (i = 0; i < size; i++)
+    {
+      keys[i] = (char *) malloc (sizeof (LONG_KEY_PREFIX) + 24);
+      switch (distribution)
+        {
+        case KEYS_SEQUENTIAL:
+          sprintf (keys[i], "key%zu", i);
+          break;
+        case KEYS_RANDOM:
+          length = 4 + next_random () % 12;
+          for (j = 0; j < length; j++)
+            keys[i][j] = 'a' + next_random () % 26;
+          sprintf (keys[i] + length, "%zu", i);
+          break;
+        case KEYS_LONG:
+          sprintf (keys[i], LONG_KEY_PREFIX "%zu", i);
+          break;
+        }
+    }
+  return keys;
+}
+
+static void
+shuffle (char **keys,
+         size_t size)
+{
+  size_t i, j;
+  char *swap;
+
+  for (i = size; i > 1; i--)
+    {
+      j = next_random () % i;
+      swap = keys[i - 1];
+      keys[i - 1] = keys[j];
+      keys[j] = swap;
+    }
+}
+
+static void
+free_keys (char **keys,
+           size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    free (keys[i]);
+  free (keys);
+}
+
+static void
+bench_object_properties (keys_t distribution,
+                         size_t size)
+{
+  char **keys = make_keys (distribution, size), **visits;
+  bench_case_t set, get, get_inline, get_key, get_slot, has, del;
+  proto_object_t *object, *shaped;
+  proto_key_t *shape_keys, *visit_keys;
+  proto_shape_t shape;
+  size_t *visit_slots;
+  double start;
+  size_t i, j, sample;
+
+  visits = (char **) malloc (size * sizeof (char *));
+  memcpy (visits, keys, size * sizeof (char *));
+  if (distribution == KEYS_RANDOM)
+    shuffle (visits, size);
+  shape_keys = (proto_key_t *) malloc (size * sizeof (proto_key_t));
+  visit_keys = (proto_key_t *) malloc (size * sizeof (proto_key_t));
+  visit_slots = (size_t *) malloc (size * sizeof (size_t));
+  for (i = 0; i < size; i++)
+    {
+      shape_keys[i] = proto_key (keys[i]);
+      visit_keys[i] = proto_key (visits[i]);
+      for (j = 0; keys[j] != visits[i]; j++)
+        ;
+      visit_slots[i] = j;
+    }
+  shape.length = size;
+  shape.keys = shape_keys;
+  init_case (&set, "object.set", keys_names[distribution], size);
+  init_case (&get, "object.get", keys_names[distribution], size);
+  init_case (&get_inline, "object.get_inline", keys_names[distribution], size);
+  init_case (&get_key, "object.get_key", keys_names[distribution], size);
+  init_case (&get_slot, "object.get_slot", keys_names[distribution], size);
+  init_case (&has, "object.has", keys_names[distribution], size);
+  init_case (&del, "object.del", keys_names[distribution], size);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      object = proto_init_object ();
+      start = now ();
+      for (i = 0; i < size; i++)
+        object->set_own_property (object, keys[i], keys[i]);
+      set.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) object->get_own_property (object, visits[i]);
+      get.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) proto_object_get (object, visits[i]);
+      get_inline.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) proto_object_get_key (object, &visit_keys[i]);
+      get_key.samples[sample] = (now () - start) / size;
+
+      shaped = proto_init_shaped_object (&shape);
+      for (i = 0; i < size; i++)
+        proto_object_set_slot (shaped, i, keys[i]);
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) proto_object_slot (shaped, visit_slots[i]);
+      get_slot.samples[sample] = (now () - start) / size;
+      proto_del_object (shaped);
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += object->has_own_property (object, visits[i]);
+      has.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) object->del_own_property (object, visits[i]);
+      del.samples[sample] = (now () - start) / size;
+      proto_del_object (object);
+    }
+  if (wanted (set.name))
+    report (&set);
+  if (wanted (get.name))
+    report (&get);
+  if (wanted (get_inline.name))
+    report (&get_inline);
+  if (wanted (get_key.name))
+    report (&get_key);
+  if (wanted (get_slot.name))
+    report (&get_slot);
+  if (wanted (has.name))
+    report (&has);
+  if (wanted (del.name))
+    report (&del);
+  free (visit_slots);
+  free (visit_keys);
+  free (shape_keys);
+  free (visits);
+  free_keys (keys, size);
+}
+
+// Chains three levels deep: "outer.inner.<key>"
+static void
+bench_object_chains (keys_t distribution,
+                     size_t size)
+{
+  char **keys = make_keys (distribution, size), **chains;
+  bench_case_t set, get;
+  proto_object_t *object;
+  double start;
+  size_t i, sample;
+
+  chains = (char **) malloc (size * sizeof (char *));
+  for (i = 0; i < size; i++)
+    {
+      chains[i] = (char *) malloc (strlen (keys[i]) + sizeof ("outer.inner."));
+      sprintf (chains[i], "outer.inner.%s", keys[i]);
+    }
+  init_case (&set, "object.set_chain", keys_names[distribution], size);
+  init_case (&get, "object.get_chain", keys_names[distribution], size);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      object = proto_init_object ();
+      start = now ();
+      for (i = 0; i < size; i++)
+        object->set_chain (object, chains[i], keys[i]);
+      set.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        sink += (size_t) object->get_chain (object, chains[size - 1 - i]);
+      get.samples[sample] = (now () - start) / size;
+      proto_del_object (object);
+    }
+  if (wanted (set.name))
+    report (&set);
+  if (wanted (get.name))
+    report (&get);
+  free_keys (chains, size);
+  free_keys (keys, size);
+}
+
+// Per key merged, into an object that holds half of them already
+static void
+bench_object_merge (keys_t distribution,
+                    size_t size)
+{
+  char **keys = make_keys (distribution, size);
+  proto_object_t *source = proto_init_object (), *target;
+  bench_case_t merge;
+  double start;
+  size_t i, sample;
+
+  init_case (&merge, "object.merge", keys_names[distribution], size);
+  if (!wanted (merge.name))
+    goto done;
+  for (i = 0; i < size; i++)
+    source->set_own_property (source, keys[i], keys[i]);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      target = proto_init_object ();
+      for (i = 0; i < size; i += 2)
+        target->set_own_property (target, keys[i], NULL);
+      start = now ();
+      target->merge (target, source);
+      merge.samples[sample] = (now () - start) / size;
+      proto_del_object (target);
+    }
+  report (&merge);
+done:
+  proto_del_object (source);
+  free_keys (keys, size);
+}
+
+static void
+bench_arrays (size_t size)
+{
+  bench_case_t push, push_fast, at, at_inline, insert, shift, includes, reverse, concat;
+  proto_array_t *array, *other, *reversed;
+  size_t *values = (size_t *) malloc (size * sizeof (size_t));
+  size_t i, lookups = size < 1024 ? size : 1024, sample, total;
+  double start;
+
+  for (i = 0; i < size; i++)
+    values[i] = i;
+  init_case (&push, "array.push", "-", size);
+  init_case (&push_fast, "array.push_fast", "-", size);
+  init_case (&at, "array.at", "-", size);
+  init_case (&at_inline, "array.at_inline", "-", size);
+  init_case (&insert, "array.insert", "-", size);
+  init_case (&shift, "array.shift", "-", size);
+  init_case (&includes, "array.includes", "-", size);
+  init_case (&reverse, "array.reverse", "-", size);
+  init_case (&concat, "array.concat", "-", size);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      array = proto_init_array ();
+      start = now ();
+      for (i = 0; i < size; i++)
+        array->push (array, &values[i]);
+      push.samples[sample] = (now () - start) / size;
+
+      // Summed locally, so the loop is only the reads
+      total = 0;
+      start = now ();
+      for (i = 0; i < size; i++)
+        total += (size_t) array->at (array, i);
+      at.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        total -= (size_t) proto_array_at (array, i);
+      at_inline.samples[sample] = (now () - start) / size;
+      sink += total;
+
+      // Lookups spread over the array, the last one a miss
+      start = now ();
+      for (i = 0; i < lookups; i++)
+        sink += array->includes (array, i + 1 == lookups ? (void *) values : &values[next_random () % size]);
+      includes.samples[sample] = (now () - start) / lookups;
+
+      start = now ();
+      reversed = (proto_array_t *) array->reverse (array);
+      reverse.samples[sample] = (now () - start) / size;
+      sink += reversed->length;
+
+      start = now ();
+      array->concat (array, reversed);
+      concat.samples[sample] = (now () - start) / size;
+      proto_del_array (reversed);
+
+      start = now ();
+      for (i = 0; i < 2 * size; i++)
+        sink += (size_t) array->shift (array);
+      shift.samples[sample] = (now () - start) / (2 * size);
+      proto_del_array (array);
+
+      other = proto_init_array ();
+      start = now ();
+      for (i = 0; i < size; i++)
+        proto_array_push_fast (other, &values[i]);
+      push_fast.samples[sample] = (now () - start) / size;
+      proto_del_array (other);
+
+      other = proto_init_array ();
+      start = now ();
+      for (i = 0; i < size; i++)
+        other->insert (other, other->length / 2, &values[i]);
+      insert.samples[sample] = (now () - start) / size;
+      proto_del_array (other);
+    }
+  if (wanted (push.name))
+    report (&push);
+  if (wanted (push_fast.name))
+    report (&push_fast);
+  if (wanted (at.name))
+    report (&at);
+  if (wanted (at_inline.name))
+    report (&at_inline);
+  if (wanted (insert.name))
+    report (&insert);
+  if (wanted (shift.name))
+    report (&shift);
+  if (wanted (includes.name))
+    report (&includes);
+  if (wanted (reverse.name))
+    report (&reverse);
+  if (wanted (concat.name))
+    report (&concat);
+  free (values);
+}
+
+/*
+ * Over a managed heap of size live objects in a list, as much garbage
+ * again: one step of the default budget, which bounds the pause, then an
+ * allocation that pays for its share of collection, then a whole
+ * collection per live cell.
+ */
+static void
+bench_heap (size_t size)
+{
+  proto_heap_t *heap = proto_init_heap ();
+  proto_array_t *list = proto_heap_array (heap);
+  proto_object_t *object, *previous = NULL;
+  bench_case_t step, alloc, collect;
+  double start;
+  size_t i, sample;
+
+  init_case (&step, "heap.step", "-", size);
+  init_case (&alloc, "heap.alloc", "-", size);
+  init_case (&collect, "heap.collect", "-", size);
+  proto_heap_set_budget (heap, 0);
+  proto_heap_root (heap, list);
+  for (i = 0; i < size; i++)
+    {
+      object = proto_heap_object (heap);
+      object->set_own_property (object, "next", previous);
+      object->set_own_property (object, "index", (const void *) i);
+      list->push (list, object);
+      previous = object;
+      proto_heap_object (heap);
+    }
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      start = now ();
+      proto_heap_step (heap, 256);
+      step.samples[sample] = now () - start;
+    }
+  proto_heap_set_budget (heap, 256);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      start = now ();
+      for (i = 0; i < size; i++)
+        proto_heap_object (heap);
+      alloc.samples[sample] = (now () - start) / size;
+    }
+  proto_heap_set_budget (heap, 0);
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      for (i = 0; i < size; i++)
+        proto_heap_object (heap);
+      start = now ();
+      proto_heap_collect (heap);
+      collect.samples[sample] = (now () - start) / (size + 1);
+    }
+  if (wanted (step.name))
+    report (&step);
+  if (wanted (alloc.name))
+    report (&alloc);
+  if (wanted (collect.name))
+    report (&collect);
+  proto_del_heap (heap);
+}
+
+/*
+ * Counted values: a retain and its deferred release, a store that
+ * replaces a counted property value, and, per value, releasing the head
+ * of a chain of size and draining until all of it is freed.
+ */
+static void
+bench_refs (size_t size)
+{
+  proto_object_t *parent = proto_counted_object (), *head, *node;
+  proto_object_t **values = (proto_object_t **) malloc (size * sizeof (proto_object_t *));
+  bench_case_t retain, store, cascade;
+  double start;
+  size_t i, sample;
+
+  init_case (&retain, "refs.retain", "-", size);
+  init_case (&store, "refs.store", "-", size);
+  init_case (&cascade, "refs.cascade", "-", size);
+  for (i = 0; i < size; i++)
+    values[i] = proto_counted_object ();
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      start = now ();
+      for (i = 0; i < size; i++)
+        {
+          proto_retain (values[i]);
+          proto_release (values[i]);
+        }
+      retain.samples[sample] = (now () - start) / size;
+
+      start = now ();
+      for (i = 0; i < size; i++)
+        parent->set_own_property (parent, "value", values[i]);
+      store.samples[sample] = (now () - start) / size;
+
+      for (head = NULL, i = 0; i < size; i++)
+        {
+          node = proto_counted_object ();
+          node->set_own_property (node, "next", head);
+          proto_release (head);
+          head = node;
+        }
+      proto_refs_drain (SIZE_MAX);
+      start = now ();
+      proto_release (head);
+      proto_refs_drain (SIZE_MAX);
+      cascade.samples[sample] = (now () - start) / size;
+    }
+  if (wanted (retain.name))
+    report (&retain);
+  if (wanted (store.name))
+    report (&store);
+  if (wanted (cascade.name))
+    report (&cascade);
+  proto_release (parent);
+  for (i = 0; i < size; i++)
+    proto_release (values[i]);
+  proto_refs_collect_cycles ();
+  free (values);
+}
+
+static void *
+consume (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+
+  sink += arguments_list->length;
+  return NULL;
+}
+
+// Per call, over one, three and eight arguments
+static void
+bench_generic_caller ()
+{
+  bench_case_t cases[3];
+  double start;
+  size_t i, sample;
+
+  init_case (&cases[0], "generic_caller", "-", 1);
+  init_case (&cases[1], "generic_caller", "-", 3);
+  init_case (&cases[2], "generic_caller", "-", 8);
+  if (!wanted (cases[0].name))
+    return;
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      start = now ();
+      for (i = 0; i < BENCH_CALLS; i++)
+        proto_generic_caller ("%i", &consume, (long) i);
+      cases[0].samples[sample] = (now () - start) / BENCH_CALLS;
+
+      start = now ();
+      for (i = 0; i < BENCH_CALLS; i++)
+        proto_generic_caller ("%i %d %s", &consume, (long) i, 0.5, "x");
+      cases[1].samples[sample] = (now () - start) / BENCH_CALLS;
+
+      start = now ();
+      for (i = 0; i < BENCH_CALLS; i++)
+        proto_generic_caller ("%i %d %s %c %i %d %s %p", &consume,
+                              (long) i, 0.5, "x", 'y', (long) i, 1.5, "z", (void *) &start);
+      cases[2].samples[sample] = (now () - start) / BENCH_CALLS;
+    }
+  for (i = 0; i < 3; i++)
+    report (&cases[i]);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  size_t i;
+  int distribution;
+
+  filter = argc > 1 ? argv[1] : NULL;
+  printf ("{\n  \"benchmark\": \"bench_core\",\n  \"samples\": %d,\n  \"unit\": \"ns/op\",\n  \"results\": [",
+          BENCH_SAMPLES);
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (distribution = KEYS_SEQUENTIAL; distribution <= KEYS_LONG; distribution++)
+      {
+        if (wanted_any (property_names))
+          bench_object_properties ((keys_t) distribution, sizes[i]);
+        if (wanted_any (chain_names))
+          bench_object_chains ((keys_t) distribution, sizes[i]);
+        bench_object_merge ((keys_t) distribution, sizes[i]);
+      }
+  if (wanted_any (array_names))
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+      bench_arrays (sizes[i]);
+  if (wanted_any (heap_names))
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+      bench_heap (sizes[i]);
+  if (wanted_any (refs_names))
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+      bench_refs (sizes[i]);
+  bench_generic_caller ();
+  printf ("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,228 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Times the same loops written against the C API and against proto.hpp,
+ * and prints one JSON document with both and the wrapper's overhead as a
+ * ratio of medians, which should stay at about 1. The boxed cases store
+ * scalars the way C callers without the wrapper often do, through a heap
+ * proto_data_t, to show what the unboxed accessors save.
+ */
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 21
+#endif
+
+#ifndef BENCH_SIZE
+#define BENCH_SIZE 4096
+#endif
+
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 50
+#endif
+
+typedef struct {
+  const char *name;
+  double samples[BENCH_SAMPLES + 1];
+  double median;
+} bench_case_t;
+
+static char keys[BENCH_SIZE][16];
+static bool first_case = true;
+static volatile long sink;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+static void
+report (bench_case_t *bench)
+{
+  double sorted[BENCH_SAMPLES];
+
+  memcpy (sorted, bench->samples + 1, sizeof (sorted));
+  qsort (sorted, BENCH_SAMPLES, sizeof (double), &compare_doubles);
+  bench->median = sorted[BENCH_SAMPLES / 2];
+  printf ("%s\n    {\"name\": \"%s\", \"keys\": \"sequential\", \"size\": %d, "
+          "\"min_ns\": %.2f, \"median_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f}",
+          first_case ? "" : ",", bench->name, BENCH_SIZE, sorted[0], bench->median,
+          sorted[(BENCH_SAMPLES * 9 + 5) / 10 - 1], sorted[BENCH_SAMPLES - 1]);
+  first_case = false;
+}
+
+// Runs body once per sample, BENCH_ROUNDS times over BENCH_SIZE elements
+template <typename Body>
+static void
+run_case (bench_case_t *bench,
+          const char *name,
+          Body body)
+{
+  size_t sample;
+  int round;
+  double start;
+
+  bench->name = name;
+  for (sample = 0; sample <= BENCH_SAMPLES; sample++)
+    {
+      start = now ();
+      for (round = 0; round < BENCH_ROUNDS; round++)
+        body ();
+      bench->samples[sample] = (now () - start) / ((double) BENCH_ROUNDS * BENCH_SIZE);
+    }
+  report (bench);
+}
+
+static void
+bench_objects (bench_case_t *cases)
+{
+  proto_object_t *c_object = proto_init_object ();
+  proto_object_t *boxed_object = proto_init_object ();
+  proto::object object;
+  proto_data_t *boxes = (proto_data_t *) calloc (BENCH_SIZE, sizeof (proto_data_t));
+
+  run_case (&cases[0], "c.object.set", [&] {
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      c_object->set_own_property (c_object, keys[i], (const void *) (uintptr_t) i);
+  });
+  run_case (&cases[1], "cpp.object.set", [&] {
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      object.set (keys[i], (long) i);
+  });
+  run_case (&cases[2], "boxed.object.set", [&] {
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      {
+        proto_data_t *box = (proto_data_t *) malloc (sizeof (proto_data_t));
+
+        box->type = integer_t;
+        box->data.integer = (long) i;
+        free (boxes[i].data.pointer);
+        boxes[i].data.pointer = box;
+        boxed_object->set_own_property (boxed_object, keys[i], box);
+      }
+  });
+  run_case (&cases[3], "c.object.get", [&] {
+    long sum = 0;
+
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      sum += (long) (uintptr_t) proto_object_get (c_object, keys[i]);
+    sink = sum;
+  });
+  run_case (&cases[4], "cpp.object.get", [&] {
+    long sum = 0;
+
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      sum += object.get<long> (keys[i]);
+    sink = sum;
+  });
+  run_case (&cases[5], "boxed.object.get", [&] {
+    long sum = 0;
+
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      sum += ((const proto_data_t *) proto_object_get (boxed_object, keys[i]))->data.integer;
+    sink = sum;
+  });
+  for (size_t i = 0; i < BENCH_SIZE; i++)
+    free (boxes[i].data.pointer);
+  free (boxes);
+  proto_del_object (boxed_object);
+  proto_del_object (c_object);
+}
+
+static void
+bench_arrays (bench_case_t *cases)
+{
+  proto_array_t *c_array = proto_init_array ();
+  proto::array array;
+
+  run_case (&cases[0], "c.array.push", [&] {
+    proto_array_t *fresh = proto_init_array ();
+
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      proto_array_push_fast (fresh, (const void *) (uintptr_t) i);
+    proto_del_array (fresh);
+  });
+  run_case (&cases[1], "cpp.array.push", [&] {
+    proto::array fresh;
+
+    for (size_t i = 0; i < BENCH_SIZE; i++)
+      fresh.push ((long) i);
+  });
+  for (size_t i = 0; i < BENCH_SIZE; i++)
+    {
+      proto_array_push_fast (c_array, (const void *) (uintptr_t) i);
+      array.push ((long) i);
+    }
+  run_case (&cases[2], "c.array.iterate", [&] {
+    long sum = 0;
+    size_t length = proto_array_length (c_array);
+
+    for (size_t i = 0; i < length; i++)
+      sum += (long) (uintptr_t) proto_array_at (c_array, i);
+    sink = sum;
+  });
+  run_case (&cases[3], "cpp.array.iterate", [&] {
+    long sum = 0;
+
+    for (long value : array.as<long> ())
+      sum += value;
+    sink = sum;
+  });
+  proto_del_array (c_array);
+}
+
+static void
+report_overhead (const bench_case_t *c,
+                 const bench_case_t *cpp,
+                 const char *name)
+{
+  printf ("%s\n    {\"name\": \"%s\", \"ratio\": %.3f}", first_case ? "" : ",", name,
+          c->median > 0 ? cpp->median / c->median : 0);
+  first_case = false;
+}
+
+int
+main ()
+{
+  bench_case_t objects[6], arrays[4];
+  size_t i;
+
+  for (i = 0; i < BENCH_SIZE; i++)
+    sprintf (keys[i], "key%zu", i);
+  printf ("{\n  \"benchmark\": \"bench_cpp\",\n  \"samples\": %d,\n  \"unit\": \"ns/op\",\n  \"results\": [",
+          BENCH_SAMPLES);
+  bench_objects (objects);
+  bench_arrays (arrays);
+  printf ("\n  ],\n  \"overhead\": [");
+  first_case = true;
+  report_overhead (&objects[0], &objects[1], "object.set");
+  report_overhead (&objects[3], &objects[4], "object.get");
+  report_overhead (&arrays[0], &arrays[1], "array.push");
+  report_overhead (&arrays[2], &arrays[3], "array.iterate");
+  printf ("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,92 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LENGTH (1UL << 22)
+
+typedef struct {
+  unsigned long key;
+  unsigned long payload;
+} record_t;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+compare_keys (const void *a,
+              const void *b)
+{
+  unsigned long x = ((const record_t *) a)->key, y = ((const record_t *) b)->key;
+
+  return (x > y) - (x < y);
+}
+
+static void
+check_order (const void *record,
+             size_t position,
+             void *context)
+{
+  unsigned long *last = (unsigned long *) context;
+
+  if (((const record_t *) record)->key < *last)
+    last[1]++;
+  *last = ((const record_t *) record)->key;
+}
+
+// Sorts LENGTH records keeping at most budget bytes of them in memory
+static double
+sort_within (size_t budget,
+             unsigned long *unordered)
+{
+  proto_external_sort_t *sorter = proto_init_external_sort (sizeof (record_t), &compare_keys, budget);
+  unsigned long last[2] = { 0, 0 };
+  record_t record;
+  double start = now ();
+  size_t i;
+
+  for (i = 0; i < LENGTH; i++)
+    {
+      record.key = i * 2654435761UL % LENGTH;
+      record.payload = i;
+      proto_external_sort_push (sorter, &record);
+    }
+  proto_external_sort_each (sorter, &check_order, last);
+  proto_del_external_sort (sorter);
+  *unordered += last[1];
+  return now () - start;
+}
+
+int
+main ()
+{
+  size_t budgets[] = { LENGTH * 2 * sizeof (record_t), 64UL << 20, 16UL << 20, 4UL << 20 }, i;
+  double memory_ns = 0, ns;
+  unsigned long unordered = 0;
+
+  printf ("%12s %8s %12s %10s\n", "budget MiB", "runs", "ns/record", "vs memory");
+  for (i = 0; i < sizeof (budgets) / sizeof (budgets[0]); i++)
+    {
+      size_t per_run = budgets[i] / (sizeof (record_t) + sizeof (void *));
+
+      ns = sort_within (budgets[i], &unordered);
+      if (i == 0)
+        memory_ns = ns;
+      printf ("%12zu %8zu %12.2f %9.2fx\n", budgets[i] >> 20, (LENGTH + per_run - 1) / per_run,
+        ns / LENGTH, ns / memory_ns);
+    }
+  return unordered != 0;
+}
@@ -0,0 +1,226 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Counts what proto allocates per object, key, array element and generic
+ * call, and how much of it stays retained, as one JSON document. The
+ * counts come from malloc, calloc and realloc defined here: a definition
+ * in the executable takes the place of libc's for the library as well,
+ * whether it's linked statically or not. Retained bytes come from
+ * proto_object_memory_usage and proto_array_memory_usage.
+ */
+
+#define OPERATIONS 1000
+#define ELEMENTS 100000
+
+#ifdef __GLIBC__
+#define INTERPOSED true
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *pointer, size_t size);
+extern void __libc_free (void *pointer);
+#else
+#define INTERPOSED false
+#endif
+
+static bool counting;
+static size_t allocations;
+static size_t bytes;
+static bool first_case = true;
+
+#ifdef __GLIBC__
+void *
+malloc (size_t size)
+{
+  if (counting)
+    {
+      allocations++;
+      bytes += size;
+    }
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t count,
+        size_t size)
+{
+  if (counting)
+    {
+      allocations++;
+      bytes += count * size;
+    }
+  return __libc_calloc (count, size);
+}
+
+void *
+realloc (void *pointer,
+         size_t size)
+{
+  if (counting)
+    {
+      allocations++;
+      bytes += size;
+    }
+  return __libc_realloc (pointer, size);
+}
+
+void
+free (void *pointer)
+{
+  __libc_free (pointer);
+}
+#endif
+
+static void
+count_start ()
+{
+  allocations = bytes = 0;
+  counting = true;
+}
+
+static void
+count_stop ()
+{
+  counting = false;
+}
+
+static void
+report (const char *name,
+        size_t size,
+        size_t operations,
+        size_t retained)
+{
+  if (INTERPOSED)
+    printf ("%s\n    {\"name\": \"%s\", \"size\": %zu, \"allocations\": %.2f, \"bytes\": %.2f, "
+            "\"retained_bytes\": %.2f}", first_case ? "" : ",", name, size,
+            (double) allocations / operations, (double) bytes / operations, (double) retained / operations);
+  else
+    printf ("%s\n    {\"name\": \"%s\", \"size\": %zu, \"allocations\": null, \"bytes\": null, "
+            "\"retained_bytes\": %.2f}", first_case ? "" : ",", name, size, (double) retained / operations);
+  first_case = false;
+}
+
+static void
+bench_objects ()
+{
+  proto_object_t *objects[OPERATIONS];
+  size_t i, retained = 0;
+
+  count_start ();
+  for (i = 0; i < OPERATIONS; i++)
+    objects[i] = proto_init_object ();
+  count_stop ();
+  for (i = 0; i < OPERATIONS; i++)
+    {
+      retained += proto_object_memory_usage (objects[i]);
+      proto_del_object (objects[i]);
+    }
+  report ("object.init", 0, OPERATIONS, retained);
+}
+
+// Per key set, with keys of about key_length characters
+static void
+bench_keys (const char *name,
+            size_t key_length,
+            bool chained)
+{
+  proto_object_t *object = proto_init_object ();
+  char (*keys)[80] = malloc (OPERATIONS * sizeof (*keys));
+  size_t i, before;
+
+  for (i = 0; i < OPERATIONS; i++)
+    {
+      snprintf (keys[i], sizeof (keys[i]), "%s%.*s%zu", chained ? "outer.inner." : "",
+                (int) key_length, "a-rather-long-property-name-shared-by-every-key-prefix-", i);
+    }
+  if (chained)
+    object->set_chain (object, "outer.inner.first", keys);
+  before = proto_object_memory_usage (object);
+  count_start ();
+  for (i = 0; i < OPERATIONS; i++)
+    if (chained)
+      object->set_chain (object, keys[i], keys[i]);
+    else
+      object->set_own_property (object, keys[i], keys[i]);
+  count_stop ();
+  report (name, key_length, OPERATIONS, proto_object_memory_usage (object) - before);
+  proto_del_object (object);
+  free (keys);
+}
+
+static void
+bench_elements (const char *name,
+                proto_array_t *(*init) (),
+                size_t length,
+                bool indexed)
+{
+  proto_array_t *array;
+  size_t i;
+
+  count_start ();
+  array = init ();
+  if (indexed)
+    proto_array_hash_index (array, true);
+  for (i = 0; i < length; i++)
+    array->push (array, (void *) (i + 1));
+  if (indexed)
+    array->includes (array, (void *) 1);
+  count_stop ();
+  report (name, length, length, proto_array_memory_usage (array));
+  proto_del_array (array);
+}
+
+static void *
+consume (const void *arguments)
+{
+  return (void *) ((const proto_array_t *) arguments)->length;
+}
+
+static void
+bench_calls ()
+{
+  proto_signature_t *signature = proto_signature_compile ("%i %d %s");
+  size_t i;
+
+  count_start ();
+  for (i = 0; i < OPERATIONS; i++)
+    proto_generic_caller ("%i %d %s", &consume, (long) i, 0.5, "x");
+  count_stop ();
+  report ("generic_caller", 3, OPERATIONS, 0);
+
+  count_start ();
+  for (i = 0; i < OPERATIONS; i++)
+    proto_signature_call (signature, &consume, (long) i, 0.5, "x");
+  count_stop ();
+  report ("signature_call", 3, OPERATIONS, 0);
+  proto_del_signature (signature);
+}
+
+int
+main ()
+{
+  if (!INTERPOSED)
+    fprintf (stderr, "bench_memory: allocations aren't counted without glibc\n");
+  printf ("{\n  \"benchmark\": \"bench_memory\",\n  \"unit\": \"per op\",\n  \"results\": [");
+  bench_objects ();
+  bench_keys ("object.key", 8, false);
+  bench_keys ("object.key", 48, false);
+  bench_keys ("object.chain_key", 8, true);
+  bench_elements ("array.element", &proto_init_array, 1000, false);
+  bench_elements ("array.element", &proto_init_array, ELEMENTS, false);
+  bench_elements ("array.indexed_element", &proto_init_array, ELEMENTS, true);
+  bench_elements ("chunked.element", &proto_init_chunked_array, ELEMENTS, false);
+  bench_calls ();
+  printf ("\n  ]\n}\n");
+  return 0;
+}
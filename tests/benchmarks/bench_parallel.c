@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LENGTH (1UL << 22)
+#define ROUNDS 5
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Same work as reduce_integers in the generic caller suite
+static void
+sum_fold (void *accumulator,
+          const void *element,
+          void *context)
+{
+  *(long *) accumulator += TYPED_VALUE ((proto_data_t *) element, long);
+}
+
+static void
+sum_combine (void *accumulator,
+             const void *partial,
+             void *context)
+{
+  *(long *) accumulator += *(const long *) partial;
+}
+
+static const void *
+pick_odd (const void *element,
+          void *context)
+{
+  return TYPED_VALUE ((proto_data_t *) element, long) % 2 ? element : NULL;
+}
+
+int
+main ()
+{
+  proto_array_t *array, *mapped;
+  proto_pool_t *pool;
+  long online = sysconf (_SC_NPROCESSORS_ONLN), total;
+  size_t workers, i, round;
+  double start, reduce_ns, map_ns, reduce_base = 0, map_base = 0;
+
+  array = proto_init_array ();
+  for (i = 0; i < LENGTH; i++)
+    array->push (array, T_INTEGER ((long) i));
+  printf ("%8s %12s %8s %12s %8s\n", "workers", "reduce ms", "speedup", "map ms", "speedup");
+  for (workers = 1; workers <= (size_t) (online > 0 ? online : 1); workers++)
+    {
+      pool = proto_init_pool (workers);
+      reduce_ns = map_ns = 0;
+      for (round = 0; round < ROUNDS; round++)
+        {
+          total = 0;
+          start = now ();
+          proto_array_parallel_reduce (pool, array, &total, sizeof (long),
+            &sum_fold, &sum_combine, NULL);
+          reduce_ns += now () - start;
+          if (total != (long) (LENGTH * (LENGTH - 1) / 2))
+            return 1;
+          start = now ();
+          mapped = proto_array_parallel_map (pool, array, &pick_odd, NULL);
+          map_ns += now () - start;
+          proto_del_array (mapped);
+        }
+      reduce_ns /= ROUNDS;
+      map_ns /= ROUNDS;
+      if (workers == 1)
+        {
+          reduce_base = reduce_ns;
+          map_base = map_ns;
+        }
+      printf ("%8zu %12.2f %7.2fx %12.2f %7.2fx\n", workers, reduce_ns / 1e6,
+        reduce_base / reduce_ns, map_ns / 1e6, map_base / map_ns);
+      proto_del_pool (pool);
+    }
+  while (array->length)
+    proto_del_data ((proto_data_t *) array->pop (array));
+  proto_del_array (array);
+  return 0;
+}
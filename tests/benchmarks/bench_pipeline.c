@@ -0,0 +1,119 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LENGTH (1UL << 21)
+#define ROUNDS 5
+
+static long *values;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Points at the value twice as large, wrapping around
+static const void *
+doubled (const void *element,
+         void *context)
+{
+  return &values[(*(const long *) element * 2) % LENGTH];
+}
+
+static bool
+is_odd (const void *element,
+        void *context)
+{
+  return *(const long *) element % 2;
+}
+
+static bool
+not_multiple_of_three (const void *element,
+                       void *context)
+{
+  return *(const long *) element % 3;
+}
+
+// One full array per step, the way chains were written before pipelines
+static proto_array_t *
+with_intermediates (const proto_array_t *array)
+{
+  proto_array_t *mapped = proto_init_array (), *odd = proto_init_array (), *result = proto_init_array ();
+  const void *element;
+  size_t i;
+
+  for (i = 0; i < array->length; i++)
+    mapped->push (mapped, doubled (array->at (array, i), NULL));
+  for (i = 0; i < mapped->length; i++)
+    if (is_odd (element = mapped->at (mapped, i), NULL))
+      odd->push (odd, element);
+  for (i = 0; i < odd->length; i++)
+    if (not_multiple_of_three (element = odd->at (odd, i), NULL))
+      result->push (result, doubled (element, NULL));
+  proto_del_array (mapped);
+  proto_del_array (odd);
+  return result;
+}
+
+static proto_array_t *
+with_pipeline (const proto_array_t *array)
+{
+  proto_pipeline_t *pipeline = proto_pipeline_from_array (array);
+  proto_array_t *result;
+
+  pipeline = proto_pipeline_map (pipeline, &doubled, NULL);
+  pipeline = proto_pipeline_filter (pipeline, &is_odd, NULL);
+  pipeline = proto_pipeline_filter (pipeline, &not_multiple_of_three, NULL);
+  pipeline = proto_pipeline_map (pipeline, &doubled, NULL);
+  result = proto_pipeline_collect (pipeline);
+  proto_del_pipeline (pipeline);
+  return result;
+}
+
+int
+main ()
+{
+  proto_array_t *array, *result;
+  size_t i, round, length = 0;
+  double start, intermediate_ns = 0, pipeline_ns = 0;
+
+  values = (long *) malloc (LENGTH * sizeof (long));
+  array = proto_init_array ();
+  for (i = 0; i < LENGTH; i++)
+    {
+      values[i] = (long) (i * 2654435761UL % LENGTH);
+      array->push (array, &values[i]);
+    }
+  for (round = 0; round < ROUNDS; round++)
+    {
+      start = now ();
+      result = with_intermediates (array);
+      intermediate_ns += now () - start;
+      length += result->length;
+      proto_del_array (result);
+
+      start = now ();
+      result = with_pipeline (array);
+      pipeline_ns += now () - start;
+      length -= result->length;
+      proto_del_array (result);
+    }
+  printf ("%14s %14s %8s\n", "arrays ns/el", "pipeline ns/el", "speedup");
+  printf ("%14.2f %14.2f %7.2fx\n", intermediate_ns / (ROUNDS * LENGTH),
+    pipeline_ns / (ROUNDS * LENGTH), intermediate_ns / pipeline_ns);
+  proto_del_array (array);
+  free (values);
+  return length != 0;
+}
@@ -0,0 +1,206 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ELEMENTS (1UL << 16)
+#define MANY 4
+
+typedef struct {
+  const char *name;
+  void *(*init) ();
+  void (*push) (void *queue, const void *element);
+  const void *(*shift) (void *queue);
+  void (*del) (void *queue);
+} bench_queue_t;
+
+typedef struct {
+  const bench_queue_t *kind;
+  void *queue;
+  size_t count;
+} bench_thread_t;
+
+// The setup the lock-free queue replaces: an array guarded by a mutex. Its
+// shift moves every queued item, so ELEMENTS stays small enough for it.
+typedef struct {
+  pthread_mutex_t lock;
+  proto_array_t *array;
+} locked_array_t;
+
+static long element;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *
+locked_init ()
+{
+  locked_array_t *locked = (locked_array_t *) malloc (sizeof (locked_array_t));
+
+  pthread_mutex_init (&locked->lock, NULL);
+  locked->array = proto_init_array ();
+  return locked;
+}
+
+static void
+locked_push (void *queue,
+             const void *element)
+{
+  locked_array_t *locked = (locked_array_t *) queue;
+
+  pthread_mutex_lock (&locked->lock);
+  locked->array->push (locked->array, element);
+  pthread_mutex_unlock (&locked->lock);
+}
+
+static const void *
+locked_shift (void *queue)
+{
+  locked_array_t *locked = (locked_array_t *) queue;
+  const void *element = NULL;
+
+  while (element == NULL)
+    {
+      pthread_mutex_lock (&locked->lock);
+      if (locked->array->length)
+        element = locked->array->shift (locked->array);
+      pthread_mutex_unlock (&locked->lock);
+      if (element == NULL)
+        sched_yield ();
+    }
+  return element;
+}
+
+static void
+locked_del (void *queue)
+{
+  locked_array_t *locked = (locked_array_t *) queue;
+
+  proto_del_array (locked->array);
+  pthread_mutex_destroy (&locked->lock);
+  free (locked);
+}
+
+static void *
+bounded_init ()
+{
+  return proto_init_queue (1024);
+}
+
+static void *
+unbounded_init ()
+{
+  return proto_init_queue (0);
+}
+
+static void
+queue_push (void *queue,
+            const void *element)
+{
+  proto_queue_push ((proto_queue_t *) queue, element);
+}
+
+static const void *
+queue_shift (void *queue)
+{
+  return proto_queue_shift ((proto_queue_t *) queue);
+}
+
+static void
+queue_del (void *queue)
+{
+  proto_del_queue ((proto_queue_t *) queue);
+}
+
+static const bench_queue_t kinds[] = {
+  { "mutex+array", &locked_init, &locked_push, &locked_shift, &locked_del },
+  { "bounded", &bounded_init, &queue_push, &queue_shift, &queue_del },
+  { "unbounded", &unbounded_init, &queue_push, &queue_shift, &queue_del }
+};
+
+static void *
+producer (void *argument)
+{
+  bench_thread_t *thread = (bench_thread_t *) argument;
+  size_t i;
+
+  for (i = 0; i < thread->count; i++)
+    thread->kind->push (thread->queue, &element);
+  return NULL;
+}
+
+static void *
+consumer (void *argument)
+{
+  bench_thread_t *thread = (bench_thread_t *) argument;
+  size_t i;
+
+  for (i = 0; i < thread->count; i++)
+    thread->kind->shift (thread->queue);
+  return NULL;
+}
+
+// Million elements handed over per second
+static double
+throughput (const bench_queue_t *kind,
+            size_t producers,
+            size_t consumers)
+{
+  pthread_t threads[2 * MANY];
+  bench_thread_t produce, consume;
+  size_t i;
+  double start, elapsed;
+
+  produce.kind = consume.kind = kind;
+  produce.queue = consume.queue = kind->init ();
+  produce.count = ELEMENTS / producers;
+  consume.count = ELEMENTS / consumers;
+  start = now ();
+  for (i = 0; i < consumers; i++)
+    pthread_create (&threads[i], NULL, &consumer, &consume);
+  for (i = 0; i < producers; i++)
+    pthread_create (&threads[consumers + i], NULL, &producer, &produce);
+  for (i = 0; i < producers + consumers; i++)
+    pthread_join (threads[i], NULL);
+  elapsed = now () - start;
+  kind->del (produce.queue);
+  return ELEMENTS / elapsed * 1e3;
+}
+
+int
+main ()
+{
+  size_t configs[3][2] = { { 1, 1 }, { MANY, MANY }, { MANY, 1 } };
+  size_t config, kind;
+
+  printf ("%8s", "config");
+  for (kind = 0; kind < sizeof (kinds) / sizeof (kinds[0]); kind++)
+    printf (" %14s", kinds[kind].name);
+  printf ("   (M elements/s)\n");
+  for (config = 0; config < 3; config++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof (name), "%zuP%zuC", configs[config][0], configs[config][1]);
+      printf ("%8s", name);
+      for (kind = 0; kind < sizeof (kinds) / sizeof (kinds[0]); kind++)
+        printf (" %14.2f", throughput (&kinds[kind], configs[config][0], configs[config][1]));
+      printf ("\n");
+    }
+  return 0;
+}
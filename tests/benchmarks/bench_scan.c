@@ -0,0 +1,69 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WORK_PER_LENGTH (1UL << 26)
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The element-at-a-time loop proto_index used before vectorized scanning
+static size_t
+scalar_index (const proto_array_t *array,
+              const void *element)
+{
+  size_t i;
+
+  for (i = 0; i < array->length; i++)
+    if (array->items[i] == element)
+      return i;
+  return -1;
+}
+
+int
+main ()
+{
+  proto_array_t *array;
+  long *values;
+  size_t length, i, repetitions, sink = 0;
+  double start, scalar_ns, proto_ns;
+
+  printf ("%8s %14s %14s %8s\n", "length", "scalar ns/op", "index ns/op", "speedup");
+  for (length = 8; length <= 65536; length <<= 1)
+    {
+      values = (long *) malloc (length * sizeof (long));
+      array = proto_init_array ();
+      for (i = 0; i < length; i++)
+        array->push (array, &values[i]);
+      repetitions = WORK_PER_LENGTH / length;
+
+      start = now ();
+      for (i = 0; i < repetitions; i++)
+        sink += scalar_index (array, &values[length - 1 - (i & 1)]);
+      scalar_ns = (now () - start) / repetitions;
+
+      start = now ();
+      for (i = 0; i < repetitions; i++)
+        sink += array->index (array, &values[length - 1 - (i & 1)]);
+      proto_ns = (now () - start) / repetitions;
+
+      printf ("%8zu %14.1f %14.1f %7.2fx\n", length, scalar_ns, proto_ns, scalar_ns / proto_ns);
+      proto_del_array (array);
+      free (values);
+    }
+  return sink == 0;
+}
@@ -0,0 +1,139 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CALLS 2000000
+
+static double sink;
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *
+consume (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+
+  sink += TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 0), long)
+    + TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 1), double)
+    + *(char *) VALUE ((proto_data_t *) arguments_list->at (arguments_list, 2));
+  return NULL;
+}
+
+static void *
+add (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+
+  return (void *) (TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 0), long)
+    + TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 1), long));
+}
+
+static void
+add_batch (const void *const *columns,
+           size_t rows,
+           void **results)
+{
+  const long *a = (const long *) columns[0], *b = (const long *) columns[1];
+  size_t i;
+
+  for (i = 0; i < rows; i++)
+    results[i] = (void *) (a[i] + b[i]);
+}
+
+// The same rows through one call each, per row over columns, and in batches
+static void
+bench_columns ()
+{
+  proto_signature_t *signature = proto_signature_compile ("%i %i");
+  long *a = (long *) malloc (CALLS * sizeof (long)), *b = (long *) malloc (CALLS * sizeof (long));
+  proto_column_t columns[2] = { { NULL, NULL }, { NULL, NULL } };
+  proto_array_t *results = proto_init_array ();
+  double start, single_ns, rows_ns, batch_ns;
+  size_t i;
+
+  for (i = 0; i < CALLS; i++)
+    {
+      a[i] = (long) i;
+      b[i] = (long) (CALLS - i);
+    }
+  columns[0].values = a;
+  columns[1].values = b;
+  start = now ();
+  for (i = 0; i < CALLS; i++)
+    results->push (results, proto_signature_call (signature, &add, a[i], b[i]));
+  single_ns = now () - start;
+  proto_del_array (results);
+
+  start = now ();
+  results = proto_signature_call_rows (signature, &add, columns, CALLS);
+  rows_ns = now () - start;
+  proto_del_array (results);
+
+  start = now ();
+  results = proto_signature_call_batch (signature, &add_batch, columns, CALLS);
+  batch_ns = now () - start;
+  if (results->at (results, CALLS - 1) != (void *) CALLS)
+    sink = -1;
+  proto_del_array (results);
+
+  printf ("\n%16s %14s %8s\n", "columns", "rows/s", "speedup");
+  printf ("%16s %14.0f %7.2fx\n", "signature_call", CALLS * 1e9 / single_ns, 1.0);
+  printf ("%16s %14.0f %7.2fx\n", "call_rows", CALLS * 1e9 / rows_ns, single_ns / rows_ns);
+  printf ("%16s %14.0f %7.2fx\n", "call_batch", CALLS * 1e9 / batch_ns, single_ns / batch_ns);
+  proto_del_signature (signature);
+  free (a);
+  free (b);
+}
+
+int
+main ()
+{
+  proto_signature_t *signature = proto_signature_compile ("%i %d %s");
+  proto_frame_t *frame = proto_init_frame (signature);
+  double start, parsed_ns, compiled_ns, framed_ns, expected;
+  size_t i;
+
+  start = now ();
+  for (i = 0; i < CALLS; i++)
+    proto_generic_caller ("%i %d %s", &consume, (long) i, 0.5, "x");
+  parsed_ns = now () - start;
+  expected = sink;
+
+  sink = 0;
+  start = now ();
+  for (i = 0; i < CALLS; i++)
+    proto_signature_call (signature, &consume, (long) i, 0.5, "x");
+  compiled_ns = now () - start;
+
+  sink = 0;
+  start = now ();
+  for (i = 0; i < CALLS; i++)
+    proto_signature_call_frame (signature, frame, &consume, (long) i, 0.5, "x");
+  framed_ns = now () - start;
+
+  printf ("%16s %14s %8s\n", "path", "calls/s", "speedup");
+  printf ("%16s %14.0f %7.2fx\n", "generic_caller", CALLS * 1e9 / parsed_ns, 1.0);
+  printf ("%16s %14.0f %7.2fx\n", "signature_call", CALLS * 1e9 / compiled_ns, parsed_ns / compiled_ns);
+  printf ("%16s %14.0f %7.2fx\n", "call_frame", CALLS * 1e9 / framed_ns, parsed_ns / framed_ns);
+  proto_del_frame (frame);
+  proto_del_signature (signature);
+  if (sink != expected)
+    return 1;
+  bench_columns ();
+  return sink < 0;
+}
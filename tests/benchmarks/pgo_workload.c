@@ -0,0 +1,130 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Training run for the profile-guided build (make pgo): a mix of object
+ * lookups, chain access, array operations and generic calls shaped like
+ * an application's, rather than like bench_core's sweeps, so the profile
+ * doesn't just learn the benchmark.
+ */
+
+#define ROUNDS 20
+#define RECORDS 2000
+
+static const char *fields[] = {
+  "id", "name", "email", "created_at", "updated_at", "owner", "status", "tags",
+  "parent", "children", "score", "visible"
+};
+
+static volatile size_t sink;
+
+static void *
+score (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+  long total = 0;
+  size_t i;
+
+  for (i = 0; i < arguments_list->length; i++)
+    {
+      proto_data_t *data = (proto_data_t *) arguments_list->at (arguments_list, i);
+
+      if (data->type == integer_t)
+        total += data->data.integer;
+    }
+  return (void *) total;
+}
+
+static void
+records ()
+{
+  proto_object_t *base = proto_init_object (), *record;
+  proto_array_t *all = proto_init_array (), *visible = proto_init_array (), *reversed;
+  proto_array_t *arguments = proto_init_array ();
+  proto_data_t numbers[3] = { { integer_t, { .integer = 1 } }, { integer_t, { .integer = 2 } },
+                              { decimal_t, { .decimal = 0.5 } } };
+  char key[32];
+  size_t i, j, nfields = sizeof (fields) / sizeof (fields[0]);
+
+  for (i = 0; i < 3; i++)
+    arguments->push (arguments, &numbers[i]);
+  base->set_own_property (base, "score", (const void *) &score);
+  base->set_chain (base, "defaults.status", "active");
+  for (i = 0; i < RECORDS; i++)
+    {
+      record = proto_init_object ();
+      for (j = 0; j < nfields; j++)
+        record->set_own_property (record, fields[j], fields[(i + j) % nfields]);
+      snprintf (key, sizeof (key), "meta.revision.r%zu", i % 7);
+      record->set_chain (record, key, record);
+      record->merge (record, base);
+      proto_array_push_fast (all, record);
+    }
+  for (i = 0; i < RECORDS; i++)
+    {
+      record = (proto_object_t *) proto_array_at (all, i);
+      for (j = 0; j < nfields; j++)
+        sink += (size_t) record->get_own_property (record, fields[j]);
+      sink += (size_t) proto_object_get (record, "missing");
+      sink += record->has_own_property (record, "visible");
+      sink += (size_t) record->get_chain (record, "defaults.status");
+      sink += (size_t) record->get_chain (record, "meta.revision.r3");
+      sink += (size_t) record->execute_property (record, "score", arguments);
+      if (i % 3)
+        visible->push (visible, record);
+      else
+        visible->insert (visible, visible->length / 2, record);
+    }
+  for (i = 0; i < RECORDS / 4; i++)
+    sink += visible->includes (visible, all->at (all, (i * 7919) % RECORDS));
+  reversed = (proto_array_t *) visible->reverse (visible);
+  visible->concat (visible, reversed);
+  while (visible->length > RECORDS)
+    sink += (size_t) visible->shift (visible);
+  for (i = 0; i < all->length; i++)
+    {
+      record = (proto_object_t *) all->at (all, i);
+      record->del_own_property (record, "tags");
+      proto_del_object (record);
+    }
+  proto_del_array (reversed);
+  proto_del_array (visible);
+  proto_del_array (all);
+  proto_del_array (arguments);
+  proto_del_object (base);
+}
+
+static void
+calls ()
+{
+  proto_signature_t *signature = proto_signature_compile ("%i %i %s");
+  size_t i;
+
+  for (i = 0; i < 50 * RECORDS; i++)
+    {
+      sink += (size_t) proto_generic_caller ("%i %d %s", &score, (long) i, 0.25, "x");
+      sink += (size_t) proto_signature_call (signature, &score, (long) i, 2L, "y");
+    }
+  proto_del_signature (signature);
+}
+
+int
+main ()
+{
+  size_t round;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      records ();
+      calls ();
+    }
+  return 0;
+}
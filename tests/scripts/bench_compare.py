@@ -0,0 +1,58 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# Copyright 2015 (c) Ewerton Assis
+#
+# Compares two bench_core JSON runs, case by case, and exits with 1 when any
+# case got slower than the threshold allows. A case only counts as slower
+# when its median moved past the threshold and its fastest sample did too,
+# which keeps one noisy sample from flagging a regression.
+
+import json
+import math
+import sys
+
+
+def load_cases(path):
+    with open(path) as f:
+        document = json.load(f)
+    return dict(((c['name'], c['keys'], c['size']), c) for c in document['results'])
+
+
+def compare_runs(baseline_path, current_path, threshold = 0.10):
+    baseline = load_cases(baseline_path)
+    current = load_cases(current_path)
+    regressions = 0
+    ratios = []
+    print("{0:<20} {1:<12} {2:>6} {3:>12} {4:>12} {5:>9}".format(
+        'case', 'keys', 'size', 'before ns', 'after ns', 'change'))
+    for key in sorted(baseline.keys()):
+        if key not in current:
+            print("{0:<20} {1:<12} {2:>6} missing from {3}".format(key[0], key[1], key[2], current_path))
+            continue
+        before, after = baseline[key], current[key]
+        change = after['median_ns'] / before['median_ns'] - 1 if before['median_ns'] > 0 else 0
+        if before['median_ns'] > 0 and after['median_ns'] > 0:
+            ratios.append(before['median_ns'] / after['median_ns'])
+        slower = change > threshold and after['min_ns'] > before['min_ns'] * (1 + threshold)
+        faster = change < -threshold
+        mark = ''
+        if slower:
+            regressions += 1
+            mark = "\033[1mREGRESSION\033[0m"
+        elif faster:
+            mark = 'faster'
+        print("{0:<20} {1:<12} {2:>6} {3:>12.2f} {4:>12.2f} {5:>+8.1f}% {6}".format(
+            key[0], key[1], key[2], before['median_ns'], after['median_ns'], change * 100, mark).rstrip())
+    if ratios:
+        speedup = math.exp(sum(math.log(r) for r in ratios) / len(ratios))
+        print("speedup over {0} case(s), geometric mean of medians: {1:.3f}x".format(len(ratios), speedup))
+    print("{0} regression(s) above {1:.0f}%".format(regressions, threshold * 100))
+    return regressions
+
+
+if __name__ == '__main__':
+    if len(sys.argv) not in (3, 4):
+        print("usage: {0} BASELINE.json CURRENT.json [THRESHOLD]".format(sys.argv[0]))
+        sys.exit(2)
+    threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 0.10
+    sys.exit(1 if compare_runs(sys.argv[1], sys.argv[2], threshold) else 0)
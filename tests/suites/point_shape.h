@@ -0,0 +1,35 @@
+// Generated by proto_keys.py; do not edit
+
+#ifndef PROTO_SHAPE_POINT
+#define PROTO_SHAPE_POINT
+
+#include <proto.h>
+
+#define PROTO_KEY_x PROTO_KEY_INIT ("x", 177693UL)
+#define PROTO_KEY_y PROTO_KEY_INIT ("y", 177694UL)
+#define PROTO_KEY_label PROTO_KEY_INIT ("label", 210719225253UL)
+#define PROTO_KEY_z_index PROTO_KEY_INIT ("z-index", 229489290431268UL)
+
+#if defined (__GNUC__)
+#define PROTO_SHAPE_UNUSED __attribute__ ((unused))
+#else
+#define PROTO_SHAPE_UNUSED
+#endif
+
+enum {
+  POINT_X,
+  POINT_Y,
+  POINT_LABEL,
+  POINT_Z_INDEX,
+};
+
+static const proto_key_t point_keys[] PROTO_SHAPE_UNUSED = {
+  PROTO_KEY_x,
+  PROTO_KEY_y,
+  PROTO_KEY_label,
+  PROTO_KEY_z_index,
+};
+
+static const proto_shape_t point_shape PROTO_SHAPE_UNUSED = PROTO_SHAPE_INIT (point_keys);
+
+#endif // PROTO_SHAPE_POINT
@@ -443,6 +443,83 @@ test_array_reverse ()
   proto_del_array (array);
 }
 
+void
+test_array_index_large ()
+{
+  proto_array_t *array;
+  long values[1000];
+  size_t i, mismatches = 0;
+
+  describe ("Find elements and their indexes in a large array");
+  array = proto_init_array ();
+  for (i = 0; i < 1000; i++)
+    array->push (array, &values[i % 500]);
+  for (i = 0; i < 500; i++)
+    {
+      if (array->index (array, &values[i]) != i)
+        mismatches++;
+      if (!array->includes (array, &values[i]))
+        mismatches++;
+    }
+  should_equal (mismatches, 0);
+  should_be_false (array->includes (array, &array));
+  should_equal (array->index (array, &array), (size_t) -1);
+  should_equal (array->del (array, 0), &values[0]);
+  should_equal (array->index (array, &values[0]), 499);
+  proto_del_array (array);
+}
+
+static int
+compare_values (const void *a,
+                const void *b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+void
+test_array_direct_calls ()
+{
+  proto_array_t *array = proto_init_array (), *sorted = proto_init_array ();
+  proto_array_t *chunked = proto_init_chunked_array ();
+  int values[300];
+  size_t i, mismatches = 0;
+
+  describe ("Push and read through the inline direct calls");
+  for (i = 0; i < 300; i++)
+    {
+      values[i] = 300 - (int) i;
+      proto_array_push_fast (array, &values[i]);
+      proto_array_push_fast (chunked, &values[i]);
+    }
+  sorted->compare = &compare_values;
+  for (i = 0; i < 300; i++)
+    proto_array_push_fast (sorted, &values[i]);
+  for (i = 0; i < 300; i++)
+    {
+      if (proto_array_at (array, i) != &values[i] || proto_array_at (array, i) != array->at (array, i))
+        mismatches++;
+      if (proto_array_at (chunked, i) != &values[i])
+        mismatches++;
+      if (proto_array_at (sorted, i) != &values[299 - i])
+        mismatches++;
+    }
+  should_equal (mismatches, 0);
+  should_equal (proto_array_length (array), 300);
+  should_equal (proto_array_length (chunked), 300);
+  should_equal (proto_array_length (NULL), 0);
+  should_equal (proto_array_at (array, 300), NULL);
+  should_equal (proto_array_at (NULL, 0), NULL);
+
+  // Indexed arrays go through push, which keeps the index current
+  proto_array_hash_index (array, true);
+  proto_array_push_fast (array, &mismatches);
+  should_be_true (array->includes (array, &mismatches));
+  should_equal (array->index (array, &mismatches), 300);
+  proto_del_array (array);
+  proto_del_array (sorted);
+  proto_del_array (chunked);
+}
+
 void
 run_tests ()
 {
@@ -458,4 +535,6 @@ run_tests ()
   test_array_stress ();
   test_array_concat ();
   test_array_reverse ();
+  test_array_index_large ();
+  test_array_direct_calls ();
 }
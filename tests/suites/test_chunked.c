@@ -0,0 +1,150 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+#define LENGTH 20000
+
+static long values[LENGTH];
+
+static size_t
+mismatches (const proto_array_t *array,
+            const proto_array_t *reference)
+{
+  size_t i, count = 0;
+
+  if (array->length != reference->length)
+    return array->length + reference->length;
+  for (i = 0; i < array->length; i++)
+    if (array->at (array, i) != reference->at (reference, i))
+      count++;
+  return count;
+}
+
+void
+test_chunked_middle_edits ()
+{
+  proto_array_t *array, *reference;
+  size_t i, position, removed = 0;
+  unsigned long seed = 7;
+
+  describe ("Insert and delete in the middle of a chunked array");
+  array = proto_init_chunked_array ();
+  reference = proto_init_array ();
+  should_equal (array->items, NULL);
+  for (i = 0; i < LENGTH; i++)
+    {
+      values[i] = (long) i;
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      position = (seed >> 33) % (array->length + 1);
+      array->insert (array, position, &values[i]);
+      reference->insert (reference, position, &values[i]);
+    }
+  should_equal (array->length, LENGTH);
+  should_equal (mismatches (array, reference), 0);
+  for (i = 0; i < LENGTH - 10; i++)
+    {
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      position = (seed >> 33) % array->length;
+      if (array->del (array, position) == reference->del (reference, position))
+        removed++;
+    }
+  should_equal (removed, LENGTH - 10);
+  should_equal (array->length, 10);
+  should_equal (mismatches (array, reference), 0);
+  should_equal (array->at (array, 10), NULL);
+  should_equal (array->del (array, 10), NULL);
+  proto_del_array (reference);
+  proto_del_array (array);
+}
+
+void
+test_chunked_ends ()
+{
+  proto_array_t *array;
+  size_t i, popped = 0;
+
+  describe ("Push, pop, shift and unshift on a chunked array");
+  array = proto_init_chunked_array ();
+  should_equal (array->pop (array), NULL);
+  should_equal (array->first (array), NULL);
+  for (i = 0; i < LENGTH; i++)
+    array->push (array, &values[i]);
+  array->unshift (array, &values[1]);
+  should_equal (array->length, LENGTH + 1);
+  should_equal (array->first (array), &values[1]);
+  should_equal (array->last (array), &values[LENGTH - 1]);
+  should_equal (array->shift (array), &values[1]);
+  should_equal (array->at (array, 4321), &values[4321]);
+  for (i = LENGTH; i > 0; i--)
+    if (array->pop (array) == &values[i - 1])
+      popped++;
+  should_equal (popped, LENGTH);
+  should_equal (array->length, 0);
+  array->push (array, &values[2]);
+  should_equal (array->first (array), &values[2]);
+  proto_del_array (array);
+}
+
+void
+test_chunked_queries ()
+{
+  proto_array_t *array, *reversed;
+  proto_array_view_t view;
+  proto_data_t *data[LENGTH / 10];
+  size_t i, out_of_order = 0;
+
+  describe ("Search, sort and view a chunked array");
+  array = proto_init_chunked_array ();
+  for (i = 0; i < LENGTH; i++)
+    array->push (array, &values[i]);
+  should_be_true (array->includes (array, &values[LENGTH - 1]));
+  should_equal (array->index (array, &values[LENGTH - 1]), LENGTH - 1);
+  should_equal (array->index (array, &values[77]), 77);
+  should_equal (array->index (array, &out_of_order), -1);
+  proto_array_hash_index (array, true);
+  array->insert (array, 100, &out_of_order);
+  should_equal (array->index (array, &out_of_order), 100);
+  should_equal (array->index (array, &values[100]), 101);
+  proto_array_hash_index (array, false);
+  reversed = array->reverse (array);
+  should_equal (reversed->at (reversed, 0), &values[LENGTH - 1]);
+  should_equal (reversed->at (reversed, LENGTH), &values[0]);
+  proto_del_array (reversed);
+  proto_init_array_view (&view, array, 99, 3, 1);
+  should_equal (view.at (&view, 1), &out_of_order);
+  proto_del_array (array);
+
+  array = proto_init_chunked_array ();
+  for (i = 0; i < LENGTH / 10; i++)
+    {
+      data[i] = proto_integer ((long) ((i * 7919) % (LENGTH / 10)));
+      array->push (array, data[i]);
+    }
+  proto_array_sort (array, &proto_compare_integer);
+  for (i = 1; i < array->length; i++)
+    if (proto_compare_integer (array->at (array, i - 1), array->at (array, i)) > 0)
+      out_of_order++;
+  should_equal (out_of_order, 0);
+  proto_array_keep_sorted (array, &proto_compare_integer);
+  array->push (array, data[3]);
+  should_equal (array->at (array, 1758), data[3]);
+  should_equal (array->index (array, data[3]), 1757);
+  for (i = 0; i < LENGTH / 10; i++)
+    proto_del_data (data[i]);
+  proto_del_array (array);
+}
+
+void
+run_tests ()
+{
+  test_chunked_middle_edits ();
+  test_chunked_ends ();
+  test_chunked_queries ();
+}
@@ -0,0 +1,187 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.hpp>
+#include <type_traits>
+#include <utility>
+
+#include "utils.h"
+
+static void *
+count_arguments (const void *arguments)
+{
+  return (void *) ((const proto_array_t *) arguments)->length;
+}
+
+void
+test_cpp_ownership ()
+{
+  static_assert (!std::is_copy_constructible_v<proto::object>, "objects are move-only");
+  static_assert (!std::is_copy_assignable_v<proto::array>, "arrays are move-only");
+  static_assert (std::is_nothrow_move_constructible_v<proto::object>, "moves don't throw");
+
+  describe ("Own objects and arrays, handing them over on move");
+  proto::object object;
+  proto_object_t *native = object.native ();
+  should_be_true (native != NULL);
+  object.set ("kept", 7L);
+
+  proto::object moved (std::move (object));
+  should_be_false (static_cast<bool> (object));
+  should_equal (moved.native (), native);
+  should_equal (moved.get<long> ("kept"), 7L);
+  // A moved-from object reads as empty rather than crashing
+  should_be_false (object.has ("kept"));
+  should_equal (object.get<long> ("kept"), 0L);
+
+  proto::object assigned;
+  assigned = std::move (moved);
+  should_equal (assigned.native (), native);
+  should_be_false (static_cast<bool> (moved));
+
+  proto_object_t *released = assigned.release ();
+  should_equal (released, native);
+  should_be_false (static_cast<bool> (assigned));
+  proto::object adopted (released);
+  should_equal (adopted.get<long> ("kept"), 7L);
+
+  proto::array array;
+  array.push (1L);
+  proto::array other (std::move (array));
+  should_equal (other.size (), 1);
+  should_equal (array.size (), 0);
+  should_be_true (array.empty ());
+}
+
+void
+test_cpp_typed_values ()
+{
+  proto::object object;
+  const char *text = "text";
+
+  describe ("Store scalars unboxed and read them back by type");
+  object.set ("long", -42L);
+  object.set ("double", 2.5);
+  object.set ("float", 0.25f);
+  object.set ("bool", true);
+  object.set ("char", 'x');
+  object.set ("text", text);
+  should_equal (object.get<long> ("long"), -42L);
+  should_equal (object.get<double> ("double"), 2.5);
+  should_equal (object.get<float> ("float"), 0.25f);
+  should_be_true (object.get<bool> ("bool"));
+  should_equal (object.get<char> ("char"), 'x');
+  should_equal (object.get<const char *> ("text"), text);
+  should_be_true (object.has ("double"));
+  object.del ("double");
+  should_be_false (object.has ("double"));
+  should_equal (object.get<double> ("double"), 0.0);
+
+  object.set_chain ("outer.inner", 3L);
+  should_equal (object.get_chain<long> ("outer.inner"), 3L);
+
+  proto::object parent;
+  parent.set ("inherited", 9L);
+  object.merge (parent);
+  should_equal (object.get<long> ("inherited"), 9L);
+
+  object.set ("count", &count_arguments);
+  proto::array arguments;
+  arguments.push (1L);
+  arguments.push (2L);
+  should_equal (object.execute<size_t> ("count", arguments.native ()), 2);
+  should_equal (object.execute<size_t> ("missing", arguments.native ()), 0);
+}
+
+void
+test_cpp_iteration ()
+{
+  proto::array array, chunked = proto::array::chunked ();
+  long i, sum = 0, chunked_sum = 0, mismatches = 0;
+  size_t count = 0;
+
+  describe ("Iterate arrays with range-for, typed or as stored");
+  for (i = 0; i < 5000; i++)
+    {
+      array.push (i);
+      chunked.push (i);
+    }
+  should_equal (array.size (), 5000);
+  should_equal (chunked.size (), 5000);
+  for (long value : array.as<long> ())
+    sum += value;
+  for (long value : chunked.as<long> ())
+    chunked_sum += value;
+  should_equal (sum, 4999L * 5000L / 2);
+  should_equal (chunked_sum, sum);
+  for (const void *element : array)
+    if (element != (const void *) count++)
+      mismatches++;
+  should_equal (mismatches, 0);
+  should_equal (count, array.size ());
+
+  auto view = array.as<long> ();
+  should_equal (view.size (), 5000);
+  should_equal (view[1234], 1234L);
+  should_equal (array.at<long> (4999), 4999L);
+  should_be_true (array.includes (4999L));
+  should_be_false (array.includes (5000L));
+
+  array.insert (0, -1L);
+  should_equal (array.shift<long> (), -1L);
+  should_equal (array.pop<long> (), 4999L);
+  should_equal (array.size (), 4999);
+
+  proto::array empty;
+  for (long value : empty.as<long> ())
+    sum += value;
+  should_be_true (empty.as<long> ().empty ());
+  should_be_true (empty.begin () == empty.end ());
+}
+
+using namespace proto::literals;
+
+static constexpr proto_key_t point_keys[] = { "x"_pk, "y"_pk, "label"_pk };
+static constexpr proto_shape_t point_shape = PROTO_SHAPE_INIT (point_keys);
+static constexpr std::size_t point_y = proto::slot_of (point_keys, "y"_pk);
+
+void
+test_cpp_keys_and_shapes ()
+{
+  static_assert (point_y == 1, "slots are found at compile time");
+  static_assert (proto::slot_of (point_keys, "z"_pk) == 3, "missing keys are past the end");
+  static_assert ("label"_pk.hash == proto::detail::key_hash ("label", 5), "keys hash when compiled");
+
+  describe ("Hash literal keys when compiling and read shapes by slot");
+  should_equal ("label"_pk.hash, proto_key_hash ("label"));
+  should_equal ("created-at"_pk.hash, proto_key ("created-at").hash);
+
+  proto::object object;
+  object.set ("id"_pk, 7L);
+  should_equal (object.get<long> ("id"), 7L);
+  should_equal (object.get<long> ("id"_pk), 7L);
+  should_be_true (object.has ("id"_pk));
+  should_be_false (object.has ("name"_pk));
+
+  proto::object point (point_shape);
+  should_be_true (point.has ("x"));
+  point.set_slot (point_y, 2.5);
+  should_equal (point.slot<double> (point_y), 2.5);
+  should_equal (point.get<double> ("y"_pk), 2.5);
+  point.set ("label", 'p');
+  should_equal (point.slot<char> (proto::slot_of (point_keys, "label"_pk)), 'p');
+  should_equal (proto_object_shape (point.native ()), &point_shape);
+}
+
+void
+run_tests ()
+{
+  test_cpp_ownership ();
+  test_cpp_typed_values ();
+  test_cpp_iteration ();
+  test_cpp_keys_and_shapes ();
+}
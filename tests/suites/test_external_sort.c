@@ -0,0 +1,140 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define LENGTH 300000
+
+typedef struct {
+  unsigned long key;
+  unsigned long position;
+} record_t;
+
+typedef struct {
+  record_t last;
+  size_t count;
+  size_t wrong;
+} check_t;
+
+static int
+compare_keys (const void *a,
+              const void *b)
+{
+  unsigned long x = ((const record_t *) a)->key, y = ((const record_t *) b)->key;
+
+  return (x > y) - (x < y);
+}
+
+static void
+check_order (const void *record,
+             size_t position,
+             void *context)
+{
+  check_t *check = (check_t *) context;
+  const record_t *current = (const record_t *) record;
+
+  if (position != check->count++ || (position > 0 && check->last.key > current->key)
+      || current->key != current->position * 2654435761UL % LENGTH)
+    check->wrong++;
+  check->last = *current;
+}
+
+static check_t
+sort_with_budget (size_t budget)
+{
+  proto_external_sort_t *sorter = proto_init_external_sort (sizeof (record_t), &compare_keys, budget);
+  check_t check = { { 0, 0 }, 0, 0 };
+  record_t record;
+  size_t i;
+
+  for (i = 0; i < LENGTH; i++)
+    {
+      record.key = i * 2654435761UL % LENGTH;
+      record.position = i;
+      if (!proto_external_sort_push (sorter, &record))
+        check.wrong++;
+    }
+  if (proto_external_sort_length (sorter) != LENGTH
+      || !proto_external_sort_each (sorter, &check_order, &check))
+    check.wrong++;
+  // A sorter finishes once
+  if (proto_external_sort_each (sorter, &check_order, &check) || proto_external_sort_push (sorter, &record))
+    check.wrong++;
+  proto_del_external_sort (sorter);
+  return check;
+}
+
+void
+test_external_sort_budgets ()
+{
+  check_t check;
+
+  describe ("Sort records in memory, in one merge and in several rounds");
+  check = sort_with_budget (0);
+  should_equal (check.count, LENGTH);
+  should_equal (check.wrong, 0);
+  check = sort_with_budget (2UL << 20);
+  should_equal (check.count, LENGTH);
+  should_equal (check.wrong, 0);
+  check = sort_with_budget (64UL << 10);
+  should_equal (check.count, LENGTH);
+  should_equal (check.wrong, 0);
+  should_equal (proto_init_external_sort (0, &compare_keys, 0), NULL);
+  should_equal (proto_init_external_sort (sizeof (record_t), NULL, 0), NULL);
+  should_be_false (proto_external_sort_push (NULL, &check));
+}
+
+void
+test_external_sort_typed_to_mapped ()
+{
+  char path[] = "/tmp/proto_external_XXXXXX";
+  proto_external_sort_t *sorter;
+  proto_mapped_array_t *output;
+  proto_array_t *array;
+  proto_data_t *data;
+  size_t i, wrong = 0;
+  int fd = mkstemp (path);
+
+  describe ("Sort a typed array into a file-backed array");
+  should_be_true (fd >= 0);
+  close (fd);
+  array = proto_init_array ();
+  for (i = 0; i < LENGTH / 10; i++)
+    array->push (array, proto_integer ((long) (LENGTH / 20) - (long) (i * 7919 % (LENGTH / 10))));
+  sorter = proto_init_external_sort (sizeof (proto_data_t), &proto_compare_integer, 32UL << 10);
+  should_be_true (proto_external_sort_push_array (sorter, array));
+  output = proto_init_mapped_array (path, sizeof (long));
+  should_be_false (proto_external_sort_to_mapped (sorter, output));
+  proto_del_mapped_array (output);
+  unlink (path);
+  output = proto_init_mapped_array (path, sizeof (proto_data_t));
+  should_be_true (proto_external_sort_to_mapped (sorter, output));
+  should_equal (proto_mapped_array_length (output), LENGTH / 10);
+  for (i = 0; i < LENGTH / 10; i++)
+    {
+      data = (proto_data_t *) proto_mapped_array_at (output, i);
+      if (data->type != integer_t || data->data.integer != (long) i - (long) (LENGTH / 20) + 1)
+        wrong++;
+    }
+  should_equal (wrong, 0);
+  proto_del_mapped_array (output);
+  proto_del_external_sort (sorter);
+  for (i = 0; i < array->length; i++)
+    proto_del_data ((proto_data_t *) array->at (array, i));
+  proto_del_array (array);
+  unlink (path);
+}
+
+void
+run_tests ()
+{
+  test_external_sort_budgets ();
+  test_external_sort_typed_to_mapped ();
+}
@@ -0,0 +1,169 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define FUTURES 200
+
+static atomic_long called_back;
+static proto_pool_t *shared_pool;
+
+static void *
+add (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+
+  return (void *) (TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 0), long)
+    + TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 1), long));
+}
+
+static void *
+slow_double (const void *arguments)
+{
+  usleep (1000);
+  return (void *) (2 * *(const long *) arguments);
+}
+
+static void *
+never_done_first (const void *arguments)
+{
+  usleep (50000);
+  return NULL;
+}
+
+// Fans out again from inside the pool and waits for its own futures
+static void *
+fan_out (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+  long base = (long) ((proto_data_t *) arguments_list->at (arguments_list, 0))->data.pointer;
+  proto_future_t *futures[8];
+  long total = 0, i;
+
+  for (i = 0; i < 8; i++)
+    futures[i] = proto_generic_call_async (shared_pool, "%i %i", &add, i, base);
+  for (i = 0; i < 8; i++)
+    {
+      total += (long) proto_future_wait (futures[i]);
+      proto_del_future (futures[i]);
+    }
+  return (void *) total;
+}
+
+static void
+count_result (void *result,
+              void *context)
+{
+  atomic_fetch_add (&called_back, (long) result * (long) context);
+}
+
+void
+test_future_calls ()
+{
+  proto_pool_t *pool = proto_init_pool (4);
+  proto_future_t *futures[FUTURES];
+  proto_signature_t *signature = proto_signature_compile ("%i %i");
+  void *result = NULL;
+  size_t i, wrong = 0;
+  long expected = 0;
+
+  describe ("Run generic calls on a pool and wait for their futures");
+  atomic_init (&called_back, 0);
+  for (i = 0; i < FUTURES; i++)
+    {
+      futures[i] = i % 2
+        ? proto_generic_call_async (pool, "%i %i", &add, (long) i, (long) i)
+        : proto_signature_call_async (pool, signature, &add, (long) i, (long) i);
+      proto_future_then (futures[i], &count_result, (void *) 1);
+      expected += 2 * i;
+    }
+  proto_future_wait_all (futures, FUTURES);
+  for (i = 0; i < FUTURES; i++)
+    if (!proto_future_poll (futures[i], &result) || result != (void *) (2 * i)
+        || proto_future_wait (futures[i]) != (void *) (2 * i))
+      wrong++;
+  should_equal (wrong, 0);
+  should_equal (atomic_load (&called_back), expected);
+  // Callbacks on a future that's done run right away
+  proto_future_then (futures[3], &count_result, (void *) 1);
+  should_equal (atomic_load (&called_back), expected + 6);
+  for (i = 0; i < FUTURES; i++)
+    proto_del_future (futures[i]);
+
+  should_equal (proto_generic_call_async (pool, "%i %x", &add, 1L, 2L), NULL);
+  should_equal (proto_generic_call_async (pool, "%i %i", NULL, 1L, 2L), NULL);
+  futures[0] = proto_generic_call_async (NULL, "%i %i", &add, 20L, 22L);
+  should_be_true (proto_future_poll (futures[0], &result));
+  should_equal (result, (void *) 42);
+  proto_del_future (futures[0]);
+  proto_del_signature (signature);
+  proto_del_pool (pool);
+}
+
+void
+test_future_properties ()
+{
+  proto_pool_t *pool = proto_init_pool (2);
+  proto_object_t *object = proto_init_object ();
+  proto_future_t *futures[3];
+  long values[2] = { 21, 50 };
+  size_t first;
+
+  describe ("Run object properties asynchronously and wait for any of them");
+  object->set_own_property (object, "double", (const void *) &slow_double);
+  object->set_own_property (object, "slow", (const void *) &never_done_first);
+  should_equal (proto_execute_property_async (pool, object, "missing", NULL), NULL);
+  futures[0] = proto_execute_property_async (pool, object, "slow", NULL);
+  futures[1] = NULL;
+  futures[2] = proto_execute_property_async (pool, object, "double", &values[0]);
+  first = proto_future_wait_any (futures, 3);
+  should_equal (first, 2);
+  should_equal (proto_future_wait (futures[2]), (void *) 42);
+  proto_del_future (futures[2]);
+  futures[2] = NULL;
+  should_equal (proto_future_wait_any (futures, 3), 0);
+  proto_del_future (futures[0]);
+  futures[0] = NULL;
+  should_equal (proto_future_wait_any (futures, 3), (size_t) -1);
+  futures[0] = proto_execute_property_async (NULL, object, "double", &values[1]);
+  should_equal (proto_future_wait (futures[0]), (void *) 100);
+  proto_del_future (futures[0]);
+  proto_del_object (object);
+  proto_del_pool (pool);
+}
+
+void
+test_future_nested ()
+{
+  proto_future_t *futures[16];
+  size_t i, wrong = 0;
+
+  describe ("Wait on futures from inside the pool without starving it");
+  shared_pool = proto_init_pool (1);
+  for (i = 0; i < 16; i++)
+    futures[i] = proto_generic_call_async (shared_pool, "%p", &fan_out, (void *) i);
+  for (i = 0; i < 16; i++)
+    {
+      if ((long) proto_future_wait (futures[i]) != 28 + 8 * (long) i)
+        wrong++;
+      proto_del_future (futures[i]);
+    }
+  should_equal (wrong, 0);
+  proto_del_pool (shared_pool);
+}
+
+void
+run_tests ()
+{
+  test_future_calls ();
+  test_future_properties ();
+  test_future_nested ();
+}
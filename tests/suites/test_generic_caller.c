@@ -6,6 +6,7 @@
 // it under the terms of the MIT license. See LICENSE for details.
 
 #include <proto.h>
+#include <string.h>
 
 #include "utils.h"
 
@@ -35,6 +36,12 @@ reduce_doubles (const void *arguments)
   return total;
 }
 
+void *
+identity (const void *arguments)
+{
+  return (void *) arguments;
+}
+
 void
 test_generic_caller ()
 {
@@ -53,8 +60,148 @@ test_generic_caller ()
   free (return_value);
 }
 
+void *
+describe_arguments (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+  static char types[32];
+  size_t i;
+
+  for (i = 0; i < arguments_list->length && i < sizeof (types) - 1; i++)
+    types[i] = '0' + ((proto_data_t *) arguments_list->at (arguments_list, i))->type;
+  types[i] = '\0';
+  return types;
+}
+
+void
+test_signature_call ()
+{
+  proto_signature_t *signature, *mixed, *wide;
+  proto_frame_t *frame;
+  proto_array_t *kept;
+  void *return_value;
+  long total = 0;
+  size_t i;
+
+  describe ("Should call a generic function through a compiled signature");
+  signature = proto_signature_compile ("%i %i %i %i %i");
+  should_equal (proto_signature_length (signature), 5);
+  return_value = proto_signature_call (signature, &reduce_integers,
+    (long) 1, (long) 2, (long) 3, (long) 4, (long) 5);
+  should_equal (*(long *) return_value, 15);
+  free (return_value);
+  mixed = proto_signature_compile ("%d %i %s %o %a %b %f %p");
+  return_value = proto_signature_call (mixed, &describe_arguments,
+    1.5, (long) 2, "three", NULL, NULL, true, NULL, NULL);
+  should_be_true (strcmp ((char *) return_value, "01234567") == 0);
+  should_equal (proto_signature_compile ("%i %x"), NULL);
+  should_equal (proto_signature_compile ("%i %"), NULL);
+  should_equal (proto_signature_call (NULL, &reduce_integers), NULL);
+
+  describe ("Should reuse a caller-provided frame across calls");
+  frame = proto_init_frame (signature);
+  for (i = 0; i < 100; i++)
+    {
+      return_value = proto_signature_call_frame (signature, frame, &reduce_integers,
+        (long) i, (long) i, (long) i, (long) i, (long) i);
+      total += *(long *) return_value;
+      free (return_value);
+    }
+  should_equal (total, 5 * 4950);
+  kept = (proto_array_t *) proto_signature_call_frame (signature, frame, &identity,
+    (long) 6, (long) 7, (long) 8, (long) 9, (long) 10);
+  should_equal (TYPED_VALUE ((proto_data_t *) kept->at (kept, 4), long), 10);
+  should_equal (proto_signature_call_frame (mixed, frame, &reduce_integers), NULL);
+  proto_del_frame (frame);
+
+  describe ("Should call through signatures longer than the stack frame");
+  wide = proto_signature_compile ("%i %i %i %i %i %i %i %i %i %i %i %i %i %i %i %i %i %i %i %i");
+  return_value = proto_signature_call (wide, &reduce_integers,
+    1L, 2L, 3L, 4L, 5L, 6L, 7L, 8L, 9L, 10L, 11L, 12L, 13L, 14L, 15L, 16L, 17L, 18L, 19L, 20L);
+  should_equal (*(long *) return_value, 210);
+  free (return_value);
+  proto_del_signature (wide);
+  proto_del_signature (mixed);
+  proto_del_signature (signature);
+}
+
+void *
+sum_row (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+
+  return (void *) (TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 0), long)
+    + (long) TYPED_VALUE ((proto_data_t *) arguments_list->at (arguments_list, 1), double));
+}
+
+void
+sum_batch (const void *const *columns,
+           size_t rows,
+           void **results)
+{
+  const long *integers = (const long *) columns[0];
+  const double *decimals = (const double *) columns[1];
+  size_t i;
+
+  for (i = 0; i < rows; i++)
+    results[i] = (void *) (integers[i] + (long) decimals[i]);
+}
+
+void
+test_signature_columns ()
+{
+  proto_signature_t *signature = proto_signature_compile ("%i %d");
+  proto_column_t columns[2];
+  proto_array_t *decimals = proto_init_array (), *rows, *batches;
+  long integers[1000];
+  double values[1000];
+  size_t i, wrong = 0;
+
+  describe ("Should call a function over columns of arguments, per row and per batch");
+  for (i = 0; i < 1000; i++)
+    {
+      integers[i] = (long) i;
+      values[i] = 2.0 * i;
+      decimals->push (decimals, proto_decimal (2.0 * i));
+    }
+  columns[0].values = integers;
+  columns[0].array = NULL;
+  columns[1].values = NULL;
+  columns[1].array = decimals;
+  rows = proto_signature_call_rows (signature, &sum_row, columns, 1000);
+  batches = proto_signature_call_batch (signature, &sum_batch, columns, 1000);
+  should_equal (rows->length, 1000);
+  should_equal (batches->length, 1000);
+  for (i = 0; i < 1000; i++)
+    if (rows->at (rows, i) != (void *) (3 * i) || batches->at (batches, i) != (void *) (3 * i))
+      wrong++;
+  should_equal (wrong, 0);
+  proto_del_array (rows);
+  proto_del_array (batches);
+
+  // Typed columns on both sides, and columns that don't fit
+  columns[1].values = values;
+  columns[1].array = NULL;
+  batches = proto_signature_call_batch (signature, &sum_batch, columns, 999);
+  should_equal (batches->at (batches, 998), (void *) (3 * 998));
+  proto_del_array (batches);
+  rows = proto_signature_call_rows (signature, &sum_row, columns, 0);
+  should_equal (rows->length, 0);
+  proto_del_array (rows);
+  columns[1].array = decimals;
+  should_equal (proto_signature_call_rows (signature, &sum_row, columns, 10), NULL);
+  columns[1].values = NULL;
+  should_equal (proto_signature_call_batch (signature, &sum_batch, columns, 1001), NULL);
+  while (decimals->length)
+    proto_del_data ((proto_data_t *) decimals->pop (decimals));
+  proto_del_array (decimals);
+  proto_del_signature (signature);
+}
+
 void
 run_tests ()
 {
   test_generic_caller ();
+  test_signature_call ();
+  test_signature_columns ();
 }
@@ -0,0 +1,178 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+static size_t
+linear_index (const proto_array_t *array,
+              const void *element)
+{
+  size_t i;
+
+  for (i = 0; i < array->length; i++)
+    if (array->items[i] == element)
+      return i;
+  return -1;
+}
+
+static int
+compare_address (const void *a,
+                 const void *b)
+{
+  return (a > b) - (a < b);
+}
+
+void
+test_hash_index_lookup ()
+{
+  proto_array_t *array;
+  short int values[200];
+  size_t i;
+
+  describe ("Look elements up through the hash index of a large array");
+  array = proto_init_array ();
+  proto_array_hash_index (array, true);
+  for (i = 0; i < 200; i++)
+    {
+      values[i] = (short int) i;
+      array->push (array, &values[i]);
+    }
+  should_be_true (array->includes (array, &values[0]));
+  should_be_true (array->includes (array, &values[199]));
+  should_equal (array->index (array, &values[150]), 150);
+  should_be_false (array->includes (array, &array));
+  should_equal (array->index (array, &array), (size_t) -1);
+  should_equal (array->shift (array), &values[0]);
+  should_be_false (array->includes (array, &values[0]));
+  should_equal (array->index (array, &values[150]), 149);
+  array->unshift (array, &values[42]);
+  should_equal (array->index (array, &values[42]), 0);
+  should_equal (array->index (array, &values[43]), 43);
+  should_equal (array->del (array, 0), &values[42]);
+  should_equal (array->index (array, &values[42]), 41);
+  array->insert (array, 10, &values[100]);
+  should_equal (array->index (array, &values[100]), 10);
+  should_equal (array->index (array, &values[10]), 9);
+  should_equal (array->index (array, &values[11]), 11);
+  should_equal (array->pop (array), &values[199]);
+  should_be_false (array->includes (array, &values[199]));
+  proto_del_array (array);
+}
+
+void
+test_hash_index_consistency ()
+{
+  proto_array_t *array;
+  short int values[32];
+  size_t i, position, step, mismatches = 0;
+  unsigned long seed = 12345;
+
+  describe ("Keep the hash index consistent through random operations");
+  array = proto_init_array ();
+  proto_array_hash_index (array, true);
+  for (i = 0; i < 100; i++)
+    array->push (array, &values[i % 32]);
+  array->push (array, NULL);
+  for (step = 0; step < 5000; step++)
+    {
+      seed = seed * 1103515245 + 12345;
+      position = array->length ? (seed >> 8) % array->length : 0;
+      switch ((seed >> 4) % 6)
+        {
+          case 0:
+            array->push (array, &values[(seed >> 16) % 32]);
+            break;
+          case 1:
+            if (array->length > 70)
+              array->pop (array);
+            break;
+          case 2:
+            array->insert (array, position, &values[(seed >> 16) % 32]);
+            break;
+          case 3:
+            if (array->length > 70)
+              array->del (array, position);
+            break;
+          case 4:
+            if (array->length > 70)
+              array->shift (array);
+            break;
+          case 5:
+            array->unshift (array, &values[(seed >> 16) % 32]);
+            break;
+        }
+      for (i = 0; i < 32; i++)
+        if (array->index (array, &values[i]) != linear_index (array, &values[i]))
+          mismatches++;
+      if (array->index (array, NULL) != linear_index (array, NULL))
+        mismatches++;
+    }
+  should_equal (mismatches, 0);
+  proto_array_sort (array, &compare_address);
+  for (i = 0; i < 32; i++)
+    if (array->index (array, &values[i]) != linear_index (array, &values[i]))
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_del_array (array);
+}
+
+void
+test_hash_index_set_operations ()
+{
+  proto_array_t *array, *another, *result;
+  short int value_a = 1,
+    value_b = 2,
+    value_c = 3,
+    value_d = 4;
+
+  describe ("Compute unique, union, intersection and difference of arrays");
+  array = proto_init_array ();
+  array->push (array, &value_a);
+  array->push (array, &value_b);
+  array->push (array, &value_a);
+  array->push (array, &value_c);
+  another = proto_init_array ();
+  another->push (another, &value_c);
+  another->push (another, &value_d);
+  another->push (another, &value_b);
+
+  result = proto_array_unique (array);
+  should_equal (result->length, 3);
+  should_equal (result->at (result, 0), &value_a);
+  should_equal (result->at (result, 1), &value_b);
+  should_equal (result->at (result, 2), &value_c);
+  proto_del_array (result);
+
+  result = proto_array_union (array, another);
+  should_equal (result->length, 4);
+  should_equal (result->at (result, 3), &value_d);
+  proto_del_array (result);
+
+  result = proto_array_intersection (array, another);
+  should_equal (result->length, 2);
+  should_equal (result->at (result, 0), &value_b);
+  should_equal (result->at (result, 1), &value_c);
+  proto_del_array (result);
+
+  result = proto_array_difference (array, another);
+  should_equal (result->length, 1);
+  should_equal (result->at (result, 0), &value_a);
+  proto_del_array (result);
+
+  proto_del_array (another);
+  proto_del_array (array);
+}
+
+void
+run_tests ()
+{
+  test_hash_index_lookup ();
+  test_hash_index_consistency ();
+  test_hash_index_set_operations ();
+}
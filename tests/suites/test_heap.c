@@ -0,0 +1,262 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+#define NODES 256
+#define KEYS 3
+#define OPERATIONS 20000
+
+void
+test_heap_reachability ()
+{
+  proto_heap_t *heap = proto_init_heap ();
+  proto_object_t *root, *child, *parent, *chained, *boxed, *first, *second;
+  proto_array_t *list;
+  proto_data_t *box;
+
+  describe ("Free what no root reaches, cycles included, and keep the rest");
+  proto_heap_set_budget (heap, 0);
+  root = proto_heap_object (heap);
+  proto_heap_root (heap, root);
+  child = proto_heap_object (heap);
+  root->set_own_property (root, "child", child);
+  parent = proto_heap_object (heap);
+  child->set_super (child, parent);
+  chained = proto_heap_object (heap);
+  root->set_chain (root, "deep.inner.value", chained);
+  list = proto_heap_array (heap);
+  child->set_own_property (child, "list", list);
+  boxed = proto_heap_object (heap);
+  box = proto_heap_data (heap, (proto_data_t) { object_t, { .object = boxed } });
+  list->push (list, box);
+  list->push (list, (const void *) (uintptr_t) 12345);
+  first = proto_heap_object (heap);
+  second = proto_heap_object (heap);
+  first->set_own_property (first, "next", second);
+  second->set_own_property (second, "next", first);
+  should_equal (proto_heap_count (heap), 9);
+  should_equal (proto_heap_collect (heap), 2);
+  should_equal (proto_heap_count (heap), 7);
+  should_equal (child->super, parent);
+  should_equal (root->get_chain (root, "deep.inner.value"), chained);
+  should_equal (((proto_data_t *) list->at (list, 0))->data.object, boxed);
+
+  // Dropping a link frees everything only it reached
+  child->del_own_property (child, "list");
+  should_equal (proto_heap_collect (heap), 3);
+  root->set_chain (root, "deep.inner.value", NULL);
+  should_equal (proto_heap_collect (heap), 1);
+  should_be_false (proto_heap_unroot (heap, child));
+  should_be_true (proto_heap_unroot (heap, root));
+  should_equal (proto_heap_collect (heap), 3);
+  should_equal (proto_heap_count (heap), 0);
+  should_be_false (proto_heap_collecting (heap));
+
+  should_equal (proto_heap_object (NULL), NULL);
+  should_equal (proto_heap_array (NULL), NULL);
+  should_be_false (proto_heap_root (NULL, root));
+  should_equal (proto_heap_collect (NULL), 0);
+  should_be_false (proto_heap_step (NULL, 1));
+  proto_heap_barrier (NULL, NULL);
+  proto_del_heap (NULL);
+  proto_del_heap (heap);
+}
+
+static size_t
+reachable_nodes (int edges[NODES][KEYS],
+                 const int *listed,
+                 size_t listed_length,
+                 bool *reachable,
+                 int *found)
+{
+  size_t i, length = 0, next = 0;
+  int k;
+
+  for (i = 0; i < NODES; i++)
+    reachable[i] = false;
+  for (i = 0; i < listed_length; i++)
+    if (!reachable[listed[i]])
+      {
+        reachable[listed[i]] = true;
+        found[length++] = listed[i];
+      }
+  while (next < length)
+    for (k = 0, i = found[next++]; k < KEYS; k++)
+      if (edges[i][k] >= 0 && !reachable[edges[i][k]])
+        {
+          reachable[edges[i][k]] = true;
+          found[length++] = edges[i][k];
+        }
+  return length;
+}
+
+/*
+ * Random moves of references between objects and a rooted array, with the
+ * collector a few units further along after each one: whatever a shadow
+ * graph still reaches must come out of every cycle intact.
+ */
+void
+test_heap_incremental ()
+{
+  proto_heap_t *heap = proto_init_heap ();
+  proto_object_t *nodes[NODES];
+  proto_array_t *list = proto_heap_array (heap);
+  const char *keys[KEYS] = { "a", "b", "c" };
+  int edges[NODES][KEYS], listed[OPERATIONS], found[NODES];
+  bool reachable[NODES];
+  size_t i, j, count, listed_length = 0, cycles = 0, mismatches = 0;
+  unsigned int seed = 7;
+  int u, v, k;
+
+  describe ("Keep reachable cells alive while the program moves them mid-cycle");
+  proto_heap_set_budget (heap, 0);
+  proto_heap_root (heap, list);
+  for (i = 0; i < NODES; i++)
+    for (k = 0; k < KEYS; k++)
+      edges[i][k] = -1;
+  for (i = 0; i < OPERATIONS; i++)
+    {
+      count = reachable_nodes (edges, listed, listed_length, reachable, found);
+      seed = seed * 1103515245 + 12345;
+      u = count ? found[(seed >> 8) % count] : -1;
+      seed = seed * 1103515245 + 12345;
+      v = count ? found[(seed >> 8) % count] : -1;
+      k = (seed >> 4) % KEYS;
+      switch (count < 16 ? 4 : (seed >> 16) % 8)
+        {
+          case 0:
+          case 1:
+            nodes[u]->set_own_property (nodes[u], keys[k], nodes[v]);
+            edges[u][k] = v;
+            break;
+          case 2:
+            nodes[u]->del_own_property (nodes[u], keys[k]);
+            edges[u][k] = -1;
+            break;
+          case 3:
+            list->unshift (list, nodes[v]);
+            for (j = listed_length++; j > 0; j--)
+              listed[j] = listed[j - 1];
+            listed[0] = v;
+            break;
+          case 4:
+            for (v = 0; v < NODES && reachable[v]; v++);
+            if (v == NODES)
+              break;
+            nodes[v] = proto_heap_object (heap);
+            nodes[v]->set_own_property (nodes[v], "id", (const void *) (uintptr_t) (2 * v + 1));
+            for (j = 0; j < KEYS; j++)
+              edges[v][j] = -1;
+            if (u >= 0 && (seed >> 12) % 2)
+              {
+                nodes[u]->set_own_property (nodes[u], keys[k], nodes[v]);
+                edges[u][k] = v;
+              }
+            else
+              {
+                list->push (list, nodes[v]);
+                listed[listed_length++] = v;
+              }
+            break;
+          default:
+            if (!listed_length)
+              break;
+            j = (seed >> 3) % listed_length;
+            list->del (list, j);
+            for (listed_length--; j < listed_length; j++)
+              listed[j] = listed[j + 1];
+            break;
+        }
+      if (proto_heap_step (heap, 5))
+        {
+          cycles++;
+          count = reachable_nodes (edges, listed, listed_length, reachable, found);
+          for (j = 0; j < count; j++)
+            if (nodes[found[j]]->get_own_property (nodes[found[j]], "id")
+                != (const void *) (uintptr_t) (2 * found[j] + 1))
+              mismatches++;
+        }
+    }
+  should_equal (mismatches, 0);
+  should_be_true (cycles > 10);
+  proto_heap_collect (heap);
+  count = reachable_nodes (edges, listed, listed_length, reachable, found);
+  should_equal (proto_heap_count (heap), count + 1);
+  for (j = 0; j < count; j++)
+    for (k = 0; k < KEYS; k++)
+      if (nodes[found[j]]->get_own_property (nodes[found[j]], keys[k])
+          != (edges[found[j]][k] < 0 ? NULL : nodes[edges[found[j]][k]]))
+        mismatches++;
+  should_equal (mismatches, 0);
+  proto_heap_unroot (heap, list);
+  proto_heap_collect (heap);
+  should_equal (proto_heap_count (heap), 0);
+  proto_del_heap (heap);
+}
+
+static int
+compare_addresses (const void *a,
+                   const void *b)
+{
+  return (uintptr_t) a < (uintptr_t) b ? -1 : (uintptr_t) a > (uintptr_t) b;
+}
+
+void
+test_heap_pacing ()
+{
+  proto_heap_t *heap = proto_init_heap ();
+  proto_array_t *kept = proto_heap_array (heap), *sorted;
+  proto_object_t *object;
+  size_t i, most = 0, mismatches = 0;
+
+  describe ("Collect as allocation goes, without the program asking");
+  proto_heap_root (heap, kept);
+  for (i = 0; i < 50000; i++)
+    {
+      object = proto_heap_object (heap);
+      if (i % 100 == 0)
+        kept->push (kept, object);
+      if (proto_heap_count (heap) > most)
+        most = proto_heap_count (heap);
+    }
+  should_equal (kept->length, 500);
+  should_be_true (most < 8 * 1024);
+  proto_heap_collect (heap);
+  should_equal (proto_heap_count (heap), 501);
+
+  // Sorting an array partway through its scan finishes the scan first
+  sorted = proto_heap_array (heap);
+  kept->push (kept, sorted);
+  for (i = 0; i < 1000; i++)
+    sorted->push (sorted, proto_heap_object (heap));
+  proto_heap_set_budget (heap, 0);
+  proto_heap_step (heap, 3);
+  while (proto_heap_collecting (heap))
+    {
+      proto_array_sort (sorted, &compare_addresses);
+      proto_heap_step (heap, 7);
+    }
+  proto_heap_collect (heap);
+  should_equal (proto_heap_count (heap), 1502);
+  for (i = 1; i < sorted->length; i++)
+    if (compare_addresses (sorted->at (sorted, i - 1), sorted->at (sorted, i)) > 0)
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_del_heap (heap);
+}
+
+void
+run_tests ()
+{
+  test_heap_reachability ();
+  test_heap_incremental ();
+  test_heap_pacing ();
+}
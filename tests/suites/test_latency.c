@@ -0,0 +1,132 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <string.h>
+
+#include "utils.h"
+
+static void *
+identity (const void *arguments)
+{
+  return (void *) arguments;
+}
+
+static void *
+other_identity (const void *arguments)
+{
+  return (void *) arguments;
+}
+
+static bool
+near (size_t value,
+      size_t expected)
+{
+  // Buckets are at most 1/32 of their values wide
+  return value >= expected - expected / 32 - 1 && value <= expected + expected / 32 + 1;
+}
+
+void
+test_latency_histograms ()
+{
+  proto_histogram_t *histogram = proto_init_histogram (), *other = proto_init_histogram ();
+  char *dump;
+  size_t i;
+
+  describe ("Record values into a histogram and read its percentiles");
+  should_equal (proto_histogram_percentile (histogram, 99), 0);
+  for (i = 1; i <= 10000; i++)
+    proto_histogram_record (histogram, i);
+  should_equal (proto_histogram_count (histogram), 10000);
+  should_equal (proto_histogram_min (histogram), 1);
+  should_equal (proto_histogram_max (histogram), 10000);
+  should_equal (proto_histogram_percentile (histogram, 0), 1);
+  should_be_true (near (proto_histogram_percentile (histogram, 50), 5000));
+  should_be_true (near (proto_histogram_percentile (histogram, 99), 9900));
+  should_be_true (near (proto_histogram_percentile (histogram, 99.9), 9990));
+  should_equal (proto_histogram_percentile (histogram, 100), 10000);
+
+  describe ("Merge histograms and dump them as JSON");
+  for (i = 0; i < 10000; i++)
+    proto_histogram_record (other, 1000000);
+  should_be_true (proto_histogram_merge (other, histogram));
+  should_be_false (proto_histogram_merge (other, NULL));
+  should_equal (proto_histogram_count (other), 20000);
+  should_equal (proto_histogram_min (other), 1);
+  should_equal (proto_histogram_max (other), 1000000);
+  should_be_true (near (proto_histogram_percentile (other, 25), 5000));
+  should_be_true (near (proto_histogram_percentile (other, 75), 1000000));
+  dump = proto_histogram_dump (other);
+  should_be_true (strstr (dump, "\"count\": 20000, \"min\": 1, \"max\": 1000000") != NULL);
+  should_be_true (strstr (dump, "[1, 1], [2, 1]") != NULL);
+  free (dump);
+  proto_histogram_reset (other);
+  should_equal (proto_histogram_count (other), 0);
+  should_equal (proto_histogram_dump (NULL), NULL);
+  proto_del_histogram (histogram);
+  proto_del_histogram (other);
+}
+
+void
+test_latency_sites ()
+{
+  proto_object_t *object = proto_init_object ();
+  const proto_histogram_t *call, *boxing;
+  char *dump;
+  size_t i;
+
+  describe ("Time execute_property and generic calls once enabled, per site");
+  object->set_own_property (object, "identity", (const void *) &identity);
+  object->set_own_property (object, "say \"hi\"", (const void *) &identity);
+  should_be_false (proto_latency_enabled ());
+  object->execute_property (object, "identity", NULL);
+  should_equal (proto_latency_histogram (PROTO_LATENCY_PROPERTY, "identity", NULL), NULL);
+
+  proto_latency_enable (true);
+  for (i = 0; i < 100; i++)
+    object->execute_property (object, "identity", NULL);
+  object->execute_property (object, "say \"hi\"", NULL);
+  object->execute_property (object, "missing", NULL);
+  for (i = 0; i < 50; i++)
+    proto_generic_caller ("%i %s", &identity, 1L, "x");
+  for (i = 0; i < 20; i++)
+    proto_generic_caller ("%i %s", &other_identity, 2L, "y");
+  proto_latency_enable (false);
+  object->execute_property (object, "identity", NULL);
+
+  should_equal (proto_histogram_count (proto_latency_histogram (PROTO_LATENCY_PROPERTY, "identity", NULL)), 100);
+  should_equal (proto_latency_histogram (PROTO_LATENCY_PROPERTY, "missing", NULL), NULL);
+  should_equal (proto_latency_histogram (PROTO_LATENCY_CALL, "identity", NULL), NULL);
+  call = proto_latency_histogram (PROTO_LATENCY_CALL, "%i %s", (const void *) &identity);
+  boxing = proto_latency_histogram (PROTO_LATENCY_BOXING, "%i %s", (const void *) &identity);
+  should_equal (proto_histogram_count (call), 50);
+  should_equal (proto_histogram_count (boxing), 50);
+  // Functions sharing a format keep apart
+  should_equal (proto_histogram_count (proto_latency_histogram (PROTO_LATENCY_CALL, "%i %s",
+                                                                (const void *) &other_identity)), 20);
+  should_equal (proto_latency_histogram (PROTO_LATENCY_CALL, "%i %s", NULL), NULL);
+  should_be_true (proto_histogram_min (boxing) <= proto_histogram_max (call));
+  dump = proto_latency_dump ();
+  should_be_true (strstr (dump, "{\"kind\": \"property\", \"name\": \"identity\", \"histogram\": {\"count\": 100") != NULL);
+  should_be_true (strstr (dump, "\"name\": \"say \\\"hi\\\"\"") != NULL);
+  should_be_true (strstr (dump, "{\"kind\": \"boxing\", \"name\": \"%i %s\", \"function\": \"0x") != NULL);
+  free (dump);
+
+  proto_latency_reset ();
+  should_equal (proto_latency_histogram (PROTO_LATENCY_CALL, "%i %s", (const void *) &identity), NULL);
+  dump = proto_latency_dump ();
+  should_be_true (strcmp (dump, "{\"sites\": []}") == 0);
+  free (dump);
+  proto_del_object (object);
+}
+
+void
+run_tests ()
+{
+  test_latency_histograms ();
+  test_latency_sites ();
+}
@@ -0,0 +1,165 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define LENGTH 200000
+
+typedef struct {
+  long id;
+  double value;
+} record_t;
+
+static char path[] = "/tmp/proto_mapped_XXXXXX";
+
+static void
+sum_ids (const void *record,
+         size_t position,
+         void *context)
+{
+  long *sums = (long *) context;
+
+  sums[0] += ((const record_t *) record)->id;
+  sums[1] += ((const record_t *) record)->id != (long) position;
+}
+
+void
+test_mapped_push_and_reopen ()
+{
+  proto_mapped_array_t *array;
+  record_t record, *stored;
+  size_t i, wrong = 0;
+
+  describe ("Push records to a file-backed array and open it again");
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  should_be_true (array != NULL);
+  should_equal (proto_mapped_array_length (array), 0);
+  should_equal (proto_mapped_array_at (array, 0), NULL);
+  should_be_false (proto_mapped_array_push (array, NULL));
+  for (i = 0; i < LENGTH; i++)
+    {
+      record.id = (long) i;
+      record.value = i / 2.0;
+      if (!proto_mapped_array_push (array, &record))
+        wrong++;
+    }
+  should_equal (wrong, 0);
+  should_equal (proto_mapped_array_length (array), LENGTH);
+  stored = (record_t *) proto_mapped_array_at (array, 1234);
+  should_equal (stored->id, 1234);
+  stored->value = -1;
+  should_be_true (proto_mapped_array_sync (array));
+  proto_del_mapped_array (array);
+
+  should_equal (proto_init_mapped_array (path, sizeof (long)), NULL);
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  should_equal (proto_mapped_array_length (array), LENGTH);
+  for (i = 0; i < LENGTH; i++)
+    {
+      stored = (record_t *) proto_mapped_array_at (array, i);
+      if (stored->id != (long) i || stored->value != (i == 1234 ? -1 : i / 2.0))
+        wrong++;
+    }
+  should_equal (wrong, 0);
+  should_equal (proto_mapped_array_at (array, LENGTH), NULL);
+  record.id = LENGTH;
+  should_be_true (proto_mapped_array_push (array, &record));
+  should_equal (((record_t *) proto_mapped_array_at (array, LENGTH))->id, LENGTH);
+  should_be_true (proto_mapped_array_flush (array));
+  proto_del_mapped_array (array);
+}
+
+void
+test_mapped_each_and_reserve ()
+{
+  proto_mapped_array_t *array;
+  record_t record = { 0, 0 }, *first;
+  long sums[2] = { 0, 0 };
+  size_t i;
+
+  describe ("Iterate over ranges of a file-backed array and reserve room");
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  proto_mapped_array_each (array, 0, LENGTH + 100, &sum_ids, sums);
+  should_equal (sums[0], (long) LENGTH * (LENGTH + 1) / 2);
+  should_equal (sums[1], 0);
+  sums[0] = 0;
+  proto_mapped_array_each (array, 10, 20, &sum_ids, sums);
+  should_equal (sums[0], 145);
+  sums[0] = 0;
+  proto_mapped_array_each (array, 20, 10, &sum_ids, sums);
+  proto_mapped_array_each (array, LENGTH + 1, LENGTH + 5, &sum_ids, sums);
+  should_equal (sums[0], 0);
+
+  // Pushing within reserved room keeps records where they are
+  should_be_true (proto_mapped_array_reserve (array, 2 * LENGTH + 2));
+  first = (record_t *) proto_mapped_array_at (array, 0);
+  for (i = LENGTH + 1; i < 2 * LENGTH + 2; i++)
+    proto_mapped_array_push (array, &record);
+  should_equal (proto_mapped_array_at (array, 0), first);
+  should_equal (proto_mapped_array_length (array), 2 * LENGTH + 2);
+  should_be_true (proto_mapped_array_reserve (array, 10));
+  proto_del_mapped_array (array);
+}
+
+void
+test_mapped_reopen_empty ()
+{
+  proto_mapped_array_t *array;
+  record_t record = { 7, 0.5 };
+
+  describe ("Push to an array that was closed while empty");
+  should_equal (truncate (path, 0), 0);
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  proto_del_mapped_array (array);
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  should_be_true (array != NULL);
+  should_equal (proto_mapped_array_length (array), 0);
+  should_be_true (proto_mapped_array_push (array, &record));
+  should_be_true (proto_mapped_array_push (array, &record));
+  should_equal (proto_mapped_array_length (array), 2);
+  proto_del_mapped_array (array);
+  array = proto_init_mapped_array (path, sizeof (record_t));
+  should_equal (proto_mapped_array_length (array), 2);
+  should_equal (((record_t *) proto_mapped_array_at (array, 1))->id, 7);
+  proto_del_mapped_array (array);
+}
+
+void
+test_mapped_foreign_files ()
+{
+  FILE *file;
+
+  describe ("Refuse files that aren't file-backed arrays");
+  file = fopen (path, "w");
+  fputs ("not a mapped array, but long enough to hold a header ......................", file);
+  fclose (file);
+  should_equal (proto_init_mapped_array (path, sizeof (record_t)), NULL);
+  should_equal (proto_init_mapped_array (NULL, sizeof (record_t)), NULL);
+  should_equal (proto_init_mapped_array (path, 0), NULL);
+  should_equal (proto_init_mapped_array ("/nonexistent/proto/array", sizeof (record_t)), NULL);
+  should_equal (proto_mapped_array_length (NULL), 0);
+  should_be_false (proto_mapped_array_sync (NULL));
+}
+
+void
+run_tests ()
+{
+  int fd = mkstemp (path);
+
+  if (fd < 0)
+    fail ("couldn't create a temporary file");
+  close (fd);
+  test_mapped_push_and_reopen ();
+  test_mapped_each_and_reserve ();
+  test_mapped_reopen_empty ();
+  test_mapped_foreign_files ();
+  unlink (path);
+}
@@ -0,0 +1,155 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <string.h>
+
+#include "utils.h"
+
+static size_t calls;
+static size_t released;
+
+static void *
+total_length (const void *arguments)
+{
+  proto_array_t *arguments_list = (proto_array_t *) arguments;
+  long *total = (long *) malloc (sizeof (long));
+  size_t i;
+
+  calls++;
+  *total = 0;
+  for (i = 0; i < arguments_list->length; i++)
+    {
+      proto_data_t *data = (proto_data_t *) arguments_list->at (arguments_list, i);
+
+      *total += data->type == string_t ? (long) strlen (data->data.string) : data->data.integer;
+    }
+  return total;
+}
+
+static void *
+negative_total (const void *arguments)
+{
+  long *total = (long *) total_length (arguments);
+
+  *total = -*total;
+  return total;
+}
+
+static void
+release_total (void *result)
+{
+  released++;
+  free (result);
+}
+
+static long
+call_with (proto_memo_t *memo,
+           long a,
+           const char *b)
+{
+  proto_data_t data[2] = { { integer_t, { .integer = a } }, { string_t, { .string = (char *) b } } };
+  proto_array_t *arguments = proto_init_array ();
+  long total;
+
+  arguments->push (arguments, &data[0]);
+  arguments->push (arguments, &data[1]);
+  total = *(long *) proto_memo_call (memo, arguments);
+  proto_del_array (arguments);
+  return total;
+}
+
+void
+test_memo_calls ()
+{
+  proto_memo_t *memo = proto_init_memo (&total_length, 4, &release_total);
+  proto_signature_t *signature = proto_signature_compile ("%i %s");
+  proto_data_t data[2] = { { integer_t, { .integer = 1 } }, { string_t, { .string = "abc" } } };
+  proto_array_t *arguments;
+  char copy[] = "abc";
+  size_t i;
+
+  describe ("Answer repeated arguments from the memo, by structure");
+  calls = released = 0;
+  should_equal (call_with (memo, 1, "abc"), 4);
+  should_equal (call_with (memo, 1, copy), 4);
+  should_equal (*(long *) proto_memo_call_signature (memo, signature, 1L, "abc"), 4);
+  should_equal (calls, 1);
+  should_equal (call_with (memo, 2, "abc"), 5);
+  should_equal (call_with (memo, 1, "abcd"), 5);
+  should_equal (calls, 3);
+  should_equal (proto_memo_hits (memo), 2);
+  should_equal (proto_memo_misses (memo), 3);
+  should_equal (proto_memo_length (memo), 3);
+
+  describe ("Evict what wasn't used since the clock hand passed, and invalidate");
+  for (i = 10; i < 20; i++)
+    {
+      call_with (memo, 1, "abc");
+      call_with (memo, (long) i, "");
+    }
+  should_equal (proto_memo_length (memo), 4);
+  // Ten new entries, one free slot: nine evictions, none of the hot entry
+  should_equal (released, 9);
+  calls = 0;
+  should_equal (call_with (memo, 1, "abc"), 4);
+  should_equal (calls, 0);
+  arguments = proto_init_array ();
+  arguments->push (arguments, &data[0]);
+  arguments->push (arguments, &data[1]);
+  should_be_true (proto_memo_invalidate (memo, arguments));
+  should_be_false (proto_memo_invalidate (memo, arguments));
+  should_equal (call_with (memo, 1, "abc"), 4);
+  should_equal (calls, 1);
+  proto_memo_clear (memo);
+  should_equal (proto_memo_length (memo), 0);
+  should_equal (proto_memo_call (NULL, arguments), NULL);
+  proto_del_array (arguments);
+  proto_del_signature (signature);
+  proto_del_memo (memo);
+}
+
+void
+test_memo_properties ()
+{
+  proto_object_t *object = proto_init_object ();
+  proto_memo_t *memo;
+  proto_array_t *arguments = proto_init_array ();
+  proto_data_t number = { integer_t, { .integer = 7 } };
+  size_t i, wrong = 0;
+
+  describe ("Memoize a pure property called through execute_property");
+  calls = 0;
+  arguments->push (arguments, &number);
+  object->set_own_property (object, "total", (const void *) &total_length);
+  should_be_true (proto_object_memoize (object, "total", 0, &free));
+  should_be_true (proto_object_memoize (object, "total", 0, &free));
+  should_equal (proto_object_memo (object, "missing"), NULL);
+  for (i = 0; i < 100; i++)
+    if (*(long *) object->execute_property (object, "total", arguments) != 7)
+      wrong++;
+  should_equal (wrong, 0);
+  should_equal (calls, 1);
+  memo = proto_object_memo (object, "total");
+  should_equal (proto_memo_hits (memo), 99);
+
+  // Another function at the same key starts from an empty memo
+  object->set_own_property (object, "total", (const void *) &negative_total);
+  should_equal (*(long *) object->execute_property (object, "total", arguments), -7);
+  should_equal (*(long *) object->execute_property (object, "total", arguments), -7);
+  should_equal (calls, 2);
+  should_equal (proto_memo_length (memo), 1);
+  proto_del_array (arguments);
+  proto_del_object (object);
+}
+
+void
+run_tests ()
+{
+  test_memo_calls ();
+  test_memo_properties ();
+}
@@ -6,6 +6,7 @@
 // it under the terms of the MIT license. See LICENSE for details.
 
 #include <proto.h>
+#include <stdio.h>
 
 #include "utils.h"
 
@@ -42,6 +43,9 @@ test_object_reassignment_of_key ()
   should_equal (object->get_own_property (object, "another_key"), NULL);
   object->set_own_property (object, "testing", &value_b);
   should_equal (*((short int *) object->get_own_property (object, "testing")), value_b);
+  // Reassigning updates the entry in place, so one delete removes the key
+  object->del_own_property (object, "testing");
+  should_be_false (object->has_own_property (object, "testing"));
   proto_del_object (object);
 }
 
@@ -163,6 +167,30 @@ test_object_deletion_of_key ()
   proto_del_object (object);
 }
 
+void
+test_object_deletion_inside_trees ()
+{
+  proto_object_t *object = proto_init_object ();
+  char keys[200][8];
+  size_t i, mismatches = 0;
+
+  describe ("Delete keys with children in their bucket's tree");
+  for (i = 0; i < 200; i++)
+    {
+      sprintf (keys[i], "k%03zu", (i * 37) % 200);
+      object->set_own_property (object, keys[i], keys[i]);
+    }
+  for (i = 0; i < 200; i += 2)
+    if (object->del_own_property (object, keys[i]) != keys[i])
+      mismatches++;
+  for (i = 0; i < 200; i++)
+    if (object->has_own_property (object, keys[i]) != (i % 2 == 1)
+        || (i % 2 == 1 && object->get_own_property (object, keys[i]) != keys[i]))
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_del_object (object);
+}
+
 void
 test_object_get_chain_calls ()
 {
@@ -377,6 +405,31 @@ test_object_merge_realcase ()
   proto_del_object (settings);
 }
 
+static const void *
+shouting_get (const void *self,
+              const char *key)
+{
+  return "SHOUT";
+}
+
+void
+test_object_direct_get ()
+{
+  proto_object_t *object = proto_init_object ();
+  short int value = 10;
+
+  describe ("Get properties through the inline direct call");
+  object->set_own_property (object, "value", &value);
+  should_equal (proto_object_get (object, "value"), (void *) &value);
+  should_equal (proto_object_get (object, "missing"), NULL);
+  should_equal (proto_object_get (NULL, "value"), NULL);
+  should_equal (proto_object_get (object, NULL), NULL);
+  // A replaced get_own_property still answers
+  object->get_own_property = &shouting_get;
+  should_equal (proto_object_get (object, "value"), (void *) "SHOUT");
+  proto_del_object (object);
+}
+
 void
 run_tests ()
 {
@@ -386,6 +439,7 @@ run_tests ()
   test_object_with_multiple_keys ();
   test_object_with_colliding_keys ();
   test_object_deletion_of_key ();
+  test_object_deletion_inside_trees ();
   test_object_get_chain_calls ();
   test_object_set_chain_calls ();
   test_object_set_chain_multiple_calls ();
@@ -394,4 +448,5 @@ run_tests ()
   test_object_merge ();
   test_object_merge_chain ();
   test_object_merge_realcase ();
+  test_object_direct_get ();
 }
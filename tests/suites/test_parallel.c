@@ -0,0 +1,220 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+#define LENGTH 100000
+
+typedef struct {
+  bool empty;
+  long first;
+  long last;
+} span_t;
+
+static long values[LENGTH];
+static long doubled[LENGTH];
+
+static void
+double_into (const void *element,
+             size_t position,
+             void *context)
+{
+  ((long *) context)[position] = *(const long *) element * 2;
+}
+
+static const void *
+next_value (const void *element,
+            void *context)
+{
+  const long *value = (const long *) element;
+
+  return value + 1 < values + LENGTH ? value + 1 : values;
+}
+
+static bool
+is_even (const void *element,
+         void *context)
+{
+  return *(const long *) element % 2 == 0;
+}
+
+static void
+sum_fold (void *accumulator,
+          const void *element,
+          void *context)
+{
+  *(long *) accumulator += *(const long *) element;
+}
+
+static void
+sum_combine (void *accumulator,
+             const void *partial,
+             void *context)
+{
+  *(long *) accumulator += *(const long *) partial;
+}
+
+static void
+span_fold (void *accumulator,
+           const void *element,
+           void *context)
+{
+  span_t *span = (span_t *) accumulator;
+
+  if (span->empty)
+    span->first = *(const long *) element;
+  span->last = *(const long *) element;
+  span->empty = false;
+}
+
+static void
+span_combine (void *accumulator,
+              const void *partial,
+              void *context)
+{
+  span_t *span = (span_t *) accumulator;
+  const span_t *other = (const span_t *) partial;
+
+  if (other->empty)
+    return;
+  if (span->empty)
+    *span = *other;
+  else
+    span->last = other->last;
+}
+
+static void
+nested_sum (const void *element,
+            size_t position,
+            void *context)
+{
+  proto_array_t *inner = (proto_array_t *) ((void **) context)[1];
+  long total = 0;
+
+  proto_array_parallel_reduce ((proto_pool_t *) ((void **) context)[0], inner,
+    &total, sizeof (long), &sum_fold, &sum_combine, NULL);
+  doubled[position] = total;
+}
+
+static proto_array_t *
+values_array (size_t length)
+{
+  proto_array_t *array = proto_init_array ();
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    {
+      values[i] = (long) i;
+      array->push (array, &values[i]);
+    }
+  return array;
+}
+
+void
+test_parallel_for_and_map (proto_pool_t *pool)
+{
+  proto_array_t *array, *mapped;
+  size_t i, mismatches = 0;
+
+  describe ("Run parallel for and map over a large array");
+  array = values_array (LENGTH);
+  proto_array_parallel_for (pool, array, &double_into, doubled);
+  for (i = 0; i < LENGTH; i++)
+    if (doubled[i] != (long) i * 2)
+      mismatches++;
+  should_equal (mismatches, 0);
+  mapped = proto_array_parallel_map (pool, array, &next_value, NULL);
+  should_equal (mapped->length, LENGTH);
+  for (i = 0; i < LENGTH; i++)
+    if (mapped->at (mapped, i) != &values[(i + 1) % LENGTH])
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_del_array (mapped);
+  proto_del_array (array);
+}
+
+void
+test_parallel_filter (proto_pool_t *pool)
+{
+  proto_array_t *array, *filtered;
+  size_t i, mismatches = 0;
+
+  describe ("Filter a large array in parallel keeping the order");
+  array = values_array (LENGTH);
+  filtered = proto_array_parallel_filter (pool, array, &is_even, NULL);
+  should_equal (filtered->length, LENGTH / 2);
+  for (i = 0; i < filtered->length; i++)
+    if (filtered->at (filtered, i) != &values[i * 2])
+      mismatches++;
+  should_equal (mismatches, 0);
+  filtered->push (filtered, &values[1]);
+  should_equal (filtered->last (filtered), &values[1]);
+  proto_del_array (filtered);
+  proto_del_array (array);
+}
+
+void
+test_parallel_reduce (proto_pool_t *pool)
+{
+  proto_array_t *array;
+  long total = 0;
+  span_t span = { true, 0, 0 };
+
+  describe ("Reduce a large array in parallel");
+  array = values_array (LENGTH);
+  should_be_true (proto_array_parallel_reduce (pool, array, &total, sizeof (long),
+    &sum_fold, &sum_combine, NULL));
+  should_equal (total, (long) LENGTH * (LENGTH - 1) / 2);
+  should_be_true (proto_array_parallel_reduce (pool, array, &span, sizeof (span_t),
+    &span_fold, &span_combine, NULL));
+  should_be_false (span.empty);
+  should_equal (span.first, 0);
+  should_equal (span.last, LENGTH - 1);
+  proto_del_array (array);
+}
+
+void
+test_parallel_nested (proto_pool_t *pool)
+{
+  proto_array_t *outer, *inner;
+  void *context[2];
+  size_t i, mismatches = 0;
+
+  describe ("Reduce in parallel from inside a parallel loop");
+  inner = values_array (4096);
+  outer = proto_init_array ();
+  for (i = 0; i < 2048; i++)
+    outer->push (outer, &values[0]);
+  context[0] = pool;
+  context[1] = inner;
+  proto_array_parallel_for (pool, outer, &nested_sum, context);
+  for (i = 0; i < 2048; i++)
+    if (doubled[i] != 4096L * 4095 / 2)
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_del_array (outer);
+  proto_del_array (inner);
+}
+
+void
+run_tests ()
+{
+  proto_pool_t *pool = proto_init_pool (4);
+
+  should_be_true (pool != NULL);
+  should_equal (proto_pool_workers (pool), 4);
+  test_parallel_for_and_map (pool);
+  test_parallel_filter (pool);
+  test_parallel_reduce (pool);
+  test_parallel_nested (pool);
+  proto_del_pool (pool);
+  test_parallel_for_and_map (NULL);
+  test_parallel_filter (NULL);
+  test_parallel_reduce (NULL);
+}
@@ -0,0 +1,152 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define LENGTH 1000
+
+static long values[LENGTH];
+static size_t calls = 0;
+
+static const void *
+next_value (const void *element,
+            void *context)
+{
+  calls++;
+  return (const long *) element + 1;
+}
+
+static bool
+is_multiple (const void *element,
+             void *context)
+{
+  return *(const long *) element % *(long *) context == 0;
+}
+
+static const void *
+larger (const void *element,
+        const void *other,
+        void *context)
+{
+  return *(const long *) element >= *(const long *) other ? element : other;
+}
+
+static const void *
+entry_value (const void *element,
+             void *context)
+{
+  return ((const proto_object_entry_t *) element)->value;
+}
+
+static void
+sum_elements (const void *element,
+              size_t position,
+              void *context)
+{
+  *(long *) context += *(const long *) element;
+}
+
+void
+test_pipeline_stages ()
+{
+  proto_array_t *array, *collected;
+  proto_pipeline_t *pipeline;
+  const void *element;
+  long three = 3;
+  size_t i;
+
+  describe ("Chain map, filter, skip and take over an array");
+  array = proto_init_array ();
+  for (i = 0; i < LENGTH; i++)
+    {
+      values[i] = (long) i;
+      array->push (array, &values[i]);
+    }
+  pipeline = proto_pipeline_from_array (array);
+  pipeline = proto_pipeline_map (pipeline, &next_value, NULL);
+  pipeline = proto_pipeline_filter (pipeline, &is_multiple, &three);
+  pipeline = proto_pipeline_skip (pipeline, 2);
+  pipeline = proto_pipeline_take (pipeline, 4);
+  should_be_true (pipeline != NULL);
+  should_equal (calls, 0);
+  collected = proto_pipeline_collect (pipeline);
+  should_equal (collected->length, 4);
+  should_equal (collected->at (collected, 0), &values[9]);
+  should_equal (collected->at (collected, 3), &values[18]);
+  // Stops pulling from the source as soon as take is satisfied
+  should_equal (calls, 18);
+  should_be_false (proto_pipeline_next (pipeline, &element));
+  proto_del_array (collected);
+  proto_del_pipeline (pipeline);
+
+  pipeline = proto_pipeline_map (proto_pipeline_from_array (array), &next_value, NULL);
+  pipeline = proto_pipeline_take (pipeline, 0);
+  should_be_false (proto_pipeline_next (pipeline, &element));
+  should_equal (calls, 18);
+  proto_del_pipeline (pipeline);
+  pipeline = proto_pipeline_skip (proto_pipeline_from_array (array), LENGTH + 5);
+  should_be_false (proto_pipeline_next (pipeline, &element));
+  proto_del_pipeline (pipeline);
+  should_equal (proto_pipeline_map (NULL, &next_value, NULL), NULL);
+  should_equal (proto_pipeline_collect (NULL), NULL);
+  proto_del_array (array);
+}
+
+void
+test_pipeline_sources ()
+{
+  proto_array_t *array, *collected;
+  proto_object_t *object;
+  proto_pipeline_t *pipeline;
+  long buffer[] = { 5, 1, 8, 2, 9 }, others[] = { 4, 4, 4 }, sum = 0, seven = 7;
+  char key[16];
+  size_t i;
+
+  describe ("Iterate chunked arrays, C buffers and object entries");
+  array = proto_init_chunked_array ();
+  for (i = 0; i < LENGTH; i++)
+    array->push (array, &values[i]);
+  pipeline = proto_pipeline_filter (proto_pipeline_from_array (array), &is_multiple, &seven);
+  proto_pipeline_each (pipeline, &sum_elements, &sum);
+  should_equal (sum, 7 * (142 * 143 / 2));
+  proto_del_pipeline (pipeline);
+  proto_del_array (array);
+
+  pipeline = proto_pipeline_from_buffer (buffer, 5, sizeof (long));
+  pipeline = proto_pipeline_zip (pipeline, proto_pipeline_from_buffer (others, 3, sizeof (long)),
+    &larger, NULL);
+  collected = proto_pipeline_collect (pipeline);
+  should_equal (collected->length, 3);
+  should_equal (collected->at (collected, 0), &buffer[0]);
+  should_equal (collected->at (collected, 1), &others[1]);
+  should_equal (collected->at (collected, 2), &buffer[2]);
+  proto_del_array (collected);
+  proto_del_pipeline (pipeline);
+
+  object = proto_init_object ();
+  for (i = 0; i < 100; i++)
+    {
+      sprintf (key, "key%zu", i);
+      object->set_own_property (object, key, &values[i]);
+    }
+  sum = 0;
+  pipeline = proto_pipeline_map (proto_pipeline_from_object (object), &entry_value, NULL);
+  proto_pipeline_each (pipeline, &sum_elements, &sum);
+  should_equal (sum, 99 * 100 / 2);
+  proto_del_pipeline (pipeline);
+  proto_del_object (object);
+}
+
+void
+run_tests ()
+{
+  test_pipeline_stages ();
+  test_pipeline_sources ();
+}
@@ -0,0 +1,138 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <pthread.h>
+
+#include "utils.h"
+
+#define THREADS 4
+#define PER_PRODUCER 50000
+
+static long values[THREADS * PER_PRODUCER];
+static unsigned char seen[THREADS * PER_PRODUCER];
+
+static void *
+produce (void *argument)
+{
+  proto_queue_t *queue = ((proto_queue_t **) argument)[0];
+  size_t first = (size_t) ((proto_queue_t **) argument)[1], i;
+
+  for (i = first; i < first + PER_PRODUCER; i++)
+    proto_queue_push (queue, &values[i]);
+  return NULL;
+}
+
+static void *
+consume (void *argument)
+{
+  proto_queue_t *queue = (proto_queue_t *) argument;
+  const long *value;
+  size_t i;
+
+  for (i = 0; i < PER_PRODUCER; i++)
+    {
+      value = (const long *) proto_queue_shift (queue);
+      seen[value - values]++;
+    }
+  return NULL;
+}
+
+void
+test_queue_bounded ()
+{
+  proto_queue_t *queue;
+  size_t i, mismatches = 0;
+
+  describe ("Push and shift on a bounded queue");
+  queue = proto_init_queue (5);
+  should_be_true (queue != NULL);
+  should_equal (proto_queue_try_shift (queue), NULL);
+  for (i = 0; i < 8; i++)
+    should_be_true (proto_queue_try_push (queue, &values[i]));
+  should_be_false (proto_queue_try_push (queue, &values[8]));
+  should_be_false (proto_queue_try_push (queue, NULL));
+  should_equal (proto_queue_length (queue), 8);
+  should_equal (proto_queue_shift (queue), &values[0]);
+  should_be_true (proto_queue_try_push (queue, &values[8]));
+  // Wrap around the ring a few times
+  for (i = 1; i < 1000; i++)
+    {
+      if (proto_queue_shift (queue) != &values[i])
+        mismatches++;
+      proto_queue_push (queue, &values[i + 8]);
+    }
+  should_equal (mismatches, 0);
+  should_equal (proto_queue_length (queue), 8);
+  proto_del_queue (queue);
+}
+
+void
+test_queue_unbounded ()
+{
+  proto_queue_t *queue;
+  size_t i, mismatches = 0;
+
+  describe ("Push and shift on an unbounded queue");
+  queue = proto_init_queue (0);
+  should_be_true (queue != NULL);
+  should_equal (proto_queue_try_shift (queue), NULL);
+  for (i = 0; i < 1000; i++)
+    if (!proto_queue_try_push (queue, &values[i]))
+      mismatches++;
+  should_equal (proto_queue_length (queue), 1000);
+  for (i = 0; i < 1000; i++)
+    if (proto_queue_try_shift (queue) != &values[i])
+      mismatches++;
+  should_equal (mismatches, 0);
+  should_equal (proto_queue_length (queue), 0);
+  should_equal (proto_queue_try_shift (queue), NULL);
+  proto_queue_push (queue, &values[1]);
+  proto_queue_push (queue, &values[2]);
+  proto_del_queue (queue);
+}
+
+void
+test_queue_threads (size_t capacity)
+{
+  proto_queue_t *queue;
+  pthread_t producers[THREADS], consumers[THREADS];
+  void *arguments[THREADS][2];
+  size_t i, mismatches = 0;
+
+  describe ("Hand elements over between producer and consumer threads");
+  queue = proto_init_queue (capacity);
+  for (i = 0; i < THREADS * PER_PRODUCER; i++)
+    seen[i] = 0;
+  for (i = 0; i < THREADS; i++)
+    {
+      arguments[i][0] = queue;
+      arguments[i][1] = (void *) (i * PER_PRODUCER);
+      pthread_create (&consumers[i], NULL, &consume, queue);
+      pthread_create (&producers[i], NULL, &produce, arguments[i]);
+    }
+  for (i = 0; i < THREADS; i++)
+    {
+      pthread_join (producers[i], NULL);
+      pthread_join (consumers[i], NULL);
+    }
+  for (i = 0; i < THREADS * PER_PRODUCER; i++)
+    if (seen[i] != 1)
+      mismatches++;
+  should_equal (mismatches, 0);
+  should_equal (proto_queue_length (queue), 0);
+  proto_del_queue (queue);
+}
+
+void
+run_tests ()
+{
+  test_queue_bounded ();
+  test_queue_unbounded ();
+  test_queue_threads (64);
+  test_queue_threads (0);
+}
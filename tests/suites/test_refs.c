@@ -0,0 +1,258 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "utils.h"
+
+#define CHAIN 10000
+#define THREADS 4
+#define PER_THREAD 10000
+
+void
+test_refs_counting ()
+{
+  proto_object_t *parent = proto_counted_object (), *child = proto_counted_object ();
+  proto_object_t *other = proto_counted_object (), *super = proto_counted_object ();
+  proto_array_t *array = proto_counted_array ();
+  proto_data_t *box;
+
+  describe ("Count references, taking and dropping them as values are stored");
+  should_equal (proto_references (parent), 1);
+  proto_retain (parent);
+  should_equal (proto_references (parent), 2);
+  proto_release (parent);
+  // Decrements wait for the thread's next batch
+  should_equal (proto_references (parent), 2);
+  should_equal (proto_refs_drain (SIZE_MAX), 0);
+  should_equal (proto_references (parent), 1);
+  should_equal (proto_references ("not counted"), 0);
+  proto_retain ("not counted");
+  proto_release ("not counted");
+  proto_release (NULL);
+
+  parent->set_own_property (parent, "child", child);
+  parent->set_own_property (parent, "again", child);
+  should_equal (proto_references (child), 3);
+  parent->set_own_property (parent, "again", other);
+  parent->del_own_property (parent, "child");
+  proto_refs_drain (SIZE_MAX);
+  should_equal (proto_references (child), 1);
+  should_equal (proto_references (other), 2);
+  parent->set_chain (parent, "deep.er", child);
+  parent->set_super (parent, super);
+  should_equal (proto_references (child), 2);
+  should_equal (proto_references (super), 2);
+
+  array->push (array, child);
+  array->unshift (array, other);
+  array->insert (array, 1, child);
+  should_equal (proto_references (child), 4);
+  array->pop (array);
+  array->shift (array);
+  proto_refs_drain (SIZE_MAX);
+  should_equal (proto_references (child), 3);
+  should_equal (proto_references (other), 2);
+  box = proto_counted_data ((proto_data_t) { object_t, { .object = array } });
+  should_equal (proto_references (array), 2);
+
+  // Freeing a value releases what it held; only what nothing else holds goes
+  proto_release (child);
+  proto_release (other);
+  proto_release (super);
+  proto_release (array);
+  should_equal (proto_refs_drain (SIZE_MAX), 0);
+  proto_release (box);
+  should_equal (proto_refs_drain (SIZE_MAX), 2);
+  should_equal (proto_references (child), 1);
+  proto_release (parent);
+  should_equal (proto_refs_drain (SIZE_MAX), 4);
+}
+
+/*
+ * Releasing the head of a long chain frees it a batch at a time instead of
+ * all at once.
+ */
+void
+test_refs_batches ()
+{
+  proto_object_t *head = NULL, *node;
+  size_t i, freed, total = 0, calls = 0, largest = 0;
+
+  describe ("Defer decrements and free what they cascade into in batches");
+  for (i = 0; i < CHAIN; i++)
+    {
+      node = proto_counted_object ();
+      node->set_own_property (node, "next", head);
+      proto_release (head);
+      head = node;
+    }
+  proto_refs_drain (SIZE_MAX);
+  should_equal (proto_references (head), 1);
+  proto_release (head);
+  while ((freed = proto_refs_drain (100)) > 0)
+    {
+      total += freed;
+      calls++;
+      if (freed > largest)
+        largest = freed;
+    }
+  should_equal (total, CHAIN);
+  should_equal (largest, 100);
+  should_be_true (calls >= CHAIN / 100);
+
+  // Batches drain on their own as releases pile up
+  for (i = 0; i < CHAIN; i++)
+    proto_release (proto_counted_object ());
+  should_be_true (proto_refs_drain (SIZE_MAX) < 256);
+}
+
+void
+test_refs_cycles ()
+{
+  proto_object_t *a = proto_counted_object (), *b = proto_counted_object ();
+  proto_object_t *c = proto_counted_object (), *d = proto_counted_object ();
+  proto_object_t *kept = proto_counted_object (), *holder = proto_counted_object ();
+  proto_array_t *items = proto_counted_array ();
+  proto_data_t *box;
+
+  describe ("Find cycles nothing outside them refers to, on demand");
+  a->set_own_property (a, "next", b);
+  b->set_own_property (b, "next", a);
+  a->set_own_property (a, "kept", kept);
+  b->set_super (b, kept);
+  proto_release (a);
+  proto_release (b);
+  should_equal (proto_refs_drain (SIZE_MAX), 0);
+  should_equal (proto_references (kept), 3);
+  should_equal (proto_refs_collect_cycles (), 2);
+  should_equal (proto_references (kept), 1);
+
+  // A reference from outside keeps a cycle, until it's dropped
+  c->set_chain (c, "inner.next", items);
+  items->push (items, d);
+  box = proto_counted_data ((proto_data_t) { object_t, { .object = c } });
+  d->set_own_property (d, "back", box);
+  holder->set_own_property (holder, "c", c);
+  proto_release (c);
+  proto_release (d);
+  proto_release (items);
+  proto_release (box);
+  should_equal (proto_refs_collect_cycles (), 0);
+  should_equal (proto_references (c), 2);
+  proto_release (holder);
+  should_equal (proto_refs_drain (SIZE_MAX), 1);
+  should_equal (proto_refs_collect_cycles (), 4);
+
+  kept->set_own_property (kept, "self", kept);
+  proto_release (kept);
+  should_equal (proto_refs_collect_cycles (), 1);
+  should_equal (proto_refs_collect_cycles (), 0);
+}
+
+static void *
+retain_and_release (void *argument)
+{
+  size_t i;
+
+  for (i = 0; i < PER_THREAD; i++)
+    {
+      proto_retain (argument);
+      proto_release (argument);
+    }
+  proto_refs_drain (SIZE_MAX);
+  return NULL;
+}
+
+/*
+ * Shares values of its own, which rebuilds the shared table over and over,
+ * while looking up one every thread holds.
+ */
+static void *
+share_while_finding (void *argument)
+{
+  proto_object_t *object;
+  size_t i, mismatches = 0;
+
+  for (i = 0; i < PER_THREAD / 10; i++)
+    {
+      object = proto_counted_object ();
+      proto_share (object);
+      proto_retain (argument);
+      if (proto_references (object) != 1 || proto_references (argument) < 2)
+        mismatches++;
+      proto_release (argument);
+      proto_release (object);
+      proto_refs_drain (SIZE_MAX);
+    }
+  return (void *) (uintptr_t) mismatches;
+}
+
+static void *
+leave_behind (void *argument)
+{
+  proto_object_t *object = proto_counted_object ();
+
+  proto_retain (object);
+  proto_release (object);
+  return object;
+}
+
+void
+test_refs_shared ()
+{
+  proto_object_t *shared = proto_counted_object (), *local = proto_counted_object ();
+  proto_array_t *list = proto_counted_array ();
+  pthread_t threads[THREADS];
+  void *left, *mismatches;
+  size_t i, total = 0;
+
+  describe ("Share values across threads with atomic counts");
+  shared->set_own_property (shared, "list", list);
+  proto_release (list);
+  should_be_true (proto_share (shared));
+  should_be_false (proto_share ("not counted"));
+  // Storing into a shared value shares what's stored
+  list->push (list, local);
+  proto_release (local);
+  for (i = 0; i < THREADS; i++)
+    pthread_create (&threads[i], NULL, &retain_and_release, i % 2 ? (void *) shared : (void *) local);
+  for (i = 0; i < THREADS; i++)
+    pthread_join (threads[i], NULL);
+  proto_refs_drain (SIZE_MAX);
+  should_equal (proto_references (shared), 1);
+  should_equal (proto_references (local), 1);
+  for (i = 0; i < THREADS; i++)
+    pthread_create (&threads[i], NULL, &share_while_finding, shared);
+  for (i = 0; i < THREADS; i++)
+    {
+      pthread_join (threads[i], &mismatches);
+      total += (uintptr_t) mismatches;
+    }
+  should_equal (total, 0);
+  should_equal (proto_references (shared), 1);
+  proto_release (shared);
+  should_equal (proto_refs_drain (SIZE_MAX), 3);
+
+  // Values a thread still holds when it exits can be released elsewhere
+  pthread_create (&threads[0], NULL, &leave_behind, NULL);
+  pthread_join (threads[0], &left);
+  should_equal (proto_references (left), 1);
+  proto_release (left);
+  should_equal (proto_refs_drain (SIZE_MAX), 1);
+}
+
+void
+run_tests ()
+{
+  test_refs_counting ();
+  test_refs_batches ();
+  test_refs_cycles ();
+  test_refs_shared ();
+}
@@ -0,0 +1,149 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+
+#include "utils.h"
+#include "point_shape.h"
+
+static const void *
+get_nothing (const void *self,
+             const char *key)
+{
+  return NULL;
+}
+
+void
+test_shapes_generated_keys ()
+{
+  size_t i, mismatches = 0;
+
+  describe ("Carry the hash objects give a key, worked out ahead of time");
+  for (i = 0; i < point_shape.length; i++)
+    if (point_keys[i].hash != proto_key_hash (point_keys[i].name))
+      mismatches++;
+  should_equal (mismatches, 0);
+  should_equal (point_shape.length, 4);
+  should_equal (PROTO_KEY (label)->hash, proto_key_hash ("label"));
+  should_equal (proto_key ("z-index").hash, point_keys[POINT_Z_INDEX].hash);
+  should_equal (proto_key (NULL).hash, 0);
+}
+
+void
+test_shapes_keyed_access ()
+{
+  proto_object_t *object = proto_init_object ();
+  proto_key_t keys[100];
+  char names[100][8];
+  size_t i, mismatches = 0;
+
+  describe ("Get, set and test properties by key without hashing them");
+  for (i = 0; i < 100; i++)
+    {
+      sprintf (names[i], "key%zu", i);
+      keys[i] = proto_key (names[i]);
+      proto_object_set_key (object, &keys[i], names[i]);
+    }
+  for (i = 0; i < 100; i++)
+    if (proto_object_get_key (object, &keys[i]) != names[i]
+        || object->get_own_property (object, names[i]) != names[i]
+        || !proto_object_has_key (object, &keys[i]))
+      mismatches++;
+  should_equal (mismatches, 0);
+  proto_object_set_key (object, PROTO_KEY (label), names[0]);
+  should_equal (object->get_own_property (object, "label"), names[0]);
+  object->del_own_property (object, "label");
+  should_be_false (proto_object_has_key (object, PROTO_KEY (label)));
+  should_equal (proto_object_get_key (object, PROTO_KEY (label)), NULL);
+  should_equal (proto_object_get_key (NULL, &keys[0]), NULL);
+  should_equal (proto_object_get_key (object, NULL), NULL);
+  should_be_false (proto_object_has_key (NULL, &keys[0]));
+  proto_object_set_key (NULL, &keys[0], NULL);
+
+  // Replaced property functions still see every access
+  object->get_own_property = &get_nothing;
+  should_equal (proto_object_get_key (object, &keys[0]), NULL);
+  proto_del_object (object);
+}
+
+void
+test_shapes_slots ()
+{
+  proto_object_t *point = proto_init_shaped_object (&point_shape), *other;
+  proto_object_stats_t stats;
+  const char *one = "one", *two = "two", *three = "three", *again = "again";
+  const char *deep = "deep", *flat = "flat", *merged = "merged";
+  char fillers[100][8];
+  size_t i, mismatches = 0;
+
+  describe ("Keep a shape's keys in slots read at constant offsets");
+  should_be_true (point != NULL);
+  should_equal (proto_object_shape (point), &point_shape);
+  should_equal (proto_object_shape (NULL), NULL);
+  proto_object_stats (point, &stats);
+  should_equal (stats.keys, 4);
+  should_be_true (point->has_own_property (point, "x"));
+  should_equal (proto_object_slot (point, POINT_X), NULL);
+
+  proto_object_set_slot (point, POINT_X, one);
+  point->set_own_property (point, "y", two);
+  proto_object_set_key (point, PROTO_KEY (label), three);
+  should_equal (point->get_own_property (point, "x"), one);
+  should_equal (proto_object_slot (point, POINT_Y), two);
+  should_equal (proto_object_slot (point, POINT_LABEL), three);
+
+  // Slots outlive changes to the rest of the object
+  for (i = 0; i < 100; i++)
+    {
+      sprintf (fillers[i], "f%zu", i);
+      point->set_own_property (point, fillers[i], fillers[i]);
+    }
+  for (i = 0; i < 100; i += 2)
+    point->del_own_property (point, fillers[i]);
+  if (proto_object_slot (point, POINT_X) != one
+      || proto_object_slot (point, POINT_Y) != two
+      || proto_object_slot (point, POINT_LABEL) != three)
+    mismatches++;
+  for (i = 1; i < 100; i += 2)
+    if (point->get_own_property (point, fillers[i]) != fillers[i])
+      mismatches++;
+  should_equal (mismatches, 0);
+
+  // Declared keys stay declared; deleting one clears it
+  should_equal (point->del_own_property (point, "x"), one);
+  should_be_true (point->has_own_property (point, "x"));
+  should_equal (proto_object_slot (point, POINT_X), NULL);
+  proto_object_set_slot (point, POINT_X, again);
+  should_equal (point->get_own_property (point, "x"), again);
+
+  // set_chain's inner objects in a slot are freed when it's set again
+  point->set_chain (point, "z-index.depth", deep);
+  should_equal (point->get_chain (point, "z-index.depth"), deep);
+  should_be_true (proto_object_slot (point, POINT_Z_INDEX) != NULL);
+  proto_object_set_slot (point, POINT_Z_INDEX, flat);
+  should_equal (point->get_own_property (point, "z-index"), flat);
+  proto_object_set_slot (point, 4, "out of range");
+  proto_object_set_slot (NULL, 0, NULL);
+
+  other = proto_init_object ();
+  other->set_own_property (other, "y", merged);
+  point->merge (point, other);
+  should_equal (proto_object_slot (point, POINT_Y), merged);
+  should_be_true (proto_object_memory_usage (point) > proto_object_memory_usage (other));
+  proto_del_object (other);
+  proto_del_object (point);
+  should_equal (proto_init_shaped_object (NULL), NULL);
+}
+
+void
+run_tests ()
+{
+  test_shapes_generated_keys ();
+  test_shapes_keyed_access ();
+  test_shapes_slots ();
+}
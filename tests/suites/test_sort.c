@@ -0,0 +1,176 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+static int
+compare_short (const void *a,
+               const void *b)
+{
+  return *(const short int *) a - *(const short int *) b;
+}
+
+static bool
+is_sorted (const proto_array_t *array,
+           proto_compare_t compare)
+{
+  size_t i;
+
+  for (i = 1; i < array->length; i++)
+    if (compare (array->at (array, i - 1), array->at (array, i)) > 0)
+      return false;
+  return true;
+}
+
+void
+test_sort_small ()
+{
+  proto_array_t *array;
+  short int value_a = 30,
+    value_b = 10,
+    value_c = 50,
+    value_d = 20,
+    value_e = 40;
+
+  describe ("Sort a small array with a comparator");
+  array = proto_init_array ();
+  array->push (array, &value_a);
+  array->push (array, &value_b);
+  array->push (array, &value_c);
+  array->push (array, &value_d);
+  array->push (array, &value_e);
+  proto_array_sort (array, &compare_short);
+  should_equal (array->length, 5);
+  should_equal (array->at (array, 0), &value_b);
+  should_equal (array->at (array, 1), &value_d);
+  should_equal (array->at (array, 2), &value_a);
+  should_equal (array->at (array, 3), &value_e);
+  should_equal (array->at (array, 4), &value_c);
+  should_equal (proto_array_bsearch (array, &value_a, &compare_short), 2);
+  proto_del_array (array);
+}
+
+void
+test_sort_patterns ()
+{
+  proto_array_t *array;
+  short int *values;
+  size_t i, length = 5000;
+
+  describe ("Sort large arrays with adversarial patterns");
+  values = (short int *) malloc (length * sizeof (short int));
+  array = proto_init_array ();
+  for (i = 0; i < length; i++)
+    {
+      values[i] = (short int) (length - i);
+      array->push (array, &values[i]);
+    }
+  proto_array_sort (array, &compare_short);
+  should_be_true (is_sorted (array, &compare_short));
+  should_equal (array->length, length);
+  proto_del_array (array);
+
+  array = proto_init_array ();
+  for (i = 0; i < length; i++)
+    {
+      values[i] = (short int) (i % 7);
+      array->push (array, &values[i]);
+    }
+  proto_array_sort (array, &compare_short);
+  should_be_true (is_sorted (array, &compare_short));
+  proto_del_array (array);
+
+  array = proto_init_array ();
+  for (i = 0; i < length; i++)
+    {
+      values[i] = (short int) ((i * 7919) % 1021);
+      array->push (array, &values[i]);
+    }
+  proto_array_sort (array, &compare_short);
+  should_be_true (is_sorted (array, &compare_short));
+  proto_array_sort (array, &compare_short);
+  should_be_true (is_sorted (array, &compare_short));
+  proto_del_array (array);
+  free (values);
+}
+
+void
+test_sort_radix ()
+{
+  proto_array_t *array;
+  size_t i, length = 1000;
+
+  describe ("Sort proto_data_t integers and decimals through the radix path");
+  array = proto_init_array ();
+  for (i = 0; i < length; i++)
+    array->push (array, T_INTEGER ((long) ((i * 7919) % 1009) - 500));
+  proto_array_sort (array, &proto_compare_integer);
+  should_be_true (is_sorted (array, &proto_compare_integer));
+  should_equal (((proto_data_t *) array->first (array))->data.integer, -500);
+  while (array->length)
+    proto_del_data ((proto_data_t *) array->pop (array));
+
+  for (i = 0; i < length; i++)
+    array->push (array, T_DECIMAL (((double) ((i * 7919) % 1009) - 500.0) / 8.0));
+  proto_array_sort (array, &proto_compare_decimal);
+  should_be_true (is_sorted (array, &proto_compare_decimal));
+  should_equal (((proto_data_t *) array->last (array))->data.decimal, 508.0 / 8.0);
+  while (array->length)
+    proto_del_data ((proto_data_t *) array->pop (array));
+  proto_del_array (array);
+}
+
+void
+test_sort_kept_sorted ()
+{
+  proto_array_t *array;
+  short int value_a = 30,
+    value_b = 10,
+    value_c = 50,
+    value_d = 20,
+    value_e = 20,
+    value_f = 99;
+
+  describe ("Keep an array sorted and look elements up by binary search");
+  array = proto_init_array ();
+  array->push (array, &value_a);
+  array->push (array, &value_b);
+  array->push (array, &value_c);
+  proto_array_keep_sorted (array, &compare_short);
+  should_equal (array->at (array, 0), &value_b);
+  should_equal (array->at (array, 2), &value_c);
+  array->push (array, &value_d);
+  array->unshift (array, &value_e);
+  array->insert (array, 0, &value_f);
+  should_equal (array->length, 6);
+  should_be_true (is_sorted (array, &compare_short));
+  should_equal (array->at (array, 1), &value_d);
+  should_equal (array->at (array, 2), &value_e);
+  should_equal (array->last (array), &value_f);
+  should_be_true (array->includes (array, &value_e));
+  should_equal (array->index (array, &value_d), 1);
+  should_equal (array->index (array, &value_e), 2);
+  should_equal (array->index (array, &value_a), 3);
+  array->del (array, 1);
+  should_be_false (array->includes (array, &value_d));
+  should_equal (array->index (array, &value_d), (size_t) -1);
+  proto_array_keep_sorted (array, NULL);
+  array->push (array, &value_d);
+  should_equal (array->last (array), &value_d);
+  proto_del_array (array);
+}
+
+void
+run_tests ()
+{
+  test_sort_small ();
+  test_sort_patterns ();
+  test_sort_radix ();
+  test_sort_kept_sorted ();
+}
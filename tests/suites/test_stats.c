@@ -0,0 +1,171 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+static void *
+count_arguments (const void *arguments)
+{
+  return (void *) ((proto_array_t *) arguments)->length;
+}
+
+void
+test_stats_object_shape ()
+{
+  proto_object_t *object = proto_init_object ();
+  proto_object_stats_t stats;
+  char keys[200][8];
+  size_t i, buckets = 0, keys_seen = 0;
+
+  describe ("Describe how an object's keys spread over buckets and trees");
+  should_be_true (proto_object_stats (object, &stats));
+  should_equal (stats.keys, 0);
+  should_equal (stats.used_buckets, 0);
+  should_equal (stats.occupancy[0], stats.buckets);
+  for (i = 0; i < 200; i++)
+    {
+      sprintf (keys[i], "k%zu", i);
+      object->set_own_property (object, keys[i], keys[i]);
+    }
+  should_be_true (proto_object_stats (object, &stats));
+  should_equal (stats.keys, 200);
+  for (i = 0; i < PROTO_STATS_HISTOGRAM; i++)
+    {
+      buckets += stats.occupancy[i];
+      keys_seen += stats.depths[i];
+    }
+  should_equal (buckets, stats.buckets);
+  should_equal (keys_seen, 200);
+  should_equal (stats.depths[0], stats.used_buckets);
+  should_be_true (stats.max_depth > 1);
+  should_be_false (proto_object_stats (NULL, &stats));
+  should_be_false (proto_object_stats (object, NULL));
+  proto_del_object (object);
+}
+
+void
+test_stats_array_shape ()
+{
+  proto_array_t *array = proto_init_array (), *chunked = proto_init_chunked_array ();
+  proto_array_stats_t stats;
+  size_t i;
+
+  describe ("Report an array's length and capacity");
+  for (i = 0; i < 100; i++)
+    {
+      array->push (array, &stats);
+      chunked->push (chunked, &stats);
+    }
+  should_be_true (proto_array_stats (array, &stats));
+  should_equal (stats.length, 100);
+  should_be_true (stats.capacity >= 100);
+  should_be_false (stats.chunked);
+  should_be_false (stats.indexed);
+  proto_array_hash_index (array, true);
+  should_be_true (proto_array_stats (array, &stats));
+  should_be_true (stats.indexed);
+  should_be_true (proto_array_stats (chunked, &stats));
+  should_equal (stats.length, 100);
+  should_be_true (stats.chunked);
+  should_be_false (proto_array_stats (NULL, &stats));
+  proto_del_array (array);
+  proto_del_array (chunked);
+}
+
+void
+test_stats_memory_usage ()
+{
+  proto_object_t *object = proto_init_object (), *empty = proto_init_object ();
+  proto_array_t *array = proto_init_array ();
+  size_t base = proto_object_memory_usage (object), with_key, with_chain, array_base, i;
+
+  describe ("Measure the bytes objects and arrays retain, deeply");
+  should_be_true (base > 0);
+  should_equal (proto_object_memory_usage (empty), base);
+  object->set_own_property (object, "twelve chars", NULL);
+  with_key = proto_object_memory_usage (object);
+  should_be_true (with_key > base + sizeof ("twelve chars"));
+  // A key costs its entry and its copy, not eight bytes per character
+  should_be_true (with_key < base + 8 * sizeof ("twelve chars"));
+  object->del_own_property (object, "twelve chars");
+  should_equal (proto_object_memory_usage (object), base);
+  object->set_chain (object, "a.b", NULL);
+  with_chain = proto_object_memory_usage (object);
+  should_be_true (with_chain > 2 * base);
+  should_equal (proto_object_memory_usage (NULL), 0);
+
+  array_base = proto_array_memory_usage (array);
+  should_be_true (array_base >= array->allocated * sizeof (void *));
+  for (i = 0; i < 1000; i++)
+    array->push (array, &i);
+  should_be_true (proto_array_memory_usage (array) >= array_base + 1000 * sizeof (void *));
+  array_base = proto_array_memory_usage (array);
+  proto_array_hash_index (array, true);
+  array->includes (array, &i);
+  should_be_true (proto_array_memory_usage (array) > array_base);
+  should_equal (proto_array_memory_usage (NULL), 0);
+  proto_del_array (array);
+  proto_del_object (object);
+  proto_del_object (empty);
+}
+
+void
+test_stats_counters ()
+{
+  proto_object_t *object;
+  proto_array_t *array;
+  proto_stats_t stats;
+  size_t i;
+
+  if (!proto_stats_enabled ())
+    {
+      skip ("Count operations (the library is built without PROTO_STATS)");
+      should_be_false (proto_stats_read (&stats));
+      should_equal (stats.lookups, 0);
+      return;
+    }
+  describe ("Count lookups, comparisons, resizes and calls on this thread");
+  object = proto_init_object ();
+  array = proto_init_array ();
+  proto_stats_reset ();
+  object->set_own_property (object, "a", "a");
+  object->set_own_property (object, "b", "b");
+  should_be_true (proto_stats_read (&stats));
+  should_equal (stats.allocations, 4);
+  should_equal (stats.lookups, 0);
+  for (i = 0; i < 10; i++)
+    object->get_own_property (object, i % 2 ? "a" : "b");
+  object->has_own_property (object, "missing");
+  proto_stats_read (&stats);
+  should_equal (stats.lookups, 11);
+  should_be_true (stats.probes >= 10);
+  should_be_true (stats.comparisons >= stats.probes);
+
+  for (i = 0; i < 100; i++)
+    array->push (array, &stats);
+  should_equal (proto_generic_caller ("%i %s", &count_arguments, 1L, "x"), (void *) 2);
+  proto_stats_read (&stats);
+  should_be_true (stats.resizes > 0);
+  should_equal (stats.calls, 1);
+  proto_stats_reset ();
+  proto_stats_read (&stats);
+  should_equal (stats.lookups, 0);
+  proto_del_array (array);
+  proto_del_object (object);
+}
+
+void
+run_tests ()
+{
+  test_stats_object_shape ();
+  test_stats_array_shape ();
+  test_stats_memory_usage ();
+  test_stats_counters ();
+}
@@ -0,0 +1,200 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+#define LENGTH 5000
+
+static long values[LENGTH];
+static const void *expected[8 * LENGTH];
+
+static size_t
+mismatches (const proto_vector_t *vector,
+            size_t length)
+{
+  size_t i, count = 0;
+
+  if (proto_vector_length (vector) != length)
+    return length + 1;
+  for (i = 0; i < length; i++)
+    if (proto_vector_at (vector, i) != expected[i])
+      count++;
+  return count;
+}
+
+static proto_vector_t *
+vector_of (size_t begin,
+           size_t end)
+{
+  proto_vector_builder_t *builder = proto_init_vector_builder (NULL);
+  size_t i;
+
+  for (i = begin; i < end; i++)
+    proto_vector_builder_push (builder, &values[i % LENGTH]);
+  return proto_vector_builder_finish (builder);
+}
+
+void
+test_vector_versions ()
+{
+  proto_vector_t *versions[LENGTH + 1], *updated, *popped;
+  size_t i, wrong = 0;
+
+  describe ("Keep every version of a vector built by push");
+  versions[0] = proto_init_vector ();
+  should_equal (proto_vector_length (versions[0]), 0);
+  should_equal (proto_vector_at (versions[0], 0), NULL);
+  should_equal (proto_vector_pop (versions[0]), NULL);
+  for (i = 0; i < LENGTH; i++)
+    {
+      values[i] = (long) i;
+      expected[i] = &values[i];
+      versions[i + 1] = proto_vector_push (versions[i], &values[i]);
+    }
+  for (i = 0; i <= LENGTH; i += 97)
+    wrong += mismatches (versions[i], i);
+  should_equal (wrong, 0);
+  should_equal (mismatches (versions[LENGTH], LENGTH), 0);
+
+  updated = proto_vector_set (versions[LENGTH], 1234, &values[0]);
+  should_equal (proto_vector_at (updated, 1234), &values[0]);
+  should_equal (proto_vector_at (versions[LENGTH], 1234), &values[1234]);
+  should_equal (proto_vector_set (updated, LENGTH, &values[0]), NULL);
+  popped = proto_vector_pop (updated);
+  should_equal (proto_vector_length (popped), LENGTH - 1);
+  should_equal (proto_vector_at (popped, LENGTH - 2), &values[LENGTH - 2]);
+  should_equal (proto_vector_length (updated), LENGTH);
+  proto_del_vector (popped);
+  proto_del_vector (updated);
+
+  for (i = LENGTH; i > 0; i--)
+    {
+      popped = proto_vector_pop (versions[i]);
+      wrong += proto_vector_length (popped) != i - 1;
+      wrong += i > 1 && proto_vector_at (popped, i - 2) != &values[i - 2];
+      proto_del_vector (popped);
+    }
+  should_equal (wrong, 0);
+  for (i = 0; i <= LENGTH; i++)
+    proto_del_vector (versions[i]);
+}
+
+void
+test_vector_concat_and_slice ()
+{
+  proto_vector_t *whole, *part, *joined, *slice, *pushed;
+  size_t sizes[] = { 1, 31, 33, 1024, 1025, 3000 }, i, j, total = 0, wrong = 0;
+
+  describe ("Concatenate and slice vectors of different shapes");
+  whole = proto_init_vector ();
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (j = 0; j < sizeof (sizes) / sizeof (sizes[0]); j++)
+      {
+        part = vector_of (total, total + sizes[j]);
+        joined = proto_vector_concat (whole, part);
+        proto_del_vector (part);
+        proto_del_vector (whole);
+        whole = joined;
+        total += sizes[j];
+      }
+  for (i = 0; i < total; i++)
+    expected[i] = &values[i % LENGTH];
+  should_equal (mismatches (whole, total), 0);
+
+  // Pushing onto relaxed nodes, and concatenating a vector with itself
+  pushed = proto_vector_push (whole, &values[7]);
+  expected[total] = &values[7];
+  should_equal (mismatches (pushed, total + 1), 0);
+  proto_del_vector (pushed);
+  joined = proto_vector_concat (whole, whole);
+  for (i = 0; i < total; i++)
+    if (proto_vector_at (joined, total + i) != expected[i])
+      wrong++;
+  should_equal (wrong, 0);
+  should_equal (proto_vector_length (joined), 2 * total);
+  proto_del_vector (joined);
+
+  for (i = 0; i < total; i += total / 7)
+    for (j = i; j <= total; j += total / 5 + 1)
+      {
+        slice = proto_vector_slice (whole, i, j);
+        if (proto_vector_length (slice) != j - i
+            || (j > i && proto_vector_at (slice, 0) != expected[i])
+            || (j > i && proto_vector_at (slice, j - i - 1) != expected[j - 1]))
+          wrong++;
+        proto_del_vector (slice);
+      }
+  should_equal (wrong, 0);
+  slice = proto_vector_slice (whole, 40, total + 100);
+  should_equal (proto_vector_length (slice), total - 40);
+  pushed = proto_vector_push (slice, &values[3]);
+  part = proto_vector_concat (pushed, slice);
+  should_equal (proto_vector_at (part, total - 40), &values[3]);
+  should_equal (proto_vector_at (part, total - 39), expected[40]);
+  proto_del_vector (part);
+  proto_del_vector (pushed);
+  proto_del_vector (slice);
+  slice = proto_vector_slice (whole, 10, 10);
+  should_equal (proto_vector_length (slice), 0);
+  proto_del_vector (slice);
+  proto_del_vector (whole);
+}
+
+void
+test_vector_builders_and_arrays ()
+{
+  proto_vector_t *vector, *built;
+  proto_vector_builder_t *builder;
+  proto_array_t *array, *back;
+  size_t i, wrong = 0;
+
+  describe ("Convert vectors from and to arrays, and batch updates");
+  array = proto_init_array ();
+  for (i = 0; i < LENGTH; i++)
+    {
+      array->push (array, &values[i]);
+      expected[i] = &values[i];
+    }
+  vector = proto_vector_from_array (array);
+  should_equal (mismatches (vector, LENGTH), 0);
+  back = proto_vector_to_array (vector);
+  should_equal (back->length, LENGTH);
+  for (i = 0; i < LENGTH; i++)
+    if (back->at (back, i) != array->at (array, i))
+      wrong++;
+  should_equal (wrong, 0);
+  back->push (back, &values[0]);
+  should_equal (back->last (back), &values[0]);
+  proto_del_array (back);
+  proto_del_array (array);
+
+  builder = proto_init_vector_builder (vector);
+  for (i = 0; i < LENGTH; i += 2)
+    proto_vector_builder_set (builder, i, &values[0]);
+  should_be_false (proto_vector_builder_set (builder, LENGTH, &values[0]));
+  for (i = 0; i < 100; i++)
+    proto_vector_builder_pop (builder);
+  proto_vector_builder_push (builder, &values[1]);
+  built = proto_vector_builder_finish (builder);
+  should_equal (proto_vector_length (built), LENGTH - 99);
+  should_equal (proto_vector_at (built, 2), &values[0]);
+  should_equal (proto_vector_at (built, 3), &values[3]);
+  should_equal (proto_vector_at (built, LENGTH - 100), &values[1]);
+  should_equal (mismatches (vector, LENGTH), 0);
+  proto_del_vector (built);
+  proto_del_vector (vector);
+}
+
+void
+run_tests ()
+{
+  test_vector_versions ();
+  test_vector_concat_and_slice ();
+  test_vector_builders_and_arrays ();
+}
@@ -0,0 +1,90 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <proto.h>
+
+#include "utils.h"
+
+static void
+sum_elements (const void *element,
+              size_t position,
+              void *context)
+{
+  *(long *) context += *(const short int *) element * (long) (position + 1);
+}
+
+void
+test_view_slice ()
+{
+  proto_array_t *array, *materialized;
+  proto_array_view_t view;
+  short int values[10];
+  size_t i;
+  long sum = 0;
+
+  describe ("View a strided slice of an array");
+  array = proto_init_array ();
+  for (i = 0; i < 10; i++)
+    {
+      values[i] = (short int) i;
+      array->push (array, &values[i]);
+    }
+  proto_init_array_view (&view, array, 1, 100, 3);
+  should_equal (view.length, 3);
+  should_equal (view.first (&view), &values[1]);
+  should_equal (view.at (&view, 1), &values[4]);
+  should_equal (view.last (&view), &values[7]);
+  should_equal (view.at (&view, 3), NULL);
+  view.each (&view, &sum_elements, &sum);
+  should_equal (sum, 1 * 1 + 4 * 2 + 7 * 3);
+  materialized = view.to_array (&view);
+  should_equal (materialized->length, 3);
+  should_equal (materialized->at (materialized, 2), &values[7]);
+  materialized->push (materialized, &values[9]);
+  should_equal (materialized->last (materialized), &values[9]);
+  proto_del_array (materialized);
+  array->pop (array);
+  array->pop (array);
+  array->pop (array);
+  should_equal (view.at (&view, 2), NULL);
+  proto_init_array_view (&view, array, 20, 5, 1);
+  should_equal (view.length, 0);
+  should_equal (view.first (&view), NULL);
+  proto_del_array (array);
+}
+
+void
+test_view_reverse ()
+{
+  proto_array_t *array;
+  proto_array_view_t view;
+  short int value_a = 1,
+    value_b = 2,
+    value_c = 3;
+
+  describe ("Iterate an array backwards through a reverse view");
+  array = proto_init_array ();
+  proto_array_reverse_view (&view, array);
+  should_equal (view.length, 0);
+  should_equal (view.last (&view), NULL);
+  array->push (array, &value_a);
+  array->push (array, &value_b);
+  array->push (array, &value_c);
+  proto_array_reverse_view (&view, array);
+  should_equal (view.length, 3);
+  should_equal (view.first (&view), &value_c);
+  should_equal (view.at (&view, 1), &value_b);
+  should_equal (view.last (&view), &value_a);
+  proto_del_array (array);
+}
+
+void
+run_tests ()
+{
+  test_view_slice ();
+  test_view_reverse ();
+}
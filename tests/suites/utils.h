@@ -20,7 +20,7 @@ extern "C" {
 static size_t success_counter = 0;
 static size_t errors_counter = 0;
 static size_t skipped_counter = 0;
-static char *description = "";
+static const char *description = "";
 
 #define fail_place fprintf (stderr, "%s:%d: ", __FILE__, __LINE__)
 
@@ -47,20 +47,20 @@ void
 run_tests ();
 
 void
-describe (char *message)
+describe (const char *message)
 {
   description = message;
 }
 
 void
-skip (char *message)
+skip (const char *message)
 {
   skipped_counter++;
   printf ("\033[93m·\033[0m");
 }
 
 static void
-spec_eval (char *filename,
+spec_eval (const char *filename,
            int line_number,
            int is_success)
 {
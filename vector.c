@@ -0,0 +1,1032 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "proto.h"
+#include "internal.h"
+
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1 << VECTOR_BITS)
+#define VECTOR_MASK (VECTOR_WIDTH - 1)
+
+// How many nodes above the minimum a concatenation may leave per level
+#ifndef VECTOR_EXTRAS
+#define VECTOR_EXTRAS 2
+#endif
+
+/*
+ * Persistent vectors are relaxed radix balanced trees: leaves hold up to 32
+ * elements, inner nodes up to 32 children. Inner nodes whose children are
+ * all full but the last are found by radix, the others ("relaxed", left by
+ * concat and slice) keep the cumulative size of their children. Versions
+ * share every node they have in common; nodes are reference counted and
+ * copied on write unless a single owner holds them.
+ */
+typedef struct {
+  atomic_size_t refs;
+  size_t size;
+  unsigned int count;
+  bool relaxed;
+  void *slots[VECTOR_WIDTH];
+  size_t sizes[];
+} proto_vector_node_t;
+
+struct proto_vector {
+  proto_vector_node_t *root;
+  unsigned int shift;
+  size_t length;
+};
+
+struct proto_vector_builder {
+  proto_vector_t vector;
+};
+
+static proto_vector_node_t *
+vector_node_new (unsigned int shift)
+{
+  size_t bytes = sizeof (proto_vector_node_t);
+  proto_vector_node_t *node;
+
+  // Only inner nodes can need a size table
+  if (shift > 0)
+    bytes += VECTOR_WIDTH * sizeof (size_t);
+  node = (proto_vector_node_t *) malloc (bytes);
+  if (!node)
+    return NULL;
+  atomic_init (&node->refs, 1);
+  node->size = 0;
+  node->count = 0;
+  node->relaxed = false;
+  return node;
+}
+
+static inline proto_vector_node_t *
+vector_node_retain (proto_vector_node_t *node)
+{
+  atomic_fetch_add_explicit (&node->refs, 1, memory_order_relaxed);
+  return node;
+}
+
+static void
+vector_node_release (proto_vector_node_t *node,
+                     unsigned int shift)
+{
+  unsigned int i;
+
+  if (node == NULL || atomic_fetch_sub_explicit (&node->refs, 1, memory_order_acq_rel) != 1)
+    return;
+  if (shift > 0)
+    for (i = 0; i < node->count; i++)
+      vector_node_release (node->slots[i], shift - VECTOR_BITS);
+  free (node);
+}
+
+static inline bool
+vector_node_owned (proto_vector_node_t *node,
+                   bool owned)
+{
+  return owned && atomic_load_explicit (&node->refs, memory_order_acquire) == 1;
+}
+
+// The node itself when the caller is its only owner, a copy otherwise
+static proto_vector_node_t *
+vector_node_editable (proto_vector_node_t *node,
+                      unsigned int shift,
+                      bool owned)
+{
+  proto_vector_node_t *copy;
+  unsigned int i;
+
+  if (owned)
+    return node;
+  copy = vector_node_new (shift);
+  if (!copy)
+    return NULL;
+  copy->size = node->size;
+  copy->count = node->count;
+  copy->relaxed = node->relaxed;
+  memcpy (copy->slots, node->slots, node->count * sizeof (void *));
+  if (shift > 0)
+    {
+      memcpy (copy->sizes, node->sizes, node->count * sizeof (size_t));
+      for (i = 0; i < node->count; i++)
+        vector_node_retain (copy->slots[i]);
+    }
+  return copy;
+}
+
+// Recomputes size, and the size table when a child before the last isn't full
+static void
+vector_node_update (proto_vector_node_t *node,
+                    unsigned int shift)
+{
+  proto_vector_node_t *child;
+  unsigned int i;
+
+  if (shift == 0)
+    {
+      node->size = node->count;
+      return;
+    }
+  node->size = 0;
+  node->relaxed = false;
+  for (i = 0; i < node->count; i++)
+    {
+      child = (proto_vector_node_t *) node->slots[i];
+      if (i + 1 < node->count && child->size != (size_t) 1 << shift)
+        node->relaxed = true;
+      node->size += child->size;
+      node->sizes[i] = node->size;
+    }
+}
+
+// Index of the child holding position, turning position into an offset in it
+static inline unsigned int
+vector_child (const proto_vector_node_t *node,
+              unsigned int shift,
+              size_t *position)
+{
+  unsigned int i = (*position >> shift) & VECTOR_MASK;
+
+  if (!node->relaxed)
+    {
+      *position -= (size_t) i << shift;
+      return i;
+    }
+  while (node->sizes[i] <= *position)
+    i++;
+  if (i > 0)
+    *position -= node->sizes[i - 1];
+  return i;
+}
+
+static bool
+vector_node_full (const proto_vector_node_t *node,
+                  unsigned int shift)
+{
+  if (node->count < VECTOR_WIDTH)
+    return false;
+  if (shift == 0)
+    return true;
+  return vector_node_full (node->slots[node->count - 1], shift - VECTOR_BITS);
+}
+
+// A node at shift holding only element
+static proto_vector_node_t *
+vector_path (unsigned int shift,
+             const void *element)
+{
+  proto_vector_node_t *node = vector_node_new (0), *parent;
+  unsigned int level;
+
+  if (!node)
+    return NULL;
+  node->slots[0] = (void *) element;
+  node->count = node->size = 1;
+  for (level = VECTOR_BITS; level <= shift; level += VECTOR_BITS)
+    {
+      parent = vector_node_new (level);
+      if (!parent)
+        {
+          vector_node_release (node, level - VECTOR_BITS);
+          return NULL;
+        }
+      parent->slots[0] = node;
+      parent->count = parent->size = 1;
+      node = parent;
+    }
+  return node;
+}
+
+/*
+ * The recursive updates below build the new child first and only then copy
+ * the parent, so a failed allocation releases what was built and leaves the
+ * original nodes as they were.
+ */
+static proto_vector_node_t *
+vector_node_push (proto_vector_node_t *node,
+                  unsigned int shift,
+                  const void *element,
+                  bool owned)
+{
+  proto_vector_node_t *copy, *last, *child;
+
+  owned = vector_node_owned (node, owned);
+  if (shift == 0)
+    {
+      copy = vector_node_editable (node, 0, owned);
+      if (!copy)
+        return NULL;
+      copy->slots[copy->count++] = (void *) element;
+      copy->size++;
+      return copy;
+    }
+  last = (proto_vector_node_t *) node->slots[node->count - 1];
+  if (vector_node_full (last, shift - VECTOR_BITS))
+    {
+      child = vector_path (shift - VECTOR_BITS, element);
+      if (!child)
+        return NULL;
+      copy = vector_node_editable (node, shift, owned);
+      if (!copy)
+        {
+          vector_node_release (child, shift - VECTOR_BITS);
+          return NULL;
+        }
+      copy->slots[copy->count++] = child;
+      if (copy->relaxed || last->size != (size_t) 1 << shift)
+        vector_node_update (copy, shift);
+      else
+        copy->size++;
+      return copy;
+    }
+  child = vector_node_push (last, shift - VECTOR_BITS, element, owned);
+  if (!child)
+    return NULL;
+  copy = vector_node_editable (node, shift, owned);
+  if (!copy)
+    {
+      vector_node_release (child, shift - VECTOR_BITS);
+      return NULL;
+    }
+  if (child != last)
+    {
+      vector_node_release (last, shift - VECTOR_BITS);
+      copy->slots[copy->count - 1] = child;
+    }
+  copy->size++;
+  if (copy->relaxed)
+    copy->sizes[copy->count - 1]++;
+  return copy;
+}
+
+// Removes the last element of a node holding at least two
+static proto_vector_node_t *
+vector_node_pop (proto_vector_node_t *node,
+                 unsigned int shift,
+                 bool owned)
+{
+  proto_vector_node_t *copy, *last, *child;
+
+  owned = vector_node_owned (node, owned);
+  if (shift == 0)
+    {
+      copy = vector_node_editable (node, 0, owned);
+      if (!copy)
+        return NULL;
+      copy->count--;
+      copy->size--;
+      return copy;
+    }
+  last = (proto_vector_node_t *) node->slots[node->count - 1];
+  if (last->size == 1)
+    {
+      copy = vector_node_editable (node, shift, owned);
+      if (!copy)
+        return NULL;
+      vector_node_release (last, shift - VECTOR_BITS);
+      copy->count--;
+      copy->size--;
+      return copy;
+    }
+  child = vector_node_pop (last, shift - VECTOR_BITS, owned);
+  if (!child)
+    return NULL;
+  copy = vector_node_editable (node, shift, owned);
+  if (!copy)
+    {
+      vector_node_release (child, shift - VECTOR_BITS);
+      return NULL;
+    }
+  if (child != last)
+    {
+      vector_node_release (last, shift - VECTOR_BITS);
+      copy->slots[copy->count - 1] = child;
+    }
+  copy->size--;
+  if (copy->relaxed)
+    copy->sizes[copy->count - 1]--;
+  return copy;
+}
+
+static proto_vector_node_t *
+vector_node_set (proto_vector_node_t *node,
+                 unsigned int shift,
+                 size_t position,
+                 const void *element,
+                 bool owned)
+{
+  proto_vector_node_t *copy, *old, *child;
+  unsigned int i;
+
+  owned = vector_node_owned (node, owned);
+  if (shift == 0)
+    {
+      copy = vector_node_editable (node, 0, owned);
+      if (!copy)
+        return NULL;
+      copy->slots[position & VECTOR_MASK] = (void *) element;
+      return copy;
+    }
+  i = vector_child (node, shift, &position);
+  old = (proto_vector_node_t *) node->slots[i];
+  child = vector_node_set (old, shift - VECTOR_BITS, position, element, owned);
+  if (!child)
+    return NULL;
+  copy = vector_node_editable (node, shift, owned);
+  if (!copy)
+    {
+      vector_node_release (child, shift - VECTOR_BITS);
+      return NULL;
+    }
+  if (child != old)
+    {
+      vector_node_release (old, shift - VECTOR_BITS);
+      copy->slots[i] = child;
+    }
+  return copy;
+}
+
+// A root with a single child is replaced by the child
+static void
+vector_collapse (proto_vector_t *vector)
+{
+  proto_vector_node_t *child;
+
+  while (vector->shift > 0 && vector->root->count == 1)
+    {
+      child = vector_node_retain (vector->root->slots[0]);
+      vector_node_release (vector->root, vector->shift);
+      vector->root = child;
+      vector->shift -= VECTOR_BITS;
+    }
+}
+
+/*
+ * The updates work on a handle owning one reference to its root. Nodes are
+ * changed in place where that handle is their only owner, which is the
+ * case for what a builder created itself; persistent operations take an
+ * extra reference first, so everything they touch is copied.
+ */
+static bool
+vector_push (proto_vector_t *vector,
+             const void *element)
+{
+  proto_vector_node_t *root;
+
+  if (vector->root == NULL)
+    {
+      vector->root = vector_path (0, element);
+      if (!vector->root)
+        return false;
+      vector->length = 1;
+      return true;
+    }
+  if (vector_node_full (vector->root, vector->shift))
+    {
+      root = vector_node_new (vector->shift + VECTOR_BITS);
+      if (!root)
+        return false;
+      root->slots[1] = vector_path (vector->shift, element);
+      if (!root->slots[1])
+        {
+          free (root);
+          return false;
+        }
+      root->slots[0] = vector->root;
+      root->count = 2;
+      vector->shift += VECTOR_BITS;
+      vector_node_update (root, vector->shift);
+      vector->root = root;
+      vector->length++;
+      return true;
+    }
+  root = vector_node_push (vector->root, vector->shift, element, true);
+  if (!root)
+    return false;
+  if (root != vector->root)
+    {
+      vector_node_release (vector->root, vector->shift);
+      vector->root = root;
+    }
+  vector->length++;
+  return true;
+}
+
+static bool
+vector_pop (proto_vector_t *vector)
+{
+  proto_vector_node_t *root;
+
+  if (vector->length == 0)
+    return false;
+  if (vector->length == 1)
+    {
+      vector_node_release (vector->root, vector->shift);
+      vector->root = NULL;
+      vector->shift = 0;
+      vector->length = 0;
+      return true;
+    }
+  root = vector_node_pop (vector->root, vector->shift, true);
+  if (!root)
+    return false;
+  if (root != vector->root)
+    {
+      vector_node_release (vector->root, vector->shift);
+      vector->root = root;
+    }
+  vector->length--;
+  vector_collapse (vector);
+  return true;
+}
+
+static bool
+vector_set (proto_vector_t *vector,
+            size_t position,
+            const void *element)
+{
+  proto_vector_node_t *root;
+
+  if (position >= vector->length)
+    return false;
+  root = vector_node_set (vector->root, vector->shift, position, element, true);
+  if (!root)
+    return false;
+  if (root != vector->root)
+    {
+      vector_node_release (vector->root, vector->shift);
+      vector->root = root;
+    }
+  return true;
+}
+
+static proto_vector_t *
+vector_handle (proto_vector_node_t *root,
+               unsigned int shift,
+               size_t length)
+{
+  proto_vector_t *vector = (proto_vector_t *) malloc (sizeof (proto_vector_t));
+
+  if (!vector)
+    {
+      vector_node_release (root, shift);
+      return NULL;
+    }
+  vector->root = root;
+  vector->shift = shift;
+  vector->length = length;
+  return vector;
+}
+
+// A new handle on the same tree, ready for a persistent update
+static proto_vector_t *
+vector_clone (const proto_vector_t *vector)
+{
+  if (vector->root != NULL)
+    vector_node_retain (vector->root);
+  return vector_handle (vector->root, vector->shift, vector->length);
+}
+
+/*
+ * Concatenation follows Bagwell and Rompf: the two trees are joined along
+ * the right edge of one and the left edge of the other, and on each level
+ * the nodes met there are redistributed so that the level has at most
+ * VECTOR_EXTRAS more nodes than it strictly needs. Nodes that come out
+ * unchanged are shared instead of copied.
+ */
+static size_t
+vector_plan (proto_vector_node_t **all,
+             size_t length,
+             unsigned int *counts)
+{
+  size_t i, j, total = 0, optimal;
+  unsigned int remaining, fill;
+
+  for (i = 0; i < length; i++)
+    {
+      counts[i] = all[i]->count;
+      total += counts[i];
+    }
+  optimal = (total + VECTOR_WIDTH - 1) / VECTOR_WIDTH;
+  i = 0;
+  while (length > optimal + VECTOR_EXTRAS)
+    {
+      while (counts[i] > VECTOR_WIDTH - 1)
+        i++;
+      // Spread the short node over the ones following it
+      remaining = counts[i];
+      do
+        {
+          fill = remaining + counts[i + 1] < VECTOR_WIDTH ? remaining + counts[i + 1] : VECTOR_WIDTH;
+          remaining = remaining + counts[i + 1] - fill;
+          counts[i++] = fill;
+        }
+      while (remaining > 0);
+      for (j = i; j < length - 1; j++)
+        counts[j] = counts[j + 1];
+      length--;
+      i--;
+    }
+  return length;
+}
+
+static void
+vector_release_all (proto_vector_node_t **nodes,
+                    size_t length,
+                    unsigned int shift)
+{
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    vector_node_release (nodes[i], shift);
+}
+
+/*
+ * Joins the children of left but the last, of middle, and of right but the
+ * first. left and right are borrowed and may be NULL; middle is the result
+ * of joining the level below, already at shift. Returns a node one level
+ * up holding one or two nodes at shift.
+ */
+static proto_vector_node_t *
+vector_rebalance (proto_vector_node_t *left,
+                  proto_vector_node_t *middle,
+                  proto_vector_node_t *right,
+                  unsigned int shift)
+{
+  proto_vector_node_t *all[3 * VECTOR_WIDTH], *built[3 * VECTOR_WIDTH], *node, *top;
+  unsigned int counts[3 * VECTOR_WIDTH], i, child_shift = shift - VECTOR_BITS;
+  size_t length = 0, planned, k, old = 0, offset = 0, take;
+
+  if (left != NULL)
+    for (i = 0; i + 1 < left->count; i++)
+      all[length++] = left->slots[i];
+  for (i = 0; i < middle->count; i++)
+    all[length++] = middle->slots[i];
+  if (right != NULL)
+    for (i = 1; i < right->count; i++)
+      all[length++] = right->slots[i];
+  planned = vector_plan (all, length, counts);
+  for (k = 0; k < planned; k++)
+    {
+      if (offset == 0 && all[old]->count == counts[k])
+        {
+          built[k] = vector_node_retain (all[old++]);
+          continue;
+        }
+      node = vector_node_new (child_shift);
+      if (!node)
+        {
+          vector_release_all (built, k, child_shift);
+          return NULL;
+        }
+      while (node->count < counts[k])
+        {
+          take = all[old]->count - offset;
+          if (take > counts[k] - node->count)
+            take = counts[k] - node->count;
+          memcpy (node->slots + node->count, all[old]->slots + offset, take * sizeof (void *));
+          if (child_shift > 0)
+            for (i = 0; i < take; i++)
+              vector_node_retain (node->slots[node->count + i]);
+          node->count += take;
+          offset += take;
+          if (offset == all[old]->count)
+            {
+              old++;
+              offset = 0;
+            }
+        }
+      vector_node_update (node, child_shift);
+      built[k] = node;
+    }
+  top = vector_node_new (shift + VECTOR_BITS);
+  if (!top)
+    {
+      vector_release_all (built, planned, child_shift);
+      return NULL;
+    }
+  for (k = 0; k < planned; k += VECTOR_WIDTH)
+    {
+      take = planned - k < VECTOR_WIDTH ? planned - k : VECTOR_WIDTH;
+      node = vector_node_new (shift);
+      if (!node)
+        {
+          vector_release_all (built + k, planned - k, child_shift);
+          vector_node_release (top, shift + VECTOR_BITS);
+          return NULL;
+        }
+      memcpy (node->slots, built + k, take * sizeof (void *));
+      node->count = take;
+      vector_node_update (node, shift);
+      top->slots[top->count++] = node;
+    }
+  vector_node_update (top, shift + VECTOR_BITS);
+  return top;
+}
+
+static proto_vector_node_t *
+vector_merge (proto_vector_node_t *left,
+              unsigned int left_shift,
+              proto_vector_node_t *right,
+              unsigned int right_shift)
+{
+  proto_vector_node_t *middle, *result, *leaf;
+
+  if (left_shift > right_shift)
+    {
+      middle = vector_merge (left->slots[left->count - 1], left_shift - VECTOR_BITS, right, right_shift);
+      if (!middle)
+        return NULL;
+      result = vector_rebalance (left, middle, NULL, left_shift);
+      vector_node_release (middle, left_shift);
+      return result;
+    }
+  if (left_shift < right_shift)
+    {
+      middle = vector_merge (left, left_shift, right->slots[0], right_shift - VECTOR_BITS);
+      if (!middle)
+        return NULL;
+      result = vector_rebalance (NULL, middle, right, right_shift);
+      vector_node_release (middle, right_shift);
+      return result;
+    }
+  if (left_shift == 0)
+    {
+      result = vector_node_new (VECTOR_BITS);
+      if (!result)
+        return NULL;
+      if (left->count + right->count > VECTOR_WIDTH)
+        {
+          result->slots[0] = vector_node_retain (left);
+          result->slots[1] = vector_node_retain (right);
+          result->count = 2;
+        }
+      else
+        {
+          leaf = vector_node_new (0);
+          if (!leaf)
+            {
+              free (result);
+              return NULL;
+            }
+          memcpy (leaf->slots, left->slots, left->count * sizeof (void *));
+          memcpy (leaf->slots + left->count, right->slots, right->count * sizeof (void *));
+          leaf->count = leaf->size = left->count + right->count;
+          result->slots[0] = leaf;
+          result->count = 1;
+        }
+      vector_node_update (result, VECTOR_BITS);
+      return result;
+    }
+  middle = vector_merge (left->slots[left->count - 1], left_shift - VECTOR_BITS,
+    right->slots[0], right_shift - VECTOR_BITS);
+  if (!middle)
+    return NULL;
+  result = vector_rebalance (left, middle, right, left_shift);
+  vector_node_release (middle, left_shift);
+  return result;
+}
+
+// The first length elements below node, sharing whole children
+static proto_vector_node_t *
+vector_take (proto_vector_node_t *node,
+             unsigned int shift,
+             size_t length)
+{
+  proto_vector_node_t *copy, *child;
+  size_t position = length - 1;
+  unsigned int i, j;
+
+  if (length == node->size)
+    return vector_node_retain (node);
+  copy = vector_node_new (shift);
+  if (!copy)
+    return NULL;
+  if (shift == 0)
+    {
+      memcpy (copy->slots, node->slots, length * sizeof (void *));
+      copy->count = copy->size = length;
+      return copy;
+    }
+  i = vector_child (node, shift, &position);
+  child = vector_take (node->slots[i], shift - VECTOR_BITS, position + 1);
+  if (!child)
+    {
+      free (copy);
+      return NULL;
+    }
+  for (j = 0; j < i; j++)
+    copy->slots[j] = vector_node_retain (node->slots[j]);
+  copy->slots[i] = child;
+  copy->count = i + 1;
+  vector_node_update (copy, shift);
+  return copy;
+}
+
+// Everything below node but the first skip elements
+static proto_vector_node_t *
+vector_drop (proto_vector_node_t *node,
+             unsigned int shift,
+             size_t skip)
+{
+  proto_vector_node_t *copy, *child;
+  size_t position = skip;
+  unsigned int i, j;
+
+  if (skip == 0)
+    return vector_node_retain (node);
+  copy = vector_node_new (shift);
+  if (!copy)
+    return NULL;
+  if (shift == 0)
+    {
+      memcpy (copy->slots, node->slots + skip, (node->count - skip) * sizeof (void *));
+      copy->count = copy->size = node->count - skip;
+      return copy;
+    }
+  i = vector_child (node, shift, &position);
+  child = vector_drop (node->slots[i], shift - VECTOR_BITS, position);
+  if (!child)
+    {
+      free (copy);
+      return NULL;
+    }
+  copy->slots[0] = child;
+  for (j = i + 1; j < node->count; j++)
+    copy->slots[j - i] = vector_node_retain (node->slots[j]);
+  copy->count = node->count - i;
+  vector_node_update (copy, shift);
+  return copy;
+}
+
+static void
+vector_collect (const proto_vector_node_t *node,
+                unsigned int shift,
+                void **items)
+{
+  unsigned int i;
+
+  if (shift == 0)
+    {
+      memcpy (items, node->slots, node->count * sizeof (void *));
+      return;
+    }
+  for (i = 0; i < node->count; i++)
+    {
+      const proto_vector_node_t *child = node->slots[i];
+
+      vector_collect (child, shift - VECTOR_BITS, items);
+      items += child->size;
+    }
+}
+
+proto_vector_t *
+proto_init_vector ()
+{
+  return vector_handle (NULL, 0, 0);
+}
+
+void
+proto_del_vector (proto_vector_t *vector)
+{
+  if (vector == NULL)
+    return;
+  vector_node_release (vector->root, vector->shift);
+  free (vector);
+}
+
+size_t
+proto_vector_length (const proto_vector_t *vector)
+{
+  if (vector == NULL)
+    return 0;
+  return vector->length;
+}
+
+const void *
+proto_vector_at (const proto_vector_t *vector,
+                 size_t position)
+{
+  const proto_vector_node_t *node;
+  unsigned int shift;
+
+  if (vector == NULL || position >= vector->length)
+    return NULL;
+  node = vector->root;
+  for (shift = vector->shift; shift > 0; shift -= VECTOR_BITS)
+    node = node->slots[vector_child (node, shift, &position)];
+  return node->slots[position & VECTOR_MASK];
+}
+
+/*
+ * Every update returns a new version and leaves the given one unchanged;
+ * both have to be released with proto_del_vector. NULL means the update
+ * couldn't be done: a position out of range, or no memory.
+ */
+proto_vector_t *
+proto_vector_push (const proto_vector_t *vector,
+                   const void *element)
+{
+  proto_vector_t *result;
+
+  if (vector == NULL || !(result = vector_clone (vector)))
+    return NULL;
+  if (vector_push (result, element))
+    return result;
+  proto_del_vector (result);
+  return NULL;
+}
+
+proto_vector_t *
+proto_vector_set (const proto_vector_t *vector,
+                  size_t position,
+                  const void *element)
+{
+  proto_vector_t *result;
+
+  if (vector == NULL || !(result = vector_clone (vector)))
+    return NULL;
+  if (vector_set (result, position, element))
+    return result;
+  proto_del_vector (result);
+  return NULL;
+}
+
+proto_vector_t *
+proto_vector_pop (const proto_vector_t *vector)
+{
+  proto_vector_t *result;
+
+  if (vector == NULL || !(result = vector_clone (vector)))
+    return NULL;
+  if (vector_pop (result))
+    return result;
+  proto_del_vector (result);
+  return NULL;
+}
+
+proto_vector_t *
+proto_vector_concat (const proto_vector_t *vector,
+                     const proto_vector_t *another)
+{
+  proto_vector_node_t *root;
+  proto_vector_t *result;
+  unsigned int shift;
+
+  if (vector == NULL || another == NULL)
+    return NULL;
+  if (another->length == 0)
+    return vector_clone (vector);
+  if (vector->length == 0)
+    return vector_clone (another);
+  root = vector_merge (vector->root, vector->shift, another->root, another->shift);
+  if (!root)
+    return NULL;
+  shift = (vector->shift > another->shift ? vector->shift : another->shift) + VECTOR_BITS;
+  result = vector_handle (root, shift, vector->length + another->length);
+  if (result)
+    vector_collapse (result);
+  return result;
+}
+
+// The elements in [begin, end), with end clamped to the length
+proto_vector_t *
+proto_vector_slice (const proto_vector_t *vector,
+                    size_t begin,
+                    size_t end)
+{
+  proto_vector_node_t *taken, *root;
+  proto_vector_t *result;
+
+  if (vector == NULL)
+    return NULL;
+  if (end > vector->length)
+    end = vector->length;
+  if (begin >= end)
+    return proto_init_vector ();
+  taken = vector_take (vector->root, vector->shift, end);
+  if (!taken)
+    return NULL;
+  root = vector_drop (taken, vector->shift, begin);
+  vector_node_release (taken, vector->shift);
+  if (!root)
+    return NULL;
+  result = vector_handle (root, vector->shift, end - begin);
+  if (result)
+    vector_collapse (result);
+  return result;
+}
+
+proto_vector_t *
+proto_vector_from_array (const proto_array_t *array)
+{
+  proto_vector_t *vector;
+  size_t position = 0, length, i;
+  void **items;
+
+  if (array == NULL)
+    return NULL;
+  vector = proto_init_vector ();
+  if (!vector)
+    return NULL;
+  while (position < array->length)
+    {
+      items = array_segment (array, position, &length);
+      for (i = 0; i < length; i++)
+        if (!vector_push (vector, items[i]))
+          {
+            proto_del_vector (vector);
+            return NULL;
+          }
+      position += length;
+    }
+  return vector;
+}
+
+proto_array_t *
+proto_vector_to_array (const proto_vector_t *vector)
+{
+  proto_array_t *array;
+
+  if (vector == NULL)
+    return NULL;
+  array = array_with_capacity (vector->length);
+  if (!array)
+    return NULL;
+  if (vector->root != NULL)
+    vector_collect (vector->root, vector->shift, array->items);
+  array->length = vector->length;
+  return array;
+}
+
+/*
+ * A builder starts from a version (or empty, for NULL) and updates nodes in
+ * place once it owns them, so a batch of updates only copies each shared
+ * node once. Finishing hands its tree over to a new version.
+ */
+proto_vector_builder_t *
+proto_init_vector_builder (const proto_vector_t *vector)
+{
+  proto_vector_builder_t *builder;
+
+  builder = (proto_vector_builder_t *) malloc (sizeof (proto_vector_builder_t));
+  if (!builder)
+    return NULL;
+  builder->vector.root = NULL;
+  builder->vector.shift = 0;
+  builder->vector.length = 0;
+  if (vector != NULL && vector->root != NULL)
+    {
+      builder->vector = *vector;
+      vector_node_retain (vector->root);
+    }
+  return builder;
+}
+
+bool
+proto_vector_builder_push (proto_vector_builder_t *builder,
+                           const void *element)
+{
+  if (builder == NULL)
+    return false;
+  return vector_push (&builder->vector, element);
+}
+
+bool
+proto_vector_builder_set (proto_vector_builder_t *builder,
+                          size_t position,
+                          const void *element)
+{
+  if (builder == NULL)
+    return false;
+  return vector_set (&builder->vector, position, element);
+}
+
+bool
+proto_vector_builder_pop (proto_vector_builder_t *builder)
+{
+  if (builder == NULL)
+    return false;
+  return vector_pop (&builder->vector);
+}
+
+proto_vector_t *
+proto_vector_builder_finish (proto_vector_builder_t *builder)
+{
+  proto_vector_t *vector;
+
+  if (builder == NULL)
+    return NULL;
+  vector = vector_handle (builder->vector.root, builder->vector.shift, builder->vector.length);
+  free (builder);
+  return vector;
+}
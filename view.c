@@ -0,0 +1,145 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Ewerton Assis <earaujoassis@gmail.com>
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the MIT license. See LICENSE for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "proto.h"
+#include "internal.h"
+
+/*
+ * Views never copy: every access reads the underlying array, so a view sees
+ * later writes to it and returns NULL for positions the array no longer has.
+ */
+static inline size_t
+proto_view_position (const proto_array_view_t *view,
+                     size_t position)
+{
+  return view->offset + (ptrdiff_t) position * view->stride;
+}
+
+static const void *
+proto_view_at (const void *self,
+               size_t position)
+{
+  if (self == NULL)
+    return NULL;
+  const proto_array_view_t *view = (const proto_array_view_t *) self;
+  size_t index;
+
+  if (position >= view->length)
+    return NULL;
+  index = proto_view_position (view, position);
+  if (index >= view->array->length)
+    return NULL;
+  return array_item (view->array, index);
+}
+
+static const void *
+proto_view_first (const void *self)
+{
+  if (self == NULL)
+    return NULL;
+  const proto_array_view_t *view = (const proto_array_view_t *) self;
+
+  return view->at (view, 0);
+}
+
+static const void *
+proto_view_last (const void *self)
+{
+  if (self == NULL)
+    return NULL;
+  const proto_array_view_t *view = (const proto_array_view_t *) self;
+
+  return view->at (view, view->length - 1);
+}
+
+static void
+proto_view_each (const void *self,
+                 void (*callback) (const void *element, size_t position, void *context),
+                 void *context)
+{
+  if (self == NULL || callback == NULL)
+    return;
+  const proto_array_view_t *view = (const proto_array_view_t *) self;
+  size_t i, index = view->offset;
+
+  for (i = 0; i < view->length; i++, index += view->stride)
+    {
+      if (index >= view->array->length)
+        return;
+      callback (array_item (view->array, index), i, context);
+    }
+}
+
+static void *
+proto_view_to_array (const void *self)
+{
+  if (self == NULL)
+    return NULL;
+  const proto_array_view_t *view = (const proto_array_view_t *) self;
+  proto_array_t *array = array_with_capacity (view->length);
+  size_t i;
+
+  if (!array)
+    return NULL;
+  for (i = 0; i < view->length; i++)
+    {
+      size_t index = proto_view_position (view, i);
+
+      if (index >= view->array->length)
+        break;
+      array->items[i] = array_item (view->array, index);
+    }
+  array->length = i;
+  return array;
+}
+
+/*
+ * Views the items at offset, offset + stride, offset + 2 * stride, ... of
+ * array; length is clamped so every position falls inside the array.
+ */
+void
+proto_init_array_view (proto_array_view_t *view,
+                       const proto_array_t *array,
+                       size_t offset,
+                       size_t length,
+                       ptrdiff_t stride)
+{
+  size_t available;
+
+  if (view == NULL)
+    return;
+  view->array = array;
+  view->offset = offset;
+  view->stride = stride;
+  if (array == NULL || offset >= array->length)
+    available = 0;
+  else if (stride > 0)
+    available = (array->length - 1 - offset) / stride + 1;
+  else if (stride < 0)
+    available = offset / -stride + 1;
+  else
+    available = length;
+  view->length = length < available ? length : available;
+  view->at = &proto_view_at;
+  view->first = &proto_view_first;
+  view->last = &proto_view_last;
+  view->each = &proto_view_each;
+  view->to_array = &proto_view_to_array;
+}
+
+void
+proto_array_reverse_view (proto_array_view_t *view,
+                          const proto_array_t *array)
+{
+  if (array == NULL || !array->length)
+    proto_init_array_view (view, array, 0, 0, -1);
+  else
+    proto_init_array_view (view, array, array->length - 1, array->length, -1);
+}